@@ -0,0 +1,145 @@
+/*
+ * AlignmentCacheFile.cpp
+ *
+ *	The AlignmentCacheFile object writes and maps alignment cache files
+ *  (see AlignmentCacheFile.h for the layout).  The symbols are stored
+ *  exactly as MultipleAlignmentFile keeps them in memory, so loading a
+ *  cache is a single mmap and the symbols are used in place.
+ *
+ *	The source path, size and modification time are recorded so a cache
+ *  whose source has changed since it was written is refused when it is
+ *  loaded (see MultipleAlignmentFile::populateFromCache), as for an
+ *  alignment index.
+ *
+ *  Created on: 10-18-26
+ */
+#include "AlignmentCacheFile.h"
+#include "MultipleAlignmentFile.h"
+#include "AlignmentIndexFile.h"
+#include "OutputBuffer.h"
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+// const variable initialization
+// ==============================================
+const char AlignmentCacheFile::fileMagic[8] = {'H', 'M', 'M', 'A', 'L', 'N', '\0', '\0'};
+const uint32_t AlignmentCacheFile::fileVersion = 3;
+
+// Constuctors
+// ==============================================
+AlignmentCacheFile::AlignmentCacheFile(string fileName) : file(fileName) {
+	header = (const CacheFileHeader*) file.data();
+	if (file.size() < sizeof(CacheFileHeader) || memcmp(header->magic, fileMagic, sizeof(fileMagic)) != 0
+		|| header->version != fileVersion || header->numColumns < 0
+		|| header->symbolsOffset + header->numColumns > file.size()
+		|| header->breaksOffset + header->numBreaks * 2 * sizeof(int32_t) > file.size())
+		throw runtime_error("Invalid alignment cache file: " + fileName);
+}
+
+// Destructor
+// =============================================
+AlignmentCacheFile::~AlignmentCacheFile() {
+}
+
+// Public Class Methods
+// =============================================
+
+// write(string fileName, MultipleAlignmentFile& alignment)
+//  Purpose: 
+//		Writes the columns of the alignment to a cache file
+void AlignmentCacheFile::write(string fileName, MultipleAlignmentFile& alignment) {
+	if (alignment.getSymbols() == NULL)
+		throw runtime_error("Alignment caches only hold three species alignments");
+
+	string& sourceFileName = alignment.getFileName();
+	CacheFileHeader fileHeader;
+	memset(&fileHeader, 0, sizeof(fileHeader));
+	if (!AlignmentIndexFile::sourceStatus(sourceFileName, fileHeader.sourceSize, fileHeader.sourceModified))
+		throw runtime_error("Unable to read alignment file: " + sourceFileName);
+
+	memcpy(fileHeader.magic, fileMagic, sizeof(fileMagic));
+	fileHeader.version = fileVersion;
+	fileHeader.sourcePathLength = sourceFileName.size();
+	fileHeader.startPosition = alignment.getStartPosition();
+	fileHeader.numColumns = alignment.getSequenceLength();
+	fileHeader.symbolsOffset = sizeof(CacheFileHeader) + sourceFileName.size();
+	fileHeader.breaksOffset = fileHeader.symbolsOffset + alignment.getSequenceLength();
+	fileHeader.numBreaks = alignment.getCoordinateBreaks().size();
+	strncpy(fileHeader.chromosome, alignment.getChromosome().c_str(), sizeof(fileHeader.chromosome) - 1);
+
+	OutputBuffer out(fileName);
+	out.append((const char*) &fileHeader, sizeof(fileHeader));
+	out.append(sourceFileName);
+	out.append((const char*) alignment.getSymbols(), alignment.getSequenceLength());
+	for (pair<int, int>& aBreak : alignment.getCoordinateBreaks()) {
+		int32_t values[2] = {aBreak.first, aBreak.second};
+		out.append((const char*) values, sizeof(values));
+	}
+	out.flush();
+}
+
+// bool isCacheFile(string fileName)
+//  Purpose: 
+//		Returns true if fileName starts with the cache file magic
+bool AlignmentCacheFile::isCacheFile(string fileName) {
+	ifstream inputFile(fileName, ios::binary);
+	char magic[sizeof(fileMagic)];
+	if (!inputFile.read(magic, sizeof(magic)))
+		return false;
+
+	return memcmp(magic, fileMagic, sizeof(fileMagic)) == 0;
+}
+
+// Public Methods
+// =============================================
+
+// bool matchesSource()
+//  Purpose: 
+//		Returns true if the source alignment file still has the size
+//		and modification time recorded when the cache was written, or
+//		can no longer be read (a cache may outlive its source)
+bool AlignmentCacheFile::matchesSource() {
+	uint64_t size;
+	int64_t modified;
+	if (!AlignmentIndexFile::sourceStatus(getSourceFileName(), size, modified))
+		return true;
+
+	return size == header->sourceSize && modified == header->sourceModified;
+}
+
+// getCoordinateBreaks(vector<pair<int, int> >& coordinateBreaks)
+//  Purpose: 
+//		Replaces coordinateBreaks with the (column, coordinate) breaks
+//		of the alignment
+void AlignmentCacheFile::getCoordinateBreaks(vector<pair<int, int> >& coordinateBreaks) {
+	coordinateBreaks.clear();
+	const char* breaks = file.data() + header->breaksOffset;
+	for (uint64_t i = 0; i < header->numBreaks; i++) {
+		int32_t values[2];
+		memcpy(values, breaks + i * sizeof(values), sizeof(values));
+		coordinateBreaks.push_back(make_pair(values[0], values[1]));
+	}
+}
+
+// Public Accessors
+// =============================================
+const unsigned char* AlignmentCacheFile::getSymbols() {
+	return (const unsigned char*) file.data() + header->symbolsOffset;
+}
+
+int AlignmentCacheFile::getNumColumns() {
+	return header->numColumns;
+}
+
+int AlignmentCacheFile::getStartPosition() {
+	return header->startPosition;
+}
+
+string AlignmentCacheFile::getChromosome() {
+	return string(header->chromosome, strnlen(header->chromosome, sizeof(header->chromosome)));
+}
+
+string AlignmentCacheFile::getSourceFileName() {
+	return string(file.data() + sizeof(CacheFileHeader), header->sourcePathLength);
+}
@@ -0,0 +1,115 @@
+/*
+ * AlignmentCacheFile.h
+ *
+ *	This is the header file for the AlignmentCacheFile object.  An
+ *  alignment cache is a binary copy of a parsed multiple alignment file:
+ *  one symbol per alignment column, so decoding the same region again
+ *  maps the cache instead of re-parsing the text alignment.
+ *
+ *  File layout (native byte order):
+ *
+ *		header			- fixed size CacheFileHeader (magic, version, start
+ *						  position, column count, chromosome, source file
+ *						  size and modification time)
+ *		source path		- sourcePathLength characters (not null terminated)
+ *		symbols			- one byte per column at symbolsOffset (see
+ *						  MultipleAlignmentFile::encodeColumn)
+ *		breaks			- numBreaks (column, coordinate) int32 pairs at
+ *						  breaksOffset (see
+ *						  MultipleAlignmentFile::getCoordinateBreaks)
+ *
+ *	Typical use:
+ *		AlignmentCacheFile::write("ENm012.hmmc", multiAlignFile);
+ *		...
+ *		MultipleAlignmentFile multiAlignFile("ENm012.hmmc");  // maps the cache
+ *
+ *  Created on: 10-18-26
+ */
+
+#ifndef ALIGNMENTCACHEFILE_H
+#define ALIGNMENTCACHEFILE_H
+
+#include "MappedFile.h"
+#include <string>
+#include <vector>
+#include <utility>
+#include <cstdint>
+using namespace std;
+
+class MultipleAlignmentFile;
+
+class AlignmentCacheFile
+{
+public:
+	// Constuctors
+	// ==============================================
+	AlignmentCacheFile(string fileName);
+
+	// Destructor
+	// =============================================
+	~AlignmentCacheFile();
+
+	// Public Class Methods
+	// =============================================
+
+	// write(string fileName, MultipleAlignmentFile& alignment)
+	//  Purpose: 
+	//		Writes the columns of the alignment to a cache file
+	static void write(string fileName, MultipleAlignmentFile& alignment);
+
+	// bool isCacheFile(string fileName)
+	//  Purpose: 
+	//		Returns true if fileName starts with the cache file magic
+	static bool isCacheFile(string fileName);
+
+	// Public Methods
+	// =============================================
+
+	// bool matchesSource()
+	//  Purpose: 
+	//		Returns true if the source alignment file still has the size
+	//		and modification time recorded when the cache was written, or
+	//		can no longer be read (a cache may outlive its source)
+	bool matchesSource();
+
+	// getCoordinateBreaks(vector<pair<int, int> >& coordinateBreaks)
+	//  Purpose: 
+	//		Replaces coordinateBreaks with the (column, coordinate) breaks
+	//		of the alignment
+	void getCoordinateBreaks(vector<pair<int, int> >& coordinateBreaks);
+
+	// Public Accessors
+	// =============================================
+	const unsigned char* getSymbols();	// one symbol per column
+	int getNumColumns();
+	int getStartPosition();
+	string getChromosome();
+	string getSourceFileName();
+
+private:
+
+	// Private Types
+	// =============================================
+	struct CacheFileHeader {
+		char magic[8];
+		uint32_t version;
+		uint32_t sourcePathLength;
+		int64_t startPosition;
+		int64_t numColumns;
+		uint64_t sourceSize;
+		int64_t sourceModified;		// seconds since the epoch
+		uint64_t symbolsOffset;
+		uint64_t breaksOffset;
+		uint64_t numBreaks;
+		char chromosome[64];
+	};
+
+	// Private Attributes
+	// =============================================
+	static const char fileMagic[8];
+	static const uint32_t fileVersion;
+	MappedFile file;
+	const CacheFileHeader* header;
+};
+
+#endif // ALIGNMENTCACHEFILE_H
@@ -0,0 +1,308 @@
+/*
+ * AlignmentIndexFile.cpp
+ *
+ *	The AlignmentIndexFile object builds and maps alignment index files
+ *  (see AlignmentIndexFile.h for the layout).  Building walks the lines
+ *  of the alignment once, recording where each block starts and ends
+ *  and the reference coordinates it covers.  Lookups are two binary
+ *  searches over the mapped block records.
+ *
+ *  Created on: 10-18-26
+ */
+#include "AlignmentIndexFile.h"
+#include "MultipleAlignmentFile.h"
+#include "GzipDecompressor.h"
+#include "MafFile.h"
+#include "OutputBuffer.h"
+#include <cstring>
+#include <cstdlib>
+#include <stdexcept>
+#include <algorithm>
+#include <sys/stat.h>
+
+// const variable initialization
+// ==============================================
+const char AlignmentIndexFile::fileMagic[8] = {'H', 'M', 'M', 'I', 'D', 'X', '\0', '\0'};
+const uint32_t AlignmentIndexFile::fileVersion = 1;
+
+// Constuctors
+// ==============================================
+AlignmentIndexFile::AlignmentIndexFile(string fileName) : file(fileName) {
+	header = (const IndexFileHeader*) file.data();
+	if (file.size() < sizeof(IndexFileHeader) || memcmp(header->magic, fileMagic, sizeof(fileMagic)) != 0
+		|| header->version != fileVersion
+		|| header->blocksOffset + header->numBlocks * sizeof(IndexEntry) > file.size())
+		throw runtime_error("Invalid alignment index file: " + fileName);
+	entries = (const IndexEntry*) (file.data() + header->blocksOffset);
+}
+
+// Destructor
+// =============================================
+AlignmentIndexFile::~AlignmentIndexFile() {
+}
+
+// Public Class Methods
+// =============================================
+
+// int build(string alignmentFileName, const vector<string>& species)
+//  Purpose:
+//		Writes the index of a text alignment to
+//		indexFileName(alignmentFileName) and returns the number of
+//		blocks indexed.  species[0] is the MAF reference species.
+int AlignmentIndexFile::build(string alignmentFileName, const vector<string>& species) {
+	IndexFileHeader fileHeader;
+	memset(&fileHeader, 0, sizeof(fileHeader));
+	if (!sourceStatus(alignmentFileName, fileHeader.sourceSize, fileHeader.sourceModified))
+		throw runtime_error("Unable to read alignment file: " + alignmentFileName);
+
+	MappedFile source(alignmentFileName);
+	if (GzipDecompressor::isGzip(source.data(), source.size()))
+		throw runtime_error("Compressed alignments cannot be indexed: " + alignmentFileName);
+
+	string chromosome;
+	vector<IndexEntry> blocks;
+	if (MafFile::isMafFile(source.data(), source.size())) {
+		if (species.empty())
+			throw runtime_error("No reference species for MAF index");
+		fileHeader.format = 1;
+		strncpy(fileHeader.referenceSpecies, species[0].c_str(), sizeof(fileHeader.referenceSpecies) - 1);
+		indexMaf(source.data(), source.size(), species[0], chromosome, blocks);
+	}
+	else
+		indexAlignment(source.data(), source.size(), chromosome, blocks);
+
+	memcpy(fileHeader.magic, fileMagic, sizeof(fileMagic));
+	fileHeader.version = fileVersion;
+	fileHeader.sourcePathLength = alignmentFileName.size();
+	fileHeader.blocksOffset = sizeof(IndexFileHeader) + alignmentFileName.size();
+	fileHeader.blocksOffset = (fileHeader.blocksOffset + 7) & ~(uint64_t) 7;
+	fileHeader.numBlocks = blocks.size();
+	strncpy(fileHeader.chromosome, chromosome.c_str(), sizeof(fileHeader.chromosome) - 1);
+
+	OutputBuffer out(indexFileName(alignmentFileName));
+	out.append((const char*) &fileHeader, sizeof(fileHeader));
+	out.append(alignmentFileName);
+	out.append(string(fileHeader.blocksOffset - sizeof(IndexFileHeader) - alignmentFileName.size(), '\0'));
+	if (!blocks.empty())
+		out.append((const char*) blocks.data(), blocks.size() * sizeof(IndexEntry));
+	out.flush();
+
+	return blocks.size();
+}
+
+// string indexFileName(string alignmentFileName)
+//  Purpose:
+//		Returns the name of the index for an alignment file
+string AlignmentIndexFile::indexFileName(string alignmentFileName) {
+	return alignmentFileName + ".hmmi";
+}
+
+// Public Methods
+// =============================================
+
+// bool matchesSource()
+//  Purpose:
+//		Returns true if the alignment still has the size and
+//		modification time recorded when the index was built
+bool AlignmentIndexFile::matchesSource() {
+	uint64_t size;
+	int64_t modified;
+	if (!sourceStatus(getSourceFileName(), size, modified))
+		return false;
+
+	return size == header->sourceSize && modified == header->sourceModified;
+}
+
+// bool findBlocks(int start, int end, size_t& textOffset, size_t& textLength, int& firstCoordinate)
+//  Purpose:
+//		Finds the blocks overlapping the coordinates [start, end).
+//		Returns false if there are none; otherwise sets the byte range
+//		of the alignment text spanning them and the first coordinate of
+//		the first block.
+bool AlignmentIndexFile::findBlocks(int start, int end, size_t& textOffset, size_t& textLength, int& firstCoordinate) {
+	const IndexEntry* entriesEnd = entries + header->numBlocks;
+
+	// First block ending after start, and the first block starting at or after end
+	const IndexEntry* first = partition_point(entries, entriesEnd,
+		[start](const IndexEntry& entry) { return entry.endCoordinate <= start; });
+	const IndexEntry* last = partition_point(first, entriesEnd,
+		[end](const IndexEntry& entry) { return entry.firstCoordinate < end; });
+	if (first == last)
+		return false;
+
+	--last;
+	textOffset = first->textOffset;
+	textLength = last->textOffset + last->textLength - first->textOffset;
+	firstCoordinate = first->firstCoordinate;
+	return true;
+}
+
+// Public Accessors
+// =============================================
+bool AlignmentIndexFile::isMaf() {
+	return header->format == 1;
+}
+
+int AlignmentIndexFile::getNumBlocks() {
+	return header->numBlocks;
+}
+
+string AlignmentIndexFile::getChromosome() {
+	return string(header->chromosome, strnlen(header->chromosome, sizeof(header->chromosome)));
+}
+
+string AlignmentIndexFile::getReferenceSpecies() {
+	return string(header->referenceSpecies, strnlen(header->referenceSpecies, sizeof(header->referenceSpecies)));
+}
+
+string AlignmentIndexFile::getSourceFileName() {
+	return string(file.data() + sizeof(IndexFileHeader), header->sourcePathLength);
+}
+
+// Private Methods
+// =============================================
+
+// indexAlignment(const char* text, size_t length, string& chromosome, vector<IndexEntry>& blocks)
+//  Purpose:
+//		Finds the blocks of .aln text.  Blocks are located as in
+//		MultipleAlignmentFile::findBlocks and the coordinates follow on
+//		from the header line's start position, one per column.
+void AlignmentIndexFile::indexAlignment(const char* text, size_t length, string& chromosome, vector<IndexEntry>& blocks) {
+	const char* end = text + length;
+	const char* lineStart = (const char*) memchr(text, '\n', length);
+	lineStart = (lineStart == NULL) ? end : lineStart + 1;
+
+	int coordinate = 0;
+	MultipleAlignmentFile::parseHeaderLine(string(text, lineStart - text), coordinate, chromosome);
+
+	while (lineStart < end) {
+		const char* lineEnd = (const char*) memchr(lineStart, '\n', end - lineStart);
+		if (lineEnd == NULL)
+			lineEnd = end;
+
+		if (lineEnd - lineStart >= 4 && memcmp(lineStart, "hg18", 4) == 0
+			&& (lineEnd - lineStart == 4 || lineStart[4] == '\t')) {
+
+			// Columns are the length of the hg18 row's last field
+			const char* fieldEnd = lineEnd;
+			if (fieldEnd > lineStart && fieldEnd[-1] == '\r')
+				fieldEnd--;
+			const char* field = fieldEnd;
+			while (field > lineStart && field[-1] != '\t')
+				field--;
+
+			// The block runs through the two rows after the hg18 row
+			const char* blockEnd = lineEnd;
+			for (int row = 1; row < 3; row++) {
+				if (blockEnd >= end)
+					throw runtime_error("Incomplete alignment block");
+				const char* rowEnd = (const char*) memchr(blockEnd + 1, '\n', end - blockEnd - 1);
+				blockEnd = (rowEnd == NULL) ? end : rowEnd;
+			}
+			if (blockEnd < end)
+				blockEnd++;
+
+			IndexEntry entry = {(uint64_t) (lineStart - text), (uint64_t) (blockEnd - lineStart),
+				coordinate, coordinate + (int32_t) (fieldEnd - field)};
+			blocks.push_back(entry);
+			coordinate = entry.endCoordinate;
+			lineStart = blockEnd;
+		}
+		else
+			lineStart = lineEnd + 1;
+	}
+}
+
+// indexMaf(const char* text, size_t length, const string& referenceSpecies,
+//		string& chromosome, vector<IndexEntry>& blocks)
+//  Purpose:
+//		Finds the reference chromosome blocks of MAF text (the
+//		chromosome of the first reference row is used).  Blocks must not
+//		overlap and must be in coordinate order, as in the UCSC files.
+void AlignmentIndexFile::indexMaf(const char* text, size_t length, const string& referenceSpecies,
+	string& chromosome, vector<IndexEntry>& blocks) {
+	const char* end = text + length;
+	const char* blockStart = NULL;
+	IndexEntry entry = {0, 0, 0, 0};
+	bool referenceSeen = false;		// only the first reference row of a block counts
+	bool onReference = false;
+
+	const char* lineStart = text;
+	while (lineStart <= end) {
+		const char* lineEnd = (lineStart < end) ? (const char*) memchr(lineStart, '\n', end - lineStart) : NULL;
+		if (lineEnd == NULL)
+			lineEnd = end;
+
+		// A block ends at an 'a' line, a blank line or the end of the text
+		bool blockEnd = lineStart == end || lineEnd == lineStart || lineStart[0] == 'a'
+			|| (lineEnd - lineStart == 1 && lineStart[0] == '\r');
+		if (blockEnd && blockStart != NULL) {
+			if (onReference) {
+				if (!blocks.empty() && entry.firstCoordinate < blocks.back().endCoordinate)
+					throw runtime_error("MAF blocks are not in reference coordinate order");
+				entry.textOffset = blockStart - text;
+				entry.textLength = lineStart - blockStart;
+				blocks.push_back(entry);
+			}
+			blockStart = NULL;
+			referenceSeen = false;
+			onReference = false;
+		}
+		if (lineStart == end)
+			break;
+
+		if (lineStart[0] == 'a')
+			blockStart = lineStart;
+		else if (lineStart[0] == 's' && blockStart != NULL && !referenceSeen) {
+			// s src start size strand srcSize text
+			const char* fields[5];
+			const char* fieldEnds[5];
+			int numFields = 0;
+			const char* position = lineStart;
+			while (numFields < 5) {
+				while (position < lineEnd && (*position == ' ' || *position == '\t' || *position == '\r'))
+					position++;
+				if (position == lineEnd)
+					break;
+				fields[numFields] = position;
+				while (position < lineEnd && *position != ' ' && *position != '\t' && *position != '\r')
+					position++;
+				fieldEnds[numFields++] = position;
+			}
+			if (numFields < 5)
+				throw runtime_error("Invalid MAF s line");
+
+			// src is species.chromosome
+			size_t speciesLength = referenceSpecies.size();
+			if ((size_t) (fieldEnds[1] - fields[1]) > speciesLength
+				&& memcmp(fields[1], referenceSpecies.data(), speciesLength) == 0
+				&& fields[1][speciesLength] == '.') {
+				referenceSeen = true;
+				string rowChromosome(fields[1] + speciesLength + 1, fieldEnds[1]);
+				if (chromosome.empty())
+					chromosome = rowChromosome;
+				if (rowChromosome == chromosome && fields[4][0] == '+') {
+					onReference = true;
+					entry.firstCoordinate = atoi(fields[2]) + 1;	// 1 based
+					entry.endCoordinate = entry.firstCoordinate + atoi(fields[3]);
+				}
+			}
+		}
+
+		lineStart = lineEnd + 1;
+	}
+}
+
+// bool sourceStatus(string fileName, uint64_t& size, int64_t& modified)
+//  Purpose:
+//		Gets the size and modification time of a file, returning false
+//		if it cannot be read
+bool AlignmentIndexFile::sourceStatus(string fileName, uint64_t& size, int64_t& modified) {
+	struct stat status;
+	if (stat(fileName.c_str(), &status) != 0)
+		return false;
+
+	size = status.st_size;
+	modified = status.st_mtime;
+	return true;
+}
@@ -0,0 +1,158 @@
+/*
+ * AlignmentIndexFile.h
+ *
+ *	This is the header file for the AlignmentIndexFile object.  An
+ *  alignment index maps reference coordinates to the byte offsets of the
+ *  blocks of a text alignment (.aln or MAF), so a subrange of a large
+ *  alignment can be loaded by parsing only the blocks that cover it
+ *  (see the MultipleAlignmentFile range constructor).
+ *
+ *	The index is built once per alignment with build() and is written
+ *  next to the alignment (indexFileName).  It records the size and
+ *  modification time of the alignment so a stale index is detected
+ *  without reading the alignment.
+ *
+ *  File layout (native byte order):
+ *
+ *		header			- fixed size IndexFileHeader (magic, version, format,
+ *						  block count, chromosome, reference species, source
+ *						  file size and modification time)
+ *		source path		- sourcePathLength characters (not null terminated)
+ *		blocks			- numBlocks IndexEntry records at blocksOffset,
+ *						  sorted by coordinate
+ *
+ *	Each block covers the 1 based reference coordinates [firstCoordinate,
+ *  endCoordinate).  For .aln files a block is an hg18 row and the two
+ *  rows after it, and covers one coordinate per column.  For MAF files a
+ *  block is an 'a' line and its rows, and covers the reference row's
+ *  start and size; only blocks on the reference chromosome's + strand
+ *  are indexed.
+ *
+ *	Compressed alignments cannot be indexed since their blocks cannot be
+ *  reached without inflating everything before them.
+ *
+ *	Typical use:
+ *		AlignmentIndexFile::build("chr7.maf", species);
+ *		...
+ *		MultipleAlignmentFile locus("chr7.maf", species, 115000, 165000);
+ *
+ *  Created on: 10-18-26
+ */
+
+#ifndef ALIGNMENTINDEXFILE_H
+#define ALIGNMENTINDEXFILE_H
+
+#include "MappedFile.h"
+#include <string>
+#include <vector>
+#include <cstdint>
+using namespace std;
+
+class AlignmentIndexFile
+{
+public:
+	// Constuctors
+	// ==============================================
+	AlignmentIndexFile(string fileName);
+
+	// Destructor
+	// =============================================
+	~AlignmentIndexFile();
+
+	// Public Class Methods
+	// =============================================
+
+	// int build(string alignmentFileName, const vector<string>& species)
+	//  Purpose:
+	//		Writes the index of a text alignment to
+	//		indexFileName(alignmentFileName) and returns the number of
+	//		blocks indexed.  species[0] is the MAF reference species.
+	static int build(string alignmentFileName, const vector<string>& species);
+
+	// string indexFileName(string alignmentFileName)
+	//  Purpose:
+	//		Returns the name of the index for an alignment file
+	static string indexFileName(string alignmentFileName);
+
+	// bool sourceStatus(string fileName, uint64_t& size, int64_t& modified)
+	//  Purpose:
+	//		Gets the size and modification time of a file, returning false
+	//		if it cannot be read
+	static bool sourceStatus(string fileName, uint64_t& size, int64_t& modified);
+
+	// Public Methods
+	// =============================================
+
+	// bool matchesSource()
+	//  Purpose:
+	//		Returns true if the alignment still has the size and
+	//		modification time recorded when the index was built
+	bool matchesSource();
+
+	// bool findBlocks(int start, int end, size_t& textOffset, size_t& textLength, int& firstCoordinate)
+	//  Purpose:
+	//		Finds the blocks overlapping the coordinates [start, end).
+	//		Returns false if there are none; otherwise sets the byte range
+	//		of the alignment text spanning them and the first coordinate of
+	//		the first block.
+	bool findBlocks(int start, int end, size_t& textOffset, size_t& textLength, int& firstCoordinate);
+
+	// Public Accessors
+	// =============================================
+	bool isMaf();
+	int getNumBlocks();
+	string getChromosome();
+	string getReferenceSpecies();	// MAF only
+	string getSourceFileName();
+
+private:
+
+	// Private Types
+	// =============================================
+	struct IndexFileHeader {
+		char magic[8];
+		uint32_t version;
+		uint32_t format;			// 0 .aln, 1 MAF
+		uint32_t sourcePathLength;
+		uint32_t reserved;
+		uint64_t sourceSize;
+		int64_t sourceModified;		// seconds since the epoch
+		uint64_t blocksOffset;
+		uint64_t numBlocks;
+		char chromosome[64];
+		char referenceSpecies[64];
+	};
+
+	struct IndexEntry {
+		uint64_t textOffset;		// start of the block's first line
+		uint64_t textLength;		// through the end of its last line
+		int32_t firstCoordinate;
+		int32_t endCoordinate;		// one past the last coordinate
+	};
+
+	// Private Attributes
+	// =============================================
+	static const char fileMagic[8];
+	static const uint32_t fileVersion;
+	MappedFile file;
+	const IndexFileHeader* header;
+	const IndexEntry* entries;
+
+	// Private Methods
+	// =============================================
+
+	// indexAlignment(const char* text, size_t length, string& chromosome, vector<IndexEntry>& blocks)
+	//  Purpose:
+	//		Finds the blocks of .aln text
+	static void indexAlignment(const char* text, size_t length, string& chromosome, vector<IndexEntry>& blocks);
+
+	// indexMaf(const char* text, size_t length, const string& referenceSpecies,
+	//		string& chromosome, vector<IndexEntry>& blocks)
+	//  Purpose:
+	//		Finds the reference chromosome blocks of MAF text (the
+	//		chromosome of the first reference row is used)
+	static void indexMaf(const char* text, size_t length, const string& referenceSpecies,
+		string& chromosome, vector<IndexEntry>& blocks);
+};
+
+#endif // ALIGNMENTINDEXFILE_H
@@ -0,0 +1,200 @@
+/*
+ * AlignmentTranspose.cpp
+ *
+ *	The AlignmentTranspose object converts alignment rows into columns.
+ *  See AlignmentTranspose.h for the tiling.
+ *
+ *	The 16 x 16 byte transpose is the usual four rounds of unpacks: bytes
+ *  of row pairs, then 16 bit pairs of those, then 32 bit and finally 64
+ *  bit halves, after which register i holds column i of the tile.
+ *
+ *  Created on: 10-18-26
+ */
+#include "AlignmentTranspose.h"
+#include "MultipleAlignmentFile.h"
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+
+// Tile dimensions (rows and columns)
+static const int tileSize = 16;
+
+// normalizeTileRow(__m128i residues)
+//  Purpose:
+//		SSE2 version of normalizeResidue for 16 residues
+static inline __m128i normalizeTileRow(__m128i residues) {
+	__m128i upper = _mm_and_si128(residues, _mm_set1_epi8((char) 0xDF));
+	__m128i isBase = _mm_or_si128(
+		_mm_or_si128(_mm_cmpeq_epi8(upper, _mm_set1_epi8('A')), _mm_cmpeq_epi8(upper, _mm_set1_epi8('C'))),
+		_mm_or_si128(_mm_cmpeq_epi8(upper, _mm_set1_epi8('G')), _mm_cmpeq_epi8(upper, _mm_set1_epi8('T'))));
+	return _mm_or_si128(_mm_and_si128(isBase, upper), _mm_andnot_si128(isBase, _mm_set1_epi8('-')));
+}
+
+// transposeTile(__m128i* tile)
+//  Purpose:
+//		Transposes 16 rows of 16 bytes in place
+static inline void transposeTile(__m128i* tile) {
+	__m128i pairs[16];
+	__m128i quads[16];
+
+	// Bytes of rows 2j and 2j + 1: pairs[j] columns 0-7, pairs[8 + j] columns 8-15
+	for (int j = 0; j < 8; j++) {
+		pairs[j] = _mm_unpacklo_epi8(tile[2 * j], tile[2 * j + 1]);
+		pairs[8 + j] = _mm_unpackhi_epi8(tile[2 * j], tile[2 * j + 1]);
+	}
+
+	// Rows 4j to 4j + 3: quads[4q + j] holds columns 4q to 4q + 3
+	for (int half = 0; half < 2; half++) {
+		for (int j = 0; j < 4; j++) {
+			quads[8 * half + j] = _mm_unpacklo_epi16(pairs[8 * half + 2 * j], pairs[8 * half + 2 * j + 1]);
+			quads[8 * half + 4 + j] = _mm_unpackhi_epi16(pairs[8 * half + 2 * j], pairs[8 * half + 2 * j + 1]);
+		}
+	}
+
+	// Rows 8k to 8k + 7: pairs[2p + k] holds columns 2p and 2p + 1
+	for (int q = 0; q < 4; q++) {
+		for (int k = 0; k < 2; k++) {
+			pairs[4 * q + k] = _mm_unpacklo_epi32(quads[4 * q + 2 * k], quads[4 * q + 2 * k + 1]);
+			pairs[4 * q + 2 + k] = _mm_unpackhi_epi32(quads[4 * q + 2 * k], quads[4 * q + 2 * k + 1]);
+		}
+	}
+
+	// All 16 rows of each column
+	for (int p = 0; p < 8; p++) {
+		tile[2 * p] = _mm_unpacklo_epi64(pairs[2 * p], pairs[2 * p + 1]);
+		tile[2 * p + 1] = _mm_unpackhi_epi64(pairs[2 * p], pairs[2 * p + 1]);
+	}
+}
+
+// encodeTileRow(__m128i residues, int weight, __m128i& valid)
+//  Purpose:
+//		Returns weight times the code (0-4) of each of 16 residues and
+//		clears valid where a residue is outside the alphabet
+static inline __m128i encodeTileRow(__m128i residues, int weight, __m128i& valid) {
+	__m128i isA = _mm_cmpeq_epi8(residues, _mm_set1_epi8('A'));
+	__m128i isC = _mm_cmpeq_epi8(residues, _mm_set1_epi8('C'));
+	__m128i isT = _mm_cmpeq_epi8(residues, _mm_set1_epi8('T'));
+	__m128i isG = _mm_cmpeq_epi8(residues, _mm_set1_epi8('G'));
+	__m128i isGap = _mm_cmpeq_epi8(residues, _mm_set1_epi8('-'));
+	valid = _mm_and_si128(valid,
+		_mm_or_si128(_mm_or_si128(isA, isC), _mm_or_si128(_mm_or_si128(isT, isG), isGap)));
+
+	__m128i codes = _mm_and_si128(isC, _mm_set1_epi8((char) weight));
+	codes = _mm_add_epi8(codes, _mm_and_si128(isT, _mm_set1_epi8((char) (2 * weight))));
+	codes = _mm_add_epi8(codes, _mm_and_si128(isG, _mm_set1_epi8((char) (3 * weight))));
+	return _mm_add_epi8(codes, _mm_and_si128(isGap, _mm_set1_epi8((char) (4 * weight))));
+}
+#endif
+
+// Public Class Methods
+// =============================================
+
+// transpose(const char* const* rows, int numRows, int length, char* columns)
+//  Purpose:
+//		Writes the normalized residue of rows[r][c] to
+//		columns[c * numRows + r] for every row and column.  A NULL row
+//		is all gaps.
+void AlignmentTranspose::transpose(const char* const* rows, int numRows, int length, char* columns) {
+#if defined(__SSE2__)
+	int tiledLength = length - length % tileSize;
+	__m128i tile[tileSize];
+	char partialColumn[tileSize];
+
+	for (int column = 0; column < tiledLength; column += tileSize) {
+		for (int firstRow = 0; firstRow < numRows; firstRow += tileSize) {
+			int tileRows = (numRows - firstRow < tileSize) ? numRows - firstRow : tileSize;
+			for (int r = 0; r < tileSize; r++) {
+				const char* row = (r < tileRows) ? rows[firstRow + r] : NULL;
+				if (row == NULL)
+					tile[r] = _mm_set1_epi8('-');
+				else
+					tile[r] = normalizeTileRow(_mm_loadu_si128((const __m128i*) (row + column)));
+			}
+
+			transposeTile(tile);
+
+			char* output = columns + (size_t) column * numRows + firstRow;
+			for (int c = 0; c < tileSize; c++, output += numRows) {
+				if (tileRows == tileSize)
+					_mm_storeu_si128((__m128i*) output, tile[c]);
+				else {
+					_mm_storeu_si128((__m128i*) partialColumn, tile[c]);
+					memcpy(output, partialColumn, tileRows);
+				}
+			}
+		}
+	}
+
+	transposeColumns(rows, numRows, tiledLength, length, columns);
+#else
+	transposeColumns(rows, numRows, 0, length, columns);
+#endif
+}
+
+// transposeScalar(const char* const* rows, int numRows, int length, char* columns)
+//  Purpose:
+//		Same as transpose, one residue at a time
+void AlignmentTranspose::transposeScalar(const char* const* rows, int numRows, int length, char* columns) {
+	transposeColumns(rows, numRows, 0, length, columns);
+}
+
+// encodeColumns(const char* human, const char* dog, const char* mouse, int length,
+//		unsigned char* symbols)
+//  Purpose:
+//		Writes the symbol of each of the length columns of the three
+//		rows to symbols (as MultipleAlignmentFile::encodeColumn)
+void AlignmentTranspose::encodeColumns(const char* human, const char* dog, const char* mouse, int length,
+	unsigned char* symbols) {
+	int column = 0;
+
+#if defined(__SSE2__)
+	// Symbols are at most 124, so the byte sums cannot overflow
+	for (; column + tileSize <= length; column += tileSize) {
+		__m128i valid = _mm_set1_epi8((char) 0xFF);
+		__m128i codes = encodeTileRow(_mm_loadu_si128((const __m128i*) (human + column)), 25, valid);
+		codes = _mm_add_epi8(codes, encodeTileRow(_mm_loadu_si128((const __m128i*) (dog + column)), 5, valid));
+		codes = _mm_add_epi8(codes, encodeTileRow(_mm_loadu_si128((const __m128i*) (mouse + column)), 1, valid));
+
+		// unknownSymbol (255) wherever a residue was outside the alphabet
+		codes = _mm_or_si128(codes, _mm_andnot_si128(valid, _mm_set1_epi8((char) 0xFF)));
+		_mm_storeu_si128((__m128i*) (symbols + column), codes);
+	}
+#endif
+
+	for (; column < length; column++)
+		symbols[column] = MultipleAlignmentFile::encodeColumn(human[column], dog[column], mouse[column]);
+}
+
+// char normalizeResidue(char residue)
+//  Purpose:
+//		Returns residue upper cased if it is A, C, G or T and a gap
+//		otherwise
+char AlignmentTranspose::normalizeResidue(char residue) {
+	switch (residue) {
+		case 'A': case 'a':
+			return 'A';
+		case 'C': case 'c':
+			return 'C';
+		case 'G': case 'g':
+			return 'G';
+		case 'T': case 't':
+			return 'T';
+		default:
+			return '-';
+	}
+}
+
+// Private Methods
+// =============================================
+
+// transposeColumns(const char* const* rows, int numRows, int begin, int end, char* columns)
+//  Purpose:
+//		Scalar transpose of columns [begin, end)
+void AlignmentTranspose::transposeColumns(const char* const* rows, int numRows, int begin, int end, char* columns) {
+	for (int column = begin; column < end; column++) {
+		char* output = columns + (size_t) column * numRows;
+		for (int r = 0; r < numRows; r++)
+			output[r] = (rows[r] == NULL) ? '-' : normalizeResidue(rows[r][column]);
+	}
+}
@@ -0,0 +1,83 @@
+/*
+ * AlignmentTranspose.h
+ *
+ *	This is the header file for the AlignmentTranspose object.
+ *  AlignmentTranspose converts the rows of an alignment block (one
+ *  string of residues per species) into columns (one residue per
+ *  species, columns stored one after another), which is the layout the
+ *  rest of the program works in.
+ *
+ *	Reading the rows one character at a time for every column touches a
+ *  different row (and usually a different cache line) for each residue.
+ *  The blocked transpose instead works on tiles of 16 rows x 16 columns:
+ *  each row of the tile is a single 16 byte load, the tile is transposed
+ *  in registers with SSE2 unpack shuffles, and each column of the tile
+ *  is written with a single store.  Tiles are visited column tile first
+ *  so the output being written stays in cache while every species' rows
+ *  are read.  Residues are normalized on the way through (upper cased,
+ *  anything other than A, C, G or T becomes a gap) so the columns are
+ *  written in their final form.
+ *
+ *	Three species blocks are transposed and encoded in one step:
+ *  encodeColumns compares 16 columns at a time against the alphabet and
+ *  writes the base 5 symbols (see MultipleAlignmentFile::encodeColumn)
+ *  directly.
+ *
+ *	Builds without SSE2 use the scalar versions.
+ *
+ *	Typical use:
+ *		const char* rows[] = {human, dog, mouse, rat};
+ *		vector<char> columns(4 * length);
+ *		AlignmentTranspose::transpose(rows, 4, length, columns.data());
+ *
+ *  Created on: 10-18-26
+ */
+
+#ifndef ALIGNMENTTRANSPOSE_H
+#define ALIGNMENTTRANSPOSE_H
+
+using namespace std;
+
+class AlignmentTranspose
+{
+public:
+	// Public Class Methods
+	// =============================================
+
+	// transpose(const char* const* rows, int numRows, int length, char* columns)
+	//  Purpose:
+	//		Writes the normalized residue of rows[r][c] to
+	//		columns[c * numRows + r] for every row and column.  A NULL row
+	//		is all gaps.
+	static void transpose(const char* const* rows, int numRows, int length, char* columns);
+
+	// transposeScalar(const char* const* rows, int numRows, int length, char* columns)
+	//  Purpose:
+	//		Same as transpose, one residue at a time
+	static void transposeScalar(const char* const* rows, int numRows, int length, char* columns);
+
+	// encodeColumns(const char* human, const char* dog, const char* mouse, int length,
+	//		unsigned char* symbols)
+	//  Purpose:
+	//		Writes the symbol of each of the length columns of the three
+	//		rows to symbols (as MultipleAlignmentFile::encodeColumn)
+	static void encodeColumns(const char* human, const char* dog, const char* mouse, int length,
+		unsigned char* symbols);
+
+	// char normalizeResidue(char residue)
+	//  Purpose:
+	//		Returns residue upper cased if it is A, C, G or T and a gap
+	//		otherwise
+	static char normalizeResidue(char residue);
+
+private:
+	// Private Methods
+	// =============================================
+
+	// transposeColumns(const char* const* rows, int numRows, int begin, int end, char* columns)
+	//  Purpose:
+	//		Scalar transpose of columns [begin, end)
+	static void transposeColumns(const char* const* rows, int numRows, int begin, int end, char* columns);
+};
+
+#endif // ALIGNMENTTRANSPOSE_H
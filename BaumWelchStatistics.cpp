@@ -0,0 +1,130 @@
+/*
+ * BaumWelchStatistics.cpp
+ *
+ *	The BaumWelchStatistics object holds the expected counts of a
+ *  Baum-Welch iteration.  See BaumWelchStatistics.h.
+ *
+ *  Created on: 10-18-26
+ */
+#include "BaumWelchStatistics.h"
+#include "MathUtilities.h"
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+// Constuctors
+// ==============================================
+BaumWelchStatistics::BaumWelchStatistics(int numberOfStates) {
+	numStates = numberOfStates;
+	clear();
+}
+
+// Destructor
+// =============================================
+BaumWelchStatistics::~BaumWelchStatistics() {
+}
+
+// Public Methods
+// =============================================
+
+// clear()
+//  Purpose:
+//		Sets every count to zero (NaN as a log)
+void BaumWelchStatistics::clear() {
+	long double logZero = std::numeric_limits<double>::quiet_NaN();
+	numRegions = 0;
+	logLikelihood = 0;
+	logInitiationCounts.assign(numStates, logZero);
+	logTransitionCounts.assign(numStates * numStates, logZero);
+	logStateCounts.assign(numStates, logZero);
+}
+
+// add(const BaumWelchStatistics& other)
+//  Purpose:
+//		Adds the counts and likelihood of other to these
+void BaumWelchStatistics::add(const BaumWelchStatistics& other) {
+	if (other.numStates != numStates)
+		throw runtime_error("Baum-Welch statistics have different numbers of states");
+
+	numRegions += other.numRegions;
+	logLikelihood += other.logLikelihood;
+	for (int i = 0; i < numStates; i++) {
+		logInitiationCounts[i] = MathUtilities::elnsum(logInitiationCounts[i], other.logInitiationCounts[i]);
+		logStateCounts[i] = MathUtilities::elnsum(logStateCounts[i], other.logStateCounts[i]);
+	}
+	for (int k = 0; k < numStates * numStates; k++)
+		logTransitionCounts[k] = MathUtilities::elnsum(logTransitionCounts[k], other.logTransitionCounts[k]);
+}
+
+// setProbabilities(HMMProbabilities* probabilities)
+//  Purpose:
+//		Sets the initiation and transition probabilities re-estimated
+//		from the counts.  The initiation probabilities are averaged
+//		over the regions.
+void BaumWelchStatistics::setProbabilities(HMMProbabilities* probabilities) {
+	if (numRegions == 0)
+		return;
+
+	// The start state is never visited, so it keeps its initiation
+	// probability and its transitions come out as zero (as in
+	// HiddenMarkovModel::calculateBaumWelchTransitionProbabilities)
+	long double logNumRegions = MathUtilities::eln(numRegions);
+	for (int state = 1; state < numStates; state++)
+		probabilities->setInitiationProbability(state,
+			MathUtilities::eexp(MathUtilities::elnprod(logInitiationCounts[state], -logNumRegions)));
+
+	for (int i = 0; i < numStates; i++) {
+		for (int j = 0; j < numStates; j++)
+			probabilities->setTransitionProbability(i, j,
+				MathUtilities::eexp(MathUtilities::elnprod(logTransitionCounts[i * numStates + j], -logStateCounts[i])));
+	}
+}
+
+// string pack()
+//  Purpose:
+//		Returns the statistics as bytes for sending to another process
+//
+//		format:
+//			numStates, numRegions (uint32)
+//			logLikelihood (double)
+//			logInitiationCounts, logTransitionCounts, logStateCounts (doubles)
+string BaumWelchStatistics::pack() {
+	uint32_t counts[2] = { (uint32_t) numStates, (uint32_t) numRegions };
+	vector<double> values;
+	values.push_back(logLikelihood);
+	values.insert(values.end(), logInitiationCounts.begin(), logInitiationCounts.end());
+	values.insert(values.end(), logTransitionCounts.begin(), logTransitionCounts.end());
+	values.insert(values.end(), logStateCounts.begin(), logStateCounts.end());
+
+	string bytes((const char*) counts, sizeof(counts));
+	bytes.append((const char*) values.data(), values.size() * sizeof(double));
+	return bytes;
+}
+
+// unpack(const string& bytes)
+//  Purpose:
+//		Sets the statistics from bytes returned by pack, throwing a
+//		runtime_error if they are not valid
+void BaumWelchStatistics::unpack(const string& bytes) {
+	uint32_t counts[2];
+	if (bytes.size() < sizeof(counts))
+		throw runtime_error("Invalid Baum-Welch statistics");
+	memcpy(counts, bytes.data(), sizeof(counts));
+	size_t numValues = 1 + counts[0] + (size_t) counts[0] * counts[0] + counts[0];
+	if ((int) counts[0] != numStates || bytes.size() != sizeof(counts) + numValues * sizeof(double))
+		throw runtime_error("Invalid Baum-Welch statistics");
+
+	vector<double> values(numValues);
+	memcpy(values.data(), bytes.data() + sizeof(counts), numValues * sizeof(double));
+	numRegions = counts[1];
+	size_t k = 0;
+	logLikelihood = values[k++];
+	for (int i = 0; i < numStates; i++)
+		logInitiationCounts[i] = values[k++];
+	for (int i = 0; i < numStates * numStates; i++)
+		logTransitionCounts[i] = values[k++];
+	for (int i = 0; i < numStates; i++)
+		logStateCounts[i] = values[k++];
+}
@@ -0,0 +1,93 @@
+/*
+ * BaumWelchStatistics.h
+ *
+ *	This is the header file for the BaumWelchStatistics object.
+ *  BaumWelchStatistics holds the expected counts one Baum-Welch iteration
+ *  re-estimates the probabilities from, summed over any number of
+ *  regions (see HMMDecoder::accumulateExpectedCounts).  Statistics from
+ *  separate sets of regions add, so regions can be split between
+ *  processes and their statistics combined before the probabilities are
+ *  updated, giving the same update as one process holding every region.
+ *
+ *	Counts are kept as logs, as the graph keeps them
+ *  (HiddenMarkovModel::calculateBaumWelchTransitionProbabilities), and
+ *  summed with MathUtilities::elnsum.  As in the single process training
+ *  only the initiation and transition probabilities are re-estimated.
+ *
+ *  Important Attributes
+ *
+ *		logInitiationCounts - expected count of each state at the first
+ *							  position of a region
+ *		logTransitionCounts - expected count of each transition
+ *							  [from state * numStates + to state]
+ *		logStateCounts - expected count of each state at every position
+ *						 but the last of a region
+ *		logLikelihood - log (base 2) likelihood of the regions
+ *
+ *	The packed form (pack/unpack) is native byte order doubles, like the
+ *  model file, so it is only read back on machines of the same kind.
+ *
+ *  Created on: 10-18-26
+ */
+
+#ifndef BAUMWELCHSTATISTICS_H
+#define BAUMWELCHSTATISTICS_H
+
+#include "HMMProbabilities.h"
+#include <string>
+#include <vector>
+using namespace std;
+
+class BaumWelchStatistics
+{
+public:
+	// Constuctors
+	// ==============================================
+	BaumWelchStatistics(int numberOfStates = 3);
+
+	// Destructor
+	// =============================================
+	~BaumWelchStatistics();
+
+	// Public Attributes
+	// =============================================
+	int numStates;
+	int numRegions;
+	double logLikelihood;
+	vector<long double> logInitiationCounts;	// [state]
+	vector<long double> logTransitionCounts;	// [from state * numStates + to state]
+	vector<long double> logStateCounts;			// [state]
+
+	// Public Methods
+	// =============================================
+
+	// clear()
+	//  Purpose:
+	//		Sets every count to zero (NaN as a log)
+	void clear();
+
+	// add(const BaumWelchStatistics& other)
+	//  Purpose:
+	//		Adds the counts and likelihood of other to these
+	void add(const BaumWelchStatistics& other);
+
+	// setProbabilities(HMMProbabilities* probabilities)
+	//  Purpose:
+	//		Sets the initiation and transition probabilities re-estimated
+	//		from the counts.  The initiation probabilities are averaged
+	//		over the regions.
+	void setProbabilities(HMMProbabilities* probabilities);
+
+	// string pack()
+	//  Purpose:
+	//		Returns the statistics as bytes for sending to another process
+	string pack();
+
+	// unpack(const string& bytes)
+	//  Purpose:
+	//		Sets the statistics from bytes returned by pack, throwing a
+	//		runtime_error if they are not valid
+	void unpack(const string& bytes);
+};
+
+#endif // BAUMWELCHSTATISTICS_H
@@ -0,0 +1,69 @@
+/*
+ * BedFileWriter.cpp
+ *
+ *  The BedFileWriter object writes segments to a BED file as they are
+ *  produced.  Lines go straight into a large OutputBuffer, so no string
+ *  is built per segment.
+ *
+ *  Segments are given as inclusive 1-based chromosome coordinates (the
+ *  coordinates used for the viterbi segments) and are written in the
+ *  BED convention of a 0-based start and an exclusive end:
+ *		<<chromosome>>\t<<first - 1>>\t<<last>>
+ *
+ *  Created on: 10-18-26
+ */
+#include "BedFileWriter.h"
+
+// Constuctors
+// ==============================================
+BedFileWriter::BedFileWriter(string fileName)
+	: output(fileName) {
+	segmentCount = 0;
+}
+
+// Destructor
+// =============================================
+BedFileWriter::~BedFileWriter() {
+}
+
+// Public Class Methods
+// =============================================
+
+// appendSegment(OutputBuffer& out, const string& chromosome, long long first, long long last)
+//  Purpose: 
+//		Appends the BED line for the segment covering the 1-based
+//		positions [first, last] on the chromosome to out (for BED text
+//		built in memory)
+void BedFileWriter::appendSegment(OutputBuffer& out, const string& chromosome, long long first, long long last) {
+	out.append(chromosome);
+	out.append('\t');
+	out.appendInt(first - 1);
+	out.append('\t');
+	out.appendInt(last);
+	out.append('\n');
+}
+
+// Public Methods
+// =============================================
+
+// writeSegment(const string& chromosome, long long first, long long last)
+//  Purpose: 
+//		Writes one BED line for the segment covering the 1-based
+//		positions [first, last] on the chromosome
+void BedFileWriter::writeSegment(const string& chromosome, long long first, long long last) {
+	appendSegment(output, chromosome, first, last);
+	segmentCount++;
+}
+
+// flush()
+//  Purpose: 
+//		Writes any buffered lines to the file
+void BedFileWriter::flush() {
+	output.flush();
+}
+
+// Public Accessors
+// =============================================
+long long BedFileWriter::getSegmentCount() {
+	return segmentCount;
+}
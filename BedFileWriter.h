@@ -0,0 +1,69 @@
+/*
+ * BedFileWriter.h
+ *
+ *  The BedFileWriter object writes segments to a BED file as they are
+ *  produced.  Lines go straight into a large OutputBuffer, so no string
+ *  is built per segment.
+ *
+ *  Segments are given as inclusive 1-based chromosome coordinates (the
+ *  coordinates used for the viterbi segments) and are written in the
+ *  BED convention of a 0-based start and an exclusive end:
+ *		<<chromosome>>\t<<first - 1>>\t<<last>>
+ *
+ *  Created on: 10-18-26
+ */
+
+#ifndef BEDFILEWRITER_H
+#define BEDFILEWRITER_H
+
+#include "OutputBuffer.h"
+#include <string>
+using namespace std;
+
+class BedFileWriter
+{
+public:
+	// Constuctors
+	// ==============================================
+	BedFileWriter(string fileName);
+
+	// Destructor
+	// =============================================
+	~BedFileWriter();
+
+	// Public Class Methods
+	// =============================================
+
+	// appendSegment(OutputBuffer& out, const string& chromosome, long long first, long long last)
+	//  Purpose: 
+	//		Appends the BED line for the segment covering the 1-based
+	//		positions [first, last] on the chromosome to out (for BED text
+	//		built in memory)
+	static void appendSegment(OutputBuffer& out, const string& chromosome, long long first, long long last);
+
+	// Public Methods
+	// =============================================
+
+	// writeSegment(const string& chromosome, long long first, long long last)
+	//  Purpose: 
+	//		Writes one BED line for the segment covering the 1-based
+	//		positions [first, last] on the chromosome
+	void writeSegment(const string& chromosome, long long first, long long last);
+
+	// flush()
+	//  Purpose: 
+	//		Writes any buffered lines to the file
+	void flush();
+
+	// Public Accessors
+	// =============================================
+	long long getSegmentCount();
+
+private:
+	// Attributes
+	// =============================================
+	OutputBuffer output;
+	long long segmentCount;
+};
+
+#endif // BEDFILEWRITER_H
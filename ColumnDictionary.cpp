@@ -0,0 +1,119 @@
+/*
+ * ColumnDictionary.cpp
+ *
+ *	The ColumnDictionary object interns alignment columns into compact
+ *  ids (see ColumnDictionary.h).  Ids are handed out in the order columns
+ *  are first seen, after the seeded three species columns.
+ *
+ *  Created on: 10-18-26
+ */
+#include "ColumnDictionary.h"
+#include <algorithm>
+
+// const variable initialization
+// ==============================================
+const int ColumnDictionary::numLegacyColumns = 100;
+
+// Constuctors
+// ==============================================
+ColumnDictionary::ColumnDictionary(const vector<string>& speciesNames) {
+	species = speciesNames;
+	numSpecies = species.size();
+	if (numSpecies == 3)
+		seedLegacyColumns();
+}
+
+// Destructor
+// =============================================
+ColumnDictionary::~ColumnDictionary() {
+}
+
+// Public Methods
+// =============================================
+
+// int intern(const char* column)
+//  Purpose: 
+//		Returns the id of the column (numSpecies residues), adding it to
+//		the dictionary if it has not been seen before
+int ColumnDictionary::intern(const char* column) {
+	unordered_map<string_view, int>::iterator existing = ids.find(string_view(column, numSpecies));
+	if (existing != ids.end())
+		return existing->second;
+
+	int id = columns.size();
+	columns.push_back(string(column, numSpecies));
+	ids[string_view(columns.back())] = id;
+	sorted.clear();
+	return id;
+}
+
+// int find(const string& column)
+//  Purpose: 
+//		Returns the id of the column, or -1 if it is not in the
+//		dictionary
+int ColumnDictionary::find(const string& column) {
+	unordered_map<string_view, int>::iterator existing = ids.find(string_view(column));
+	if (existing == ids.end())
+		return -1;
+
+	return existing->second;
+}
+
+// string& column(int id)
+//  Purpose: 
+//		Returns the residues of the column with the id
+const string& ColumnDictionary::column(int id) {
+	return columns[id];
+}
+
+// vector<int>& sortedIds()
+//  Purpose: 
+//		Returns every id ordered by column (the order the emission
+//		probabilities are reported in)
+const vector<int>& ColumnDictionary::sortedIds() {
+	if (sorted.size() != columns.size()) {
+		sorted.resize(columns.size());
+		for (size_t i = 0; i < sorted.size(); i++)
+			sorted[i] = i;
+		sort(sorted.begin(), sorted.end(),
+			[this](int a, int b) { return columns[a] < columns[b]; });
+	}
+
+	return sorted;
+}
+
+// Public Accessors
+// =============================================
+int ColumnDictionary::size() {
+	return columns.size();
+}
+
+int ColumnDictionary::getNumSpecies() {
+	return numSpecies;
+}
+
+const vector<string>& ColumnDictionary::getSpecies() {
+	return species;
+}
+
+// Private Methods
+// =============================================
+
+// seedLegacyColumns()
+//  Purpose: 
+//		Adds the 100 human/dog/mouse columns in symbol order (base 5 with
+//		the alphabet A, C, T, G, -; the human residue is never a gap)
+void ColumnDictionary::seedLegacyColumns() {
+	static const char alphabet[] = "ACTG-";
+	char column[3];
+	for (int human = 0; human < 4; human++) {
+		for (int dog = 0; dog < 5; dog++) {
+			for (int mouse = 0; mouse < 5; mouse++) {
+				column[0] = alphabet[human];
+				column[1] = alphabet[dog];
+				column[2] = alphabet[mouse];
+				intern(column);
+			}
+		}
+	}
+}
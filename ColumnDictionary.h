@@ -0,0 +1,107 @@
+/*
+ * ColumnDictionary.h
+ *
+ *	This is the header file for the ColumnDictionary object.  The
+ *  ColumnDictionary interns every distinct alignment column (one residue
+ *  per species) once and gives it a compact id.  Emission probabilities
+ *  and counts are kept per id, so their size grows with the number of
+ *  distinct columns observed rather than with the 5^k possible columns
+ *  of a k species alignment, and emissions are looked up per position
+ *  with an array index.
+ *
+ *	A three species dictionary is seeded with the 100 human/dog/mouse
+ *  columns of the original model (A, C, T, G or - for dog and mouse, no
+ *  human gap) so those columns always have the ids 0-99, which are also
+ *  their MultipleAlignmentFile symbols.
+ *
+ *	The dictionary also keeps the names of its species (reference first),
+ *  so a model trained on one species list is not applied to another.
+ *
+ *	Typical use:
+ *		ColumnDictionary columns(vector<string>({"hg18", "canFam2", "mm8"}));
+ *		int id = columns.intern("AC-");
+ *		string column = columns.column(id);
+ *
+ *  Created on: 10-18-26
+ */
+
+#ifndef COLUMNDICTIONARY_H
+#define COLUMNDICTIONARY_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <deque>
+#include <unordered_map>
+using namespace std;
+
+class ColumnDictionary
+{
+public:
+	// Constuctors
+	// ==============================================
+	ColumnDictionary(const vector<string>& speciesNames);
+
+	// Destructor
+	// =============================================
+	~ColumnDictionary();
+
+	// Public Attributes
+	// =============================================
+	static const int numLegacyColumns;	// seeded three species columns
+
+	// Public Methods
+	// =============================================
+
+	// int intern(const char* column)
+	//  Purpose: 
+	//		Returns the id of the column (numSpecies residues), adding it to
+	//		the dictionary if it has not been seen before
+	int intern(const char* column);
+
+	// int find(const string& column)
+	//  Purpose: 
+	//		Returns the id of the column, or -1 if it is not in the
+	//		dictionary
+	int find(const string& column);
+
+	// string& column(int id)
+	//  Purpose: 
+	//		Returns the residues of the column with the id
+	const string& column(int id);
+
+	// vector<int>& sortedIds()
+	//  Purpose: 
+	//		Returns every id ordered by column (the order the emission
+	//		probabilities are reported in)
+	const vector<int>& sortedIds();
+
+	// Public Accessors
+	// =============================================
+	int size();
+	int getNumSpecies();
+	const vector<string>& getSpecies();
+
+private:
+	// Private Attributes
+	// =============================================
+	int numSpecies;
+	vector<string> species;					// names, in column residue order
+	deque<string> columns;					// stable storage for the keys
+	unordered_map<string_view, int> ids;
+	vector<int> sorted;						// cache for sortedIds
+
+	// Private Methods
+	// =============================================
+
+	// seedLegacyColumns()
+	//  Purpose: 
+	//		Adds the 100 human/dog/mouse columns in symbol order
+	void seedLegacyColumns();
+
+	// Not copyable (the keys point into columns)
+	ColumnDictionary(const ColumnDictionary&);
+	ColumnDictionary& operator=(const ColumnDictionary&);
+};
+
+#endif // COLUMNDICTIONARY_H
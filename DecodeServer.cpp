@@ -0,0 +1,688 @@
+/*
+ * DecodeServer.cpp
+ *
+ *	The DecodeServer object answers decode requests over a socket with
+ *  the model and alignments kept in memory.  See DecodeServer.h for the
+ *  requests and replies.
+ *
+ *	A request lives on the stack of the connection thread that read it;
+ *  the decode thread that takes it from the queue fills in the reply and
+ *  sets done (under requestsLock) and does not touch it again.
+ *
+ *  Created on: 10-18-26
+ */
+#include "DecodeServer.h"
+#include "MultipleAlignmentFile.h"
+#include "HMMProbabilities.h"
+#include "HMMDecoder.h"
+#include "DecoderWorkspace.h"
+#include "ParameterStore.h"
+#include "ColumnDictionary.h"
+#include "SocketChannel.h"
+#include "StatePathUtilities.h"
+#include "BedFileWriter.h"
+#include "OutputBuffer.h"
+#include "StringUtilities.h"
+#include "TraceRecorder.h"
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <thread>
+#include <cstdlib>
+#include <stdexcept>
+
+// const variable initialization
+// ==============================================
+const uint64_t DecodeServer::maxRequestLength = 1 << 16;		// one line of text
+const uint64_t DecodeServer::maxReplyLength = (uint64_t) 1 << 32;	// the posteriors of a whole chromosome
+
+// Constuctors
+// ==============================================
+DecodeServer::DecodeServer(string aModelFileName, const vector<string>& someSpecies, int aNumThreads,
+	int aMaxAlignments) {
+	initialize(someSpecies, aNumThreads, aMaxAlignments);
+
+	// The model file's own columns; each alignment's decoder is built
+	// against its columns from these
+	modelColumns = HMMProbabilities::loadColumns(aModelFileName);
+	ownedParameterStore = new ParameterStore();
+	parameterStore = ownedParameterStore;
+	try {
+		parameterStore->publish(shared_ptr<const HMMProbabilities>(
+			HMMProbabilities::load(aModelFileName, modelColumns)));
+	}
+	catch (...) {
+		delete ownedParameterStore;
+		delete modelColumns;
+		throw;
+	}
+}
+
+DecodeServer::DecodeServer(ParameterStore* aParameterStore, const vector<string>& someSpecies, int aNumThreads,
+	int aMaxAlignments) {
+	initialize(someSpecies, aNumThreads, aMaxAlignments);
+	parameterStore = aParameterStore;
+}
+
+// Destructor
+// =============================================
+DecodeServer::~DecodeServer() {
+	for (pair<const string, Alignment*>& entry : alignments)
+		freeAlignment(entry.second);
+
+	// The snapshots refer to the model's columns
+	delete ownedParameterStore;
+	delete modelColumns;
+}
+
+// Public Class Methods
+// =============================================
+
+// string request(string address, string text)
+//  Purpose:
+//		Sends one request to the server at address and returns the
+//		reply, throwing with the server's message if it failed
+string DecodeServer::request(string address, string text) {
+	SocketChannel* channel = SocketChannel::connect(address, 0);
+	channel->setMaxPayloadLength(maxReplyLength);
+	string reply;
+	uint32_t type;
+	try {
+		channel->send(requestMessage, text);
+		type = channel->receive(reply);
+	}
+	catch (...) {
+		delete channel;
+		throw;
+	}
+	delete channel;
+
+	if (type == errorMessage)
+		throw runtime_error(reply);
+	return reply;
+}
+
+// Public Methods
+// =============================================
+
+// preload(string fileName)
+//  Purpose:
+//		Parses an alignment before any request needs it, and lets
+//		requests name it.  Throws if it cannot be loaded.  Called
+//		before serve.
+void DecodeServer::preload(string fileName) {
+	shared_ptr<HMMDecoder> decoder;
+	Alignment* alignment = acquireAlignment(fileName, decoder);
+	decoder.reset();
+	releaseAlignment(alignment);
+	preloadedFileNames.insert(fileName);
+}
+
+// setDataDirectory(string directory)
+//  Purpose:
+//		Lets requests name any file inside directory as well as the
+//		preloaded ones.  Throws if the directory cannot be found.
+//		Called before serve.
+void DecodeServer::setDataDirectory(string directory) {
+	char* resolved = realpath(directory.c_str(), NULL);
+	if (resolved == NULL)
+		throw runtime_error("Unable to find data directory: " + directory);
+	dataDirectory = resolved;
+	free(resolved);
+	if (dataDirectory.back() != '/')
+		dataDirectory += '/';
+}
+
+// serve(string address)
+//  Purpose:
+//		Listens on the address and answers requests until a shutdown
+//		request.  Requests already queued are answered first.
+void DecodeServer::serve(string anAddress) {
+	address = anAddress;
+	int listener = SocketChannel::listen(address);
+
+	vector<thread> workers;
+	for (int i = 0; i < numThreads; i++)
+		workers.push_back(thread(&DecodeServer::runWorker, this));
+	cout << "Serving on " << address << " with " << numThreads << " decode threads\n" << flush;
+
+	string error;
+	while (true) {
+		SocketChannel* channel = NULL;
+		try {
+			channel = SocketChannel::accept(listener);
+		}
+		catch (const exception& acceptError) {
+			error = acceptError.what();
+			lock_guard<mutex> guard(requestsLock);
+			stopping = true;
+			break;
+		}
+
+		{
+			// A shutdown request wakes the accept with a connection of its own
+			lock_guard<mutex> guard(requestsLock);
+			if (stopping) {
+				delete channel;
+				break;
+			}
+		}
+
+		lock_guard<mutex> guard(connectionsLock);
+		connections.push_back(channel);
+		thread(&DecodeServer::serveConnection, this, channel).detach();
+	}
+	SocketChannel::closeListener(listener, address);
+
+	// Close the connections (their threads free them), then let the
+	// decode threads finish what is queued
+	{
+		unique_lock<mutex> lock(connectionsLock);
+		for (SocketChannel* channel : connections)
+			channel->shutdown();
+		connectionClosed.wait(lock, [this]() { return connections.empty(); });
+	}
+	requestQueued.notify_all();
+	for (thread& worker : workers)
+		worker.join();
+
+	if (!error.empty())
+		throw runtime_error(error);
+}
+
+// string statisticsString()
+//  Purpose:
+//		Returns the request and alignment cache counts
+//
+//		format:
+//			Requests: <<n>>  Failed: <<n>>  Batches: <<n>>  Mean Latency: <<ms>>ms  Max Latency: <<ms>>ms
+//			Alignments: <<n>>  Loads: <<n>>  Evictions: <<n>>  Decoders Built: <<n>>  Snapshots Published: <<n>>
+string DecodeServer::statisticsString() {
+	stringstream ss;
+	ss << fixed << setprecision(3);
+	{
+		lock_guard<mutex> guard(requestsLock);
+		double meanSeconds = (numRequests > 0) ? totalSeconds / numRequests : 0;
+		ss
+			<< "Requests: " << numRequests
+			<< "  Failed: " << numFailed
+			<< "  Batches: " << numBatches
+			<< "  Mean Latency: " << 1000 * meanSeconds << "ms"
+			<< "  Max Latency: " << 1000 * maxSeconds << "ms"
+			<< "\n";
+	}
+	{
+		lock_guard<mutex> guard(alignmentsLock);
+		ss
+			<< "Alignments: " << alignments.size()
+			<< "  Loads: " << numLoads
+			<< "  Evictions: " << numEvictions
+			<< "  Decoders Built: " << numDecodersBuilt
+			<< "  Snapshots Published: " << parameterStore->getNumPublished()
+			<< "\n";
+	}
+	return ss.str();
+}
+
+// Private Methods
+// =============================================
+
+// serveConnection(SocketChannel* channel)
+//  Purpose:
+//		Answers the requests of one connection until it closes, then
+//		frees it
+void DecodeServer::serveConnection(SocketChannel* channel) {
+	channel->setMaxPayloadLength(maxRequestLength);
+	try {
+		string text;
+		while (true) {
+			uint32_t type = channel->receive(text);
+			Request request;
+			if (type != requestMessage || !parseRequest(text, request)) {
+				channel->send(errorMessage, "Invalid request: " + text);
+				continue;
+			}
+
+			if (request.command == "stats") {
+				channel->send(replyMessage, statisticsString());
+				continue;
+			}
+			if (request.command == "shutdown") {
+				{
+					lock_guard<mutex> guard(requestsLock);
+					stopping = true;
+				}
+				channel->send(replyMessage, "Stopping\n");
+				try {
+					delete SocketChannel::connect(address, 0);
+				}
+				catch (const exception&) {
+					// Already stopped
+				}
+				continue;
+			}
+
+			if (!isServed(request.fileName)) {
+				channel->send(errorMessage, "File is not served: " + request.fileName);
+				continue;
+			}
+
+			// Queue it for the decode threads and wait for the reply
+			unique_lock<mutex> lock(requestsLock);
+			if (stopping) {
+				lock.unlock();
+				channel->send(errorMessage, "Server is stopping");
+				continue;
+			}
+			request.queued = chrono::steady_clock::now();
+			requests.push_back(&request);
+			requestQueued.notify_one();
+			requestDone.wait(lock, [&request]() { return request.done; });
+			lock.unlock();
+
+			channel->send(request.failed ? errorMessage : replyMessage, request.reply);
+		}
+	}
+	catch (const exception&) {
+		// The client closed the connection or the server is stopping
+	}
+
+	lock_guard<mutex> guard(connectionsLock);
+	connections.erase(find(connections.begin(), connections.end(), channel));
+	delete channel;
+	connectionClosed.notify_all();
+}
+
+// runWorker()
+//  Purpose:
+//		Answers batches of queued requests until the server stops and
+//		the queue is empty
+void DecodeServer::runWorker() {
+	TraceRecorder::setThreadName("decode worker");
+
+	// Kept across requests so decoding stops allocating once warm
+	DecoderWorkspace workspace;
+	vector<double> statePosteriors;
+	vector<Request*> batch;
+
+	while (true) {
+		string fileName;
+		{
+			TraceRecorder::Span span("wait", "idle");
+			unique_lock<mutex> lock(requestsLock);
+			requestQueued.wait(lock, [this]() { return stopping || !requests.empty(); });
+			if (requests.empty())
+				return;
+
+			// The oldest request and its share of the others queued for
+			// the same alignment
+			size_t batchLimit = max((size_t) 1, requests.size() / numThreads);
+			fileName = requests.front()->fileName;
+			batch.clear();
+			deque<Request*>::iterator request = requests.begin();
+			while (request != requests.end() && batch.size() < batchLimit) {
+				if ((*request)->fileName == fileName) {
+					batch.push_back(*request);
+					request = requests.erase(request);
+				}
+				else
+					request++;
+			}
+			numBatches++;
+		}
+
+		TraceRecorder::Span span("decode", "decode batch", "requests", batch.size());
+
+		// The decoder is pinned for the whole batch, whatever is
+		// published meanwhile
+		Alignment* alignment = NULL;
+		shared_ptr<HMMDecoder> decoder;
+		string error;
+		try {
+			alignment = acquireAlignment(fileName, decoder);
+		}
+		catch (const exception& loadError) {
+			error = loadError.what();
+		}
+
+		for (Request* request : batch) {
+			request->failed = true;
+			if (alignment == NULL)
+				request->reply = error;
+			else {
+				try {
+					answer(*request, alignment->multiAlignFile, decoder.get(), workspace, statePosteriors);
+					request->failed = false;
+				}
+				catch (const exception& answerError) {
+					request->reply = answerError.what();
+				}
+			}
+
+			double seconds = chrono::duration<double>(chrono::steady_clock::now() - request->queued).count();
+			lock_guard<mutex> guard(requestsLock);
+			numRequests++;
+			if (request->failed)
+				numFailed++;
+			totalSeconds += seconds;
+			maxSeconds = max(maxSeconds, seconds);
+			request->done = true;
+			requestDone.notify_all();
+		}
+
+		decoder.reset();
+		if (alignment != NULL)
+			releaseAlignment(alignment);
+	}
+}
+
+// bool parseRequest(const string& text, Request& request)
+//  Purpose:
+//		Sets the command, file name and range of a request from its
+//		text, returning false if it is not a valid request
+bool DecodeServer::parseRequest(const string& text, Request& request) {
+	request.rangeStart = 0;
+	request.rangeEnd = 0;
+	request.failed = false;
+	request.done = false;
+
+	vector<string> words;
+	istringstream in(text);
+	string word;
+	while (in >> word)
+		words.push_back(word);
+	if (words.empty())
+		return false;
+
+	request.command = words[0];
+	if (request.command == "stats" || request.command == "shutdown")
+		return words.size() == 1;
+	if (request.command != "decode" && request.command != "posterior" && request.command != "likelihood")
+		return false;
+	if (words.size() < 2 || words.size() > 3)
+		return false;
+
+	request.fileName = words[1];
+	if (words.size() == 3) {
+		vector<string> range;
+		StringUtilities::split(words[2], '-', range);
+		if (range.size() != 2 || atoi(range[1].c_str()) <= atoi(range[0].c_str()))
+			return false;
+		request.rangeStart = atoi(range[0].c_str());
+		request.rangeEnd = atoi(range[1].c_str());
+	}
+	return true;
+}
+
+// bool isServed(const string& fileName)
+//  Purpose:
+//		Returns true if requests may name the file (it was preloaded
+//		or is inside the data directory)
+bool DecodeServer::isServed(const string& fileName) {
+	if (preloadedFileNames.count(fileName) > 0)
+		return true;
+	if (dataDirectory.empty())
+		return false;
+
+	// Resolved first, so neither .. nor a symbolic link leads out
+	char* resolved = realpath(fileName.c_str(), NULL);
+	if (resolved == NULL)
+		return false;
+	string path = resolved;
+	free(resolved);
+	return path.compare(0, dataDirectory.size(), dataDirectory) == 0;
+}
+
+// answer(Request& request, MultipleAlignmentFile* multiAlignFile, HMMDecoder* decoder,
+//		DecoderWorkspace& workspace, vector<double>& statePosteriors)
+//  Purpose:
+//		Decodes the request's range of the alignment and sets the reply
+void DecodeServer::answer(Request& request, MultipleAlignmentFile* multiAlignFile, HMMDecoder* decoder,
+	DecoderWorkspace& workspace, vector<double>& statePosteriors) {
+	int firstColumn = 0;
+	int lastColumn = multiAlignFile->getSequenceLength();
+	if (request.rangeEnd > request.rangeStart) {
+		firstColumn = multiAlignFile->findColumn(request.rangeStart);
+		lastColumn = multiAlignFile->findColumn(request.rangeEnd);
+	}
+	int length = lastColumn - firstColumn;
+	if (length <= 0)
+		throw runtime_error("No alignment columns in range");
+	const int* symbols = multiAlignFile->getColumnIds() + firstColumn;
+	string& chromosome = multiAlignFile->getChromosome();
+
+	// Summary line
+	OutputBuffer out;
+	out.append(chromosome);
+	out.append('\t');
+	out.appendInt(multiAlignFile->getCoordinate(firstColumn));
+	out.append('\t');
+	out.appendInt(multiAlignFile->getCoordinate(lastColumn - 1));
+	out.append('\t');
+	out.appendInt(length);
+
+	if (request.command == "decode") {
+		double pathWeight = decoder->viterbi(symbols, length, workspace);
+		vector<StatePathUtilities::StateRun> runs;
+		StatePathUtilities::extractRuns(workspace.getStatePath(), length, runs);
+
+		// Runs as columns of the file, split where a MAF file skips
+		// reference coordinates
+		for (StatePathUtilities::StateRun& run : runs) {
+			run.start += firstColumn;
+			run.end += firstColumn;
+		}
+		StatePathUtilities::splitRunsAtBreaks(runs, multiAlignFile->getCoordinateBreaks());
+
+		OutputBuffer segments;
+		long long conservedColumns = 0;
+		long long conservedSegments = 0;
+		for (StatePathUtilities::StateRun& run : runs) {
+			if (run.state != 2)
+				continue;
+			conservedColumns += run.end - run.start + 1;
+			conservedSegments++;
+			BedFileWriter::appendSegment(segments, chromosome, multiAlignFile->getCoordinate(run.start),
+				multiAlignFile->getCoordinate(run.end));
+		}
+		out.append('\t');
+		out.appendInt(conservedColumns);
+		out.append('\t');
+		out.appendInt(conservedSegments);
+		out.append('\t');
+		out.appendDouble(pathWeight, 10);
+		out.append('\n');
+		out.append(segments.str());
+	}
+	else if (request.command == "posterior") {
+		double logLikelihood = decoder->posteriors(symbols, length, workspace, statePosteriors);
+		int numHiddenStates = decoder->getNumStates() - 1;
+		out.append('\t');
+		out.appendDouble(logLikelihood, 10);
+		out.append('\n');
+		for (int position = 0; position < length; position++) {
+			out.appendInt(multiAlignFile->getCoordinate(firstColumn + position));
+			out.append('\t');
+			out.appendDouble(statePosteriors[(size_t) position * numHiddenStates + 1]);
+			out.append('\n');
+		}
+	}
+	else {
+		double logLikelihood = decoder->forwardBackward(symbols, length, workspace);
+		out.append('\t');
+		out.appendDouble(logLikelihood, 10);
+		out.append('\n');
+	}
+
+	workspace.reset();
+	request.reply = out.str();
+}
+
+// Alignment* acquireAlignment(string fileName, shared_ptr<HMMDecoder>& decoder)
+//  Purpose:
+//		Returns the loaded alignment for a file, parsing it if no other
+//		request has, and marks it in use until released.  decoder is
+//		set to (and pins) its decoder for the current parameters.
+//		Throws if it cannot be loaded.
+DecodeServer::Alignment* DecodeServer::acquireAlignment(string fileName, shared_ptr<HMMDecoder>& decoder) {
+	shared_ptr<const HMMProbabilities> snapshot = parameterStore->pin();
+	if (!snapshot)
+		throw runtime_error("No parameters have been published");
+
+	unique_lock<mutex> lock(alignmentsLock);
+	Alignment* alignment;
+	map<string, Alignment*>::iterator found = alignments.find(fileName);
+	if (found != alignments.end()) {
+		alignment = found->second;
+		alignment->users++;
+		alignment->lastUsed = ++useCount;
+		alignmentLoaded.wait(lock, [alignment]() { return alignment->loaded; });
+		if (!alignment->error.empty()) {
+			string error = alignment->error;
+			lock.unlock();
+			releaseAlignment(alignment);
+			throw runtime_error(error);
+		}
+	}
+	else {
+		// Parsed outside the lock; other requests for it wait above
+		alignment = new Alignment();
+		alignment->fileName = fileName;
+		alignment->multiAlignFile = NULL;
+		alignment->loaded = false;
+		alignment->users = 1;
+		alignment->lastUsed = ++useCount;
+		alignments[fileName] = alignment;
+		lock.unlock();
+
+		string error;
+		try {
+			alignment->multiAlignFile = new MultipleAlignmentFile(fileName, species);
+		}
+		catch (const exception& loadError) {
+			error = loadError.what();
+		}
+
+		lock.lock();
+		alignment->loaded = true;
+		alignment->error = error;
+		alignmentLoaded.notify_all();
+		if (!error.empty()) {
+			// Dropped so the next request for the file tries again
+			alignments.erase(fileName);
+			lock.unlock();
+			releaseAlignment(alignment);
+			throw runtime_error(error);
+		}
+		numLoads++;
+		evictAlignments();
+	}
+
+	if (alignment->decoderParameters == snapshot) {
+		decoder = alignment->decoder;
+		return alignment;
+	}
+
+	// First use since the parameters changed: build a decoder from the
+	// snapshot outside the lock (batches holding the old one keep it)
+	lock.unlock();
+	try {
+		decoder.reset(buildDecoder(*snapshot, alignment->multiAlignFile));
+	}
+	catch (...) {
+		releaseAlignment(alignment);
+		throw;
+	}
+	lock.lock();
+	numDecodersBuilt++;
+	if (parameterStore->pin() == snapshot) {
+		alignment->decoder = decoder;
+		alignment->decoderParameters = snapshot;
+	}
+	return alignment;
+}
+
+// HMMDecoder* buildDecoder(const HMMProbabilities& snapshot, MultipleAlignmentFile* multiAlignFile)
+//  Purpose:
+//		Returns a decoder for the alignment's columns with the
+//		parameters of snapshot (whose columns may differ)
+HMMDecoder* DecodeServer::buildDecoder(const HMMProbabilities& snapshot, MultipleAlignmentFile* multiAlignFile) {
+	// Through the model file format, which matches columns by residues
+	OutputBuffer model;
+	snapshot.save(model);
+	string contents = model.str();
+	HMMProbabilities* probabilities = HMMProbabilities::load(contents.data(), contents.size(),
+		multiAlignFile->getColumnDictionary(), "parameter snapshot");
+	HMMDecoder* decoder = new HMMDecoder(probabilities);
+	delete probabilities;
+	return decoder;
+}
+
+// releaseAlignment(Alignment* alignment)
+//  Purpose:
+//		Marks an acquired alignment no longer in use by the caller
+void DecodeServer::releaseAlignment(Alignment* alignment) {
+	lock_guard<mutex> guard(alignmentsLock);
+	alignment->users--;
+	if (alignment->users > 0)
+		return;
+
+	map<string, Alignment*>::iterator found = alignments.find(alignment->fileName);
+	if (found == alignments.end() || found->second != alignment)
+		freeAlignment(alignment);
+	else
+		evictAlignments();
+}
+
+// evictAlignments()
+//  Purpose:
+//		Drops least recently used alignments not in use until at most
+//		maxAlignments are kept.  alignmentsLock must be held.
+void DecodeServer::evictAlignments() {
+	while ((int) alignments.size() > maxAlignments) {
+		Alignment* oldest = NULL;
+		for (pair<const string, Alignment*>& entry : alignments) {
+			Alignment* alignment = entry.second;
+			if (alignment->users == 0 && (oldest == NULL || alignment->lastUsed < oldest->lastUsed))
+				oldest = alignment;
+		}
+		if (oldest == NULL)
+			return;			// all in use; tried again as they are released
+
+		alignments.erase(oldest->fileName);
+		freeAlignment(oldest);
+		numEvictions++;
+	}
+}
+
+// freeAlignment(Alignment* alignment)
+//  Purpose:
+//		Deletes an alignment (its decoder goes with the last batch
+//		using it)
+void DecodeServer::freeAlignment(Alignment* alignment) {
+	delete alignment->multiAlignFile;
+	delete alignment;
+}
+
+// initialize(const vector<string>& someSpecies, int aNumThreads, int aMaxAlignments)
+//  Purpose:
+//		Sets the attributes common to both constructors
+void DecodeServer::initialize(const vector<string>& someSpecies, int aNumThreads, int aMaxAlignments) {
+	parameterStore = NULL;
+	ownedParameterStore = NULL;
+	modelColumns = NULL;
+	species = someSpecies;
+	numThreads = (aNumThreads > 0) ? aNumThreads : max(1, (int) thread::hardware_concurrency());
+	maxAlignments = max(1, aMaxAlignments);
+	useCount = 0;
+	numLoads = 0;
+	numEvictions = 0;
+	numDecodersBuilt = 0;
+	stopping = false;
+	numRequests = 0;
+	numFailed = 0;
+	numBatches = 0;
+	totalSeconds = 0;
+	maxSeconds = 0;
+}
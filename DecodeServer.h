@@ -0,0 +1,292 @@
+/*
+ * DecodeServer.h
+ *
+ *	This is the header file for the DecodeServer object.  A DecodeServer
+ *  is a long running process that answers decode requests over a socket
+ *  (usually a Unix domain socket, see SocketChannel for the address
+ *  forms).  The parameters are loaded once and alignments stay parsed
+ *  between requests, each with an HMMDecoder built from the parameters,
+ *  so a request only pays for decoding its own range.
+ *
+ *	The parameters come from a ParameterStore: either one the server
+ *  fills from a model file, or one a HiddenMarkovModel training in the
+ *  same process publishes to.  A batch of requests pins the decoder
+ *  built from the current snapshot for as long as it runs; when a new
+ *  snapshot is published the next batch for each alignment builds a new
+ *  decoder, while batches already running finish with the old one.
+ *
+ *	Requests are one line of text, a command and its arguments:
+ *
+ *		decode file [start-end]		viterbi path over the columns with
+ *									coordinates in [start, end) (the
+ *									whole alignment if no range is given)
+ *		posterior file [start-end]	probability of the conserved state at
+ *									each column
+ *		likelihood file [start-end]	log likelihood (log 2) of the columns
+ *		stats						request and alignment cache counts
+ *		shutdown					stop the server
+ *
+ *	A request may only name a file that was preloaded or, if a data
+ *  directory is set, a file inside it (after resolving .. and symbolic
+ *  links); any other file is refused without being opened.  Requests
+ *  longer than maxRequestLength are refused.
+ *
+ *	Every reply begins with a summary line (tab separated):
+ *
+ *		chromosome  first coordinate  last coordinate  columns  ...
+ *
+ *  followed by, for decode, the conserved columns, conserved segments
+ *  and path weight and one BED line per conserved segment; for posterior,
+ *  the log likelihood and one "coordinate  posterior" line per column; for
+ *  likelihood, just the log likelihood.
+ *
+ *	Each connection is read by its own thread, which queues its requests
+ *  for a fixed pool of decode threads and sends the reply when it is
+ *  done.  A decode thread takes the oldest request together with other
+ *  queued requests for the same alignment (a batch), so the alignment
+ *  is looked up once and decoded back to back in the thread's
+ *  workspace.  Concurrent requests for the same alignment are spread
+ *  over the decode threads rather than all going to one.
+ *
+ *	At most maxAlignments alignments are kept; the least recently used
+ *  one not in use is dropped to make room.  An alignment is parsed by the
+ *  first request that needs it (or by preload) and any other request for
+ *  it waits for that parse rather than parsing it again.
+ *
+ *	Messages (SocketChannel frames):
+ *		client -> server	request		request text
+ *		server -> client	reply		reply text
+ *		server -> client	error		message text
+ *
+ *	Typical use:
+ *		DecodeServer server("trained.hmmp", species, 8, 16);	// or (&parameterStore, ...)
+ *		server.preload("chr7.aln");
+ *		server.setDataDirectory("alignments");		// optional
+ *		server.serve("unix:/tmp/hmm.sock");
+ *	and from a client:
+ *		string reply = DecodeServer::request("unix:/tmp/hmm.sock", "decode chr7.aln 115000-215000");
+ *
+ *  Created on: 10-18-26
+ */
+
+#ifndef DECODESERVER_H
+#define DECODESERVER_H
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <set>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <memory>
+#include <cstdint>
+using namespace std;
+
+class MultipleAlignmentFile;
+class HMMDecoder;
+class HMMProbabilities;
+class DecoderWorkspace;
+class ColumnDictionary;
+class ParameterStore;
+class SocketChannel;
+
+class DecodeServer
+{
+public:
+	// Public Types
+	// =============================================
+	enum MessageType {
+		requestMessage = 1,
+		replyMessage = 2,
+		errorMessage = 3
+	};
+
+	// Constuctors
+	// ==============================================
+	DecodeServer(string aModelFileName, const vector<string>& someSpecies, int aNumThreads = 0,
+		int aMaxAlignments = 16);	// 0 threads for one per hardware thread
+	DecodeServer(ParameterStore* aParameterStore, const vector<string>& someSpecies, int aNumThreads = 0,
+		int aMaxAlignments = 16);	// store not owned; something must have published to it
+
+	// Destructor
+	// =============================================
+	~DecodeServer();
+
+	// Public Class Methods
+	// =============================================
+
+	// string request(string address, string text)
+	//  Purpose:
+	//		Sends one request to the server at address and returns the
+	//		reply, throwing with the server's message if it failed
+	static string request(string address, string text);
+
+	// Public Methods
+	// =============================================
+
+	// preload(string fileName)
+	//  Purpose:
+	//		Parses an alignment before any request needs it, and lets
+	//		requests name it.  Throws if it cannot be loaded.  Called
+	//		before serve.
+	void preload(string fileName);
+
+	// setDataDirectory(string directory)
+	//  Purpose:
+	//		Lets requests name any file inside directory as well as the
+	//		preloaded ones.  Throws if the directory cannot be found.
+	//		Called before serve.
+	void setDataDirectory(string directory);
+
+	// serve(string address)
+	//  Purpose:
+	//		Listens on the address and answers requests until a shutdown
+	//		request.  Requests already queued are answered first.
+	void serve(string address);
+
+	// string statisticsString()
+	//  Purpose:
+	//		Returns the request and alignment cache counts
+	//
+	//		format:
+	//			Requests: <<n>>  Failed: <<n>>  Batches: <<n>>  Mean Latency: <<ms>>ms  Max Latency: <<ms>>ms
+	//			Alignments: <<n>>  Loads: <<n>>  Evictions: <<n>>  Decoders Built: <<n>>  Snapshots Published: <<n>>
+	string statisticsString();
+
+private:
+	// Private Types
+	// =============================================
+	struct Alignment {
+		string fileName;
+		MultipleAlignmentFile* multiAlignFile;
+		shared_ptr<HMMDecoder> decoder;	// for this alignment's columns, built from
+		shared_ptr<const HMMProbabilities> decoderParameters;	// this snapshot
+		string error;					// why it could not be loaded
+		bool loaded;					// set once parsed (or failed)
+		int users;						// requests holding it
+		long long lastUsed;				// useCount when last acquired
+	};
+
+	struct Request {
+		string command;
+		string fileName;
+		int rangeStart;					// coordinates [rangeStart, rangeEnd),
+		int rangeEnd;					// the whole alignment unless rangeEnd > rangeStart
+		string reply;
+		bool failed;
+		bool done;
+		chrono::steady_clock::time_point queued;
+	};
+
+	// Private Attributes
+	// =============================================
+	static const uint64_t maxRequestLength;
+	static const uint64_t maxReplyLength;
+
+	ParameterStore* parameterStore;
+	ParameterStore* ownedParameterStore;	// holds the model file's parameters (or NULL)
+	ColumnDictionary* modelColumns;		// columns of the model file (or NULL)
+	vector<string> species;
+	int numThreads;
+	int maxAlignments;
+	string address;
+	set<string> preloadedFileNames;		// files requests may name,
+	string dataDirectory;				// and any inside this (resolved, ending in /)
+
+	mutex alignmentsLock;
+	condition_variable alignmentLoaded;
+	map<string, Alignment*> alignments;
+	long long useCount;
+	long long numLoads;
+	long long numEvictions;
+	long long numDecodersBuilt;
+
+	mutex requestsLock;
+	condition_variable requestQueued;
+	condition_variable requestDone;
+	deque<Request*> requests;
+	bool stopping;
+	long long numRequests;
+	long long numFailed;
+	long long numBatches;
+	double totalSeconds;
+	double maxSeconds;
+
+	mutex connectionsLock;
+	condition_variable connectionClosed;
+	vector<SocketChannel*> connections;	// open connections
+
+	// Private Methods
+	// =============================================
+
+	// serveConnection(SocketChannel* channel)
+	//  Purpose:
+	//		Answers the requests of one connection until it closes, then
+	//		frees it
+	void serveConnection(SocketChannel* channel);
+
+	// runWorker()
+	//  Purpose:
+	//		Answers batches of queued requests until the server stops and
+	//		the queue is empty
+	void runWorker();
+
+	// bool parseRequest(const string& text, Request& request)
+	//  Purpose:
+	//		Sets the command, file name and range of a request from its
+	//		text, returning false if it is not a valid request
+	bool parseRequest(const string& text, Request& request);
+
+	// bool isServed(const string& fileName)
+	//  Purpose:
+	//		Returns true if requests may name the file (it was preloaded
+	//		or is inside the data directory)
+	bool isServed(const string& fileName);
+
+	// answer(Request& request, MultipleAlignmentFile* multiAlignFile, HMMDecoder* decoder,
+	//		DecoderWorkspace& workspace, vector<double>& statePosteriors)
+	//  Purpose:
+	//		Decodes the request's range of the alignment and sets the reply
+	void answer(Request& request, MultipleAlignmentFile* multiAlignFile, HMMDecoder* decoder,
+		DecoderWorkspace& workspace, vector<double>& statePosteriors);
+
+	// Alignment* acquireAlignment(string fileName, shared_ptr<HMMDecoder>& decoder)
+	//  Purpose:
+	//		Returns the loaded alignment for a file, parsing it if no other
+	//		request has, and marks it in use until released.  decoder is
+	//		set to (and pins) its decoder for the current parameters.
+	//		Throws if it cannot be loaded.
+	Alignment* acquireAlignment(string fileName, shared_ptr<HMMDecoder>& decoder);
+
+	// HMMDecoder* buildDecoder(const HMMProbabilities& snapshot, MultipleAlignmentFile* multiAlignFile)
+	//  Purpose:
+	//		Returns a decoder for the alignment's columns with the
+	//		parameters of snapshot (whose columns may differ)
+	HMMDecoder* buildDecoder(const HMMProbabilities& snapshot, MultipleAlignmentFile* multiAlignFile);
+
+	// releaseAlignment(Alignment* alignment)
+	//  Purpose:
+	//		Marks an acquired alignment no longer in use by the caller
+	void releaseAlignment(Alignment* alignment);
+
+	// evictAlignments()
+	//  Purpose:
+	//		Drops least recently used alignments not in use until at most
+	//		maxAlignments are kept.  alignmentsLock must be held.
+	void evictAlignments();
+
+	// freeAlignment(Alignment* alignment)
+	//  Purpose:
+	//		Deletes an alignment (its decoder goes with the last batch
+	//		using it)
+	void freeAlignment(Alignment* alignment);
+
+	// initialize(const vector<string>& someSpecies, int aNumThreads, int aMaxAlignments)
+	//  Purpose:
+	//		Sets the attributes common to both constructors
+	void initialize(const vector<string>& someSpecies, int aNumThreads, int aMaxAlignments);
+};
+
+#endif // DECODESERVER_H
@@ -0,0 +1,111 @@
+/*
+ * DecoderWorkspace.cpp
+ *
+ *	The DecoderWorkspace object holds the grow only decoding buffers.
+ *  Buffers grow to at least twice their old size so a run of slowly
+ *  growing regions does not reallocate for every region.
+ *
+ *  Created on: 10-18-26
+ */
+#include "DecoderWorkspace.h"
+#include "Instrumentation.h"
+
+// growBuffer(vector<T>& buffer, size_t size)
+//  Purpose:
+//		Grows buffer to hold at least size entries, returning true if it
+//		had to be reallocated
+template <class T>
+static bool growBuffer(vector<T>& buffer, size_t size) {
+	if (buffer.size() >= size)
+		return false;
+
+	buffer.resize(size > 2 * buffer.size() ? size : 2 * buffer.size());
+	Instrumentation::count(Instrumentation::bufferGrowthsCounter);
+	return true;
+}
+
+// Constuctors
+// ==============================================
+DecoderWorkspace::DecoderWorkspace() {
+	length = 0;
+	numHiddenStates = 0;
+	numGrowths = 0;
+}
+
+// Destructor
+// =============================================
+DecoderWorkspace::~DecoderWorkspace() {
+}
+
+// Public Methods
+// =============================================
+
+// reserve(int aLength, int aNumHiddenStates, bool forwardBackward)
+//  Purpose:
+//		Makes room for a region of aLength positions, growing the
+//		buffers that are too small.  The alpha and beta buffers are
+//		only grown if forwardBackward is set.
+void DecoderWorkspace::reserve(int aLength, int aNumHiddenStates, bool forwardBackward) {
+	length = aLength;
+	numHiddenStates = aNumHiddenStates;
+
+	size_t entries = (size_t) aLength * aNumHiddenStates;
+	if (growBuffer(scores, entries))
+		numGrowths++;
+	if (growBuffer(backpointers, entries))
+		numGrowths++;
+	if (growBuffer(statePath, aLength))
+		numGrowths++;
+	if (forwardBackward) {
+		if (growBuffer(alphas, entries))
+			numGrowths++;
+		if (growBuffer(betas, entries))
+			numGrowths++;
+	}
+}
+
+// reset()
+//  Purpose:
+//		Forgets the current region.  Nothing is freed or cleared.
+void DecoderWorkspace::reset() {
+	length = 0;
+}
+
+// Public Accessors
+// =============================================
+int DecoderWorkspace::getLength() {
+	return length;
+}
+
+int DecoderWorkspace::getNumHiddenStates() {
+	return numHiddenStates;
+}
+
+double* DecoderWorkspace::getScores() {
+	return scores.data();
+}
+
+unsigned char* DecoderWorkspace::getBackpointers() {
+	return backpointers.data();
+}
+
+long double* DecoderWorkspace::getAlphas() {
+	return alphas.data();
+}
+
+long double* DecoderWorkspace::getBetas() {
+	return betas.data();
+}
+
+unsigned char* DecoderWorkspace::getStatePath() {
+	return statePath.data();
+}
+
+int DecoderWorkspace::getNumGrowths() {
+	return numGrowths;
+}
+
+size_t DecoderWorkspace::getBytesReserved() {
+	return scores.size() * sizeof(double) + backpointers.size() + statePath.size()
+		+ (alphas.size() + betas.size()) * sizeof(long double);
+}
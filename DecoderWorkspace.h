@@ -0,0 +1,88 @@
+/*
+ * DecoderWorkspace.h
+ *
+ *	This is the header file for the DecoderWorkspace object.
+ *  DecoderWorkspace holds the per position buffers used by HMMDecoder:
+ *  viterbi scores and backpointers, forward (alpha) and backward (beta)
+ *  log probabilities and the decoded state path.
+ *
+ *	The buffers only ever grow.  reserve() makes room for a region and
+ *  reset() just forgets the length, so decoding many regions back to
+ *  back with one workspace stops allocating once the workspace has seen
+ *  the largest region.  A workspace is not shared between threads; each
+ *  worker keeps its own.
+ *
+ *	Buffers are indexed [position * numHiddenStates + state - 1] (the
+ *  start state 0 has no entries).  A backpointer is the state of the
+ *  previous position on the best path to the entry (0 for the first
+ *  position).
+ *
+ *	Typical use:
+ *		DecoderWorkspace workspace;
+ *		for (each region) {
+ *			decoder.viterbi(symbols, length, workspace);
+ *			... workspace.getStatePath() ...
+ *		}
+ *
+ *  Created on: 10-18-26
+ */
+
+#ifndef DECODERWORKSPACE_H
+#define DECODERWORKSPACE_H
+
+#include <vector>
+#include <cstddef>
+using namespace std;
+
+class DecoderWorkspace
+{
+public:
+	// Constuctors
+	// ==============================================
+	DecoderWorkspace();
+
+	// Destructor
+	// =============================================
+	~DecoderWorkspace();
+
+	// Public Methods
+	// =============================================
+
+	// reserve(int aLength, int aNumHiddenStates, bool forwardBackward)
+	//  Purpose:
+	//		Makes room for a region of aLength positions, growing the
+	//		buffers that are too small.  The alpha and beta buffers are
+	//		only grown if forwardBackward is set.
+	void reserve(int aLength, int aNumHiddenStates, bool forwardBackward);
+
+	// reset()
+	//  Purpose:
+	//		Forgets the current region.  Nothing is freed or cleared.
+	void reset();
+
+	// Public Accessors
+	// =============================================
+	int getLength();
+	int getNumHiddenStates();
+	double* getScores();
+	unsigned char* getBackpointers();
+	long double* getAlphas();
+	long double* getBetas();
+	unsigned char* getStatePath();
+	int getNumGrowths();			// times a buffer has been (re)allocated
+	size_t getBytesReserved();
+
+private:
+	// Private Attributes
+	// =============================================
+	vector<double> scores;
+	vector<unsigned char> backpointers;
+	vector<long double> alphas;
+	vector<long double> betas;
+	vector<unsigned char> statePath;
+	int length;
+	int numHiddenStates;
+	int numGrowths;
+};
+
+#endif // DECODERWORKSPACE_H
@@ -0,0 +1,184 @@
+/*
+ * EmissionCounter.cpp
+ *
+ *	The EmissionCounter object tallies alignment columns inside BED
+ *  annotations.  See EmissionCounter.h for how the work is split between
+ *  threads.
+ *
+ *  Created on: 10-18-26
+ */
+#include "EmissionCounter.h"
+#include "ColumnDictionary.h"
+#include "MappedFile.h"
+#include "OutputBuffer.h"
+#include <cstring>
+#include <cstdlib>
+#include <stdexcept>
+#include <thread>
+#include <algorithm>
+
+// Constuctors
+// ==============================================
+EmissionCounter::EmissionCounter(MultipleAlignmentFile* aMultiAlignFile, long long aPseudocount) {
+	multiAlignFile = aMultiAlignFile;
+	pseudocount = aPseudocount;
+}
+
+// Destructor
+// =============================================
+EmissionCounter::~EmissionCounter() {
+}
+
+// Public Class Methods
+// =============================================
+
+// bool isBedFile(string fileName)
+//  Purpose:
+//		Returns true if fileName names a BED file (ends in .bed)
+bool EmissionCounter::isBedFile(string fileName) {
+	return fileName.size() > 4 && fileName.compare(fileName.size() - 4, 4, ".bed") == 0;
+}
+
+// Public Methods
+// =============================================
+
+// long long countAnnotations(string bedFileName, vector<long long>& counts)
+//  Purpose:
+//		Replaces counts with the number of columns of each column id
+//		inside the annotated intervals, plus the pseudocount (so no
+//		column has a zero probability).  Returns the number of columns
+//		counted.
+long long EmissionCounter::countAnnotations(string bedFileName, vector<long long>& counts) {
+	vector<pair<int, int> > intervals;
+	readIntervals(bedFileName, intervals);
+
+	// One chunk of columns per thread (small alignments are not worth
+	// the thread start up)
+	const int minChunkLength = 1 << 16;
+	int numColumns = multiAlignFile->getSequenceLength();
+	int numChunks = thread::hardware_concurrency();
+	if (numChunks < 1)
+		numChunks = 1;
+	if (numChunks > numColumns / minChunkLength)
+		numChunks = max(1, numColumns / minChunkLength);
+
+	int numIds = multiAlignFile->getColumnDictionary()->size();
+	vector<vector<long long> > histograms(numChunks, vector<long long>(numIds, 0));
+	vector<thread> threads;
+	for (int chunk = 0; chunk < numChunks - 1; chunk++)
+		threads.push_back(thread(&EmissionCounter::countColumns, this,
+			(int) ((long long) numColumns * chunk / numChunks), (int) ((long long) numColumns * (chunk + 1) / numChunks),
+			&intervals, &histograms[chunk]));
+	countColumns((int) ((long long) numColumns * (numChunks - 1) / numChunks), numColumns,
+		&intervals, &histograms[numChunks - 1]);
+	for (thread& aThread : threads)
+		aThread.join();
+
+	// Sum the histograms
+	long long numCounted = 0;
+	counts.assign(numIds, pseudocount);
+	for (vector<long long>& histogram : histograms) {
+		for (int columnId = 0; columnId < numIds; columnId++) {
+			counts[columnId] += histogram[columnId];
+			numCounted += histogram[columnId];
+		}
+	}
+
+	return numCounted;
+}
+
+// writeCounts(const vector<long long>& counts, string fileName)
+//  Purpose:
+//		Writes the counts in the counts file format, one line per
+//		column in column id order
+void EmissionCounter::writeCounts(const vector<long long>& counts, string fileName) {
+	ColumnDictionary* columnDictionary = multiAlignFile->getColumnDictionary();
+	OutputBuffer out(fileName);
+	for (size_t columnId = 0; columnId < counts.size(); columnId++) {
+		out.append(columnDictionary->column(columnId));
+		out.append('\t');
+		out.appendInt(counts[columnId]);
+		out.append('\n');
+	}
+	out.flush();
+}
+
+// Private Methods
+// =============================================
+
+// readIntervals(string bedFileName, vector<pair<int, int> >& intervals)
+//  Purpose:
+//		Replaces intervals with the sorted, merged [first, end)
+//		coordinate ranges of the alignment chromosome's BED lines.
+//		Header (track, browser) and comment lines are skipped.
+void EmissionCounter::readIntervals(string bedFileName, vector<pair<int, int> >& intervals) {
+	MappedFile bedFile(bedFileName);
+	const char* text = bedFile.data();
+	const char* end = text + bedFile.size();
+	const string& chromosome = multiAlignFile->getChromosome();
+
+	intervals.clear();
+	const char* lineStart = text;
+	while (lineStart < end) {
+		const char* lineEnd = (const char*) memchr(lineStart, '\n', end - lineStart);
+		if (lineEnd == NULL)
+			lineEnd = end;
+
+		// chrom start end ...
+		const char* chromosomeEnd = lineStart;
+		while (chromosomeEnd < lineEnd && *chromosomeEnd != '\t' && *chromosomeEnd != ' ')
+			chromosomeEnd++;
+		bool header = chromosomeEnd == lineStart || lineStart[0] == '#'
+			|| (chromosomeEnd - lineStart == 5 && memcmp(lineStart, "track", 5) == 0)
+			|| (chromosomeEnd - lineStart == 7 && memcmp(lineStart, "browser", 7) == 0);
+		if (!header && (chromosome.empty() || ((size_t) (chromosomeEnd - lineStart) == chromosome.size()
+			&& memcmp(lineStart, chromosome.data(), chromosome.size()) == 0))) {
+			char* startEnd;
+			char* stopEnd;
+			long start = strtol(chromosomeEnd, &startEnd, 10);
+			long stop = strtol(startEnd, &stopEnd, 10);
+			if (startEnd == chromosomeEnd || stopEnd == startEnd || stopEnd > lineEnd)
+				throw runtime_error("Invalid BED line in " + bedFileName);
+			if (stop > start)
+				intervals.push_back(make_pair((int) start + 1, (int) stop + 1));
+		}
+
+		lineStart = lineEnd + 1;
+	}
+
+	// Sort and merge overlapping or touching intervals
+	sort(intervals.begin(), intervals.end());
+	size_t numMerged = 0;
+	for (size_t i = 0; i < intervals.size(); i++) {
+		if (numMerged > 0 && intervals[i].first <= intervals[numMerged - 1].second)
+			intervals[numMerged - 1].second = max(intervals[numMerged - 1].second, intervals[i].second);
+		else
+			intervals[numMerged++] = intervals[i];
+	}
+	intervals.resize(numMerged);
+}
+
+// countColumns(int begin, int end, const vector<pair<int, int> >* intervals,
+//		vector<long long>* histogram)
+//  Purpose:
+//		Tallies the column ids of the columns [begin, end) that are in
+//		the intervals into histogram.  Column coordinates increase, so
+//		one pass over the intervals covers the chunk.
+void EmissionCounter::countColumns(int begin, int end, const vector<pair<int, int> >* intervals,
+	vector<long long>* histogram) {
+	if (begin >= end)
+		return;
+
+	const int* columnIds = multiAlignFile->getColumnIds();
+	vector<pair<int, int> >::const_iterator interval = partition_point(intervals->begin(), intervals->end(),
+		[this, begin](const pair<int, int>& anInterval) {
+			return anInterval.second <= multiAlignFile->getCoordinate(begin); });
+
+	for (int column = begin; column < end && interval != intervals->end(); column++) {
+		int coordinate = multiAlignFile->getCoordinate(column);
+		while (interval != intervals->end() && interval->second <= coordinate)
+			++interval;
+		if (interval != intervals->end() && interval->first <= coordinate)
+			(*histogram)[columnIds[column]]++;
+	}
+}
@@ -0,0 +1,104 @@
+/*
+ * EmissionCounter.h
+ *
+ *	This is the header file for the EmissionCounter object.
+ *  EmissionCounter builds the emission count tables for the hidden
+ *  markov model straight from an alignment and BED annotations (e.g.
+ *  ancestral repeats for the neutral state and codon positions for the
+ *  conserved state): every alignment column inside an annotated interval
+ *  is tallied by its column id.
+ *
+ *	The intervals are sorted and merged, the columns are split into one
+ *  chunk per thread, and each thread tallies its chunk into its own
+ *  histogram, walking the intervals alongside the (increasing) column
+ *  coordinates.  The histograms are summed at the end, so the threads
+ *  never share a counter.
+ *
+ *	Counts can be written in the counts file format read by
+ *  HMMProbabilities (one "column<tab>count" line per column) or handed
+ *  to HMMProbabilities::initialProbabilities directly.
+ *
+ *	BED intervals use a 0-based start and an exclusive end, so the
+ *  interval (start, end) covers the 1-based coordinates start + 1 to end
+ *  (see BedFileWriter).  Intervals on other chromosomes than the
+ *  alignment's are ignored.
+ *
+ *	Typical use:
+ *		EmissionCounter counter(multiAlignFile);
+ *		vector<long long> counts;
+ *		counter.countAnnotations("ancestral_repeats.bed", counts);
+ *		counter.writeCounts(counts, "neutral_counts.txt");
+ *
+ *  Created on: 10-18-26
+ */
+
+#ifndef EMISSIONCOUNTER_H
+#define EMISSIONCOUNTER_H
+
+#include "MultipleAlignmentFile.h"
+#include <string>
+#include <vector>
+#include <utility>
+using namespace std;
+
+class EmissionCounter
+{
+public:
+	// Constuctors
+	// ==============================================
+	EmissionCounter(MultipleAlignmentFile* aMultiAlignFile, long long aPseudocount = 1);
+
+	// Destructor
+	// =============================================
+	~EmissionCounter();
+
+	// Public Class Methods
+	// =============================================
+
+	// bool isBedFile(string fileName)
+	//  Purpose:
+	//		Returns true if fileName names a BED file (ends in .bed)
+	static bool isBedFile(string fileName);
+
+	// Public Methods
+	// =============================================
+
+	// long long countAnnotations(string bedFileName, vector<long long>& counts)
+	//  Purpose:
+	//		Replaces counts with the number of columns of each column id
+	//		inside the annotated intervals, plus the pseudocount (so no
+	//		column has a zero probability).  Returns the number of columns
+	//		counted.
+	long long countAnnotations(string bedFileName, vector<long long>& counts);
+
+	// writeCounts(const vector<long long>& counts, string fileName)
+	//  Purpose:
+	//		Writes the counts in the counts file format, one line per
+	//		column in column id order
+	void writeCounts(const vector<long long>& counts, string fileName);
+
+private:
+	// Private Attributes
+	// =============================================
+	MultipleAlignmentFile* multiAlignFile;
+	long long pseudocount;		// added to every column's count
+
+	// Private Methods
+	// =============================================
+
+	// readIntervals(string bedFileName, vector<pair<int, int> >& intervals)
+	//  Purpose:
+	//		Replaces intervals with the sorted, merged [first, end)
+	//		coordinate ranges of the alignment chromosome's BED lines
+	void readIntervals(string bedFileName, vector<pair<int, int> >& intervals);
+
+	// countColumns(int begin, int end, const vector<pair<int, int> >* intervals,
+	//		vector<long long>* histogram)
+	//  Purpose:
+	//		Tallies the column ids of the columns [begin, end) that are in
+	//		the intervals into histogram
+	void countColumns(int begin, int end, const vector<pair<int, int> >* intervals,
+		vector<long long>* histogram);
+};
+
+#endif // EMISSIONCOUNTER_H
@@ -0,0 +1,232 @@
+/*
+ * GzipDecompressor.cpp
+ *
+ *	The GzipDecompressor object inflates gzip and BGZF data held in memory
+ *  (see GzipDecompressor.h).  Requires zlib (link with -lz).
+ *
+ *	BGZF block layout (all little endian):
+ *		1f 8b 08 04			- gzip magic, deflate, FEXTRA flag
+ *		MTIME XFL OS		- 6 bytes
+ *		XLEN				- 2 bytes, length of the extra field
+ *		extra field			- contains the subfield 'B' 'C' 02 00 BSIZE,
+ *							  where BSIZE + 1 is the total block size
+ *		deflate data
+ *		CRC32 ISIZE			- 4 bytes each, ISIZE is the uncompressed size
+ *
+ *  Created on: 10-18-26
+ */
+#include "GzipDecompressor.h"
+#include <zlib.h>
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+#include <algorithm>
+
+// Public Class Methods
+// =============================================
+
+// bool isGzip(const char* data, size_t length)
+//  Purpose: 
+//		Returns true if data starts with the gzip magic number
+bool GzipDecompressor::isGzip(const char* data, size_t length) {
+	return length >= 2 && (unsigned char) data[0] == 0x1f && (unsigned char) data[1] == 0x8b;
+}
+
+// bool isBgzf(const char* data, size_t length)
+//  Purpose: 
+//		Returns true if data starts with a BGZF block header
+bool GzipDecompressor::isBgzf(const char* data, size_t length) {
+	const unsigned char* bytes = (const unsigned char*) data;
+	return length >= 18 && isGzip(data, length) && bytes[2] == 8 && (bytes[3] & 4) != 0
+		&& bytes[12] == 'B' && bytes[13] == 'C';
+}
+
+// decompress(const char* data, size_t length, vector<char>& text)
+//  Purpose: 
+//		Replaces text with the inflated contents of the gzip or BGZF
+//		data.  Throws a runtime_error if the data is corrupt.
+//
+//		BGZF data is inflated in parallel: the blocks are split into one
+//		contiguous run per thread, and since every block knows its
+//		uncompressed size each run inflates straight into its final place
+//		in text.
+void GzipDecompressor::decompress(const char* data, size_t length, vector<char>& text) {
+	vector<BgzfBlock> blocks;
+	if (!isBgzf(data, length) || !findBgzfBlocks(data, length, blocks)) {
+		inflateStream(data, length, text);
+		return;
+	}
+
+	text.resize(blocks.empty() ? 0 : blocks.back().textOffset + blocks.back().textLength);
+
+	int numBlocks = blocks.size();
+	int numChunks = thread::hardware_concurrency();
+	if (numChunks < 1)
+		numChunks = 1;
+	numChunks = max(1, min(numChunks, numBlocks));
+
+	// One failure flag per chunk (vector<bool> is not addressable)
+	bool* failed = new bool[numChunks];
+	vector<thread> threads;
+	for (int chunk = 0; chunk < numChunks; chunk++) {
+		failed[chunk] = false;
+		int first = (int) ((long long) numBlocks * chunk / numChunks);
+		int last = (int) ((long long) numBlocks * (chunk + 1) / numChunks);
+		if (chunk < numChunks - 1)
+			threads.push_back(thread(&GzipDecompressor::inflateBgzfBlocks, data, blocks.data() + first,
+				last - first, text.data(), failed + chunk));
+		else
+			inflateBgzfBlocks(data, blocks.data() + first, last - first, text.data(), failed + chunk);
+	}
+	for (thread& aThread : threads)
+		aThread.join();
+
+	bool anyFailed = false;
+	for (int chunk = 0; chunk < numChunks; chunk++)
+		anyFailed = anyFailed || failed[chunk];
+	delete [] failed;
+
+	if (anyFailed)
+		throw runtime_error("Corrupt BGZF block");
+}
+
+// Private Methods
+// =============================================
+
+// bool findBgzfBlocks(const char* data, size_t length, vector<BgzfBlock>& blocks)
+//  Purpose: 
+//		Walks the BGZF block headers and fills in blocks.  Returns false
+//		if the data is not entirely BGZF blocks.
+bool GzipDecompressor::findBgzfBlocks(const char* data, size_t length, vector<BgzfBlock>& blocks) {
+	const unsigned char* bytes = (const unsigned char*) data;
+	size_t offset = 0;
+	size_t textOffset = 0;
+	while (offset < length) {
+		const unsigned char* block = bytes + offset;
+		if (length - offset < 18 || block[0] != 0x1f || block[1] != 0x8b || block[2] != 8 || (block[3] & 4) == 0)
+			return false;
+
+		// Find the BC subfield in the extra field
+		size_t extraLength = block[10] | (block[11] << 8);
+		if (length - offset < 12 + extraLength)
+			return false;
+		size_t blockSize = 0;
+		for (size_t field = 12; field + 4 <= 12 + extraLength; ) {
+			size_t fieldLength = block[field + 2] | (block[field + 3] << 8);
+			if (block[field] == 'B' && block[field + 1] == 'C' && fieldLength == 2 && field + 6 <= 12 + extraLength) {
+				blockSize = (block[field + 4] | (block[field + 5] << 8)) + 1;
+				break;
+			}
+			field += 4 + fieldLength;
+		}
+		if (blockSize < 12 + extraLength + 8 || blockSize > length - offset)
+			return false;
+
+		const unsigned char* trailer = block + blockSize - 4;
+		BgzfBlock aBlock;
+		aBlock.compressedOffset = offset + 12 + extraLength;
+		aBlock.compressedLength = blockSize - 12 - extraLength - 8;
+		aBlock.textOffset = textOffset;
+		aBlock.textLength = (size_t) trailer[0] | ((size_t) trailer[1] << 8)
+			| ((size_t) trailer[2] << 16) | ((size_t) trailer[3] << 24);
+		aBlock.crc = (unsigned long) block[blockSize - 8] | ((unsigned long) block[blockSize - 7] << 8)
+			| ((unsigned long) block[blockSize - 6] << 16) | ((unsigned long) block[blockSize - 5] << 24);
+		blocks.push_back(aBlock);
+
+		textOffset += aBlock.textLength;
+		offset += blockSize;
+	}
+
+	return true;
+}
+
+// inflateBgzfBlocks(const char* data, const BgzfBlock* blocks, int numBlocks,
+//		char* text, bool* failed)
+//  Purpose: 
+//		Inflates each block into its slice of text, setting failed if a
+//		block does not inflate to its recorded size or its CRC32 does
+//		not match.  Empty blocks (such as the EOF marker) are skipped.
+void GzipDecompressor::inflateBgzfBlocks(const char* data, const BgzfBlock* blocks, int numBlocks,
+	char* text, bool* failed) {
+
+	z_stream stream;
+	memset(&stream, 0, sizeof(stream));
+	if (inflateInit2(&stream, -MAX_WBITS) != Z_OK) {
+		*failed = true;
+		return;
+	}
+
+	for (int i = 0; i < numBlocks && !*failed; i++) {
+		const BgzfBlock& block = blocks[i];
+		if (block.textLength == 0) {
+			// Nothing to inflate (and text may have no storage at all)
+			if (block.crc != 0)
+				*failed = true;
+			continue;
+		}
+
+		inflateReset(&stream);
+		stream.next_in = (Bytef*) (data + block.compressedOffset);
+		stream.avail_in = block.compressedLength;
+		stream.next_out = (Bytef*) (text + block.textOffset);
+		stream.avail_out = block.textLength;
+		int status = inflate(&stream, Z_FINISH);
+		if (status != Z_STREAM_END || stream.avail_out != 0
+				|| crc32(0, (const Bytef*) (text + block.textOffset), block.textLength) != block.crc)
+			*failed = true;
+	}
+
+	inflateEnd(&stream);
+}
+
+// inflateStream(const char* data, size_t length, vector<char>& text)
+//  Purpose: 
+//		Inflates gzip data (one or more members) on a single thread
+void GzipDecompressor::inflateStream(const char* data, size_t length, vector<char>& text) {
+	z_stream stream;
+	memset(&stream, 0, sizeof(stream));
+	if (inflateInit2(&stream, MAX_WBITS + 16) != Z_OK)
+		throw runtime_error("Unable to initialize zlib");
+
+	// Guess a 4:1 compression ratio and grow as needed
+	text.resize(max((size_t) 1 << 16, length * 4));
+	size_t used = 0;
+	stream.next_in = (Bytef*) data;
+	stream.avail_in = 0;
+	size_t remaining = length;
+
+	int status = Z_OK;
+	while (true) {
+		// avail_in is only 32 bits, so feed very large inputs in pieces
+		if (stream.avail_in == 0 && remaining > 0) {
+			stream.avail_in = (uInt) min(remaining, (size_t) 1 << 30);
+			remaining -= stream.avail_in;
+		}
+		if (used == text.size())
+			text.resize(text.size() * 2);
+		stream.next_out = (Bytef*) (text.data() + used);
+		stream.avail_out = (uInt) min(text.size() - used, (size_t) 1 << 30);
+		size_t availOut = stream.avail_out;
+
+		status = inflate(&stream, Z_NO_FLUSH);
+		used += availOut - stream.avail_out;
+
+		if (status == Z_STREAM_END) {
+			// Concatenated gzip members continue after the end of a stream
+			if (stream.avail_in == 0 && remaining == 0)
+				break;
+			inflateReset(&stream);
+		}
+		else if (status == Z_BUF_ERROR && stream.avail_in == 0 && remaining == 0) {
+			inflateEnd(&stream);
+			throw runtime_error("Truncated gzip data");
+		}
+		else if (status != Z_OK && status != Z_BUF_ERROR) {
+			inflateEnd(&stream);
+			throw runtime_error("Corrupt gzip data");
+		}
+	}
+
+	inflateEnd(&stream);
+	text.resize(used);
+}
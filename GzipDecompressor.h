@@ -0,0 +1,91 @@
+/*
+ * GzipDecompressor.h
+ *
+ *	This is the header file for the GzipDecompressor object.
+ *  GzipDecompressor inflates gzip compressed data held in memory (for
+ *  example a memory mapped alignment file) using zlib.
+ *
+ *	BGZF files (the blocked gzip format used by samtools/tabix) are a
+ *  series of small independent gzip members whose header records the
+ *  compressed block size and whose trailer records the uncompressed
+ *  size.  Their blocks are located with a quick walk over the headers,
+ *  given pre-sized slices of the output, and inflated in parallel, each
+ *  checked against the CRC32 in its trailer.  Any other gzip data
+ *  (including several concatenated members) falls back to inflating it
+ *  as a single stream.
+ *
+ *	Typical use:
+ *		if (GzipDecompressor::isGzip(data, length)) {
+ *			vector<char> text;
+ *			GzipDecompressor::decompress(data, length, text);
+ *		}
+ *
+ *  Created on: 10-18-26
+ */
+
+#ifndef GZIPDECOMPRESSOR_H
+#define GZIPDECOMPRESSOR_H
+
+#include <string>
+#include <vector>
+using namespace std;
+
+class GzipDecompressor
+{
+public:
+	// Public Class Methods
+	// =============================================
+
+	// bool isGzip(const char* data, size_t length)
+	//  Purpose: 
+	//		Returns true if data starts with the gzip magic number
+	static bool isGzip(const char* data, size_t length);
+
+	// bool isBgzf(const char* data, size_t length)
+	//  Purpose: 
+	//		Returns true if data starts with a BGZF block header
+	static bool isBgzf(const char* data, size_t length);
+
+	// decompress(const char* data, size_t length, vector<char>& text)
+	//  Purpose: 
+	//		Replaces text with the inflated contents of the gzip or BGZF
+	//		data.  Throws a runtime_error if the data is corrupt.
+	static void decompress(const char* data, size_t length, vector<char>& text);
+
+private:
+
+	// Private Types
+	// =============================================
+	struct BgzfBlock {
+		size_t compressedOffset;	// start of the deflate data
+		size_t compressedLength;	// length of the deflate data
+		size_t textOffset;			// start of the block in the output
+		size_t textLength;			// uncompressed length (ISIZE)
+		unsigned long crc;			// CRC32 of the uncompressed data
+	};
+
+	// Private Methods
+	// =============================================
+
+	// bool findBgzfBlocks(const char* data, size_t length, vector<BgzfBlock>& blocks)
+	//  Purpose: 
+	//		Walks the BGZF block headers and fills in blocks.  Returns false
+	//		if the data is not entirely BGZF blocks.
+	static bool findBgzfBlocks(const char* data, size_t length, vector<BgzfBlock>& blocks);
+
+	// inflateBgzfBlocks(const char* data, const BgzfBlock* blocks, int numBlocks,
+	//		char* text, bool* failed)
+	//  Purpose: 
+	//		Inflates each block into its slice of text, setting failed if a
+	//		block does not inflate to its recorded size or its CRC32 does
+	//		not match.  Empty blocks (such as the EOF marker) are skipped.
+	static void inflateBgzfBlocks(const char* data, const BgzfBlock* blocks, int numBlocks,
+		char* text, bool* failed);
+
+	// inflateStream(const char* data, size_t length, vector<char>& text)
+	//  Purpose: 
+	//		Inflates gzip data (one or more members) on a single thread
+	static void inflateStream(const char* data, size_t length, vector<char>& text);
+};
+
+#endif // GZIPDECOMPRESSOR_H
@@ -0,0 +1,375 @@
+/*
+ * HMMDecoder.cpp
+ *
+ *	The HMMDecoder object decodes regions with dense arrays.  See
+ *  HMMDecoder.h for how it relates to the model graph.  Scores are kept
+ *  as doubles and each step is computed in long double, exactly as the
+ *  graph nodes do, so the two agree bit for bit.
+ *
+ *  Created on: 10-18-26
+ */
+#include "HMMDecoder.h"
+#include "MathUtilities.h"
+#include "Instrumentation.h"
+#include <cfloat>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+// Constuctors
+// ==============================================
+HMMDecoder::HMMDecoder(const HMMProbabilities* someProbabilities) {
+	numStates = someProbabilities->getNumStates();
+	numHiddenStates = numStates - 1;
+	numColumns = someProbabilities->getNumColumns();
+
+	logInitiation.resize(numStates);
+	logTransition.resize(numStates * numStates);
+	logEmission.resize((size_t) numColumns * numHiddenStates);
+	for (int state = 0; state < numStates; state++) {
+		logInitiation[state] = someProbabilities->logInitiationProbability(state);
+		for (int toState = 0; toState < numStates; toState++)
+			logTransition[state * numStates + toState] = someProbabilities->logTransitionProbability(state, toState);
+	}
+	for (int columnId = 0; columnId < numColumns; columnId++) {
+		for (int state = 1; state < numStates; state++)
+			logEmission[(size_t) columnId * numHiddenStates + state - 1] =
+				someProbabilities->logEmissionProbability(state, columnId);
+	}
+}
+
+// Destructor
+// =============================================
+HMMDecoder::~HMMDecoder() {
+}
+
+// Public Methods
+// =============================================
+
+// double viterbi(const int* symbols, int length, DecoderWorkspace& workspace)
+//  Purpose:
+//		Finds the viterbi path through the length column ids in
+//		symbols and returns its weight.  The scores, backpointers and
+//		state path of the workspace are set.
+double HMMDecoder::viterbi(const int* symbols, int length, DecoderWorkspace& workspace) {
+	viterbiScores(symbols, length, 0, workspace);
+	if (length == 0)
+		return 0;
+
+	// Walk back from the highest scoring state of the last position
+	const double* lastScores = workspace.getScores() + (size_t) (length - 1) * numHiddenStates;
+	int state = bestState(lastScores);
+	traceback(workspace, state, workspace.getStatePath());
+
+	return lastScores[state - 1];
+}
+
+// viterbiScores(const int* symbols, int length, int entryState, DecoderWorkspace& workspace)
+//  Purpose:
+//		Calculates the viterbi scores and backpointers of the length
+//		column ids in symbols, entering the first position from
+//		entryState with a weight of zero (entryState 0 is the start
+//		state and uses the initiation probabilities).  Decoding a
+//		region in chunks runs this once per entry state for each chunk
+//		after the first (see RegionScanner).  Throws a runtime_error if
+//		no state can emit one of the columns.
+void HMMDecoder::viterbiScores(const int* symbols, int length, int entryState, DecoderWorkspace& workspace) {
+	workspace.reserve(length, numHiddenStates, false);
+	if (length == 0)
+		return;
+	Instrumentation::Timer timer(Instrumentation::viterbiPhase);
+	timer.addColumns(length);
+	Instrumentation::count(Instrumentation::columnsCounter, length);
+
+	double* scores = workspace.getScores();
+	unsigned char* backpointers = workspace.getBackpointers();
+
+	// First position, entered from the entry state (weight 0)
+	const long double* emissions = columnEmissions(symbols[0]);
+	bool reachable = false;
+	for (int state = 1; state < numStates; state++) {
+		long double logEntry = (entryState == 0) ? logInitiation[state]
+			: logTransition[entryState * numStates + state];
+		double highestWeight = -DBL_MAX;
+		long double score = MathUtilities::elnprod(0.0,
+			MathUtilities::elnprod(logEntry, emissions[state - 1]));
+		if (!MathUtilities::isNaN(score) && score > highestWeight) {
+			highestWeight = score;
+			reachable = true;
+		}
+		scores[state - 1] = highestWeight;
+		backpointers[state - 1] = entryState;
+	}
+	if (!reachable)
+		throw runtime_error(unreachableColumnError(symbols[0]));
+
+	// Every other position takes the best incoming transition
+	for (int position = 1; position < length; position++) {
+		emissions = columnEmissions(symbols[position]);
+		const double* previousScores = scores + (size_t) (position - 1) * numHiddenStates;
+		double* positionScores = scores + (size_t) position * numHiddenStates;
+		unsigned char* positionBackpointers = backpointers + (size_t) position * numHiddenStates;
+
+		reachable = false;
+		for (int state = 1; state < numStates; state++) {
+			double highestWeight = -DBL_MAX;
+			unsigned char previousState = 0;
+			for (int fromState = 1; fromState < numStates; fromState++) {
+				long double score = MathUtilities::elnprod(previousScores[fromState - 1],
+					MathUtilities::elnprod(logTransition[fromState * numStates + state], emissions[state - 1]));
+				if (!MathUtilities::isNaN(score) && score > highestWeight) {
+					highestWeight = score;
+					previousState = fromState;
+				}
+			}
+			positionScores[state - 1] = highestWeight;
+			positionBackpointers[state - 1] = previousState;
+			if (previousState != 0)
+				reachable = true;
+		}
+		if (!reachable)
+			throw runtime_error(unreachableColumnError(symbols[position]));
+	}
+}
+
+// traceback(DecoderWorkspace& workspace, int endState, unsigned char* statePath)
+//  Purpose:
+//		Writes the states of the best path ending in endState at the
+//		last position to statePath, following the backpointers set by
+//		viterbiScores.  Throws a runtime_error if the path reaches the
+//		start state before the first position.
+void HMMDecoder::traceback(DecoderWorkspace& workspace, int endState, unsigned char* statePath) {
+	Instrumentation::Timer timer(Instrumentation::tracebackPhase);
+	timer.addColumns(workspace.getLength());
+	const unsigned char* backpointers = workspace.getBackpointers();
+	int state = endState;
+	for (int position = workspace.getLength() - 1; position >= 0; position--) {
+		if (state == 0)
+			throw runtime_error("Viterbi path has no state at position " + to_string(position));
+		statePath[position] = state;
+		state = backpointers[(size_t) position * numHiddenStates + state - 1];
+	}
+}
+
+// int bestState(const double* scores)
+//  Purpose:
+//		Returns the hidden state with the highest of the scores (one per
+//		hidden state), the lowest state winning ties
+int HMMDecoder::bestState(const double* scores) {
+	int state = 1;
+	for (int aState = 2; aState < numStates; aState++) {
+		if (scores[aState - 1] > scores[state - 1])
+			state = aState;
+	}
+	return state;
+}
+
+// double forwardBackward(const int* symbols, int length, DecoderWorkspace& workspace)
+//  Purpose:
+//		Calculates the log forward and backward probabilities of every
+//		state at every position into the workspace alphas and betas and
+//		returns the log likelihood of the region (log 2, as
+//		HMMPosition::logLikelihood).  Throws a runtime_error if no state
+//		can emit a column (as viterbi does).
+double HMMDecoder::forwardBackward(const int* symbols, int length, DecoderWorkspace& workspace) {
+	workspace.reserve(length, numHiddenStates, true);
+	if (length == 0)
+		return 0;
+	Instrumentation::Timer timer(Instrumentation::expectationPhase);
+	timer.addColumns(length);
+	Instrumentation::count(Instrumentation::columnsCounter, length);
+
+	long double* alphas = workspace.getAlphas();
+	long double* betas = workspace.getBetas();
+
+	// Forward (a position where every state has log probability NaN,
+	// i.e. zero, cannot be reached)
+	const long double* emissions = columnEmissions(symbols[0]);
+	bool reachable = false;
+	for (int state = 1; state < numStates; state++) {
+		alphas[state - 1] = MathUtilities::elnprod(logInitiation[state], emissions[state - 1]);
+		if (!MathUtilities::isNaN(alphas[state - 1]))
+			reachable = true;
+	}
+	if (!reachable)
+		throw runtime_error(unreachableColumnError(symbols[0]));
+
+	for (int position = 1; position < length; position++) {
+		emissions = columnEmissions(symbols[position]);
+		const long double* previousAlphas = alphas + (size_t) (position - 1) * numHiddenStates;
+		long double* positionAlphas = alphas + (size_t) position * numHiddenStates;
+
+		reachable = false;
+		for (int state = 1; state < numStates; state++) {
+			long double logAlpha = std::numeric_limits<double>::quiet_NaN();
+			for (int fromState = 1; fromState < numStates; fromState++)
+				logAlpha = MathUtilities::elnsum(logAlpha,
+					MathUtilities::elnprod(previousAlphas[fromState - 1], logTransition[fromState * numStates + state]));
+			positionAlphas[state - 1] = MathUtilities::elnprod(logAlpha, emissions[state - 1]);
+			if (!MathUtilities::isNaN(positionAlphas[state - 1]))
+				reachable = true;
+		}
+		if (!reachable)
+			throw runtime_error(unreachableColumnError(symbols[position]));
+	}
+
+	// Backward
+	long double* lastBetas = betas + (size_t) (length - 1) * numHiddenStates;
+	for (int state = 1; state < numStates; state++)
+		lastBetas[state - 1] = 0.0;
+
+	for (int position = length - 2; position >= 0; position--) {
+		emissions = columnEmissions(symbols[position + 1]);
+		const long double* nextBetas = betas + (size_t) (position + 1) * numHiddenStates;
+		long double* positionBetas = betas + (size_t) position * numHiddenStates;
+
+		for (int state = 1; state < numStates; state++) {
+			long double logBeta = std::numeric_limits<double>::quiet_NaN();
+			for (int toState = 1; toState < numStates; toState++)
+				logBeta = MathUtilities::elnsum(logBeta,
+					MathUtilities::elnprod(logTransition[state * numStates + toState],
+						MathUtilities::elnprod(emissions[toState - 1], nextBetas[toState - 1])));
+			positionBetas[state - 1] = logBeta;
+		}
+	}
+
+	// Likelihood from the last position's forward probabilities
+	double logLikelihood = std::numeric_limits<double>::quiet_NaN();
+	const long double* lastAlphas = alphas + (size_t) (length - 1) * numHiddenStates;
+	for (int state = 1; state < numStates; state++)
+		logLikelihood = MathUtilities::elnsum(logLikelihood, lastAlphas[state - 1]);
+
+	return logLikelihood / log(2);
+}
+
+// double posteriors(const int* symbols, int length, DecoderWorkspace& workspace,
+//		vector<double>& statePosteriors)
+//  Purpose:
+//		Runs forwardBackward and sets statePosteriors[position *
+//		numHiddenStates + state - 1] to the probability of each hidden
+//		state at each position given the whole region.  Returns the
+//		log likelihood of the region.
+double HMMDecoder::posteriors(const int* symbols, int length, DecoderWorkspace& workspace,
+	vector<double>& statePosteriors) {
+	double logLikelihood = forwardBackward(symbols, length, workspace);
+	statePosteriors.resize((size_t) length * numHiddenStates);
+
+	const long double* alphas = workspace.getAlphas();
+	const long double* betas = workspace.getBetas();
+	vector<long double> gammas(numHiddenStates);
+	for (size_t index = 0; index < statePosteriors.size(); index += numHiddenStates) {
+		// Normalized per position, as the gammas of accumulateExpectedCounts
+		long double normalizer = std::numeric_limits<double>::quiet_NaN();
+		for (int state = 0; state < numHiddenStates; state++) {
+			gammas[state] = MathUtilities::elnprod(alphas[index + state], betas[index + state]);
+			normalizer = MathUtilities::elnsum(normalizer, gammas[state]);
+		}
+		for (int state = 0; state < numHiddenStates; state++)
+			statePosteriors[index + state] = MathUtilities::eexp(MathUtilities::elnprod(gammas[state], -normalizer));
+	}
+
+	return logLikelihood;
+}
+
+// double accumulateExpectedCounts(const int* symbols, int length, DecoderWorkspace& workspace,
+//		BaumWelchStatistics& statistics)
+//  Purpose:
+//		Runs forwardBackward and adds the region's expected state and
+//		transition counts and likelihood to statistics.  Returns the
+//		log likelihood of the region.
+//
+//		The conditional probabilities are normalized per position, as
+//		HMMPosition::calculateNodeLogConditionalProbabilities and
+//		calculateTransitionLogConditionalProbabilities do, and summed in
+//		the same order.
+double HMMDecoder::accumulateExpectedCounts(const int* symbols, int length, DecoderWorkspace& workspace,
+	BaumWelchStatistics& statistics) {
+	double logLikelihood = forwardBackward(symbols, length, workspace);
+	if (length == 0)
+		return logLikelihood;
+	Instrumentation::Timer timer(Instrumentation::statisticsPhase);
+	timer.addColumns(length);
+
+	const long double* alphas = workspace.getAlphas();
+	const long double* betas = workspace.getBetas();
+	vector<long double> gammas(numHiddenStates);
+	vector<long double> xis(numHiddenStates * numHiddenStates);
+
+	for (int position = 0; position < length; position++) {
+		const long double* positionAlphas = alphas + (size_t) position * numHiddenStates;
+		const long double* positionBetas = betas + (size_t) position * numHiddenStates;
+
+		// State probabilities (gamma)
+		long double normalizer = std::numeric_limits<double>::quiet_NaN();
+		for (int state = 1; state < numStates; state++) {
+			gammas[state - 1] = MathUtilities::elnprod(positionAlphas[state - 1], positionBetas[state - 1]);
+			normalizer = MathUtilities::elnsum(normalizer, gammas[state - 1]);
+		}
+		for (int state = 1; state < numStates; state++) {
+			gammas[state - 1] = MathUtilities::elnprod(gammas[state - 1], -normalizer);
+			if (position == 0)
+				statistics.logInitiationCounts[state] =
+					MathUtilities::elnsum(statistics.logInitiationCounts[state], gammas[state - 1]);
+		}
+
+		// Transition probabilities (xi) to the next position
+		if (position == length - 1)
+			break;
+		const long double* emissions = columnEmissions(symbols[position + 1]);
+		const long double* nextBetas = positionBetas + numHiddenStates;
+		normalizer = std::numeric_limits<double>::quiet_NaN();
+		for (int fromState = 1; fromState < numStates; fromState++) {
+			for (int toState = 1; toState < numStates; toState++) {
+				long double xi = MathUtilities::elnprod(positionAlphas[fromState - 1],
+					MathUtilities::elnprod(logTransition[fromState * numStates + toState],
+						MathUtilities::elnprod(emissions[toState - 1], nextBetas[toState - 1])));
+				xis[(fromState - 1) * numHiddenStates + toState - 1] = xi;
+				normalizer = MathUtilities::elnsum(normalizer, xi);
+			}
+		}
+		for (int fromState = 1; fromState < numStates; fromState++) {
+			for (int toState = 1; toState < numStates; toState++) {
+				long double& count = statistics.logTransitionCounts[fromState * numStates + toState];
+				count = MathUtilities::elnsum(count,
+					MathUtilities::elnprod(xis[(fromState - 1) * numHiddenStates + toState - 1], -normalizer));
+			}
+			statistics.logStateCounts[fromState] =
+				MathUtilities::elnsum(statistics.logStateCounts[fromState], gammas[fromState - 1]);
+		}
+	}
+
+	statistics.numRegions++;
+	statistics.logLikelihood += logLikelihood;
+	return logLikelihood;
+}
+
+// Public Accessors
+// =============================================
+int HMMDecoder::getNumStates() {
+	return numStates;
+}
+
+int HMMDecoder::getNumColumns() {
+	return numColumns;
+}
+
+// Private Methods
+// =============================================
+
+// const long double* columnEmissions(int symbol)
+//  Purpose:
+//		Returns the log emission probabilities of the hidden states for
+//		a column id, throwing if the id is not in the probabilities
+const long double* HMMDecoder::columnEmissions(int symbol) {
+	if (symbol < 0 || symbol >= numColumns)
+		throw runtime_error("Column id outside the decoder's probabilities");
+	return logEmission.data() + (size_t) symbol * numHiddenStates;
+}
+
+// string unreachableColumnError(int symbol)
+//  Purpose:
+//		Returns the error for a column id no state can emit
+string HMMDecoder::unreachableColumnError(int symbol) {
+	return "No state can emit alignment column id " + to_string(symbol)
+		+ " (it has no emission probability in the model)";
+}
@@ -0,0 +1,150 @@
+/*
+ * HMMDecoder.h
+ *
+ *	This is the header file for the HMMDecoder object.  HMMDecoder runs
+ *  the viterbi and forward-backward algorithms over the column ids of a
+ *  region with dense arrays instead of building the HMMPosition/HMMNode
+ *  graph, keeping every per position value in a DecoderWorkspace.
+ *
+ *	The decoder copies the log probabilities it needs when it is made
+ *  (emissions are stored by column id with the states of a column next
+ *  to each other) and is read only afterwards, so one decoder can be
+ *  shared by any number of threads, each with its own workspace.
+ *
+ *	The arithmetic is the same as the graph's, step for step
+ *  (HiddenMarkovModel::calculateHighestWeightPath and
+ *  HMMPosition::calculateLogForwardProbability), so a path decoded here
+ *  is identical to one decoded from the graph, ties included.
+ *
+ *	posteriors gives the probability of each state at each position
+ *  (the normalized product of the forward and backward probabilities).
+ *
+ *	viterbiScores and traceback expose the two halves of viterbi so a long
+ *  region can be decoded in chunks: each chunk is scored from every
+ *  possible entry state in parallel and the chunks are joined afterwards
+ *  with max-plus products of their exit scores.
+ *
+ *	Typical use:
+ *		HMMDecoder decoder(probabilities);
+ *		DecoderWorkspace workspace;
+ *		decoder.viterbi(columnIds, length, workspace);
+ *		unsigned char* path = workspace.getStatePath();
+ *
+ *  Created on: 10-18-26
+ */
+
+#ifndef HMMDECODER_H
+#define HMMDECODER_H
+
+#include "HMMProbabilities.h"
+#include "DecoderWorkspace.h"
+#include "BaumWelchStatistics.h"
+#include <string>
+#include <vector>
+using namespace std;
+
+class HMMDecoder
+{
+public:
+	// Constuctors
+	// ==============================================
+	HMMDecoder(const HMMProbabilities* someProbabilities);
+
+	// Destructor
+	// =============================================
+	~HMMDecoder();
+
+	// Public Methods
+	// =============================================
+
+	// double viterbi(const int* symbols, int length, DecoderWorkspace& workspace)
+	//  Purpose:
+	//		Finds the viterbi path through the length column ids in
+	//		symbols and returns its weight.  The scores, backpointers and
+	//		state path of the workspace are set.
+	double viterbi(const int* symbols, int length, DecoderWorkspace& workspace);
+
+	// viterbiScores(const int* symbols, int length, int entryState, DecoderWorkspace& workspace)
+	//  Purpose:
+	//		Calculates the viterbi scores and backpointers of the length
+	//		column ids in symbols, entering the first position from
+	//		entryState with a weight of zero (entryState 0 is the start
+	//		state and uses the initiation probabilities).  Decoding a
+	//		region in chunks runs this once per entry state for each chunk
+	//		after the first (see RegionScanner).  Throws a runtime_error if
+	//		no state can emit one of the columns.
+	void viterbiScores(const int* symbols, int length, int entryState, DecoderWorkspace& workspace);
+
+	// traceback(DecoderWorkspace& workspace, int endState, unsigned char* statePath)
+	//  Purpose:
+	//		Writes the states of the best path ending in endState at the
+	//		last position to statePath, following the backpointers set by
+	//		viterbiScores.  Throws a runtime_error if the path reaches the
+	//		start state before the first position.
+	void traceback(DecoderWorkspace& workspace, int endState, unsigned char* statePath);
+
+	// int bestState(const double* scores)
+	//  Purpose:
+	//		Returns the hidden state with the highest of the scores (one per
+	//		hidden state), the lowest state winning ties
+	int bestState(const double* scores);
+
+	// double forwardBackward(const int* symbols, int length, DecoderWorkspace& workspace)
+	//  Purpose:
+	//		Calculates the log forward and backward probabilities of every
+	//		state at every position into the workspace alphas and betas and
+	//		returns the log likelihood of the region (log 2, as
+	//		HMMPosition::logLikelihood).  Throws a runtime_error if no state
+	//		can emit a column (as viterbi does).
+	double forwardBackward(const int* symbols, int length, DecoderWorkspace& workspace);
+
+	// double posteriors(const int* symbols, int length, DecoderWorkspace& workspace,
+	//		vector<double>& statePosteriors)
+	//  Purpose:
+	//		Runs forwardBackward and sets statePosteriors[position *
+	//		numHiddenStates + state - 1] to the probability of each hidden
+	//		state at each position given the whole region.  Returns the
+	//		log likelihood of the region.
+	double posteriors(const int* symbols, int length, DecoderWorkspace& workspace,
+		vector<double>& statePosteriors);
+
+	// double accumulateExpectedCounts(const int* symbols, int length, DecoderWorkspace& workspace,
+	//		BaumWelchStatistics& statistics)
+	//  Purpose:
+	//		Runs forwardBackward and adds the region's expected state and
+	//		transition counts and likelihood to statistics.  Returns the
+	//		log likelihood of the region.
+	double accumulateExpectedCounts(const int* symbols, int length, DecoderWorkspace& workspace,
+		BaumWelchStatistics& statistics);
+
+	// Public Accessors
+	// =============================================
+	int getNumStates();
+	int getNumColumns();
+
+private:
+	// Private Attributes
+	// =============================================
+	int numStates;
+	int numHiddenStates;			// states other than the start state
+	int numColumns;
+	vector<long double> logInitiation;		// [state]
+	vector<long double> logTransition;		// [from state * numStates + to state]
+	vector<long double> logEmission;		// [column id * numHiddenStates + state - 1]
+
+	// Private Methods
+	// =============================================
+
+	// const long double* columnEmissions(int symbol)
+	//  Purpose:
+	//		Returns the log emission probabilities of the hidden states for
+	//		a column id, throwing if the id is not in the probabilities
+	const long double* columnEmissions(int symbol);
+
+	// string unreachableColumnError(int symbol)
+	//  Purpose:
+	//		Returns the error for a column id no state can emit
+	string unreachableColumnError(int symbol);
+};
+
+#endif // HMMDECODER_H
@@ -8,11 +8,13 @@
  *  Important Attributes:
  *		id - position in the HMM
  *		state - the underlying state this node represents in the HMM
- *		residue - the residue in this position in the sequence used to build the HMM
+ *		symbol - column id (see ColumnDictionary) of the alignment column at this
+ *				 position in the sequence used to build the HMM
  *		inTransitions - HMMTransitions that are coming into this node from the previous
  *						position in the HMM
  *		outTransitions - HMMTransitions that are leaving this node to the next position
  *						 in the HMM
+ *						 (both are ArenaArrays, the nodes live in the model's ModelArena)
  *		highestWeight - the highest weight determined by the viterbi path
  *		higheestWeightPreviousNode - the previous node in the HMM that gave the highest
  *									 weight viterbi path
@@ -23,6 +25,7 @@
 #include "HMMNode.h"
 #include "HiddenMarkovModel.h"
 #include "HMMProbabilities.h"
+#include <cfloat>
 
 // Constuctors
 // ==============================================
@@ -30,7 +33,7 @@ HMMNode::HMMNode(){
 	// Initialize as start node
 	id = 0;
 	state = 0;
-	residue = "";
+	symbol = -1;
 	highestWeight = 0; // set to zero only on start node
 	highestWeightPreviousNode = NULL;
 	logForwardProbability = 0;
@@ -38,12 +41,16 @@ HMMNode::HMMNode(){
 	logConditionalProbability = 0;
 }
 
-HMMNode::HMMNode(int anId, int aState, string aResidue, HiddenMarkovModel* aModel) {
+HMMNode::HMMNode(int anId, int aState, int aSymbol, HiddenMarkovModel* aModel) {
 	id = anId;
 	state = aState;
-	residue = aResidue;
+	symbol = aSymbol;
 	model = aModel;
+	highestWeight = -DBL_MAX;
 	highestWeightPreviousNode = NULL;
+	logForwardProbability = 0;
+	logBackwardProbability = 0;
+	logConditionalProbability = 0;
 }
 
 // Destructor
@@ -58,26 +65,30 @@ HMMNode::~HMMNode()
 // addInTransition(HMMTransition* aTranstion)
 //  Purpose: 
 //		Add aTransition to the inTranstions collection	
+//  Preconditions:
+//		inTransitions - has room reserved for aTransition
 //  Postconditions:
 //		inTransitions - contains aTransition
 void HMMNode::addInTransition(HMMTransition* aTransition) {
-	inTransitions.push_back(aTransition);
+	inTransitions.add(aTransition);
 }
 
 // addOutTransition(HMMTransition* aTranstion)
 //  Purpose: 
 //		Add aTransition to the outTranstions collection	
+//  Preconditions:
+//		outTransitions - has room reserved for aTransition
 //  Postconditions:
 //		outTransitions - contains aTransition
 void HMMNode::addOutTransition(HMMTransition* aTransition) {
-	outTransitions.push_back(aTransition);
+	outTransitions.add(aTransition);
 }
 
 // 	double logEmissionProbability()
 //  Purpose: 
 //		Returns the log of the emission probability for the state and
-//		residue on this node
+//		column on this node
 long double HMMNode::logEmissionProbability() {
-	return model->probabilities->logEmissionProbability(state, residue);
+	return model->probabilities->logEmissionProbability(state, symbol);
 }
 
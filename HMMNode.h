@@ -8,11 +8,13 @@
  *  Important Attributes:
  *		id - position in the HMM
  *		state - the underlying state this node represents in the HMM
- *		residue - the residue in this position in the sequence used to build the HMM
+ *		symbol - column id (see ColumnDictionary) of the alignment column at this
+ *				 position in the sequence used to build the HMM
  *		inTransitions - HMMTransitions that are coming into this node from the previous
  *						position in the HMM
  *		outTransitions - HMMTransitions that are leaving this node to the next position
  *						 in the HMM
+ *						 (both are ArenaArrays, the nodes live in the model's ModelArena)
  *		highestWeight - the highest weight determined by the viterbi path
  *		higheestWeightPreviousNode - the previous node in the HMM that gave the highest
  *									 weight viterbi path
@@ -23,6 +25,7 @@
 
 #ifndef HMMNODE_H
 #define HMMNODE_H
+#include "ModelArena.h"
 #include <vector>
 #include <map>
 #include <string>
@@ -37,7 +40,7 @@ public:
 	// Constuctors
 	// ==============================================
 	HMMNode();
-	HMMNode(int anId, int aState, string aResidue, HiddenMarkovModel* aModel);
+	HMMNode(int anId, int aState, int aSymbol, HiddenMarkovModel* aModel);
 
 	// Destructor
 	// =============================================
@@ -47,9 +50,9 @@ public:
 	// =============================================
 	int id;
 	int state;
-	string residue;
-	vector<HMMTransition*> inTransitions;
-	vector<HMMTransition*> outTransitions;
+	int symbol;
+	ArenaArray<HMMTransition*> inTransitions;
+	ArenaArray<HMMTransition*> outTransitions;
 	double highestWeight;
 	HMMNode* highestWeightPreviousNode;
 	long double logForwardProbability;
@@ -63,6 +66,8 @@ public:
 	// addInTransition(HMMTransition* aTranstion)
 	//  Purpose: 
 	//		Add aTransition to the inTranstions collection	
+	//  Preconditions:
+	//		inTransitions - has room reserved for aTransition
 	//  Postconditions:
 	//		inTransitions - contains aTransition
 	void addInTransition(HMMTransition* aTranstion);
@@ -70,6 +75,8 @@ public:
 	// addOutTransition(HMMTransition* aTranstion)
 	//  Purpose: 
 	//		Add aTransition to the outTranstions collection	
+	//  Preconditions:
+	//		outTransitions - has room reserved for aTransition
 	//  Postconditions:
 	//		outTransitions - contains aTransition
 	void addOutTransition(HMMTransition* aTranstion);
@@ -77,7 +84,7 @@ public:
 	// 	double logEmissionProbability()
 	//  Purpose: 
 	//		Returns the log of the emission probability for the state and
-	//		residue on this node
+	//		column on this node
 	long double logEmissionProbability();
 
 };
@@ -0,0 +1,248 @@
+/*
+ * HMMPathFile.cpp
+ *
+ *	The HMMPathFile object writes a decoded viterbi state path to a
+ *  compact binary file and answers point and range queries against it
+ *  through a read only memory mapping (see HMMPathFile.h for the file
+ *  layout).
+ *
+ *	States are packed 2 bits per column (32 columns per 64 bit word) so a
+ *  whole chromosome path is a quarter of the size of the text path, and
+ *  the per state counts stored every checkpointInterval columns let a
+ *  range count be answered from two checkpoints and at most one
+ *  interval's worth of popcounts on each end.
+ *
+ *  Created on: 10-18-26
+ */
+#include "HMMPathFile.h"
+#include "OutputBuffer.h"
+#include <cstring>
+#include <stdexcept>
+#include <algorithm>
+
+// const variable initialization
+// ==============================================
+const char HMMPathFile::fileMagic[8] = {'H', 'M', 'M', 'P', 'A', 'T', 'H', '\0'};
+const uint32_t HMMPathFile::fileVersion = 1;
+const uint32_t HMMPathFile::checkpointInterval = 512;
+
+// Constuctors
+// ==============================================
+HMMPathFile::HMMPathFile(string fileName) : file(fileName) {
+	const char* base = file.data();
+	header = (const PathFileHeader*) base;
+	if (file.size() < sizeof(PathFileHeader) || memcmp(header->magic, fileMagic, sizeof(fileMagic)) != 0
+		|| header->version != fileVersion || (header->bitsPerState != 2 && header->bitsPerState != 8)
+		|| header->numStates == 0 || header->numStates > (1u << header->bitsPerState)
+		|| header->checkpointInterval != checkpointInterval || header->numColumns < 0
+		|| header->statesOffset < sizeof(PathFileHeader) || header->statesOffset % sizeof(uint64_t) != 0
+		|| header->checkpointsOffset % sizeof(uint32_t) != 0
+		|| header->checkpointsOffset > file.size() || header->statesOffset > header->checkpointsOffset)
+		throw runtime_error("Invalid path file: " + fileName);
+
+	// Every table must fit in the file (the column count is checked
+	// against the file size first so the table sizes cannot overflow)
+	uint64_t columnsPerWord = 64 / header->bitsPerState;
+	uint64_t numColumns = header->numColumns;
+	if (numColumns / columnsPerWord >= file.size())
+		throw runtime_error("Invalid path file: " + fileName);
+	uint64_t statesSize = (numColumns + columnsPerWord - 1) / columnsPerWord * sizeof(uint64_t);
+	uint64_t checkpointsSize = (numColumns / checkpointInterval + 1) * header->numStates * sizeof(uint32_t);
+	if (header->checkpointsOffset - header->statesOffset < statesSize
+		|| file.size() - header->checkpointsOffset < checkpointsSize)
+		throw runtime_error("Invalid path file: " + fileName);
+
+	words = (const uint64_t*) (base + header->statesOffset);
+	checkpoints = (const uint32_t*) (base + header->checkpointsOffset);
+}
+
+// Destructor
+// =============================================
+HMMPathFile::~HMMPathFile() {
+}
+
+// Public Class Methods
+// =============================================
+
+// write(string fileName, const vector<unsigned char>& statePath, const string& chromosome,
+//		 long long startPosition, int numStates)
+//  Purpose: 
+//		Writes the state path to fileName in the binary path format
+//
+//		The header is followed by the packed states (padded to a whole
+//		64 bit word) and then numStates running counts for every block of
+//		checkpointInterval columns, plus a final set for the end of the path.
+void HMMPathFile::write(string fileName, const vector<unsigned char>& statePath, const string& chromosome,
+	long long startPosition, int numStates) {
+
+	long long numColumns = statePath.size();
+	uint32_t bitsPerState = numStates <= 4 ? 2 : 8;
+	long long columnsPerWord = 64 / bitsPerState;
+	long long numWords = (numColumns + columnsPerWord - 1) / columnsPerWord;
+	long long numCheckpoints = numColumns / checkpointInterval + 1;
+
+	PathFileHeader fileHeader;
+	memset(&fileHeader, 0, sizeof(fileHeader));
+	memcpy(fileHeader.magic, fileMagic, sizeof(fileMagic));
+	fileHeader.version = fileVersion;
+	fileHeader.numStates = numStates;
+	fileHeader.bitsPerState = bitsPerState;
+	fileHeader.checkpointInterval = checkpointInterval;
+	fileHeader.startPosition = startPosition;
+	fileHeader.numColumns = numColumns;
+	fileHeader.statesOffset = sizeof(PathFileHeader);
+	fileHeader.checkpointsOffset = fileHeader.statesOffset + numWords * sizeof(uint64_t);
+	strncpy(fileHeader.chromosome, chromosome.c_str(), sizeof(fileHeader.chromosome) - 1);
+
+	OutputBuffer out(fileName);
+	out.append((const char*) &fileHeader, sizeof(fileHeader));
+
+	// Packed states
+	uint64_t mask = (((uint64_t) 1) << bitsPerState) - 1;
+	for (long long word = 0; word < numWords; word++) {
+		uint64_t packed = 0;
+		long long first = word * columnsPerWord;
+		long long last = min(numColumns, first + columnsPerWord);
+		for (long long column = first; column < last; column++)
+			packed |= ((uint64_t) statePath[column] & mask) << ((column - first) * bitsPerState);
+		out.append((const char*) &packed, sizeof(packed));
+	}
+
+	// Checkpoint counts
+	vector<uint32_t> counts(numStates, 0);
+	for (long long checkpoint = 0; checkpoint < numCheckpoints; checkpoint++) {
+		out.append((const char*) counts.data(), counts.size() * sizeof(uint32_t));
+		long long first = checkpoint * checkpointInterval;
+		long long last = min(numColumns, first + checkpointInterval);
+		for (long long column = first; column < last; column++)
+			counts[statePath[column]]++;
+	}
+
+	out.flush();
+}
+
+// Public Methods
+// =============================================
+
+// int stateAt(long long coordinate)
+//  Purpose: 
+//		Returns the state at the chromosome coordinate, or -1 if the
+//		coordinate is not covered by the path
+int HMMPathFile::stateAt(long long coordinate) {
+	long long column = coordinate - header->startPosition;
+	if (column < 0 || column >= header->numColumns)
+		return -1;
+
+	return stateAtColumn(column);
+}
+
+// long long stateCount(int state, long long start, long long end)
+//  Purpose: 
+//		Returns the number of columns in the coordinate range [start, end)
+//		that are in the state (the range is clipped to the path)
+long long HMMPathFile::stateCount(int state, long long start, long long end) {
+	if (state < 0 || state >= (int) header->numStates)
+		return 0;
+
+	long long first = max(0LL, start - header->startPosition);
+	long long last = min((long long) header->numColumns, end - header->startPosition);
+	if (first >= last)
+		return 0;
+
+	return statePrefixCount(state, last) - statePrefixCount(state, first);
+}
+
+// copyStates(long long start, long long end, vector<unsigned char>& states)
+//  Purpose: 
+//		Replaces states with the state of every column in the coordinate
+//		range [start, end) (clipped to the path)
+void HMMPathFile::copyStates(long long start, long long end, vector<unsigned char>& states) {
+	states.clear();
+	long long first = max(0LL, start - header->startPosition);
+	long long last = min((long long) header->numColumns, end - header->startPosition);
+	if (first >= last)
+		return;
+
+	states.resize(last - first);
+	if (header->bitsPerState == 8) {
+		memcpy(states.data(), (const unsigned char*) words + first, last - first);
+		return;
+	}
+
+	// Unpack a word at a time
+	long long column = first;
+	while (column < last) {
+		uint64_t word = words[column >> 5] >> ((column & 31) * 2);
+		long long wordEnd = min(last, (column | 31) + 1);
+		for (; column < wordEnd; column++) {
+			states[column - first] = (unsigned char) (word & 3);
+			word >>= 2;
+		}
+	}
+}
+
+// Public Accessors
+// =============================================
+string HMMPathFile::getChromosome() {
+	return string(header->chromosome, strnlen(header->chromosome, sizeof(header->chromosome)));
+}
+
+long long HMMPathFile::getStartPosition() {
+	return header->startPosition;
+}
+
+long long HMMPathFile::getNumColumns() {
+	return header->numColumns;
+}
+
+int HMMPathFile::getNumStates() {
+	return header->numStates;
+}
+
+// Private Methods
+// =============================================
+
+// int stateAtColumn(long long column)
+//  Purpose: 
+//		Returns the state of a column of the path
+int HMMPathFile::stateAtColumn(long long column) {
+	if (header->bitsPerState == 8)
+		return ((const unsigned char*) words)[column];
+
+	return (int) ((words[column >> 5] >> ((column & 31) * 2)) & 3);
+}
+
+// long long statePrefixCount(int state, long long column)
+//  Purpose: 
+//		Returns the number of columns before column that are in the state
+//
+//		Starts from the checkpoint for column's block and counts the rest
+//		of the block.  In the packed format every 2 bit field is compared
+//		against the state with an xor, and the fields that came out 00 are
+//		counted with a popcount.
+long long HMMPathFile::statePrefixCount(int state, long long column) {
+	long long checkpoint = column / checkpointInterval;
+	long long count = checkpoints[checkpoint * header->numStates + state];
+	long long blockStart = checkpoint * checkpointInterval;
+
+	if (header->bitsPerState == 8) {
+		const unsigned char* bytes = (const unsigned char*) words;
+		for (long long i = blockStart; i < column; i++)
+			count += bytes[i] == state;
+		return count;
+	}
+
+	// 0101... replicated state pattern
+	const uint64_t lowBits = 0x5555555555555555ULL;
+	uint64_t pattern = lowBits * (uint64_t) state;
+	for (long long word = blockStart >> 5; word << 5 < column; word++) {
+		uint64_t diff = words[word] ^ pattern;
+		uint64_t matches = ~(diff | (diff >> 1)) & lowBits;
+		long long remaining = column - (word << 5);
+		if (remaining < 32)
+			matches &= (((uint64_t) 1) << (remaining * 2)) - 1;
+		count += __builtin_popcountll(matches);
+	}
+
+	return count;
+}
@@ -0,0 +1,135 @@
+/*
+ * HMMPathFile.h
+ *
+ *	This is the header file for the HMMPathFile object.  HMMPathFile
+ *  writes a decoded viterbi state path to a fixed width binary file
+ *  and reads it back through a memory mapping, so tools that need the
+ *  state at arbitrary chromosome coordinates can answer point and range
+ *  queries without parsing anything.
+ *
+ *  File layout (native byte order):
+ *
+ *		header			- fixed size PathFileHeader (magic, version, state
+ *						  count, chromosome, start position, column count)
+ *		states			- the state of every column packed into 64 bit
+ *						  words, 2 bits per column when there are at most
+ *						  4 states, otherwise one byte per column
+ *		checkpoints		- for every block of checkpointInterval columns, the
+ *						  number of columns in each state before the block
+ *						  (uint32 per state)
+ *
+ *	Column k of the path is at chromosome coordinate startPosition + k
+ *  (the same coordinates used for the viterbi segments).
+ *
+ *	Queries:
+ *		stateAt(coordinate)			- the state at one coordinate, O(1)
+ *		stateCount(state, start, end)
+ *									- number of columns in [start, end)
+ *									  in the state, O(1) (a checkpoint
+ *									  lookup plus a bounded popcount)
+ *		copyStates(start, end, out)	- unpacks the states in [start, end)
+ *
+ *  Created on: 10-18-26
+ */
+
+#ifndef HMMPATHFILE_H
+#define HMMPATHFILE_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include "MappedFile.h"
+using namespace std;
+
+class HMMPathFile
+{
+public:
+	// Constuctors
+	// ==============================================
+	HMMPathFile(string fileName);
+
+	// Destructor
+	// =============================================
+	~HMMPathFile();
+
+	// Public Class Methods
+	// =============================================
+
+	// write(string fileName, const vector<unsigned char>& statePath, const string& chromosome,
+	//		 long long startPosition, int numStates)
+	//  Purpose: 
+	//		Writes the state path to fileName in the binary path format
+	static void write(string fileName, const vector<unsigned char>& statePath, const string& chromosome,
+		long long startPosition, int numStates);
+
+	// Public Methods
+	// =============================================
+
+	// int stateAt(long long coordinate)
+	//  Purpose: 
+	//		Returns the state at the chromosome coordinate, or -1 if the
+	//		coordinate is not covered by the path
+	int stateAt(long long coordinate);
+
+	// long long stateCount(int state, long long start, long long end)
+	//  Purpose: 
+	//		Returns the number of columns in the coordinate range [start, end)
+	//		that are in the state (the range is clipped to the path)
+	long long stateCount(int state, long long start, long long end);
+
+	// copyStates(long long start, long long end, vector<unsigned char>& states)
+	//  Purpose: 
+	//		Replaces states with the state of every column in the coordinate
+	//		range [start, end) (clipped to the path)
+	void copyStates(long long start, long long end, vector<unsigned char>& states);
+
+	// Public Accessors
+	// =============================================
+	string getChromosome();
+	long long getStartPosition();
+	long long getNumColumns();
+	int getNumStates();
+
+private:
+
+	// Private Types
+	// =============================================
+	struct PathFileHeader {
+		char magic[8];
+		uint32_t version;
+		uint32_t numStates;
+		uint32_t bitsPerState;
+		uint32_t checkpointInterval;
+		int64_t startPosition;
+		int64_t numColumns;
+		uint64_t statesOffset;
+		uint64_t checkpointsOffset;
+		char chromosome[64];
+	};
+
+	// Private Attributes
+	// =============================================
+	static const char fileMagic[8];
+	static const uint32_t fileVersion;
+	static const uint32_t checkpointInterval;
+	MappedFile file;
+	const PathFileHeader* header;
+	const uint64_t* words;
+	const uint32_t* checkpoints;
+
+	// Private Methods
+	// =============================================
+
+	// int stateAtColumn(long long column)
+	//  Purpose: 
+	//		Returns the state of a column of the path
+	int stateAtColumn(long long column);
+
+	// long long statePrefixCount(int state, long long column)
+	//  Purpose: 
+	//		Returns the number of columns before column that are in the state
+	long long statePrefixCount(int state, long long column);
+
+};
+
+#endif // HMMPATHFILE_H
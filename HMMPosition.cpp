@@ -7,18 +7,20 @@
 
 // Constuctors
 // ==============================================
-HMMPosition::HMMPosition() {
+HMMPosition::HMMPosition(ModelArena& arena) {
 	// 
 	id = 0;
-	HMMNode* startNode = new HMMNode();
-	nodes.push_back(startNode);
+	HMMNode* startNode = arena.create<HMMNode>();
+	nodes.reserve(arena, 1);
+	nodes.add(startNode);
 }
 
-HMMPosition::HMMPosition(int anId, string residue, int numStates, HiddenMarkovModel* model) {
+HMMPosition::HMMPosition(int anId, int symbol, int numStates, HiddenMarkovModel* model, ModelArena& arena) {
 	id = anId;
+	nodes.reserve(arena, numStates - 1);
 	for (int state = 1; state < numStates; state++) {
-		HMMNode* node = new HMMNode(anId, state, residue, model);
-		nodes.push_back(node);
+		HMMNode* node = arena.create<HMMNode>(anId, state, symbol, model);
+		nodes.add(node);
 	}
 }
 
@@ -48,6 +50,24 @@ HMMNode* HMMPosition::highestScoringNode() {
 	return highestScorer;
 }
 
+// bool isStartPosition()
+//  Purpose: 
+//		Returns true if this is the start position (the position holding
+//		the single start node).  The id can not be used for this as the
+//		first position in the sequence also has an id of zero.
+bool HMMPosition::isStartPosition() {
+	return nodes.front()->state == 0;
+}
+
+// bool isFirstPosition()
+//  Purpose: 
+//		Returns true if this is the first position in the sequence (the
+//		position whose incoming transitions all come from the start node).
+bool HMMPosition::isFirstPosition() {
+	HMMNode* node = nodes.front();
+	return !node->inTransitions.empty() && node->inTransitions.front()->startNode->state == 0;
+}
+
 // calculateLogForwardProbabilty()
 //  Purpose: 
 //		Calculate and store the log forward probabilty for the forward-backward
@@ -65,12 +85,12 @@ HMMNode* HMMPosition::highestScoringNode() {
 //		logForwardProb - set to calculated log probability
 void HMMPosition::calculateLogForwardProbability() {
 
-	// Skip start node
-	if (id == 0)
+	// Skip start position
+	if (isStartPosition())
 		return;
 
-	// Calculation for first node only
-	if (id == 1) {
+	// Calculation for first position only
+	if (isFirstPosition()) {
 		for (HMMNode* node : nodes) {
 			node->logForwardProbability = 
 				MathUtilities::elnprod(
@@ -153,7 +173,7 @@ void HMMPosition::calculateNodeLogConditionalProbabilities() {
 	long double normalizer = std::numeric_limits<double>::quiet_NaN();
 	for (HMMNode* node : nodes) {
 		// Skip start node
-		if (node->id == 0) {
+		if (node->state == 0) {
 			continue;
 		}
 
@@ -170,7 +190,7 @@ void HMMPosition::calculateNodeLogConditionalProbabilities() {
 	//	(forwardProb*backwardProp/normalizer)
 	for (HMMNode* node : nodes) {
 		// Skip start node
-		if (node->id == 0) {
+		if (node->state == 0) {
 			continue;
 		}
 
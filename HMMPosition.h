@@ -6,6 +6,9 @@
  *  essentially a collection of HMMNodes.  One node for each state
  *  in the HMM.
  *
+ *	Positions and their nodes are created in the model's ModelArena and
+ *  are released with it, never deleted one at a time.
+ *
  *  Created on: 2-15-13
  *      Author: tomkolar
  */
@@ -22,8 +25,8 @@ class HMMPosition
 public:
 	// Constuctors
 	// ==============================================
-	HMMPosition();
-	HMMPosition(int anId, string residue, int numStates, HiddenMarkovModel* model);
+	HMMPosition(ModelArena& arena);
+	HMMPosition(int anId, int symbol, int numStates, HiddenMarkovModel* model, ModelArena& arena);
 
 	// Destructor
 	// =============================================
@@ -31,7 +34,7 @@ public:
 
 	// Public Attributes
 	// =============================================
-	vector<HMMNode*> nodes;
+	ArenaArray<HMMNode*> nodes;
 	int id;
 
 	// Public Methods
@@ -43,6 +46,19 @@ public:
 	//		collection of nodes.
 	HMMNode* highestScoringNode();
 
+	// bool isStartPosition()
+	//  Purpose: 
+	//		Returns true if this is the start position (the position holding
+	//		the single start node).  The id can not be used for this as the
+	//		first position in the sequence also has an id of zero.
+	bool isStartPosition();
+
+	// bool isFirstPosition()
+	//  Purpose: 
+	//		Returns true if this is the first position in the sequence (the
+	//		position whose incoming transitions all come from the start node).
+	bool isFirstPosition();
+
 	// calculateLogForwardProbabilty()
 	//  Purpose: 
 	//		Calculate and store the log forward probabilty for the forward-backward
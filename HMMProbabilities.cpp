@@ -18,26 +18,34 @@
 #include <limits>
 #include <iostream>
 #include <fstream>
+#include <stdexcept>
+#include <cstring>
+
+// const variable initialization
+// ==============================================
+const char HMMProbabilities::modelFileMagic[8] = {'H', 'M', 'M', 'P', 'R', 'O', 'B', '\0'};
+const uint32_t HMMProbabilities::modelFileVersion = 2;
+const char HMMProbabilities::modelAlphabet[8] = {'A', 'C', 'T', 'G', '-', '\0', '\0', '\0'};
 
 // Constuctors
 // ==============================================
 HMMProbabilities::HMMProbabilities() {
 }
 
-HMMProbabilities::HMMProbabilities(int numOfStates) {
+HMMProbabilities::HMMProbabilities(int numOfStates, ColumnDictionary* aColumnDictionary) {
 	numStates = numOfStates;
-	createEmissionResidueMap();
+	columnDictionary = aColumnDictionary;
 
 	// Initialize all probabilities to zero
+	int numColumns = columnDictionary->size();
+	emissionProbabilities.assign(numStates, vector<long double>(numColumns, 0));
+	logEmissionProbabilities.assign(numStates,
+		vector<long double>(numColumns, std::numeric_limits<double>::quiet_NaN()));
 	for (int i = 0; i < numStates; i++) {
 		setInitiationProbability(i, 0);
 		for (int j = 0; j < numStates; j++) {
 			setTransitionProbability(i, j, 0);
 		}
-		for (pair<string, int> mapPair : emissionResidueMap) {
-			string& residue = mapPair.first;
-			setEmissionProbability(i, residue, 0);
-		}
 	}
 }
 
@@ -55,19 +63,10 @@ HMMProbabilities::~HMMProbabilities() {
 //		Returns a probabilites object initialzed to the initial
 //		probabilites required by genome540 homework #7	
 HMMProbabilities* HMMProbabilities::initialProbabilities(
-	string neutralCountsFile, string conservedCountsFile) {
-
-	HMMProbabilities* probs = new HMMProbabilities(3);
+	string neutralCountsFile, string conservedCountsFile, ColumnDictionary* columnDictionary) {
 
-	// initiation probabilties
-	probs->setInitiationProbability(1, 0.95);
-	probs->setInitiationProbability(2, 0.05);
-
-	// transition probabilities
-	probs->setTransitionProbability(1, 1, 0.95);
-	probs->setTransitionProbability(1, 2, 0.05);
-	probs->setTransitionProbability(2, 1, 0.10);
-	probs->setTransitionProbability(2, 2, 0.90);
+	HMMProbabilities* probs = new HMMProbabilities(3, columnDictionary);
+	probs->setInitialTransitionProbabilities();
 
 	// emission probabilities
 	probs->populateEmissionProbabilities(1, neutralCountsFile);
@@ -77,6 +76,155 @@ HMMProbabilities* HMMProbabilities::initialProbabilities(
 
 }
 
+// HMMProbabilities* initialProbabilities(const vector<long long>& neutralCounts,
+//		const vector<long long>& conservedCounts, ColumnDictionary* columnDictionary)
+//  Purpose: 
+//		Same as above with the emission counts given per column id
+//		(see EmissionCounter) instead of read from counts files
+HMMProbabilities* HMMProbabilities::initialProbabilities(const vector<long long>& neutralCounts,
+	const vector<long long>& conservedCounts, ColumnDictionary* columnDictionary) {
+
+	HMMProbabilities* probs = new HMMProbabilities(3, columnDictionary);
+	probs->setInitialTransitionProbabilities();
+
+	// emission probabilities
+	long long neutralTotal = 0;
+	for (long long count : neutralCounts)
+		neutralTotal += count;
+	long long conservedTotal = 0;
+	for (long long count : conservedCounts)
+		conservedTotal += count;
+	probs->populateEmissionProbabilities(1, neutralCounts, neutralTotal);
+	probs->populateEmissionProbabilities(2, conservedCounts, conservedTotal);
+
+	return probs;
+}
+
+// HMMProbabilities* load(string fileName, ColumnDictionary* columnDictionary)
+//  Purpose: 
+//		Returns the probabilities saved in a model file (read with a
+//		single read).  Columns of the model that are not in the column
+//		dictionary are ignored; columns that are not in the model are
+//		emitted with the product of the state's frequency of each of
+//		their residues.  Throws a runtime_error if the file is not a
+//		model file for the dictionary's species.
+HMMProbabilities* HMMProbabilities::load(string fileName, ColumnDictionary* columnDictionary) {
+	ifstream inputFile(fileName, ios::binary | ios::ate);
+	if (!inputFile)
+		throw runtime_error("Unable to open model file: " + fileName);
+	size_t fileSize = inputFile.tellg();
+	inputFile.seekg(0);
+	vector<char> contents(fileSize);
+	if (!inputFile.read(contents.data(), fileSize))
+		throw runtime_error("Unable to read model file: " + fileName);
+
+	return load(contents.data(), fileSize, columnDictionary, fileName);
+}
+
+// HMMProbabilities* load(const char* contents, size_t size, ColumnDictionary* columnDictionary,
+//		string name)
+//  Purpose: 
+//		Same as above with the model file already in memory (e.g.
+//		received from a training coordinator).  name is used in errors.
+HMMProbabilities* HMMProbabilities::load(const char* contents, size_t size, ColumnDictionary* columnDictionary,
+	string name) {
+	vector<string> species;
+	ModelFileHeader header = checkModelFile(contents, size, name, species);
+	if (species != columnDictionary->getSpecies())
+		throw runtime_error("Model file species (" + string(contents + sizeof(header), header.speciesLength)
+			+ ") do not match the alignment's species: " + name);
+
+	int numResidues = strlen(modelAlphabet);
+	size_t speciesLength = ((size_t) header.speciesLength + 7) & ~(size_t) 7;
+	size_t columnsLength = ((size_t) header.numColumns * header.numSpecies + 7) & ~(size_t) 7;
+	size_t numLogs = header.numStates + (size_t) header.numStates * header.numStates
+		+ (size_t) header.numStates * header.numColumns
+		+ (size_t) header.numStates * header.numSpecies * numResidues;
+	const char* columns = contents + sizeof(header) + speciesLength;
+	const char* logValues = columns + columnsLength;
+	vector<double> logs(numLogs);
+	memcpy(logs.data(), logValues, numLogs * sizeof(double));
+
+	// Probabilities are set from the logs, and the stored logs are kept
+	// exactly as they were
+	HMMProbabilities* probs = new HMMProbabilities(header.numStates, columnDictionary);
+	size_t k = 0;
+	for (int i = 0; i < probs->numStates; i++, k++) {
+		probs->setInitiationProbability(i, std::isnan(logs[k]) ? 0 : expl(logs[k]));
+		probs->logInitiationProbabilities[i] = logs[k];
+	}
+	for (int i = 0; i < probs->numStates; i++) {
+		for (int j = 0; j < probs->numStates; j++, k++) {
+			probs->setTransitionProbability(i, j, std::isnan(logs[k]) ? 0 : expl(logs[k]));
+			probs->logTransitionProbabilities[i][j] = logs[k];
+		}
+	}
+	vector<int> columnIds(header.numColumns);
+	vector<bool> inModel(columnDictionary->size(), false);
+	for (uint32_t c = 0; c < header.numColumns; c++) {
+		columnIds[c] = columnDictionary->find(string(columns + (size_t) c * header.numSpecies, header.numSpecies));
+		if (columnIds[c] >= 0)
+			inModel[columnIds[c]] = true;
+	}
+	for (int i = 0; i < probs->numStates; i++) {
+		for (uint32_t c = 0; c < header.numColumns; c++, k++) {
+			if (columnIds[c] < 0)
+				continue;
+			probs->setEmissionProbability(i, columnIds[c], std::isnan(logs[k]) ? 0 : expl(logs[k]));
+			probs->logEmissionProbabilities[i][columnIds[c]] = logs[k];
+		}
+	}
+
+	// Columns the model has not seen are emitted with the product of
+	// their residues' frequencies (NaN, so zero, for a residue outside
+	// the alphabet or a state that emits nothing)
+	const double* residueLogs = logs.data() + k;
+	for (int columnId = 0; columnId < (int) inModel.size(); columnId++) {
+		if (inModel[columnId])
+			continue;
+		const string& column = columnDictionary->column(columnId);
+		for (int i = 0; i < probs->numStates; i++) {
+			double logProbability = 0;
+			for (uint32_t s = 0; s < header.numSpecies; s++) {
+				const char* residue = strchr(modelAlphabet, column[s]);
+				if (residue == NULL || column[s] == '\0')
+					logProbability = std::numeric_limits<double>::quiet_NaN();
+				else
+					logProbability += residueLogs[(i * header.numSpecies + s) * numResidues + (residue - modelAlphabet)];
+			}
+			probs->setEmissionProbability(i, columnId, std::isnan(logProbability) ? 0 : expl(logProbability));
+		}
+	}
+
+	return probs;
+}
+
+// ColumnDictionary* loadColumns(string fileName)
+//  Purpose: 
+//		Returns a new column dictionary holding the columns of a model
+//		file, for loading the model without an alignment.  The caller
+//		owns the dictionary.
+ColumnDictionary* HMMProbabilities::loadColumns(string fileName) {
+	ifstream inputFile(fileName, ios::binary | ios::ate);
+	if (!inputFile)
+		throw runtime_error("Unable to open model file: " + fileName);
+	size_t fileSize = inputFile.tellg();
+	inputFile.seekg(0);
+	vector<char> contents(fileSize);
+	if (!inputFile.read(contents.data(), fileSize))
+		throw runtime_error("Unable to read model file: " + fileName);
+
+	vector<string> species;
+	ModelFileHeader header = checkModelFile(contents.data(), fileSize, fileName, species);
+	ColumnDictionary* columnDictionary = new ColumnDictionary(species);
+	size_t speciesLength = ((size_t) header.speciesLength + 7) & ~(size_t) 7;
+	const char* columns = contents.data() + sizeof(header) + speciesLength;
+	for (uint32_t c = 0; c < header.numColumns; c++)
+		columnDictionary->intern(columns + (size_t) c * header.numSpecies);
+
+	return columnDictionary;
+}
+
 // Public Methods
 // =============================================
 
@@ -87,10 +235,17 @@ long double HMMProbabilities::emissionProbability(int state, string residue) {
 	return emissionProbabilities.at(state).at(getEmissionResidueIndex(residue));
 }
 
+// double emissionProbability(int state, int columnId)
+//  Purpose: 
+//		Returns the emission probability for the state and column id
+long double HMMProbabilities::emissionProbability(int state, int columnId) const {
+	return emissionProbabilities[state][columnId];
+}
+
 // double initiationProbability(int state)
 //  Purpose: 
 //		Returns the initiation probability for the state
-long double HMMProbabilities::initiationProbability(int state) {
+long double HMMProbabilities::initiationProbability(int state) const {
 	return initiationProbabilities[state];
 }
 	
@@ -98,7 +253,7 @@ long double HMMProbabilities::initiationProbability(int state) {
 //  Purpose: 
 //		Returns the transition probability for transition from beginState
 //		to endState
-long double HMMProbabilities::transitionProbability(int beginState, int endState) {
+long double HMMProbabilities::transitionProbability(int beginState, int endState) const {
 	return transitionProbabilities[beginState][endState];
 }
 
@@ -109,10 +264,18 @@ long double HMMProbabilities::logEmissionProbability(int state, string residue)
 	return logEmissionProbabilities.at(state).at(getEmissionResidueIndex(residue));
 }
 
+// double logEmissionProbability(int state, int columnId)
+//  Purpose: 
+//		Returns the log of the emission probability for the state and
+//		column id
+long double HMMProbabilities::logEmissionProbability(int state, int columnId) const {
+	return logEmissionProbabilities[state][columnId];
+}
+
 // double logInitiationProbability(int state)
 //  Purpose: 
 //		Returns the log of the initiation probability for the state
-long double HMMProbabilities::logInitiationProbability(int state) {
+long double HMMProbabilities::logInitiationProbability(int state) const {
 	return logInitiationProbabilities[state];
 }
 	
@@ -120,7 +283,7 @@ long double HMMProbabilities::logInitiationProbability(int state) {
 //  Purpose: 
 //		Returns the log of the transition probability for transition from
 //		beginState to endState
-long double HMMProbabilities::logTransitionProbability(int beginState, int endState) {
+long double HMMProbabilities::logTransitionProbability(int beginState, int endState) const {
 	return logTransitionProbabilities[beginState][endState];
 }
 
@@ -131,13 +294,23 @@ long double HMMProbabilities::logTransitionProbability(int beginState, int endSt
 //		emissionProbabilites - value set for state/residue
 //		logEmissionProbabilites - value set for state/residue
 void HMMProbabilities::setEmissionProbability(int state, string residue, long double value) {
-	emissionProbabilities[state][getEmissionResidueIndex(residue)] = value;
+	setEmissionProbability(state, getEmissionResidueIndex(residue), value);
+}
+
+// setEmissionProbability(int state, int columnId, double value)
+//  Purpose: 
+//		Sets the emission probability for the state and column id to value
+//	Postconditions:
+//		emissionProbabilites - value set for state/column
+//		logEmissionProbabilites - value set for state/column
+void HMMProbabilities::setEmissionProbability(int state, int columnId, long double value) {
+	emissionProbabilities[state][columnId] = value;
 	double logVal;
 	if (value == 0)
 		logVal = std::numeric_limits<double>::quiet_NaN();
 	else
 		logVal = log(value);
-	logEmissionProbabilities[state][getEmissionResidueIndex(residue)] = logVal;
+	logEmissionProbabilities[state][columnId] = logVal;
 }
 
 // setInitiationProbability(int state, double value)
@@ -173,298 +346,440 @@ void HMMProbabilities::setTransitionProbability(int beginState, int endState, lo
 	logTransitionProbabilities[beginState][endState] = logVal;
 }
 
+// vector<long double> parameterVector()
+//  Purpose: 
+//		Returns the initiation, transition and emission probabilities of
+//		the non start states packed into one vector (in that order).  Used
+//		by the EM accelerator to extrapolate across training iterations.
+vector<long double> HMMProbabilities::parameterVector() {
+	vector<long double> parameters;
+
+	for (int i = 1; i < numStates; i++)
+		parameters.push_back(initiationProbability(i));
+
+	for (int i = 1; i < numStates; i++)
+		for (int j = 1; j < numStates; j++)
+			parameters.push_back(transitionProbability(i, j));
+
+	const vector<int>& columnIds = columnDictionary->sortedIds();
+	for (int i = 1; i < numStates; i++) {
+		for (int columnId : columnIds)
+			parameters.push_back(emissionProbability(i, columnId));
+	}
+
+	return parameters;
+}
+
+// bool setParameterVector(const vector<long double>& parameters)
+//  Purpose: 
+//		Sets the probabilities from a vector packed by parameterVector().
+//		Each distribution (initiation, each transition row and each
+//		emission row) is projected back to a valid distribution: negative
+//		or NaN values are set to zero and the row is renormalized.
+//		Returns false (and leaves the probabilities untouched) if any row
+//		can not be renormalized.
+//	Postconditions:
+//		initiation, transition and emission probabilities - set from parameters
+bool HMMProbabilities::setParameterVector(const vector<long double>& parameters) {
+	int emittingStates = numStates - 1;
+	int numResidues = columnDictionary->size();
+
+	// Row lengths in packing order: initiation, transition rows, emission rows
+	vector<int> rowLengths;
+	rowLengths.push_back(emittingStates);
+	for (int i = 0; i < emittingStates; i++)
+		rowLengths.push_back(emittingStates);
+	for (int i = 0; i < emittingStates; i++)
+		rowLengths.push_back(numResidues);
+
+	// Project each row on to the probability simplex
+	vector<long double> projected(parameters.size());
+	size_t start = 0;
+	for (int rowLength : rowLengths) {
+		long double rowSum = 0;
+		for (size_t k = start; k < start + rowLength; k++) {
+			long double value = parameters[k];
+			if (!(value > 0) || std::isinf(value))
+				value = 0;
+			projected[k] = value;
+			rowSum += value;
+		}
+		if (!(rowSum > 0))
+			return false;
+		for (size_t k = start; k < start + rowLength; k++)
+			projected[k] /= rowSum;
+		start += rowLength;
+	}
+
+	// Unpack
+	size_t k = 0;
+	for (int i = 1; i < numStates; i++)
+		setInitiationProbability(i, projected[k++]);
+
+	for (int i = 1; i < numStates; i++)
+		for (int j = 1; j < numStates; j++)
+			setTransitionProbability(i, j, projected[k++]);
+
+	const vector<int>& columnIds = columnDictionary->sortedIds();
+	for (int i = 1; i < numStates; i++) {
+		for (int columnId : columnIds)
+			setEmissionProbability(i, columnId, projected[k++]);
+	}
+
+	return true;
+}
+
+// save(string fileName)
+//  Purpose: 
+//		Writes the log probabilities and the columns they emit to a
+//		binary model file (see load)
+void HMMProbabilities::save(string fileName) {
+	OutputBuffer out(fileName);
+	save(out);
+	out.flush();
+}
+
+// save(OutputBuffer& out)
+//  Purpose: 
+//		Appends the model file contents to out
+void HMMProbabilities::save(OutputBuffer& out) const {
+	int numColumns = columnDictionary->size();
+	int numSpecies = columnDictionary->getNumSpecies();
+	string species;
+	for (const string& aSpecies : columnDictionary->getSpecies()) {
+		if (!species.empty())
+			species += ',';
+		species += aSpecies;
+	}
+
+	ModelFileHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, modelFileMagic, sizeof(modelFileMagic));
+	header.version = modelFileVersion;
+	header.numStates = numStates;
+	header.numSpecies = numSpecies;
+	header.numColumns = numColumns;
+	memcpy(header.alphabet, modelAlphabet, sizeof(modelAlphabet));
+	header.speciesLength = species.size();
+
+	out.append((const char*) &header, sizeof(header));
+	out.append(species);
+	out.append(string(((species.size() + 7) & ~(size_t) 7) - species.size(), '\0'));
+	for (int columnId = 0; columnId < numColumns; columnId++)
+		out.append(columnDictionary->column(columnId));
+	size_t columnsLength = (size_t) numColumns * numSpecies;
+	out.append(string(((columnsLength + 7) & ~(size_t) 7) - columnsLength, '\0'));
+
+	vector<double> logs;
+	for (int i = 0; i < numStates; i++)
+		logs.push_back(logInitiationProbability(i));
+	for (int i = 0; i < numStates; i++)
+		for (int j = 0; j < numStates; j++)
+			logs.push_back(logTransitionProbability(i, j));
+	for (int i = 0; i < numStates; i++)
+		for (int columnId = 0; columnId < numColumns; columnId++)
+			logs.push_back(logEmissionProbability(i, columnId));
+	vector<double> residueLogs = logResidueFrequencies();
+	logs.insert(logs.end(), residueLogs.begin(), residueLogs.end());
+	out.append((const char*) logs.data(), logs.size() * sizeof(double));
+}
+
 // string probabilitiesResultsString()
 //  Purpose:
-//		Returns a string representing the probabilites
+//		Returns a string representing the probabilites (see
+//		writeProbabilitiesResults)
+string HMMProbabilities::probabilitiesResultsString() {
+	OutputBuffer out;
+	writeProbabilitiesResults(out);
+	return out.str();
+}
+
+// writeProbabilitiesResults(OutputBuffer& out)
+//  Purpose:
+//		Appends the probabilities to out
 //
 //		format:
-//			<<statesResultsString>>
-//			<<initiationProbabilitesResultsString>>
-//			<<transmissionProbabilitesResultsString>>
+//			<<statesResults>>
+//			<<initiationProbabilitesResults>>
+//			<<transmissionProbabilitesResults>>
 //			...
-//			<<emissionProbabilitesResultsString>>
+//			<<emissionProbabilitesResults>>
 //			...
-string HMMProbabilities::probabilitiesResultsString() {
-	stringstream ss;
-
+void HMMProbabilities::writeProbabilitiesResults(OutputBuffer& out) {
 	// Begin Model
-	ss << "      <model type=\"hmm\">\n";
+	out.append("      <model type=\"hmm\">\n");
 
 	// States
-	ss << statesResultsString();
+	writeStatesResults(out);
 
 	// Probabiltiies
-	ss << intitiationProbabiltiesResultsString();
+	writeInitiationProbabilitiesResults(out);
 	for (int i = 1; i < numStates; i++)
-		ss << transitionProbablitiesResultsString(i);
+		writeTransitionProbabilitiesResults(out, i);
 	for (int i = 1; i < numStates; i++)
-		ss << emissionProbablitiesResultsString(i);
+		writeEmissionProbabilitiesResults(out, i);
 	
 	// End Model
-	ss << "      </model>\n";
-
-	return ss.str();
+	out.append("      </model>\n");
 }
 
-// string statesResultsString()
+// writeStatesResults(OutputBuffer& out)
 //  Purpose:
-//		Returns a string representing the states
+//		Appends the states to out
 //
 //		format:
 //			<result type="states">
 //				<<state1>>,<<state2>>,...
 //			</result>
-string HMMProbabilities::statesResultsString() {
-	stringstream ss;
-
+void HMMProbabilities::writeStatesResults(OutputBuffer& out) {
 	// Header 
-	ss << "        <states>";
+	out.append("        <states>");
 
 	// States
 	for (int i = 1; i < numStates; i++) {
-		ss << i ;
+		out.appendInt(i);
 
 		if ( i < numStates - 1)
-		   ss << ",";
+		   out.append(',');
 	}
 
 	// Footer
-	ss << "</states>\n";
-
-	return ss.str();
+	out.append("</states>\n");
 }
 
-// string intitiationProbabiltiesResultsString()
+// writeInitiationProbabilitiesResults(OutputBuffer& out)
 //  Purpose:
-//		Returns a string representing the initiation probablities
+//		Appends the initiation probablities to out
 //
 //		format:
 //			<result type="initiation_probabilites">
 //				<<state>>=<<initiation probability>>,
 //			</result>
-string HMMProbabilities::intitiationProbabiltiesResultsString() {
-	stringstream ss;
-	ss.precision(5);
-
+void HMMProbabilities::writeInitiationProbabilitiesResults(OutputBuffer& out) {
 	// Header 
-	ss << "        <initial_state_probabilities>";
+	out.append("        <initial_state_probabilities>");
 
 	// States
 	for (int i = 1; i < numStates; i++) {
-		ss
-			<< i 
-			<< "="
-			<< initiationProbability(i);
+		out.appendInt(i);
+		out.append('=');
+		out.appendDouble(initiationProbability(i), 5);
 
 		if ( i < numStates - 1)
-		   ss << ",";
+		   out.append(',');
 	}
 
 	// Footer
-	ss << "</initial_state_probabilities>\n";
-
-	return ss.str();
+	out.append("</initial_state_probabilities>\n");
 }
 
-// transitionProbablitiesResultsString(int state)
+// writeTransitionProbabilitiesResults(OutputBuffer& out, int state)
 //  Purpose:
-//		Returns a string representing the transition probablities for a state
+//		Appends the transition probablities for a state to out
 //
 //		format:
 //			<result type="transition_probabilites" state="<<state>>">
 //				<<to state>>=<<transition probability>>,
 //			</result>
-string HMMProbabilities::transitionProbablitiesResultsString(int state) {
-	stringstream ss;
-	ss.precision(5);
-
+void HMMProbabilities::writeTransitionProbabilitiesResults(OutputBuffer& out, int state) {
 	// Header 
-	ss << "        <transition_probabilities state=\"" << state << "\">";
+	out.append("        <transition_probabilities state=\"");
+	out.appendInt(state);
+	out.append("\">");
 
 	// States
 	for (int i = 1; i < numStates; i++) {
-		ss
-			<< i
-			<< "="
-			<< transitionProbability(state, i);
+		out.appendInt(i);
+		out.append('=');
+		out.appendDouble(transitionProbability(state, i), 5);
 
 		if ( i < numStates - 1)
-		   ss << ",";
+		   out.append(',');
 	}
 
 	// Footer
-	ss << "</transition_probabilities>\n";
-
-	return ss.str();
+	out.append("</transition_probabilities>\n");
 }
 
-// emissionProbablitiesResultsString(int state)
+// writeEmissionProbabilitiesResults(OutputBuffer& out, int state)
 //  Purpose:
-//		Returns a string representing the emission probablities for a state
+//		Appends the emission probablities for a state to out
 //
 //		format:
 //			<result type="emission_probabilites" state="<<state>>">
 //				<<residue>>=<<emission probability>>,
 //			</result>
-string HMMProbabilities::emissionProbablitiesResultsString(int state) {
-	stringstream ss;
-	ss.precision(5);
-
+void HMMProbabilities::writeEmissionProbabilitiesResults(OutputBuffer& out, int state) {
 	// Header 
-	ss << "        <emission_probabilities state=\"" << state << "\">";
+	out.append("        <emission_probabilities state=\"");
+	out.appendInt(state);
+	out.append("\">");
 
 	// Residues
-	for (pair<string, int> mapPair : emissionResidueMap) {
-		string& residue = mapPair.first;
-		ss << residue << "=" << emissionProbability(state, residue) << ",";
+	for (int columnId : columnDictionary->sortedIds()) {
+		out.append(columnDictionary->column(columnId));
+		out.append('=');
+		out.appendDouble(emissionProbabilities[state][columnId], 5);
+		out.append(',');
 	}
 
 	// Footer
-	ss << "</emission_probabilities>\n";
+	out.append("</emission_probabilities>\n");
+}
+
+// Public Accessors
+// =============================================
+int HMMProbabilities::getNumStates() const {
+	return numStates;
+}
 
-	return ss.str();
+int HMMProbabilities::getNumColumns() const {
+	return emissionProbabilities.empty() ? 0 : emissionProbabilities[0].size();
 }
 
-// map<string, int> createEmissionMap()
+// ModelFileHeader checkModelFile(const char* contents, size_t size, string name)
 //  Purpose: 
-//		Creates a map of the index location for a trinucleotide emission
-//		in the emission probabilities array
-void HMMProbabilities::createEmissionResidueMap() {
-
-	emissionResidueMap["AAA"]= 0;
-	emissionResidueMap["AAC"]= 1;
-	emissionResidueMap["AAT"]= 2;
-	emissionResidueMap["AAG"]= 3;
-	emissionResidueMap["AA-"]= 4;
-	emissionResidueMap["ACA"]= 5;
-	emissionResidueMap["ACC"]= 6;
-	emissionResidueMap["ACT"]= 7;
-	emissionResidueMap["ACG"]= 8;
-	emissionResidueMap["AC-"]= 9;
-	emissionResidueMap["ATA"]= 10;
-	emissionResidueMap["ATC"]= 11;
-	emissionResidueMap["ATT"]= 12;
-	emissionResidueMap["ATG"]= 13;
-	emissionResidueMap["AT-"]= 14;
-	emissionResidueMap["AGA"]= 15;
-	emissionResidueMap["AGC"]= 16;
-	emissionResidueMap["AGT"]= 17;
-	emissionResidueMap["AGG"]= 18;
-	emissionResidueMap["AG-"]= 19;
-	emissionResidueMap["A-A"]= 20;
-	emissionResidueMap["A-C"]= 21;
-	emissionResidueMap["A-T"]= 22;
-	emissionResidueMap["A-G"]= 23;
-	emissionResidueMap["A--"]= 24;
-	emissionResidueMap["CAA"]= 25;
-	emissionResidueMap["CAC"]= 26;
-	emissionResidueMap["CAT"]= 27;
-	emissionResidueMap["CAG"]= 28;
-	emissionResidueMap["CA-"]= 29;
-	emissionResidueMap["CCA"]= 30;
-	emissionResidueMap["CCC"]= 31;
-	emissionResidueMap["CCT"]= 32;
-	emissionResidueMap["CCG"]= 33;
-	emissionResidueMap["CC-"]= 34;
-	emissionResidueMap["CTA"]= 35;
-	emissionResidueMap["CTC"]= 36;
-	emissionResidueMap["CTT"]= 37;
-	emissionResidueMap["CTG"]= 38;
-	emissionResidueMap["CT-"]= 39;
-	emissionResidueMap["CGA"]= 40;
-	emissionResidueMap["CGC"]= 41;
-	emissionResidueMap["CGT"]= 42;
-	emissionResidueMap["CGG"]= 43;
-	emissionResidueMap["CG-"]= 44;
-	emissionResidueMap["C-A"]= 45;
-	emissionResidueMap["C-C"]= 46;
-	emissionResidueMap["C-T"]= 47;
-	emissionResidueMap["C-G"]= 48;
-	emissionResidueMap["C--"]= 49;
-	emissionResidueMap["TAA"]= 50;
-	emissionResidueMap["TAC"]= 51;
-	emissionResidueMap["TAT"]= 52;
-	emissionResidueMap["TAG"]= 53;
-	emissionResidueMap["TA-"]= 54;
-	emissionResidueMap["TCA"]= 55;
-	emissionResidueMap["TCC"]= 56;
-	emissionResidueMap["TCT"]= 57;
-	emissionResidueMap["TCG"]= 58;
-	emissionResidueMap["TC-"]= 59;
-	emissionResidueMap["TTA"]= 60;
-	emissionResidueMap["TTC"]= 61;
-	emissionResidueMap["TTT"]= 62;
-	emissionResidueMap["TTG"]= 63;
-	emissionResidueMap["TT-"]= 64;
-	emissionResidueMap["TGA"]= 65;
-	emissionResidueMap["TGC"]= 66;
-	emissionResidueMap["TGT"]= 67;
-	emissionResidueMap["TGG"]= 68;
-	emissionResidueMap["TG-"]= 69;
-	emissionResidueMap["T-A"]= 70;
-	emissionResidueMap["T-C"]= 71;
-	emissionResidueMap["T-T"]= 72;
-	emissionResidueMap["T-G"]= 73;
-	emissionResidueMap["T--"]= 74;
-	emissionResidueMap["GAA"]= 75;
-	emissionResidueMap["GAC"]= 76;
-	emissionResidueMap["GAT"]= 77;
-	emissionResidueMap["GAG"]= 78;
-	emissionResidueMap["GA-"]= 79;
-	emissionResidueMap["GCA"]= 80;
-	emissionResidueMap["GCC"]= 81;
-	emissionResidueMap["GCT"]= 82;
-	emissionResidueMap["GCG"]= 83;
-	emissionResidueMap["GC-"]= 84;
-	emissionResidueMap["GTA"]= 85;
-	emissionResidueMap["GTC"]= 86;
-	emissionResidueMap["GTT"]= 87;
-	emissionResidueMap["GTG"]= 88;
-	emissionResidueMap["GT-"]= 89;
-	emissionResidueMap["GGA"]= 90;
-	emissionResidueMap["GGC"]= 91;
-	emissionResidueMap["GGT"]= 92;
-	emissionResidueMap["GGG"]= 93;
-	emissionResidueMap["GG-"]= 94;
-	emissionResidueMap["G-A"]= 95;
-	emissionResidueMap["G-C"]= 96;
-	emissionResidueMap["G-T"]= 97;
-	emissionResidueMap["G-G"]= 98;
-	emissionResidueMap["G--"]= 99;
+//		Returns the header of a model file in memory, throwing a
+//		runtime_error if it is not a valid model file
+//	Postconditions:
+//		species - the model's species names
+HMMProbabilities::ModelFileHeader HMMProbabilities::checkModelFile(const char* contents, size_t size, string name,
+	vector<string>& species) {
+	// Check the header and that the tables fit in the file
+	ModelFileHeader header;
+	if (size < sizeof(header))
+		throw runtime_error("Invalid model file: " + name);
+	memcpy(&header, contents, sizeof(header));
+	size_t speciesLength = ((size_t) header.speciesLength + 7) & ~(size_t) 7;
+	size_t columnsLength = ((size_t) header.numColumns * header.numSpecies + 7) & ~(size_t) 7;
+	size_t numLogs = header.numStates + (size_t) header.numStates * header.numStates
+		+ (size_t) header.numStates * header.numColumns
+		+ (size_t) header.numStates * header.numSpecies * strlen(modelAlphabet);
+	if (memcmp(header.magic, modelFileMagic, sizeof(modelFileMagic)) != 0 || header.version != modelFileVersion
+		|| size != sizeof(header) + speciesLength + columnsLength + numLogs * sizeof(double))
+		throw runtime_error("Invalid model file: " + name);
+	if (header.numStates != 3)
+		throw runtime_error("Model file does not have 3 states: " + name);
+	if (header.numSpecies == 0 || memcmp(header.alphabet, modelAlphabet, sizeof(modelAlphabet)) != 0)
+		throw runtime_error("Model file does not match the alignment's species: " + name);
+
+	species.clear();
+	StringUtilities::split(string(contents + sizeof(header), header.speciesLength), ',', species);
+	if (species.size() != header.numSpecies)
+		throw runtime_error("Invalid model file: " + name);
+
+	return header;
+}
+
+// vector<double> logResidueFrequencies()
+//  Purpose: 
+//		Returns the log frequency of each residue in each species' row
+//		of each state's emissions ([state][species][residue]).  The
+//		state's least likely column is added to every residue first, so
+//		no residue has zero frequency in an emitting state.
+vector<double> HMMProbabilities::logResidueFrequencies() const {
+	int numColumns = columnDictionary->size();
+	int numSpecies = columnDictionary->getNumSpecies();
+	int numResidues = strlen(modelAlphabet);
+
+	vector<double> logs;
+	for (int i = 0; i < numStates; i++) {
+		long double pseudocount = 0;
+		for (int columnId = 0; columnId < numColumns; columnId++) {
+			long double probability = emissionProbabilities[i][columnId];
+			if (probability > 0 && (pseudocount == 0 || probability < pseudocount))
+				pseudocount = probability;
+		}
+
+		for (int s = 0; s < numSpecies; s++) {
+			vector<long double> frequencies(numResidues, pseudocount);
+			for (int columnId = 0; columnId < numColumns; columnId++) {
+				const char* residue = strchr(modelAlphabet, columnDictionary->column(columnId)[s]);
+				if (residue != NULL && *residue != '\0')
+					frequencies[residue - modelAlphabet] += emissionProbabilities[i][columnId];
+			}
+
+			long double total = 0;
+			for (long double frequency : frequencies)
+				total += frequency;
+			for (long double frequency : frequencies)
+				logs.push_back((total > 0) ? (double) log(frequency / total) : std::numeric_limits<double>::quiet_NaN());
+		}
+	}
+
+	return logs;
 }
 
 // int getIndex(char residue)
 //  Purpose: 
 //	  Returns the index in the emission probabilities for the residue
 int HMMProbabilities::getEmissionResidueIndex(string residue) {
-	return emissionResidueMap.at(residue);
+	int columnId = columnDictionary->find(residue);
+	if (columnId < 0)
+		throw out_of_range("No emission probability for column: " + residue);
+
+	return columnId;
 }
 
+// populateEmissionProbabilities(int state, string file)
+//  Purpose: 
+//	  Sets the emission probabilities for the state from a counts file
+//	  (one "column<tab>count" line per column).  Every count goes into
+//	  the total, but only columns in the column dictionary are kept.
+//	  Throws a runtime_error if the file cannot be opened.
 void HMMProbabilities::populateEmissionProbabilities(int state, string file) {
 	ifstream inputFile(file);
+	if (!inputFile)
+		throw runtime_error("Unable to open counts file: " + file);
 	int totalCount = 0;
 	string line;
+	vector<long long> counts(columnDictionary->size(), 0);
 
-	// Set the probabilty to the count from the file (we will divide by the total
-	//  count in the next step to get the actual probability)
+	// Collect the count for each column from the file
 	while(getline(inputFile, line)) {
 		vector<string> tokens;
 		StringUtilities::split(line, '\t', tokens);
+		if (tokens.empty())
+			continue;
 		int count = atoi(tokens.back().c_str());
-		setEmissionProbability(state, tokens.front(), count);
+		int columnId = columnDictionary->find(tokens.front());
+		if (columnId >= 0)
+			counts[columnId] = count;
 		totalCount += count;
 	}
 
 	//  Done reading in file 
 	inputFile.close();
 
-	// Divide the count set in the first step by the total count to get the probability
-	for (pair<string, int> mapPair : emissionResidueMap) {
-		string& residue = mapPair.first;
-		long double probability =
-			emissionProbability(state, residue) / (double) totalCount;
-		setEmissionProbability(state, residue, probability);
-	}
+	populateEmissionProbabilities(state, counts, totalCount);
+}
 
+// populateEmissionProbabilities(int state, const vector<long long>& counts, long long totalCount)
+//  Purpose: 
+//	  Sets the emission probability of each column id for the state to
+//	  its count divided by totalCount
+void HMMProbabilities::populateEmissionProbabilities(int state, const vector<long long>& counts,
+	long long totalCount) {
+	int numColumns = columnDictionary->size();
+	for (int columnId = 0; columnId < numColumns; columnId++) {
+		long double count = (columnId < (int) counts.size()) ? counts[columnId] : 0;
+		long double probability = count / (double) totalCount;
+		setEmissionProbability(state, columnId, probability);
+	}
 }
 
+// setInitialTransitionProbabilities()
+//  Purpose: 
+//	  Sets the initiation and transition probabilities required by
+//	  genome540 homework #8
+void HMMProbabilities::setInitialTransitionProbabilities() {
+	// initiation probabilties
+	setInitiationProbability(1, 0.95);
+	setInitiationProbability(2, 0.05);
+
+	// transition probabilities
+	setTransitionProbability(1, 1, 0.95);
+	setTransitionProbability(1, 2, 0.05);
+	setTransitionProbability(2, 1, 0.10);
+	setTransitionProbability(2, 2, 0.90);
+}
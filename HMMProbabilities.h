@@ -7,14 +7,42 @@
  *	convenience methods for setting and retriving probabilties as well as
  *  the log value of each probabilty.
  *
+ *	Trained probabilities can be saved to a binary model file and loaded
+ *  back for decoding without training or reading counts files.  Model
+ *  file layout (native byte order):
+ *
+ *		header			- fixed size ModelFileHeader (magic, version, number
+ *						  of states, species and columns, residue alphabet,
+ *						  length of the species names)
+ *		species			- comma separated species names (reference first),
+ *						  padded to 8 bytes
+ *		columns			- numColumns columns of numSpecies residues, padded
+ *						  to 8 bytes
+ *		initiation		- numStates log probabilities (doubles)
+ *		transition		- numStates x numStates log probabilities
+ *		emission		- numStates x numColumns log probabilities
+ *		residues		- numStates x numSpecies x alphabet log frequencies of
+ *						  each residue in each species' row of the state's
+ *						  emissions
+ *
+ *	Zero probabilities are stored as NaN (their log here).  Emissions are
+ *  keyed by column so a model can be loaded against any alignment with
+ *  the same species.  A column the model never saw is emitted with the
+ *  product of its residues' frequencies, so alignments with columns
+ *  missing from the training alignment can still be decoded.
+ *
  *  Created on: 2-15-13
  *      Author: tomkolar
  */
 
 #ifndef HMMPROBABILITIES_H
 #define HMMPROBABILITIES_H
+#include "OutputBuffer.h"
+#include "ColumnDictionary.h"
 #include <map>
 #include <string>
+#include <vector>
+#include <cstdint>
 using namespace std;
 
 class HMMProbabilities
@@ -23,7 +51,7 @@ public:
 	// Constuctors
 	// ==============================================
 	HMMProbabilities();
-	HMMProbabilities(int numOfStates);
+	HMMProbabilities(int numOfStates, ColumnDictionary* aColumnDictionary);
 
 	// Destructor
 	// =============================================
@@ -31,16 +59,51 @@ public:
 
 	// Public Attributes
 	// =============================================
-	map<string, int> emissionResidueMap;
+	ColumnDictionary* columnDictionary;		// ids of the emitted alignment columns
 
 	// Public Class Methods
 	// =============================================
 
-	// HMMProbabilities* initialProbabilities(string neutralCountsFile, string conservedCountsFile)
+	// HMMProbabilities* initialProbabilities(string neutralCountsFile, string conservedCountsFile,
+	//		ColumnDictionary* columnDictionary)
 	//  Purpose: 
 	//		Returns a probabilites object initialzed to the initial
 	//		probabilites required by genome540 homework #8	
-	static HMMProbabilities* initialProbabilities(string neutralCountsFile, string conservedCountsFile);
+	static HMMProbabilities* initialProbabilities(string neutralCountsFile, string conservedCountsFile,
+		ColumnDictionary* columnDictionary);
+
+	// HMMProbabilities* initialProbabilities(const vector<long long>& neutralCounts,
+	//		const vector<long long>& conservedCounts, ColumnDictionary* columnDictionary)
+	//  Purpose: 
+	//		Same as above with the emission counts given per column id
+	//		(see EmissionCounter) instead of read from counts files
+	static HMMProbabilities* initialProbabilities(const vector<long long>& neutralCounts,
+		const vector<long long>& conservedCounts, ColumnDictionary* columnDictionary);
+
+	// HMMProbabilities* load(string fileName, ColumnDictionary* columnDictionary)
+	//  Purpose: 
+	//		Returns the probabilities saved in a model file (read with a
+	//		single read).  Columns of the model that are not in the column
+	//		dictionary are ignored; columns that are not in the model are
+	//		emitted with the product of the state's frequency of each of
+	//		their residues.  Throws a runtime_error if the file is not a
+	//		model file for the dictionary's species.
+	static HMMProbabilities* load(string fileName, ColumnDictionary* columnDictionary);
+
+	// HMMProbabilities* load(const char* contents, size_t size, ColumnDictionary* columnDictionary,
+	//		string name)
+	//  Purpose: 
+	//		Same as above with the model file already in memory (e.g.
+	//		received from a training coordinator).  name is used in errors.
+	static HMMProbabilities* load(const char* contents, size_t size, ColumnDictionary* columnDictionary,
+		string name);
+
+	// ColumnDictionary* loadColumns(string fileName)
+	//  Purpose: 
+	//		Returns a new column dictionary holding the columns of a model
+	//		file, for loading the model without an alignment.  The caller
+	//		owns the dictionary.
+	static ColumnDictionary* loadColumns(string fileName);
 
 	// Public Methods
 	// =============================================
@@ -50,32 +113,43 @@ public:
 	//		Returns the emission probability for the state and residue
 	long  double emissionProbability(int state, string residue);
 
+	// double emissionProbability(int state, int columnId)
+	//  Purpose: 
+	//		Returns the emission probability for the state and column id
+	long double emissionProbability(int state, int columnId) const;
+
 	// double initiationProbability(int state)
 	//  Purpose: 
 	//		Returns the initiation probability for the state
-	long  double initiationProbability(int state);
+	long  double initiationProbability(int state) const;
 
 	// double transitionProbability(int beginState, int endState)
 	//  Purpose: 
 	//		Returns the transition probability for transition from beginState
 	//		to endState
-	long  double transitionProbability(int beginState, int endState);
+	long  double transitionProbability(int beginState, int endState) const;
 
 	// double logEmissionProbability(int state, string residue)
 	//  Purpose: 
 	//		Returns the log of the emission probability for the state and residue
 	long  double logEmissionProbability(int state, string residue);
 
+	// double logEmissionProbability(int state, int columnId)
+	//  Purpose: 
+	//		Returns the log of the emission probability for the state and
+	//		column id
+	long double logEmissionProbability(int state, int columnId) const;
+
 	// double logInitiationProbability(int state)
 	//  Purpose: 
 	//		Returns the log of the initiation probability for the state
-	long  double logInitiationProbability(int state);
+	long  double logInitiationProbability(int state) const;
 
 	// double logTransitionProbability(int beginState, int endState)
 	//  Purpose: 
 	//		Returns the log of the transition probability for transition from
 	//		beginState to endState
-	long double logTransitionProbability(int beginState, int endState);
+	long double logTransitionProbability(int beginState, int endState) const;
 	
 	// setEmissionProbability(int state, char residue, double value)
 	//  Purpose: 
@@ -85,6 +159,14 @@ public:
 	//		logEmissionProbabilites - value set for state/residue
 	void setEmissionProbability(int state, string residue, long double value);
 
+	// setEmissionProbability(int state, int columnId, double value)
+	//  Purpose: 
+	//		Sets the emission probability for the state and column id to value
+	//	Postconditions:
+	//		emissionProbabilites - value set for state/column
+	//		logEmissionProbabilites - value set for state/column
+	void setEmissionProbability(int state, int columnId, long double value);
+
 	// setInitiationProbability(int state, double value)
 	//  Purpose: 
 	//		Sets the initiation probability for the state to value
@@ -102,75 +184,151 @@ public:
 	//		logTransitionProbabilites - value set for beginState to endState
 	void setTransitionProbability(int beginState, int endState, long double value);
 
+	// vector<long double> parameterVector()
+	//  Purpose: 
+	//		Returns the initiation, transition and emission probabilities of
+	//		the non start states packed into one vector (in that order).  Used
+	//		by the EM accelerator to extrapolate across training iterations.
+	vector<long double> parameterVector();
+
+	// bool setParameterVector(const vector<long double>& parameters)
+	//  Purpose: 
+	//		Sets the probabilities from a vector packed by parameterVector().
+	//		Each distribution (initiation, each transition row and each
+	//		emission row) is projected back to a valid distribution: negative
+	//		or NaN values are set to zero and the row is renormalized.
+	//		Returns false (and leaves the probabilities untouched) if any row
+	//		can not be renormalized.
+	//	Postconditions:
+	//		initiation, transition and emission probabilities - set from parameters
+	bool setParameterVector(const vector<long double>& parameters);
+
+	// save(string fileName)
+	//  Purpose: 
+	//		Writes the log probabilities and the columns they emit to a
+	//		binary model file (see load)
+	void save(string fileName);
+
+	// save(OutputBuffer& out)
+	//  Purpose: 
+	//		Appends the model file contents to out
+	void save(OutputBuffer& out) const;
+
 	// string probabilitiesResultsString()
 	//  Purpose:
-	//		Returns a string representing the probabilites
+	//		Returns a string representing the probabilites (see
+	//		writeProbabilitiesResults)
+	string probabilitiesResultsString();
+
+	// writeProbabilitiesResults(OutputBuffer& out)
+	//  Purpose:
+	//		Appends the probabilities to out
 	//
 	//		format:
-	//			<<statesResultsString>>
-	//			<<initiationProbabilitesResultsString>>
-	//			<<transmissionProbabilitesResultsString>>
+	//			<<statesResults>>
+	//			<<initiationProbabilitesResults>>
+	//			<<transmissionProbabilitesResults>>
 	//			...
-	//			<<emissionProbabilitesResultsString>>
+	//			<<emissionProbabilitesResults>>
 	//			...
-	string probabilitiesResultsString();
+	void writeProbabilitiesResults(OutputBuffer& out);
 
-	// string statesResultsString()
+	// writeStatesResults(OutputBuffer& out)
 	//  Purpose:
-	//		Returns a string representing the states
+	//		Appends the states to out
 	//
 	//		format:
 	//			<result type="states">
 	//				<<state1>>,<<state2>>,...
 	//			</result>
-	string statesResultsString();
+	void writeStatesResults(OutputBuffer& out);
 
-	// string intitiationProbabiltiesResultsString()
+	// writeInitiationProbabilitiesResults(OutputBuffer& out)
 	//  Purpose:
-	//		Returns a string representing the initiation probablities
+	//		Appends the initiation probablities to out
 	//
 	//		format:
 	//			<result type="initiation_probabilites">
 	//				<<state>>=<<initiation probability>>,
 	//			</result>
-	string intitiationProbabiltiesResultsString();
+	void writeInitiationProbabilitiesResults(OutputBuffer& out);
 
-	// transitionProbablitiesResultsString(int state)
+	// writeTransitionProbabilitiesResults(OutputBuffer& out, int state)
 	//  Purpose:
-	//		Returns a string representing the transition probablities for a state
+	//		Appends the transition probablities for a state to out
 	//
 	//		format:
 	//			<result type="transition_probabilites" state="<<state>>">
 	//				<<to state>>=<<transition probability>>,
 	//			</result>
-	string transitionProbablitiesResultsString(int state);
+	void writeTransitionProbabilitiesResults(OutputBuffer& out, int state);
 
-	// emissionProbablitiesResultsString(int state)
+	// writeEmissionProbabilitiesResults(OutputBuffer& out, int state)
 	//  Purpose:
-	//		Returns a string representing the emission probablities for a state
+	//		Appends the emission probablities for a state to out
 	//
 	//		format:
 	//			<result type="emission_probabilites" state="<<state>>">
 	//				<<residue>>=<<emission probability>>,
 	//			</result>
-	string emissionProbablitiesResultsString(int state);
+	void writeEmissionProbabilitiesResults(OutputBuffer& out, int state);
+
+	// Public Accessors
+	// =============================================
+	int getNumStates() const;
+	int getNumColumns() const;				// emission probabilities per state
 
 private:
 
+	// Private Types
+	// =============================================
+	struct ModelFileHeader {
+		char magic[8];
+		uint32_t version;
+		uint32_t numStates;
+		uint32_t numSpecies;
+		uint32_t numColumns;
+		char alphabet[8];		// residues in symbol order
+		uint32_t speciesLength;	// comma separated species names
+		uint32_t reserved;
+	};
+
 	// Private Attributes
 	// =============================================
+	static const char modelFileMagic[8];
+	static const uint32_t modelFileVersion;
+	static const char modelAlphabet[8];
 	int numStates;
-	map<int, map<int, long double>> emissionProbabilities;
-	map<int, map<int, long double>> logEmissionProbabilities;
+	vector<vector<long double>> emissionProbabilities;		// [state][column id]
+	vector<vector<long double>> logEmissionProbabilities;	// [state][column id]
 	long double transitionProbabilities[3][3];
 	long double logTransitionProbabilities[3][3];
 	long double initiationProbabilities[3];
 	long double logInitiationProbabilities[3];
 
 	// Private Methods
-	void createEmissionResidueMap();
+
+	// ModelFileHeader checkModelFile(const char* contents, size_t size, string name)
+	//  Purpose: 
+	//		Returns the header of a model file in memory, throwing a
+	//		runtime_error if it is not a valid model file
+	//	Postconditions:
+	//		species - the model's species names
+	static ModelFileHeader checkModelFile(const char* contents, size_t size, string name,
+		vector<string>& species);
+
+	// vector<double> logResidueFrequencies()
+	//  Purpose: 
+	//		Returns the log frequency of each residue in each species' row
+	//		of each state's emissions ([state][species][residue]).  The
+	//		state's least likely column is added to every residue first, so
+	//		no residue has zero frequency in an emitting state.
+	vector<double> logResidueFrequencies() const;
+
 	int getEmissionResidueIndex(string residue);
 	void populateEmissionProbabilities(int state, string file);
+	void populateEmissionProbabilities(int state, const vector<long long>& counts, long long totalCount);
+	void setInitialTransitionProbabilities();
 
 };
 
@@ -19,27 +19,32 @@
  *
  *	resultsWithoutSegments() - returns a string of all results except segments
  *	allResults() - returns a string of all results (including segements)
+ *	writeResultsWithoutSegments(out), writeAllResults(out) - append the same
+ *		results to an OutputBuffer
  *
  *  Created on: 2-15-13
  *      Author: tomkolar
  */
 #include "HMMViterbiResults.h"
 #include "StringUtilities.h"
-#include <sstream>
+#include "StatePathUtilities.h"
+#include "MafFile.h"
 #include <vector>
 #include <algorithm>
+#include <thread>
 
 // Constuctors
 // ==============================================
 HMMViterbiResults::HMMViterbiResults() {
+	probabilities = NULL;
 }
 
-HMMViterbiResults::HMMViterbiResults(int anIteration, int numberOfStates) {
+HMMViterbiResults::HMMViterbiResults(int anIteration, int numberOfStates, ColumnDictionary* columnDictionary) {
 
 	iteration = anIteration;
 	numStates = numberOfStates;
-	probabilities = new HMMProbabilities(numStates);
-
+	probabilities = new HMMProbabilities(numStates, columnDictionary);
+	numResidues = columnDictionary->size();
 
 	// initialize counts vectors
 	for (int i = 0; i < numStates; i++) {
@@ -50,12 +55,7 @@ HMMViterbiResults::HMMViterbiResults(int anIteration, int numberOfStates) {
 		for (int j = 0; j < numStates; j++) {
 			transitionCounts[i].push_back(0);
 		}
-		if (i > 0) {
-			for (pair<string, int> mapPair : probabilities->emissionResidueMap) {
-				string& residue = mapPair.first;
-				emissionCounts[i][residue] = 0;
-			}
-		}
+		emissionCounts.push_back(vector<int>(numResidues, 0));
 
 	}
 }
@@ -63,6 +63,7 @@ HMMViterbiResults::HMMViterbiResults(int anIteration, int numberOfStates) {
 // Destructor
 // =============================================
 HMMViterbiResults::~HMMViterbiResults(){
+	delete probabilities;
 }
 
 // Public Methods
@@ -71,55 +72,65 @@ HMMViterbiResults::~HMMViterbiResults(){
 // string resultsWithoutSegments()
 //  Purpose:
 //		Returns a string representing the viterbi results for 
-//		a particular iteration
+//		a particular iteration (see writeResultsWithoutSegments)
+string HMMViterbiResults::resultsWithoutSegments() {
+	OutputBuffer out;
+	writeResultsWithoutSegments(out);
+	return out.str();
+}
+
+// string allResults()
+//  Purpose:
+//		Returns a string representing the viterbi results for 
+//		a particular iteration (see writeAllResults)
+string HMMViterbiResults::allResults() {
+	OutputBuffer out;
+	writeAllResults(out);
+	return out.str();
+}
+
+// writeResultsWithoutSegments(OutputBuffer& out)
+//  Purpose:
+//		Appends the viterbi results for a particular iteration to out
 //
 //		format:
 //			<result type="viterbi_iteration" iteration="<< iteration >>">
-//				<<stateHistogramResultsString>>
-//				<<segmentHistogramResultsString>>
-//				<<probabiltiesResultsString>>
+//				<<stateHistogramResults>>
+//				<<segmentHistogramResults>>
+//				<<probabiltiesResults>>
 //			</result>
-string HMMViterbiResults::resultsWithoutSegments() {
-	stringstream ss;
-
+void HMMViterbiResults::writeResultsWithoutSegments(OutputBuffer& out) {
 	// Header
-	ss << "    <result type=\"viterbi_iteration\" iteration=\"" << iteration << "\">\n";
+	out.append("    <result type=\"viterbi_iteration\" iteration=\"");
+	out.appendInt(iteration);
+	out.append("\">\n");
 
 	// Results
-	ss 
-		<< stateHistogramResultsString()
-		<< segmentHistogramResultsString()
-		<< probabilitiesResultsString();
+	writeStateHistogramResults(out);
+	writeSegmentHistogramResults(out);
+	probabilities->writeProbabilitiesResults(out);
 
-//	ss 	<< transitionCountsResultsString();
+//	writeTransitionCountsResults(out);
 
 	// Footer
-	ss << "    </result>\n";
-
-	return ss.str();
+	out.append("    </result>\n");
 }
 
-// string allResults()
+// writeAllResults(OutputBuffer& out)
 //  Purpose:
-//		Returns a string representing the viterbi results for 
-//		a particular iteration
+//		Appends the viterbi results for a particular iteration,
+//		including the segments, to out
 //
 //		format:
 //			<result type="viterbi_iteration" iteration="<< iteration >>">
-//				<<stateHistogramResultsString>>
-//				<<segmentHistogramResultsString>>
-//				<<probabiltiesResultsString>>
+//				<<stateHistogramResults>>
+//				<<segmentHistogramResults>>
+//				<<probabiltiesResults>>
 //			</result>
-//			<<segmentResultsString>>
-string HMMViterbiResults::allResults() {
-	stringstream ss;
-
-	// Results
-	ss 
-		<< resultsWithoutSegments()
-		<< segmentResultsString();
-
-	return ss.str();
+//			<<segmentResults>>
+void HMMViterbiResults::writeAllResults(OutputBuffer& out) {
+	writeResultsWithoutSegments(out);
+	writeSegmentResults(out);
 }
 
 // calculateProbabilities(HMMProbabilities* previousProbs)
@@ -143,11 +154,10 @@ void HMMViterbiResults::calculateProbabilities(HMMProbabilities* previousProbs)
 
 	// emission probabilities
 	for (int state = 1; state < numStates; state++) {
-		for (pair<string, int> mapPair : probabilities->emissionResidueMap) {
-			string& residue = mapPair.first;
+		for (int columnId = 0; columnId < numResidues; columnId++) {
 			long double newProbability = 
-				emissionCounts.at(state).at(residue) / (double) stateCounts[state];
-			probabilities->setEmissionProbability(state, residue, newProbability);
+				emissionCounts[state][columnId] / (double) stateCounts[state];
+			probabilities->setEmissionProbability(state, columnId, newProbability);
 		}
 	}
 
@@ -161,138 +171,264 @@ void HMMViterbiResults::calculateProbabilities(HMMProbabilities* previousProbs)
 	}
 }
 
+// gatherCounts(const vector<unsigned char>& statePath, const vector<int>& symbols,
+//				int firstPosition, int offset, const vector<pair<int, int> >& coordinateBreaks)
+//  Purpose:
+//		Gathers the state, emission, transition and segment counts from a
+//		decoded state path (one state per sequence position) and the
+//		column id of each position, starting at firstPosition.
+//		Segment coordinates are position + offset, or from the
+//		alignment's (column, coordinate) breaks if it has any (a MAF
+//		region), in which case segments are also split at every break
+//		so none covers unaligned coordinates.
+//
+//		The path is split into chunks that are counted in parallel into
+//		dense per-thread count arrays and merged at the end.  Segments are
+//		extracted from the whole path in one SIMD pass (see
+//		StatePathUtilities::extractRuns), so runs that cross a chunk edge
+//		need no stitching.  The results are identical to walking the path
+//		one node at a time.
+//	Postconditions:
+//		stateCounts, emissionCounts, transitionCounts, segmentCounts and
+//		segments - populated
+void HMMViterbiResults::gatherCounts(const vector<unsigned char>& statePath, const vector<int>& symbols,
+	int firstPosition, int offset, const vector<pair<int, int> >& coordinateBreaks) {
+
+	int pathLength = statePath.size();
+	int length = pathLength - firstPosition;
+	if (length <= 0)
+		return;
+
+	// Split the path into one chunk per thread (small paths are not worth
+	// the thread start up)
+	const int minChunkLength = 1 << 16;
+	int numChunks = thread::hardware_concurrency();
+	if (numChunks < 1)
+		numChunks = 1;
+	if (numChunks > length / minChunkLength)
+		numChunks = max(1, length / minChunkLength);
+
+	// Count all but the last chunk on their own threads
+	vector<ChunkCounts> chunks(numChunks);
+	vector<thread> threads;
+	for (int chunk = 0; chunk < numChunks - 1; chunk++) {
+		int start = firstPosition + (int) ((long long) length * chunk / numChunks);
+		int end = firstPosition + (int) ((long long) length * (chunk + 1) / numChunks);
+		threads.push_back(thread(&HMMViterbiResults::gatherChunkCounts, this,
+			cref(statePath), cref(symbols), start, end, ref(chunks[chunk])));
+	}
+
+	// Extract the segments and count the last chunk while they run.  Run
+	// positions are made columns of the whole path, and the earliest
+	// segment starts at the first column itself.
+	vector<StatePathUtilities::StateRun> runs;
+	StatePathUtilities::extractRuns(statePath.data() + firstPosition, length, runs);
+	for (StatePathUtilities::StateRun& run : runs) {
+		run.start += firstPosition;
+		run.end += firstPosition;
+	}
+	runs.front().start = 0;
+	StatePathUtilities::splitRunsAtBreaks(runs, coordinateBreaks);
+	StatePathUtilities::countSegments(runs, segmentCounts);
+
+	int lastStart = firstPosition + (int) ((long long) length * (numChunks - 1) / numChunks);
+	gatherChunkCounts(statePath, symbols, lastStart, pathLength, chunks[numChunks - 1]);
+
+	for (thread& aThread : threads)
+		aThread.join();
+
+	// Merge the chunk counts
+	for (ChunkCounts& counts : chunks) {
+		for (int i = 0; i < numStates; i++) {
+			stateCounts[i] += counts.stateCounts[i];
+			for (int j = 0; j < numStates; j++)
+				transitionCounts[i][j] += counts.transitionCounts[i * numStates + j];
+			for (int k = 0; k < numResidues; k++)
+				emissionCounts[i][k] += counts.emissionCounts[i * numResidues + k];
+		}
+	}
+
+	// Segments are collected walking the path backward (latest segment first)
+	for (int i = runs.size() - 1; i >= 0; i--) {
+		StatePathUtilities::StateRun& run = runs[i];
+		if (coordinateBreaks.empty())
+			segments[run.state].push_back(pair<int,int>(run.start + offset, run.end + offset));
+		else
+			segments[run.state].push_back(pair<int,int>(MafFile::getCoordinate(coordinateBreaks, run.start),
+				MafFile::getCoordinate(coordinateBreaks, run.end)));
+	}
+}
+
 // Private Methods
 // =============================================
 
-// string stateHistogramResultsString()
+// writeStateHistogramResults(OutputBuffer& out)
 //  Purpose:
-//		Returns a string representing the state histogram
+//		Appends the state histogram to out
 //
 //		format:
 //			<result type="state_histogram">
 //				<<state>>=<<state count>>,
 //			</result>
-string HMMViterbiResults::stateHistogramResultsString() {
-	stringstream ss;
+void HMMViterbiResults::writeStateHistogramResults(OutputBuffer& out) {
+	StringUtilities::xmlResultStart(out, "state_histogram");
 
 	for (int i = 1; i < numStates; i++) {
-		ss 
-			<< i  
-			<< "="
-			<< stateCounts[i];
+		out.appendInt(i);
+		out.append('=');
+		out.appendInt(stateCounts[i]);
 
 		if ( i < numStates -1)
-		   ss << ",";
+		   out.append(',');
 	}
 
-	return StringUtilities::xmlResult("state_histogram", ss.str());
+	StringUtilities::xmlResultEnd(out);
 }
 
-// string segmentHistogramResultsString()
+// writeSegmentHistogramResults(OutputBuffer& out)
 //  Purpose:
-//		Returns a string representing the segment histogram
+//		Appends the segment histogram to out
 //
 //		format:
 //			<result type="segment_histogram">
 //				<<state>>=<<segment count>>,
 //			</result>
-string HMMViterbiResults::segmentHistogramResultsString() {
-	stringstream ss;
+void HMMViterbiResults::writeSegmentHistogramResults(OutputBuffer& out) {
+	StringUtilities::xmlResultStart(out, "segment_histogram");
 
 	for (int i = 1; i < numStates; i++) {
-		ss 
-			<< i  
-			<< "="
-			<< segmentCounts[i];
+		out.appendInt(i);
+		out.append('=');
+		out.appendInt(segmentCounts[i]);
 
 		if ( i < numStates -1)
-		   ss << ",";
+		   out.append(',');
 	}
 
-	return StringUtilities::xmlResult("segment_histogram", ss.str());
-}
-
-// string probabilitiesResultsString()
-//  Purpose:
-//		Returns a string representing the probabilites
-//
-//		format:
-//			<<statesResultsString>>
-//			<<initiationProbabilitesResultsString>>
-//			<<transmissionProbabilitesResultsString>>
-//			...
-//			<<emissionProbabilitesResultsString>>
-//			...
-string HMMViterbiResults::probabilitiesResultsString() {
-	return probabilities->probabilitiesResultsString();
+	StringUtilities::xmlResultEnd(out);
 }
 
-// string segmentResultsString()
+// writeSegmentResults(OutputBuffer& out)
 //  Purpose:
-//		Returns a string representing the segments
+//		Appends the ten longest conserved (state 2) segments, longest
+//		first, to out
 //
 //		format:
 //			<result type="segments">
 //				(segment1start, segment1end),(segment2start, segment2end),...
 //			</result>
-string HMMViterbiResults::segmentResultsString() {
-	stringstream ss;
+void HMMViterbiResults::writeSegmentResults(OutputBuffer& out) {
+	const size_t numToPrint = 10;
+	size_t numSegments = segments[2].size();
+	vector<pair<int, int>> longest = longestSegments(2, numToPrint);
+
+	StringUtilities::xmlResultStart(out, "segment_list");
 
-	vector<pair<int, int>>& gcSegments = segments[2];
-	sort(gcSegments.begin(), gcSegments.end(), sort_segment());
-	
 	int counter = 0;
-	for (int i = gcSegments.size() - 1; i >= 0; i--) {
-		pair<int, int>& segment = gcSegments[i];
-		ss 
-			<< "("
-			<< segment.first
-			<< ","
-			<< segment.second
-			<< ")";
-		if (i > 0)
-			ss << ",";
+	for (pair<int, int>& segment : longest) {
+		out.append('(');
+		out.appendInt(segment.first);
+		out.append(',');
+		out.appendInt(segment.second);
+		out.append(')');
+
+		// No comma after the shortest segment of the whole collection
+		if (numSegments - counter > 1)
+			out.append(',');
 
 		counter++;
 		if (counter % 5 == 0)
-			ss << "\n";
+			out.append('\n');
+	}
 
-		if (counter >= 10)
-			break;
+	StringUtilities::xmlResultEnd(out);
+}
+
+// vector<pair<int, int>> longestSegments(int state, size_t k)
+//  Purpose:
+//		Returns the k longest segments for the state, longest first.  A
+//		min-heap of the k longest seen so far is kept while scanning
+//		the segments, which is O(n log k) instead of a full sort.
+vector<pair<int, int>> HMMViterbiResults::longestSegments(int state, size_t k) {
+	vector<pair<int, int>> heap;
+	if (k == 0)
+		return heap;
+	heap.reserve(k + 1);
+
+	for (pair<int, int>& segment : segments[state]) {
+		if (heap.size() < k) {
+			heap.push_back(segment);
+			push_heap(heap.begin(), heap.end(), longer_segment());
+		}
+		else if (sort_segment()(heap.front(), segment)) {
+			pop_heap(heap.begin(), heap.end(), longer_segment());
+			heap.back() = segment;
+			push_heap(heap.begin(), heap.end(), longer_segment());
+		}
 	}
 
-	return StringUtilities::xmlResult("segment_list", ss.str());
+	// Sorting a min-heap ordered container by the reversed comparison
+	// leaves the longest segment first
+	sort_heap(heap.begin(), heap.end(), longer_segment());
+	return heap;
 }
 
-// transitionCountsResultsString(int state)
+// writeTransitionCountsResults(OutputBuffer& out)
 //  Purpose:
-//		Returns a string representing the transimission counts
+//		Appends the transimission counts to out
 //
 //		format:
 //			<result type="transitionCounts">
 //				<<transition>>=<<transition count>>,
 //			</result>
-string HMMViterbiResults::transitionCountsResultsString() {
-	stringstream ss;
-
+void HMMViterbiResults::writeTransitionCountsResults(OutputBuffer& out) {
 	// Header 
-	ss << "        <transition_counts>";
+	out.append("        <transition_counts>");
 
 	// States
 	for (int i = 0; i < numStates; i++) {
 		for (int j = 0; j < numStates; j++) {
-			ss
-				<< i + 1 << j + 1
-				<< "="
-				<< transitionCounts[i][j];
+			out.appendInt(i + 1);
+			out.appendInt(j + 1);
+			out.append('=');
+			out.appendInt(transitionCounts[i][j]);
 
 			if ( i < numStates - 1 || j < numStates - 1)
-			   ss << ",";
+			   out.append(',');
 		}
 	}
 
 	// Footer
-	ss << "</transition_counts>\n";
+	out.append("</transition_counts>\n");
+}
 
-	return ss.str();
+// gatherChunkCounts(const vector<unsigned char>& statePath, const vector<int>& symbols,
+//					 int start, int end, ChunkCounts& counts)
+//  Purpose:
+//		Gathers the counts for the positions [start, end) of the path.  The
+//		transition from end - 1 to end is counted here as well (if end is
+//		not the end of the path).
+void HMMViterbiResults::gatherChunkCounts(const vector<unsigned char>& statePath, const vector<int>& symbols,
+	int start, int end, ChunkCounts& counts) {
+
+	counts.stateCounts.assign(numStates, 0);
+	counts.emissionCounts.assign(numStates * numResidues, 0);
+	counts.transitionCounts.assign(numStates * numStates, 0);
+
+	int pathLength = statePath.size();
+	int transitionEnd = min(end, pathLength - 1);
+	const unsigned char* states = statePath.data();
+	const int* residues = symbols.data();
+
+	for (int position = start; position < end; position++) {
+		int state = states[position];
+		counts.stateCounts[state]++;
+
+		int residue = residues[position];
+		if (residue >= 0)
+			counts.emissionCounts[state * numResidues + residue]++;
+
+		if (position < transitionEnd)
+			counts.transitionCounts[state * numStates + states[position + 1]]++;
+	}
 }
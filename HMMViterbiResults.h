@@ -19,6 +19,8 @@
  *
  *	resultsWithoutSegments() - returns a string of all results except segments
  *	allResults() - returns a string of all results (including segements)
+ *	writeResultsWithoutSegments(out), writeAllResults(out) - append the same
+ *		results to an OutputBuffer
  *
  *  Created on: 2-15-13
  *      Author: tomkolar
@@ -38,7 +40,7 @@ public:
 	// Constuctors
 	// ==============================================
 	HMMViterbiResults();
-	HMMViterbiResults(int iteration, int numberOfStates);
+	HMMViterbiResults(int iteration, int numberOfStates, ColumnDictionary* columnDictionary);
 
 	// Destructor
 	// =============================================
@@ -50,9 +52,10 @@ public:
 	vector<int> stateCounts;
 	vector<int> segmentCounts;
 	map<int,vector<pair<int,int>>> segments;
-	map<int, map<string, int>> emissionCounts;
+	vector<vector<int>> emissionCounts;	// [state][column id]
 	vector<vector<int>> transitionCounts;
-	HMMProbabilities* probabilities;
+	HMMProbabilities* probabilities;		// owned, deleted with the results
+	int numResidues;					// distinct alignment columns
 
 	// Public Methods
 	// =============================================
@@ -60,29 +63,40 @@ public:
 	// string resultsWithoutSegments()
 	//  Purpose:
 	//		Returns a string representing the viterbi results for 
-	//		a particular iteration
+	//		a particular iteration (see writeResultsWithoutSegments)
+	string resultsWithoutSegments();
+
+	// string allResults()
+	//  Purpose:
+	//		Returns a string representing the viterbi results for 
+	//		a particular iteration (see writeAllResults)
+	string allResults();
+
+	// writeResultsWithoutSegments(OutputBuffer& out)
+	//  Purpose:
+	//		Appends the viterbi results for a particular iteration to out
 	//
 	//		format:
 	//			<result type="viterbi_iteration" iteration="<< iteration >>">
-	//				<<stateHistogramResultsString>>
-	//				<<segmentHistogramResultsString>>
-	//				<<probabiltiesResultsString>>
+	//				<<stateHistogramResults>>
+	//				<<segmentHistogramResults>>
+	//				<<probabiltiesResults>>
 	//			</result>
-	string resultsWithoutSegments();
+	void writeResultsWithoutSegments(OutputBuffer& out);
 
-	// string allResults()
+	// writeAllResults(OutputBuffer& out)
 	//  Purpose:
-	//		Returns a string representing the viterbi results for 
-	//		a particular iteration
+	//		Appends the viterbi results for a particular iteration,
+	//		including the segments, to out
 	//
 	//		format:
 	//			<result type="viterbi_iteration" iteration="<< iteration >>">
-	//				<<stateHistogramResultsString>>
-	//				<<segmentHistogramResultsString>>
-	//				<<probabiltiesResultsString>>
+	//				<<stateHistogramResults>>
+	//				<<segmentHistogramResults>>
+	//				<<probabiltiesResults>>
 	//			</result>
-	//			<<segmentResultsString>>
-	string allResults();
+	//			<<segmentResults>>
+	void writeAllResults(OutputBuffer& out);
 
 	// calculateProbabilities(HMMProbabilities* previousProbs)
 	//  Purpose:
@@ -98,110 +112,117 @@ public:
 	//		probabilites - will be populated
 	void calculateProbabilities(HMMProbabilities* previousProbs);
 
+	// gatherCounts(const vector<unsigned char>& statePath, const vector<int>& symbols,
+	//				int firstPosition, int offset, const vector<pair<int, int> >& coordinateBreaks)
+	//  Purpose:
+	//		Gathers the state, emission, transition and segment counts from a
+	//		decoded state path (one state per sequence position) and the
+	//		column id of each position, starting at firstPosition.
+	//		Segment coordinates are position + offset, or from the
+	//		alignment's (column, coordinate) breaks if it has any (a MAF
+	//		region), in which case segments are also split at every break
+	//		so none covers unaligned coordinates.
+	//
+	//		The path is split into chunks that are counted in parallel into
+	//		dense per-thread count arrays and merged at the end.  Segments are
+	//		extracted from the whole path in one SIMD pass (see
+	//		StatePathUtilities::extractRuns), so runs that cross a chunk edge
+	//		need no stitching.  The results are identical to walking the path
+	//		one node at a time.
+	//	Postconditions:
+	//		stateCounts, emissionCounts, transitionCounts, segmentCounts and
+	//		segments - populated
+	void gatherCounts(const vector<unsigned char>& statePath, const vector<int>& symbols,
+		int firstPosition, int offset, const vector<pair<int, int> >& coordinateBreaks);
+
 private:
 
+	// Private Types
+	// =============================================
+
+	// Counts gathered for one chunk of the state path
+	struct ChunkCounts {
+		vector<int> stateCounts;
+		vector<int> emissionCounts;		// [state * numResidues + column id]
+		vector<int> transitionCounts;	// [state * numStates + next state]
+	};
+
 	// Private Methods
 	// =============================================
 
-	// string stateHistogramResultsString()
+	// gatherChunkCounts(const vector<unsigned char>& statePath, const vector<int>& symbols,
+	//					 int start, int end, ChunkCounts& counts)
 	//  Purpose:
-	//		Returns a string representing the state histogram
+	//		Gathers the counts for the positions [start, end) of the path.  The
+	//		transition from end - 1 to end is counted here as well (if end is
+	//		not the end of the path).
+	void gatherChunkCounts(const vector<unsigned char>& statePath, const vector<int>& symbols,
+		int start, int end, ChunkCounts& counts);
+
+	// Private Methods
+	// =============================================
+
+	// writeStateHistogramResults(OutputBuffer& out)
+	//  Purpose:
+	//		Appends the state histogram to out
 	//
 	//		format:
 	//			<result type="state_histogram">
 	//				<<state>>=<<state count>>,
 	//			</result>
-	string stateHistogramResultsString();
+	void writeStateHistogramResults(OutputBuffer& out);
 
-	// string segmentHistogramResultsString()
+	// writeSegmentHistogramResults(OutputBuffer& out)
 	//  Purpose:
-	//		Returns a string representing the segment histogram
+	//		Appends the segment histogram to out
 	//
 	//		format:
 	//			<result type="segment_histogram">
 	//				<<state>>=<<segment count>>,
 	//			</result>
-	string segmentHistogramResultsString();
+	void writeSegmentHistogramResults(OutputBuffer& out);
 
-	// string probabilitiesResultsString()
+	// writeSegmentResults(OutputBuffer& out)
 	//  Purpose:
-	//		Returns a string representing the probabilites
-	//
-	//		format:
-	//			<<statesResultsString>>
-	//			<<initiationProbabilitesResultsString>>
-	//			<<transmissionProbabilitesResultsString>>
-	//			...
-	//			<<emissionProbabilitesResultsString>>
-	//			...
-	string probabilitiesResultsString();
-
-	// string segmentResultsString()
-	//  Purpose:
-	//		Returns a string representing the segments
+	//		Appends the ten longest conserved (state 2) segments, longest
+	//		first, to out
 	//
 	//		format:
 	//			<result type="segments">
 	//				(segment1start, segment1end),(segment2start, segment2end),...
 	//			</result>
-	string segmentResultsString();
+	void writeSegmentResults(OutputBuffer& out);
 
-	// string statesResultsString()
+	// writeTransitionCountsResults(OutputBuffer& out)
 	//  Purpose:
-	//		Returns a string representing the states
+	//		Appends the transimission counts to out
 	//
 	//		format:
-	//			<result type="states">
-	//				<<state1>>,<<state2>>,...
-	//			</result>
-	string statesResultsString();
-
-	// string intitiationProbabiltiesResultsString()
-	//  Purpose:
-	//		Returns a string representing the initiation probablities
-	//
-	//		format:
-	//			<result type="initiation_probabilites">
-	//				<<state>>=<<initiation probability>>,
-	//			</result>
-	string intitiationProbabiltiesResultsString();
-
-	// transitionProbablitiesResultsString(int state)
-	//  Purpose:
-	//		Returns a string representing the transition probablities for a state
-	//
-	//		format:
-	//			<result type="transition_probabilites" state="<<state>>">
-	//				<<to state>>=<<transition probability>>,
+	//			<result type="transitionCounts">
+	//				<<transition>>=<<transition count>>,
 	//			</result>
-	string transitionProbablitiesResultsString(int state);
+	void writeTransitionCountsResults(OutputBuffer& out);
 
-	// emissionProbablitiesResultsString(int state)
+	// vector<pair<int, int>> longestSegments(int state, size_t k)
 	//  Purpose:
-	//		Returns a string representing the emission probablities for a state
-	//
-	//		format:
-	//			<result type="emission_probabilites" state="<<state>>">
-	//				<<residue>>=<<emission probability>>,
-	//			</result>
-	string emissionProbablitiesResultsString(int state);
+	//		Returns the k longest segments for the state, longest first.  A
+	//		min-heap of the k longest seen so far is kept while scanning
+	//		the segments, which is O(n log k) instead of a full sort.
+	vector<pair<int, int>> longestSegments(int state, size_t k);
 
-	// transitionCountsResultsString(int state)
-	//  Purpose:
-	//		Returns a string representing the transimission counts
-	//
-	//		format:
-	//			<result type="transitionCounts">
-	//				<<transition>>=<<transition count>>,
-	//			</result>
-	string transitionCountsResultsString();
-	
 	struct sort_segment {
 		bool operator()(const std::pair<int,int> &left, const std::pair<int,int> &right) {
 			return left.second - left.first < right.second - right.first;
 		}
 	};
 
+	// Orders segments so the longest is at the top of a min-heap
+	struct longer_segment {
+		bool operator()(const std::pair<int,int> &left, const std::pair<int,int> &right) {
+			return left.second - left.first > right.second - right.first;
+		}
+	};
+
 };
 
 #endif // HMMVITERBIRESULTS_H
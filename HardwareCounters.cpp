@@ -0,0 +1,201 @@
+/*
+ * HardwareCounters.cpp
+ *
+ *	The HardwareCounters object reads the calling thread's CPU
+ *  performance counters through perf_event_open.  See
+ *  HardwareCounters.h.
+ *
+ *  Created on: 10-18-26
+ */
+#include "HardwareCounters.h"
+#include <atomic>
+#include <mutex>
+#include <cstring>
+#include <cerrno>
+#include <cstdint>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// Availability, shared by every thread
+static atomic<bool> unavailable(false);
+static atomic<bool> eventUncounted[HardwareCounters::numEvents];
+static mutex reasonLock;
+static string unavailableReason;
+
+// setUnavailable(string reason)
+//  Purpose:
+//		Stops every thread from reading counters, keeping the first
+//		reason given
+static void setUnavailable(string reason) {
+	lock_guard<mutex> guard(reasonLock);
+	if (!unavailable) {
+		unavailableReason = reason;
+		unavailable = true;
+	}
+}
+
+#ifdef __linux__
+// string openFailureReason(int error)
+//  Purpose:
+//		Returns why opening the counters failed with errno error
+static string openFailureReason(int error) {
+	if (error == ENOENT || error == EOPNOTSUPP || error == ENODEV)
+		return "Hardware counters are not available (no PMU, as in many virtual machines and containers)";
+	if (error == EACCES || error == EPERM)
+		return "Hardware counters are not permitted (see /proc/sys/kernel/perf_event_paranoid)";
+	if (error == ENOSYS)
+		return "Hardware counters are not supported by the kernel";
+	return string("Opening hardware counters failed: ") + strerror(error);
+}
+
+// The counters of one thread, closed when it exits
+struct ThreadCounters {
+	bool tried;						// opening has been attempted
+	int leader;						// group leader (cycles), -1 if not open
+	int fds[HardwareCounters::numEvents];
+	int positions[HardwareCounters::numEvents];	// index in a group read, -1 if not counted
+	int numOpen;
+
+	ThreadCounters() {
+		tried = false;
+		leader = -1;
+		numOpen = 0;
+		for (int event = 0; event < HardwareCounters::numEvents; event++) {
+			fds[event] = -1;
+			positions[event] = -1;
+		}
+	}
+
+	~ThreadCounters() {
+		for (int event = 0; event < HardwareCounters::numEvents; event++)
+			if (fds[event] >= 0)
+				close(fds[event]);
+	}
+};
+
+static thread_local ThreadCounters threadCounters;
+
+// bool openCounters(ThreadCounters& counters)
+//  Purpose:
+//		Opens the calling thread's counters as one group led by the
+//		cycle counter, returning false if the leader cannot be opened
+static bool openCounters(ThreadCounters& counters) {
+	static const uint64_t configs[HardwareCounters::numEvents] = {
+		PERF_COUNT_HW_CPU_CYCLES,
+		PERF_COUNT_HW_INSTRUCTIONS,
+		PERF_COUNT_HW_CACHE_MISSES,
+		PERF_COUNT_HW_BRANCH_MISSES
+	};
+
+	for (int event = 0; event < HardwareCounters::numEvents; event++) {
+		struct perf_event_attr attributes;
+		memset(&attributes, 0, sizeof(attributes));
+		attributes.size = sizeof(attributes);
+		attributes.type = PERF_TYPE_HARDWARE;
+		attributes.config = configs[event];
+		attributes.exclude_kernel = 1;
+		attributes.exclude_hv = 1;
+		attributes.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+		int fd = syscall(SYS_perf_event_open, &attributes, 0, -1, counters.leader, PERF_FLAG_FD_CLOEXEC);
+		if (fd < 0) {
+			if (event == HardwareCounters::cyclesEvent) {
+				setUnavailable(openFailureReason(errno));
+				return false;
+			}
+			eventUncounted[event] = true;
+			continue;
+		}
+
+		if (counters.leader < 0)
+			counters.leader = fd;
+		counters.fds[event] = fd;
+		counters.positions[event] = counters.numOpen++;
+	}
+	return true;
+}
+#endif
+
+// Public Class Methods
+// =============================================
+
+// bool read(Reading& reading)
+//  Purpose:
+//		Sets reading to the calling thread's counts, opening its
+//		counters if this is its first read.  Returns false if
+//		counters are not available.
+bool HardwareCounters::read(Reading& reading) {
+	if (unavailable)
+		return false;
+
+#ifdef __linux__
+	ThreadCounters& counters = threadCounters;
+	if (!counters.tried) {
+		counters.tried = true;
+		if (!openCounters(counters))
+			return false;
+	}
+	if (counters.leader < 0)
+		return false;
+
+	// nr, time enabled, time running, then one value per open event
+	uint64_t buffer[3 + numEvents];
+	ssize_t size = ::read(counters.leader, buffer, sizeof(buffer));
+	if (size < (ssize_t) ((3 + counters.numOpen) * sizeof(uint64_t))) {
+		setUnavailable("Reading the counters failed");
+		return false;
+	}
+
+	// Scaled up if the counters were multiplexed
+	double scale = 1;
+	if (buffer[2] > 0 && buffer[2] < buffer[1])
+		scale = (double) buffer[1] / buffer[2];
+	for (int event = 0; event < numEvents; event++) {
+		int position = counters.positions[event];
+		reading.values[event] = (position < 0) ? -1 : (long long) (buffer[3 + position] * scale);
+	}
+	return true;
+#else
+	setUnavailable("Hardware counters are only read on Linux");
+	return false;
+#endif
+}
+
+// bool isAvailable()
+//  Purpose:
+//		Returns false once opening counters has failed
+bool HardwareCounters::isAvailable() {
+	return !unavailable;
+}
+
+// bool isCounted(Event event)
+//  Purpose:
+//		Returns false if the event could not be counted by some
+//		thread
+bool HardwareCounters::isCounted(Event event) {
+	return !unavailable && !eventUncounted[event];
+}
+
+// string getUnavailableReason()
+//  Purpose:
+//		Returns why counters are not available (empty if they are)
+string HardwareCounters::getUnavailableReason() {
+	lock_guard<mutex> guard(reasonLock);
+	return unavailableReason;
+}
+
+// string eventName(Event event)
+//  Purpose:
+//		Returns the name of an event in the report
+string HardwareCounters::eventName(Event event) {
+	switch (event) {
+		case cyclesEvent:			return "cycles";
+		case instructionsEvent:		return "instructions";
+		case cacheMissesEvent:		return "cacheMisses";
+		case branchMissesEvent:		return "branchMisses";
+		default:					return "unknown";
+	}
+}
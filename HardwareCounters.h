@@ -0,0 +1,93 @@
+/*
+ * HardwareCounters.h
+ *
+ *	This is the header file for the HardwareCounters object.
+ *  HardwareCounters is a container for reading the CPU's performance
+ *  counters (cycles, instructions, cache misses and branch misses) for
+ *  the calling thread through Linux perf_event_open, so Instrumentation
+ *  can report how each phase uses the processor as well as how long it
+ *  takes.
+ *
+ *	The counters of a thread are opened (as one group, so they count
+ *  over the same time) the first time it reads them and stay open until
+ *  it exits.  They count user space only, which needs no privileges
+ *  with the usual perf_event_paranoid setting of 2 or less.
+ *
+ *	Counters are often not available: containers and virtual machines
+ *  without a virtual PMU, a perf_event_paranoid of 3, or another OS.
+ *  Then read() returns false and getUnavailableReason() says why; no
+ *  thread tries again after the first failure.  An event the CPU does
+ *  not have (e.g. cache misses on some virtual PMUs) is left out and
+ *  reads as -1 while the others are counted.
+ *
+ *	When the kernel multiplexes the counters with other users, the
+ *  counts are scaled up by the fraction of time they were running.
+ *
+ *	Typical use:
+ *		HardwareCounters::Reading start, end;
+ *		if (HardwareCounters::read(start)) {
+ *			...
+ *			HardwareCounters::read(end);
+ *			long long cycles = end.values[HardwareCounters::cyclesEvent] - start.values[...];
+ *		}
+ *
+ *  Created on: 10-18-26
+ */
+
+#ifndef HARDWARECOUNTERS_H
+#define HARDWARECOUNTERS_H
+
+#include <string>
+using namespace std;
+
+class HardwareCounters
+{
+public:
+	// Public Types
+	// =============================================
+	enum Event {
+		cyclesEvent,
+		instructionsEvent,
+		cacheMissesEvent,				// last level cache misses
+		branchMissesEvent,
+		numEvents
+	};
+
+	// The counts of the calling thread since its counters were opened
+	struct Reading {
+		long long values[numEvents];	// -1 for an event not counted
+	};
+
+	// Public Class Methods
+	// =============================================
+
+	// bool read(Reading& reading)
+	//  Purpose:
+	//		Sets reading to the calling thread's counts, opening its
+	//		counters if this is its first read.  Returns false if
+	//		counters are not available.
+	static bool read(Reading& reading);
+
+	// bool isAvailable()
+	//  Purpose:
+	//		Returns false once opening counters has failed
+	static bool isAvailable();
+
+	// bool isCounted(Event event)
+	//  Purpose:
+	//		Returns false if the event could not be counted by some
+	//		thread
+	static bool isCounted(Event event);
+
+	// string getUnavailableReason()
+	//  Purpose:
+	//		Returns why counters are not available (empty if they are)
+	static string getUnavailableReason();
+
+	// string eventName(Event event)
+	//  Purpose:
+	//		Returns the name of an event in the report
+	static string eventName(Event event);
+};
+
+#endif // HARDWARECOUNTERS_H
@@ -66,12 +66,18 @@
 #include "HMMTransition.h"
 #include "HMMProbabilities.h"
 #include "MathUtilities.h"
+#include "StatePathUtilities.h"
+#include "HMMPathFile.h"
+#include "HMMDecoder.h"
+#include "ParameterStore.h"
+#include "Instrumentation.h"
 #include <sstream>
 #include <cmath>
 #include <cfloat>
 #include <iostream>
 #include <limits>
 #include <stdexcept> 
+#include <chrono>
 
 // const variable initialization
 // ==============================================
@@ -80,29 +86,45 @@ const int HiddenMarkovModel::numStates = 3;
 // Constuctors
 // ==============================================
 HiddenMarkovModel::HiddenMarkovModel() {
+	multiAlignFile = NULL;
+	modelBuilt = false;
+	probabilities = NULL;
+	parameterStore = NULL;
 }
 
 HiddenMarkovModel::HiddenMarkovModel(MultipleAlignmentFile* aMultiAlignFile,
 		string neutralCountsFileName, string conservedCountsFileName) {
 	multiAlignFile = aMultiAlignFile;
 	modelBuilt = false;
-	probabilities = HMMProbabilities::initialProbabilities(neutralCountsFileName, conservedCountsFileName);
-	
-	// Print out the initial probabilities
-	cout << probabilities->probabilitiesResultsString();
+	parameterStore = NULL;
+	probabilities = HMMProbabilities::initialProbabilities(neutralCountsFileName, conservedCountsFileName,
+		multiAlignFile->getColumnDictionary());
+}
+
+HiddenMarkovModel::HiddenMarkovModel(MultipleAlignmentFile* aMultiAlignFile,
+		HMMProbabilities* someProbabilities) {
+	multiAlignFile = aMultiAlignFile;
+	modelBuilt = false;
+	probabilities = someProbabilities;
+	parameterStore = NULL;
 }
 
 // Destructor
 // =============================================
 HiddenMarkovModel::~HiddenMarkovModel() {
+	// The model graph goes with the arena
+	clearViterbiResults();
+	delete probabilities;
 }
 
 // Public Methods
 // =============================================
 
-// viterbiTraining(int numIterations)
+// viterbiTraining(int numIterations, bool accelerate)
 //  Purpose: 
 //		Perform viterbi training for the number of iterations specified.
+//		If accelerate is set, SQUAREM extrapolation is used instead (see
+//		squaremTraining), taking the same numIterations EM steps.
 //
 //		Each iteration consists of the following steps
 //			1. Build Hidden Markov Model and calculate viterbi weight
@@ -117,95 +139,228 @@ HiddenMarkovModel::~HiddenMarkovModel() {
 //		probabilities - modified at end of each training iteration to 
 //						reflect calculated probabilities from the viterbi
 //						results
-void HiddenMarkovModel::viterbiTraining(int numIterations) {
-
-	for (int iteration = 1; iteration <= numIterations; iteration++) {
-		// Build the model and calculate the weights
-		buildAndCalculateModel(false);
-		cout << "Model Built.\n";
-
-		// Gather the viterbi reuslts
-		HMMViterbiResults* aViterbiResults = gatherViterbiResults(iteration);
-		viterbiResults.push_back(aViterbiResults);
-		cout << "Viterbi Results Gathered.\n";
-
-		// Reset the probabilities to the viterbi calculated ones for the next
-		// iteration
-		probabilities = aViterbiResults->probabilities;
-	}
+void HiddenMarkovModel::viterbiTraining(int numIterations, bool accelerate) {
+	int iterations;
+	if (accelerate)
+		squaremTraining(true, numIterations, iterations, std::numeric_limits<double>::quiet_NaN());
+	else
+		plainEMTraining(true, numIterations, iterations);
 }
 
-// baumWelchTraining()
+// baumWelchTraining(bool accelerate)
 //  Purpose: 
 //		Use the Baum-Welch (forward-backward) algorithm to estimate
-//		the paramters for the model
+//		the paramters for the model.  If accelerate is set, SQUAREM
+//		extrapolation is used (see squaremTraining).
 //
 //		Each iteration consists of the following steps
 //			1. Build Hidden Markov Model and calculate forward-backward weight
 //			   for each node
-void HiddenMarkovModel::baumWelchTraining() {
-	bool trainingDone = false;
-	int iterationCounter = 0;
-	double previousLogLikelihood = 0;
-	while (!trainingDone) {
-		// Build the model and calculate the forward/backward probabilites
-		buildAndCalculateModel(true);
-		calculateLogBackwardProbabilities();
-		calculateLogConditionalProbabilities();
+void HiddenMarkovModel::baumWelchTraining(bool accelerate) {
+	int iterations;
+	double logLikelihood;
+	if (accelerate)
+		logLikelihood = squaremTraining(false, 0, iterations, std::numeric_limits<double>::quiet_NaN());
+	else
+		logLikelihood = plainEMTraining(false, 0, iterations);
+
+	cout << baumWelchResultsString(iterations, logLikelihood);
+}
 
-		// Calculate the new transition/emission probabilties
-		calculateBaumWelchEmissionProbabilities();
-		calculateBaumWelchInitiationProbabilities();
-		calculateBaumWelchTransitionProbabilities();
+// viterbiDecode(DecoderWorkspace* workspace)
+//  Purpose: 
+//		Finds the viterbi path with the current probabilities (e.g. ones
+//		loaded from a model file) without training.  The results for
+//		the path are gathered as for one viterbi training iteration, but
+//		the probabilities are left unchanged.
+//
+//		The path is found by HMMDecoder without building the model graph.
+//		Passing a workspace that outlives the model lets a caller decoding
+//		region after region reuse its buffers; otherwise a temporary one
+//		is used.
+//  Postconditions:
+//		viterbiResults - contains the results for the path
+void HiddenMarkovModel::viterbiDecode(DecoderWorkspace* workspace) {
+	DecoderWorkspace temporaryWorkspace;
+	if (workspace == NULL)
+		workspace = &temporaryWorkspace;
+
+	const int* columnIds = multiAlignFile->getColumnIds();
+	int seqLength = multiAlignFile->getSequenceLength();
+	symbols.assign(columnIds, columnIds + seqLength);
+
+	HMMDecoder decoder(probabilities);
+	decoder.viterbi(columnIds, seqLength, *workspace);
+	statePath.assign(workspace->getStatePath(), workspace->getStatePath() + seqLength);
+	workspace->reset();
+
+	viterbiResults.push_back(gatherViterbiResults(1));
+}
 
-		// Calcualte likelihood and check if done
-		double currentLogLikelihood = model.back()->logLikelihood();
-		if (abs(previousLogLikelihood - currentLogLikelihood) < 0.1)
-			trainingDone = true;
+// resetModel()
+//  Purpose: 
+//		Releases the model graph and the viterbi results, keeping the
+//		probabilities.  The graph is freed in bulk with the arena, so a
+//		long running process can decode again without the memory of
+//		the previous model building up.
+//  Postconditions:
+//		model - empty, rebuilt by the next training or decode
+//		viterbiResults - empty
+void HiddenMarkovModel::resetModel() {
+	model.clear();
+	modelBuilt = false;
+	arena.reset();
+	statePath.clear();
+	clearViterbiResults();
+}
 
-		// Set values for next iteration
-		previousLogLikelihood = currentLogLikelihood;
-		iterationCounter++;
+// compareEMAcceleration(bool viterbi, int numIterations)
+//  Purpose: 
+//		Runs plain EM training (viterbi or Baum-Welch) and then SQUAREM
+//		accelerated training from the same starting probabilities.  Both
+//		runs stop by the same rule, with numIterations as their EM step
+//		budget, and SQUAREM also stops as soon as it reaches the final
+//		likelihood of plain EM, so the iterations saved are the EM steps
+//		it did not need to get as far.  The iterations and wall-clock
+//		time saved are logged and the probabilities (and viterbi results
+//		and path) of whichever run ended with the higher likelihood are
+//		kept, so the result is never worse than plain EM.  The node
+//		scores of the model graph are left from the last SQUAREM step.
+//  Postconditions:
+//		probabilities - set to the better of the two trained probabilities
+//		viterbiResults - results of the kept run (viterbi only)
+//		statePath - viterbi path of the kept run (viterbi only)
+void HiddenMarkovModel::compareEMAcceleration(bool viterbi, int numIterations) {
+	HMMProbabilities* initialProbabilities = new HMMProbabilities(*probabilities);
+
+	// Plain EM
+	int plainIterations;
+	chrono::steady_clock::time_point plainStart = chrono::steady_clock::now();
+	double plainLogLikelihood = plainEMTraining(viterbi, numIterations, plainIterations);
+	chrono::duration<double> plainSeconds = chrono::steady_clock::now() - plainStart;
+	HMMProbabilities* plainProbabilities = probabilities;
+	vector<HMMViterbiResults*> plainResults = viterbiResults;
+	vector<unsigned char> plainStatePath = statePath;
+
+	// SQUAREM from the same starting probabilities (the plain EM
+	// probabilities and results are kept aside until one run is chosen)
+	probabilities = initialProbabilities;
+	viterbiResults.clear();
+	int evaluations;
+	chrono::steady_clock::time_point squaremStart = chrono::steady_clock::now();
+	double squaremLogLikelihood = squaremTraining(viterbi, numIterations, evaluations, plainLogLikelihood);
+	chrono::duration<double> squaremSeconds = chrono::steady_clock::now() - squaremStart;
+
+	cout
+		<< "EM Acceleration:"
+		<< "  Plain Iterations: " << plainIterations
+		<< "  SQUAREM Iterations: " << evaluations
+		<< "  Iterations Saved: " << plainIterations - evaluations
+		<< "  Wall-Clock Saved: " << (plainSeconds - squaremSeconds).count() << "s"
+		<< "\n";
+
+	// Never do worse than plain EM
+	if (MathUtilities::isNaN(squaremLogLikelihood) || squaremLogLikelihood < plainLogLikelihood) {
 		cout
-			<< "Iteration: " << iterationCounter 
-			<< "  Likelihood: " << currentLogLikelihood
-			<< "\n";
+			<< "EM Acceleration: SQUAREM likelihood " << squaremLogLikelihood
+			<< " below plain EM likelihood " << plainLogLikelihood
+			<< ", keeping plain EM probabilities\n";
+		replaceProbabilities(plainProbabilities);
+		clearViterbiResults();
+		viterbiResults = plainResults;
+		statePath.swap(plainStatePath);
+		evaluations = plainIterations;
+		squaremLogLikelihood = plainLogLikelihood;
+	}
+	else {
+		delete plainProbabilities;
+		for (HMMViterbiResults* aViterbiResults : plainResults)
+			delete aViterbiResults;
 	}
+	publishProbabilities();
 
-	cout << baumWelchResultsString(iterationCounter, previousLogLikelihood);
+	if (!viterbi)
+		cout << baumWelchResultsString(evaluations, squaremLogLikelihood);
 }
 
 string HiddenMarkovModel::baumWelchResultsString(int iterations, double logLikelihood) {
-	stringstream ss;
+	OutputBuffer out;
+	writeBaumWelchResults(out, iterations, logLikelihood);
+	return out.str();
+}
 
+void HiddenMarkovModel::writeBaumWelchResults(OutputBuffer& out, int iterations, double logLikelihood) {
 	// EM Result header
-	ss << "    <result type=\"EM_result\">\n";
+	out.append("    <result type=\"EM_result\">\n");
 
 	// Iterations
-	ss
-		<< "      <result type=\"iterations\">"
-		<< iterations
-		<< "</result>\n";
+	out.append("      <result type=\"iterations\">");
+	out.appendInt(iterations);
+	out.append("</result>\n");
 
 	// Log Likelihood
-	ss
-		<< "      <result type=\"log_likelihood\">"
-		<< logLikelihood
-		<< "</result>\n";
+	out.append("      <result type=\"log_likelihood\">");
+	out.appendDouble(logLikelihood);
+	out.append("</result>\n");
 
 	// Probabilities
-	ss << probabilities->probabilitiesResultsString();
+	probabilities->writeProbabilitiesResults(out);
 
 	// EM Result footer
-	ss << "    </result>\n";
+	out.append("    </result>\n");
+}
 
-	return ss.str();
+// setParameterStore(ParameterStore* aParameterStore)
+//  Purpose: 
+//		Publishes the current probabilities to aParameterStore, and the
+//		probabilities of every completed training iteration (or SQUAREM
+//		cycle) from then on.  NULL stops publishing.  The store is not
+//		owned.
+void HiddenMarkovModel::setParameterStore(ParameterStore* aParameterStore) {
+	parameterStore = aParameterStore;
+	publishProbabilities();
 }
 
 // string allScoresResultsString()
 //  Purpose:
 //		Returns a string representing the score (weight) from each node
-//		in each position of the viterbi path.
+//		in each position of the viterbi path (see writeAllScoresResults)
+//  Preconditions:
+//		viterbiTraining has been run
+string HiddenMarkovModel::allScoresResultsString() {
+	OutputBuffer out;
+	writeAllScoresResults(out);
+	return out.str();
+}
+
+// string pathStatesResultsString()
+//  Purpose:
+//		Returns a string representing the state for each position in the
+//		viterbi path (see writePathStatesResults)
+//  Preconditions:
+//		viterbiTraining has been run
+string HiddenMarkovModel::pathStatesResultsString() {
+	OutputBuffer out;
+	writePathStatesResults(out);
+	return out.str();
+}
+
+// string viterbiResultsString()
+//  Purpose:
+//		Returns a string representing the results for each iteration in
+//		the viterbi training (see writeViterbiResults)
+//  Preconditions:
+//		viterbiTraining has been run
+string HiddenMarkovModel::viterbiResultsString() {
+	OutputBuffer out;
+	writeViterbiResults(out);
+	return out.str();
+}
+
+// writeAllScoresResults(OutputBuffer& out)
+//  Purpose:
+//		Appends the score (weight) from each node in each position of
+//		the viterbi path to out.
 //
 //		format:
 //			Position: <positionId>
@@ -214,51 +369,48 @@ string HiddenMarkovModel::baumWelchResultsString(int iterations, double logLikel
 //			  ...
 //  Preconditions:
 //		viterbiTraining has been run
-string HiddenMarkovModel::allScoresResultsString() {
-	stringstream ss;
-
+void HiddenMarkovModel::writeAllScoresResults(OutputBuffer& out) {
 	for (HMMPosition* aPosition : model) {
-		ss << "Position: " << aPosition->id << "\n";
+		out.append("Position: ");
+		out.appendInt(aPosition->id);
+		out.append('\n');
 		for (HMMNode* node : aPosition->nodes) {
-			ss << "  Node: ("
-			   <<  node->state
-			   << ", "
-			   << node->highestWeight
-			   << ")\n";
+			out.append("  Node: (");
+			out.appendInt(node->state);
+			out.append(", ");
+			out.appendDouble(node->highestWeight);
+			out.append(")\n");
 		}
 	}
-
-	return ss.str();
 }
 
-// string pathStatesResultsString()
+// writePathStatesResults(OutputBuffer& out)
 //  Purpose:
-//		Returns a string representing the state for each position in the
-//		viterbi path.
+//		Appends the state for each position in the viterbi path to out.
 //
 //		format:
 //			<position1State><position2State> ... <positionNstate>
 //  Preconditions:
 //		viterbiTraining has been run
-string HiddenMarkovModel::pathStatesResultsString() {
-	stringstream ss;
-
-	HMMPosition* lastPosition = model.back();
-	HMMNode* aNode = lastPosition->highestScoringNode();
-	while (aNode->state != 0) {
-		ss << aNode->state;
-		aNode = aNode->highestWeightPreviousNode;
+void HiddenMarkovModel::writePathStatesResults(OutputBuffer& out) {
+	const size_t blockLength = 4096;
+	char block[blockLength];
+	size_t used = 0;
+	for (unsigned char state : statePath) {
+		block[used++] = (char) ('0' + state);
+		if (used == blockLength) {
+			out.append(block, used);
+			used = 0;
+		}
 	}
-
-	string reversePath = ss.str();
-	return string(reversePath.rbegin(), reversePath.rend());
+	out.append(block, used);
 }
 
-// string viterbiResultsString()
+// writeViterbiResults(OutputBuffer& out)
 //  Purpose:
-//		Returns a string representing the results for each iteration in
-//		the viterbi training. See HMMViterbiResults.resultsWithoutSegments()
-//		and HMMViterbiResults.allResults() for details on the format of
+//		Appends the results for each iteration in the viterbi training to
+//		out. See HMMViterbiResults.writeResultsWithoutSegments() and
+//		HMMViterbiResults.writeAllResults() for details on the format of
 //		the viterbi results for a particular iteration.
 //
 //		format:
@@ -268,23 +420,104 @@ string HiddenMarkovModel::pathStatesResultsString() {
 //			<viterbiResultsIterationLast.allResults()>
 //  Preconditions:
 //		viterbiTraining has been run
-string HiddenMarkovModel::viterbiResultsString() {
-	stringstream ss;
-
+void HiddenMarkovModel::writeViterbiResults(OutputBuffer& out) {
 	int numResults = viterbiResults.size();
 	for (int i = 0; i < numResults; i++) {
 		if (i < numResults -1)
-			ss << viterbiResults[i]->resultsWithoutSegments();
+			viterbiResults[i]->writeResultsWithoutSegments(out);
 		else
-			ss << viterbiResults[i]->allResults();
+			viterbiResults[i]->writeAllResults(out);
 	}
-	
-	return ss.str();
+}
+
+// writeSegmentsBed(BedFileWriter& bedFile, int state)
+//  Purpose:
+//		Writes every segment of the state in the viterbi path to the BED
+//		file as it is found.  The path is scanned for state changes one
+//		block at a time, so segments are streamed out a block at a time
+//		rather than collected first.  Segments are split at the
+//		alignment's coordinate breaks, so none covers unaligned
+//		coordinates.
+//  Preconditions:
+//		viterbiTraining has been run
+void HiddenMarkovModel::writeSegmentsBed(BedFileWriter& bedFile, int state) {
+	const int blockLength = 1 << 20;
+	int length = statePath.size();
+	if (length == 0)
+		return;
+
+	const unsigned char* states = statePath.data();
+	vector<int> changes;
+	vector<StatePathUtilities::StateRun> segments;
+	int runStart = 0;
+	for (int blockStart = 1; blockStart < length; blockStart += blockLength) {
+		changes.clear();
+		StatePathUtilities::findStateChanges(states, blockStart, min(length, blockStart + blockLength), changes);
+		for (int change : changes) {
+			if (states[runStart] == state) {
+				StatePathUtilities::StateRun segment = { state, runStart, change - 1 };
+				segments.push_back(segment);
+			}
+			runStart = change;
+		}
+		writeSegments(bedFile, segments);
+	}
+	if (states[runStart] == state) {
+		StatePathUtilities::StateRun segment = { state, runStart, length - 1 };
+		segments.push_back(segment);
+	}
+	writeSegments(bedFile, segments);
+
+	bedFile.flush();
+}
+
+// writePathFile(string fileName)
+//  Purpose:
+//		Writes the viterbi state path to a binary path file that can be
+//		queried by coordinate (see HMMPathFile).  Coordinates that are
+//		not in the alignment (between MAF blocks) have state 0.
+//  Preconditions:
+//		viterbiTraining has been run
+void HiddenMarkovModel::writePathFile(string fileName) {
+	vector<pair<int, int> >& coordinateBreaks = multiAlignFile->getCoordinateBreaks();
+	if (coordinateBreaks.size() <= 1) {
+		HMMPathFile::write(fileName, statePath, multiAlignFile->getChromosome(),
+			multiAlignFile->getCoordinate(0), numStates);
+		return;
+	}
+
+	// The path file covers a contiguous range of coordinates, so the
+	// coordinates skipped by the alignment get the start state (0)
+	int firstCoordinate = multiAlignFile->getCoordinate(0);
+	int lastCoordinate = multiAlignFile->getCoordinate(statePath.size() - 1);
+	vector<unsigned char> coordinateStates(lastCoordinate - firstCoordinate + 1, 0);
+	for (size_t i = 0; i < coordinateBreaks.size(); i++) {
+		int runStart = coordinateBreaks[i].first;
+		int runEnd = (i + 1 < coordinateBreaks.size()) ? coordinateBreaks[i + 1].first : statePath.size();
+		copy(statePath.begin() + runStart, statePath.begin() + runEnd,
+			coordinateStates.begin() + (coordinateBreaks[i].second - firstCoordinate));
+	}
+	HMMPathFile::write(fileName, coordinateStates, multiAlignFile->getChromosome(),
+		firstCoordinate, numStates);
 }
 
 // Private Methods
 // =============================================
 
+// writeSegments(BedFileWriter& bedFile, vector<StatePathUtilities::StateRun>& segments)
+//  Purpose:
+//		Writes the segments (runs of sequence positions, in order) to the
+//		BED file, split at the alignment's coordinate breaks, and clears
+//		them
+void HiddenMarkovModel::writeSegments(BedFileWriter& bedFile, vector<StatePathUtilities::StateRun>& segments) {
+	StatePathUtilities::splitRunsAtBreaks(segments, multiAlignFile->getCoordinateBreaks());
+	string& chromosome = multiAlignFile->getChromosome();
+	for (StatePathUtilities::StateRun& segment : segments)
+		bedFile.writeSegment(chromosome, multiAlignFile->getCoordinate(segment.start),
+			multiAlignFile->getCoordinate(segment.end));
+	segments.clear();
+}
+
 // buildAndCalculateModel(bool calculateForward)
 //  Purpose: 
 //		Build the hidden markov model (if not already built) and calculate
@@ -301,48 +534,52 @@ string HiddenMarkovModel::viterbiResultsString() {
 //			   following:
 //				a. create a HMMPosition object with one node for each state
 //				b. create HMMTransitions for this position
-//				c. calculate the viterbi weight or forwared probability for each
-//				   node in the position
-//				d. add the position to the model attribute
+//				c. add the position to the model attribute
+//			3. Calculate the viterbi weight or forward probability for each
+//			   node, position by position
+//
+//		Building and calculating are separate passes so each is timed as
+//		its own phase (see Instrumentation).  Building throws a
+//		runtime_error if no state can emit one of the columns.
 //
 //  Postconditions:
 //		model - contains HMMPosition objects for every position in the
 //				sequence from the fastaFile
 void HiddenMarkovModel::buildAndCalculateModel(bool calculateForward) {
 
-	if (modelBuilt) {
-		// Model already built so just recalculate the weights using
-		// the newly set probabilities
-		for (HMMPosition* aPosition : model) {
-			if (calculateForward)
-				aPosition->calculateLogForwardProbability();
-			else
-				calculateHighestWeightPath(aPosition);
+	if (!modelBuilt) {
+		Instrumentation::Timer timer(Instrumentation::buildPhase);
+
+		// Each position emits its column dictionary id
+		const int* columnIds = multiAlignFile->getColumnIds();
+		int seqLength = multiAlignFile->getSequenceLength();
+		timer.addColumns(seqLength);
+		symbols.assign(columnIds, columnIds + seqLength);
+		model.reserve(seqLength + 1);
+
+		// A column no state can emit leaves no path through the model
+		for (int seqPos = 0; seqPos < seqLength; seqPos++) {
+			bool emitted = false;
+			for (int state = 1; state < numStates && !emitted; state++)
+				emitted = !MathUtilities::isNaN(probabilities->logEmissionProbability(state, symbols[seqPos]));
+			if (!emitted)
+				throw runtime_error("No state can emit the alignment column at "
+					+ to_string(multiAlignFile->getCoordinate(seqPos)) + " (it has no emission probability)");
 		}
-	}
-	else {
-		vector<string>& sequence = multiAlignFile->getSequence();
 
 		// Create Start Position
-		HMMPosition* startPosition = new HMMPosition();
+		HMMPosition* startPosition = arena.create<HMMPosition>(arena);
 		model.push_back(startPosition);
 
 		// Iterate through the sequence and create model on the fly
 		HMMPosition* previousPosition = startPosition;
-		int seqLength = sequence.size();
 		for (int seqPos = 0; seqPos <= seqLength - 1; seqPos++) {
 			// Create a Position object with one node for each state
-			HMMPosition* aPosition = new HMMPosition(seqPos, sequence[seqPos], numStates, this);
+			HMMPosition* aPosition = arena.create<HMMPosition>(seqPos, symbols[seqPos], numStates, this, arena);
 
 			// Create the incoming transitions for the curent position
 			createTransitionsFor(aPosition, previousPosition);
 
-			// Calculate forward probability or highest weight path
-			if (calculateForward)
-				aPosition->calculateLogForwardProbability();
-			else
-				calculateHighestWeightPath(aPosition);
-
 			// Add position to the model
 			model.push_back(aPosition);
 
@@ -353,6 +590,18 @@ void HiddenMarkovModel::buildAndCalculateModel(bool calculateForward) {
 
 		modelBuilt = true;
 	}
+
+	// Calculate the weights using the current probabilities (the start
+	// position has no incoming transitions and is left as it is)
+	Instrumentation::Timer timer(calculateForward ? Instrumentation::expectationPhase : Instrumentation::viterbiPhase);
+	timer.addColumns(model.size() - 1);
+	for (HMMPosition* aPosition : model) {
+		if (calculateForward)
+			aPosition->calculateLogForwardProbability();
+		else
+			calculateHighestWeightPath(aPosition);
+	}
+	Instrumentation::count(Instrumentation::columnsCounter, model.size() - 1);
 }
 
 // calculateLogBackwaredPorbabilities()
@@ -391,7 +640,7 @@ void HiddenMarkovModel::calculateLogConditionalProbabilities() {
 	int numPositions = model.size();
 	for (HMMPosition* position : model) {
 		// Skip start node
-		if (position->id == 0)
+		if (position->isStartPosition())
 			continue;
 
 		// Node Probabilities (Gamma)
@@ -403,6 +652,283 @@ void HiddenMarkovModel::calculateLogConditionalProbabilities() {
 	}
 }
 
+// double emIteration(bool viterbi, int iteration)
+//  Purpose: 
+//		Performs one EM step (viterbi training or Baum-Welch) starting
+//		from the current probabilities and returns the log likelihood of
+//		the probabilities the step started from (the viterbi path weight
+//		for viterbi training).
+//  Postconditions:
+//		probabilities - set to the re-estimated probabilities
+//		viterbiResults - results for the iteration appended (viterbi only)
+double HiddenMarkovModel::emIteration(bool viterbi, int iteration) {
+	if (viterbi) {
+		// Build the model and calculate the weights
+		buildAndCalculateModel(false);
+		cout << "Model Built.\n";
+		double logLikelihood = model.back()->highestScoringNode()->highestWeight;
+
+		// Gather the viterbi reuslts
+		decodeStatePath();
+		HMMViterbiResults* aViterbiResults = gatherViterbiResults(iteration);
+		viterbiResults.push_back(aViterbiResults);
+		cout << "Viterbi Results Gathered.\n";
+
+		// Reset the probabilities to the viterbi calculated ones for the next
+		// iteration (the results keep their own copy for reporting)
+		replaceProbabilities(new HMMProbabilities(*aViterbiResults->probabilities));
+
+		Instrumentation::endIteration(iteration, logLikelihood);
+		return logLikelihood;
+	}
+
+	// Build the model and calculate the forward/backward probabilites
+	buildAndCalculateModel(true);
+	{
+		Instrumentation::Timer timer(Instrumentation::expectationPhase);
+		timer.addColumns(model.size() - 1);
+		calculateLogBackwardProbabilities();
+		calculateLogConditionalProbabilities();
+	}
+
+	// Calculate the new transition/emission probabilties
+	{
+		Instrumentation::Timer timer(Instrumentation::maximizationPhase);
+		timer.addColumns(model.size() - 1);
+		calculateBaumWelchEmissionProbabilities();
+		calculateBaumWelchInitiationProbabilities();
+		calculateBaumWelchTransitionProbabilities();
+	}
+
+	double logLikelihood = model.back()->logLikelihood();
+	Instrumentation::endIteration(iteration, logLikelihood);
+	return logLikelihood;
+}
+
+// double plainEMTraining(bool viterbi, int maxIterations, int& iterations)
+//  Purpose: 
+//		Runs unaccelerated EM until it is done (see emStepAllowed and
+//		emConverged).  Returns the final log likelihood.
+double HiddenMarkovModel::plainEMTraining(bool viterbi, int maxIterations, int& iterations) {
+	double logLikelihood = 0;
+	bool trainingDone = false;
+	iterations = 0;
+	while (!trainingDone && emStepAllowed(viterbi, iterations, maxIterations)) {
+		// Calcualte likelihood and check if done
+		double currentLogLikelihood = emIteration(viterbi, iterations + 1);
+		publishProbabilities();
+		trainingDone = emConverged(viterbi, logLikelihood, currentLogLikelihood);
+
+		// Set values for next iteration
+		logLikelihood = currentLogLikelihood;
+		iterations++;
+		if (!viterbi)
+			cout
+				<< "Iteration: " << iterations 
+				<< "  Likelihood: " << currentLogLikelihood
+				<< "\n";
+	}
+
+	return logLikelihood;
+}
+
+// bool emStepAllowed(bool viterbi, int steps, int maxSteps)
+//  Purpose: 
+//		Returns true if EM training that has taken steps EM steps may
+//		take another.  Viterbi training takes exactly maxSteps steps,
+//		Baum-Welch at most maxSteps (no limit if maxSteps <= 0).
+bool HiddenMarkovModel::emStepAllowed(bool viterbi, int steps, int maxSteps) {
+	if (maxSteps <= 0)
+		return !viterbi;
+	return steps < maxSteps;
+}
+
+// bool emConverged(bool viterbi, double lastLogLikelihood, double logLikelihood)
+//  Purpose: 
+//		Returns true if Baum-Welch training has converged (the log
+//		likelihood changed by less than 0.1).  Viterbi training only
+//		stops at its step budget.
+bool HiddenMarkovModel::emConverged(bool viterbi, double lastLogLikelihood, double logLikelihood) {
+	return !viterbi && abs(logLikelihood - lastLogLikelihood) < 0.1;
+}
+
+// double squaremTraining(bool viterbi, int maxEvaluations, int& evaluations,
+//		double targetLogLikelihood)
+//  Purpose: 
+//		Runs SQUAREM accelerated EM (Varadhan & Roland, 2008).  Each cycle
+//		takes three EM steps theta1 = F(theta0), theta2 = F(theta1) and
+//		theta3 = F(theta2), the last of which gives the likelihood of the
+//		plain EM point theta2, and extrapolates along r = theta1 - theta0,
+//		v = theta2 - theta1 - r:
+//			theta' = theta0 - 2 alpha r + alpha^2 v,  alpha = -|r|/|v|
+//		theta' is projected back to valid probabilities and followed by
+//		one stabilizing EM step.  If theta' is less likely than theta2,
+//		alpha is halved toward -1 (alpha = -1 gives theta2 itself, whose
+//		EM step theta3 is then kept), so every cycle does at least as
+//		well as plain EM.
+//
+//		Training stops by the same rule as plain EM (see emStepAllowed
+//		and emConverged), counting every EM step against maxEvaluations,
+//		or as soon as an EM step's log likelihood reaches
+//		targetLogLikelihood (NaN for no target).  The budget is checked
+//		before each step, so it is never exceeded; a cycle cut short
+//		keeps the last EM point reached.  Returns the final log
+//		likelihood.
+double HiddenMarkovModel::squaremTraining(bool viterbi, int maxEvaluations, int& evaluations,
+	double targetLogLikelihood) {
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	evaluations = 0;
+	int cycles = 0;
+	int extrapolations = 0;
+	double logLikelihood = 0;
+	bool trainingDone = false;
+
+	while (!trainingDone && emStepAllowed(viterbi, evaluations, maxEvaluations)) {
+		cycles++;
+
+		// Three plain EM steps (stopping at the last EM point if the budget
+		// runs out or the target is reached)
+		vector<vector<long double>> theta(3);
+		double stepLogLikelihoods[3];
+		bool stopped = false;
+		for (int step = 0; step < 3 && !stopped; step++) {
+			theta[step] = probabilities->parameterVector();
+			stepLogLikelihoods[step] = emIteration(viterbi, ++evaluations);
+			logLikelihood = stepLogLikelihoods[step];
+			stopped = !emStepAllowed(viterbi, evaluations, maxEvaluations) || logLikelihood >= targetLogLikelihood;
+		}
+		if (stopped) {
+			publishProbabilities();
+			break;
+		}
+		HMMProbabilities theta3Probabilities(*probabilities);
+		vector<unsigned char> theta2StatePath;
+		if (viterbi)
+			theta2StatePath = statePath;
+
+		// Step length from the first and second differences
+		size_t numParameters = theta[0].size();
+		vector<long double> r(numParameters);
+		vector<long double> v(numParameters);
+		long double rNorm = 0;
+		long double vNorm = 0;
+		for (size_t k = 0; k < numParameters; k++) {
+			r[k] = theta[1][k] - theta[0][k];
+			v[k] = theta[2][k] - theta[1][k] - r[k];
+			rNorm += r[k] * r[k];
+			vNorm += v[k] * v[k];
+		}
+		long double alpha = -sqrt(rNorm / vNorm);
+		if (!(alpha < -1) || std::isinf(alpha))
+			alpha = -1;
+
+		// Extrapolate and stabilize, backtracking toward theta2 whenever the
+		// likelihood does not reach that of theta2 (keeping theta3 once
+		// alpha gets to -1 or the budget runs out)
+		double newLogLikelihood = stepLogLikelihoods[2];
+		bool accepted = false;
+		while (alpha < -1 && emStepAllowed(viterbi, evaluations, maxEvaluations)) {
+			vector<long double> extrapolated(numParameters);
+			for (size_t k = 0; k < numParameters; k++)
+				extrapolated[k] = theta[0][k] - 2 * alpha * r[k] + alpha * alpha * v[k];
+
+			if (setProbabilitiesFromVector(extrapolated)) {
+				double extrapolatedLogLikelihood = emIteration(viterbi, ++evaluations);
+				if (!MathUtilities::isNaN(extrapolatedLogLikelihood)
+					&& extrapolatedLogLikelihood >= stepLogLikelihoods[2]) {
+					newLogLikelihood = extrapolatedLogLikelihood;
+					accepted = true;
+					extrapolations++;
+					break;
+				}
+
+				// Rejected, discard the results from the stabilizing step
+				if (viterbi) {
+					delete viterbiResults.back();
+					viterbiResults.pop_back();
+				}
+			}
+
+			alpha = (alpha - 1) / 2;
+			if (alpha > -1.01)
+				alpha = -1;
+		}
+		if (!accepted) {
+			replaceProbabilities(new HMMProbabilities(theta3Probabilities));
+			if (viterbi)
+				statePath.swap(theta2StatePath);
+			alpha = -1;
+		}
+
+		// Only the accepted point of a cycle is published
+		publishProbabilities();
+
+		cout
+			<< "SQUAREM Cycle: " << cycles
+			<< "  Step: " << alpha
+			<< "  Likelihood: " << newLogLikelihood
+			<< "\n";
+
+		// Check if done
+		logLikelihood = newLogLikelihood;
+		trainingDone = emConverged(viterbi, stepLogLikelihoods[0], newLogLikelihood)
+			|| newLogLikelihood >= targetLogLikelihood;
+	}
+
+	chrono::duration<double> seconds = chrono::steady_clock::now() - start;
+	cout
+		<< "SQUAREM: " << evaluations << " EM iterations in " << cycles << " cycles"
+		<< " (" << extrapolations << " extrapolations accepted)"
+		<< "  Time: " << seconds.count() << "s"
+		<< "\n";
+
+	return logLikelihood;
+}
+
+// bool setProbabilitiesFromVector(const vector<long double>& parameters)
+//  Purpose: 
+//		Replaces probabilities with a copy set from a packed parameter
+//		vector.  Returns false if the vector can not be projected to
+//		valid probabilities.
+bool HiddenMarkovModel::setProbabilitiesFromVector(const vector<long double>& parameters) {
+	HMMProbabilities* newProbabilities = new HMMProbabilities(*probabilities);
+	if (!newProbabilities->setParameterVector(parameters)) {
+		delete newProbabilities;
+		return false;
+	}
+
+	replaceProbabilities(newProbabilities);
+	return true;
+}
+
+// replaceProbabilities(HMMProbabilities* newProbabilities)
+//  Purpose: 
+//		Deletes the current probabilities and takes ownership of
+//		newProbabilities in their place
+void HiddenMarkovModel::replaceProbabilities(HMMProbabilities* newProbabilities) {
+	if (newProbabilities != probabilities)
+		delete probabilities;
+	probabilities = newProbabilities;
+}
+
+// clearViterbiResults()
+//  Purpose: 
+//		Deletes the results of every viterbi iteration
+void HiddenMarkovModel::clearViterbiResults() {
+	for (HMMViterbiResults* aViterbiResults : viterbiResults)
+		delete aViterbiResults;
+	viterbiResults.clear();
+}
+
+// publishProbabilities()
+//  Purpose: 
+//		Publishes a snapshot of the probabilities to the parameter
+//		store, if there is one
+void HiddenMarkovModel::publishProbabilities() {
+	if (parameterStore != NULL)
+		parameterStore->publish(*probabilities);
+}
+
 void HiddenMarkovModel::calculateBaumWelchEmissionProbabilities() {
 /*
 	// Create and initialize vectors to track the numerator and denominator
@@ -488,7 +1014,7 @@ void HiddenMarkovModel::calculateBaumWelchTransitionProbabilities() {
 	int numPositions = model.size();
 	for (HMMPosition* position : model) {
 		// Do not calculate for start nodes or last node
-		if (position->id == 0 || position->id == numPositions)
+		if (position->isStartPosition() || position->id == numPositions)
 			continue;
 		
 		for (HMMNode* node : position->nodes) {
@@ -536,13 +1062,19 @@ void HiddenMarkovModel::calculateBaumWelchTransitionProbabilities() {
 //		previousPosition.outTransitions
 //			- contains transitions to each node in the current position
 void HiddenMarkovModel::createTransitionsFor(HMMPosition* currentPosition, HMMPosition* previousPosition) {
+	// Make room for the transitions on both sides
+	for (HMMNode* previousPositionNode : previousPosition->nodes)
+		previousPositionNode->outTransitions.reserve(arena, currentPosition->nodes.size());
+
 	// Create inTransitions for the  current position nodes
 	for (HMMNode* currentPositionNode : currentPosition->nodes) {
+		currentPositionNode->inTransitions.reserve(arena, previousPosition->nodes.size());
+
 		// Create one transition for each node from the previous position
 		// to this node in the current position
 		for (HMMNode* previousPositionNode : previousPosition->nodes) {
 			// Create the transition
-			HMMTransition* aTransition = new HMMTransition(previousPositionNode, currentPositionNode, this);
+			HMMTransition* aTransition = arena.create<HMMTransition>(previousPositionNode, currentPositionNode, this);
 
 			// Add to the transitions collections on nodes
 			currentPositionNode->addInTransition(aTransition);
@@ -572,8 +1104,10 @@ void HiddenMarkovModel::calculateHighestWeightPath(HMMPosition* aPosition) {
 	// Calculate hwp for each node
 	for (HMMNode* positionNode : aPosition->nodes) {
 		// initialize highest weight to negative infinity (except start node)
-		if (positionNode->id != 0)
+		if (positionNode->state != 0) {
 			positionNode->highestWeight = -DBL_MAX;
+			positionNode->highestWeightPreviousNode = NULL;
+		}
 
 		// Iterater through each of the incoming transitions to find
 		// the highest score
@@ -597,12 +1131,38 @@ void HiddenMarkovModel::calculateHighestWeightPath(HMMPosition* aPosition) {
 	}
 }
 	
+// decodeStatePath()
+//  Purpose: 
+//		Walks the viterbi path backward from the highest scoring node in
+//		the last position of the model graph and records the state of
+//		every sequence position.  Throws a runtime_error if a position
+//		has no path into it (no state can emit its column).
+//
+//  Postconditions:
+//		statePath - contains the viterbi state for each sequence position
+void HiddenMarkovModel::decodeStatePath() {
+	Instrumentation::Timer timer(Instrumentation::tracebackPhase);
+	int numPositions = model.size() - 1; // skip start position
+	timer.addColumns(numPositions);
+	statePath.resize(numPositions);
+
+	HMMNode* aNode = model.back()->highestScoringNode();
+	for (int seqPos = numPositions - 1; seqPos >= 0; seqPos--) {
+		if (aNode == NULL || aNode->state == 0)
+			throw runtime_error("Viterbi path is broken at alignment column "
+				+ to_string(multiAlignFile->getCoordinate(seqPos)));
+		statePath[seqPos] = aNode->state;
+		aNode = aNode->highestWeightPreviousNode;
+	}
+}
+
 // HMMViterbiResults* gatherViterbiResults(int iteration);
 //  Purpose: 
 //		Creates, populates, and return a HMMViterbiResults object containing
 //		the results for the most recent iteration in the viterbi training.
 //
-//		Results are gathered by walking the viterbi path backward.  Results
+//		The results are gathered from the decoded state path (see
+//		HMMViterbiResults::gatherCounts).  Results
 //		gathered include the following:
 //			state counts - how many times a state occurs in the path
 //			segment counts - how many segments (i.e., continuos occurencee of
@@ -620,55 +1180,14 @@ void HiddenMarkovModel::calculateHighestWeightPath(HMMPosition* aPosition) {
 //		currentPosition.highestWeightPreviousNode
 //			- set to the previous node that generated the highest calculated weight
 HMMViterbiResults* HiddenMarkovModel::gatherViterbiResults(int iteration) {
-	HMMViterbiResults* results = new HMMViterbiResults(iteration, numStates);
-
-	// Find the end of the highest scoring path
-	HMMPosition* lastPosition = model.back();
-	HMMNode* aNode = lastPosition->highestScoringNode();
+	Instrumentation::Timer timer(Instrumentation::statisticsPhase);
+	timer.addColumns(multiAlignFile->getSequenceLength());
+	HMMViterbiResults* results = new HMMViterbiResults(iteration, numStates, multiAlignFile->getColumnDictionary());
 
-	// Walk the path backward and gather the data
-	int previousState = -1; 
-	pair<int, int> currentSegment = pair<int,int>(-1,-1);
+	// Gather the data (the first sequence position shares the start node's
+	// id of zero and has never been included in the results)
 	int offset = multiAlignFile->getStartPosition();
-
-	while (aNode->id != 0) {
-		int currentState = aNode->state;
-		
-		// Update number of occurrences for a state
-		results->stateCounts[currentState]++;
-
-		// Update emission count for state
-		results->emissionCounts.at(currentState).at(aNode->residue)++;
-
-		// Update segment info
-		if (currentState != previousState) {
-			// Set the start of the segment
-			currentSegment.first = aNode->id + 1 + offset;
-
-			// Add segment to segments map (except for first time through)
-			if (currentSegment.second != -1) 
-				results->segments[previousState].push_back(currentSegment);
-
-			// Create new segment
-			currentSegment = pair<int,int>(aNode->id + offset, aNode->id + offset);
-
-			// Update number of segments for a state
-			results->segmentCounts[currentState]++;
-		}
-
-		// Update transition counts
-		if (previousState >= 0) {
-			results->transitionCounts[currentState][previousState]++;
-		}
-
-		// Set up variables for next iteration
-		previousState = currentState;
-		aNode = aNode->highestWeightPreviousNode;
-	}
-
-	// Add the last segment to the collection
-	currentSegment.first =  offset;
-	results->segments[previousState].push_back(currentSegment);
+	results->gatherCounts(statePath, symbols, 1, offset, multiAlignFile->getCoordinateBreaks());
 
 	// Calculate the probabilities
 	results->calculateProbabilities(probabilities);
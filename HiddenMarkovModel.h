@@ -17,12 +17,29 @@
  *  are determined by the start/stop node states for an HMMTransition
  *  object.
  *
+ *	The positions, nodes and transitions are allocated in the model's
+ *  ModelArena and are released together when the model is destroyed or
+ *  resetModel() is called.
+ *
  *	The probabilitites attribute holds the inititation, emission and
  *  transition probabilties that are used when finding a path through
  *  the model.  HMMNodes will access the probabilites to determine their
  *  emission probabilities.  HMMTransitions will access the probabilties
  *  to determine their initiation/transition probabilties.
  *
+ *	The HiddenMarkovModel owns probabilities (including ones passed to
+ *  the constructor) and the viterbiResults, and deletes them when they
+ *  are replaced or the model is destroyed.  Each HMMViterbiResults owns
+ *  the probabilities calculated from it; the model trains on a copy.
+ *
+ *	probabilities is the training thread's working copy: training
+ *  replaces it (and Baum-Welch changes it in place) every iteration and
+ *  the model graph reads it throughout.  Other threads must not touch
+ *  it.  To decode with the parameters while training runs, attach a
+ *  ParameterStore (setParameterStore); the model publishes a snapshot
+ *  of the probabilities to it after every completed iteration, which
+ *  other threads pin for as long as they need it.
+ *
  *  Viterbi training is currently the only implmented method for creating
  *  a path.  Typical use would be:
  *
@@ -68,10 +85,16 @@
 #include "HMMPosition.h"
 #include "HMMProbabilities.h"
 #include "HMMViterbiResults.h"
+#include "BedFileWriter.h"
+#include "ModelArena.h"
+#include "DecoderWorkspace.h"
+#include "StatePathUtilities.h"
 #include <vector>
 #include <map>
 using namespace std;
 
+class ParameterStore;
+
 class HiddenMarkovModel
 {
 public:
@@ -80,6 +103,7 @@ public:
 	HiddenMarkovModel();
 	HiddenMarkovModel(MultipleAlignmentFile* aMultiAlginFile,
 		string neutralCountsFileName, string conservedCountsFileName);
+	HiddenMarkovModel(MultipleAlignmentFile* aMultiAlginFile, HMMProbabilities* someProbabilities);
 
 	// Destructor
 	// =============================================
@@ -87,15 +111,17 @@ public:
 
 	// Public Attributes
 	// =============================================
-	HMMProbabilities* probabilities;
-	vector<HMMViterbiResults*> viterbiResults;
+	HMMProbabilities* probabilities;				// owned, training thread only
+	vector<HMMViterbiResults*> viterbiResults;		// owned
 
 	// Public Methods
 	// =============================================
 
-	// viterbiTraining(int numIterations)
+	// viterbiTraining(int numIterations, bool accelerate)
 	//  Purpose: 
 	//		Perform viterbi training for the number of iterations specified.
+	//		If accelerate is set, SQUAREM extrapolation is used instead (see
+	//		squaremTraining), taking the same numIterations EM steps.
 	//
 	//		Each iteration consists of the following steps
 	//			1. Build Hidden Markov Model and calculate viterbi weight
@@ -110,22 +136,106 @@ public:
 	//		probabilities - modified at end of each training iteration to 
 	//						reflect calculated probabilities from the viterbi
 	//						results
-	void viterbiTraining(int numIterations);
+	void viterbiTraining(int numIterations, bool accelerate = false);
 
-	// baumWelchTraining()
+	// baumWelchTraining(bool accelerate)
 	//  Purpose: 
 	//		Use the Baum-Welch (forward-backward) algorithm to estimate
-	//		the paramters for the model
+	//		the paramters for the model.  If accelerate is set, SQUAREM
+	//		extrapolation is used (see squaremTraining).
 	//
 	//		Each iteration consists of the following steps
 	//			1. Build Hidden Markov Model and calculate forward-backward weight
 	//			   for each node
-	void baumWelchTraining();
+	void baumWelchTraining(bool accelerate = false);
+
+	// viterbiDecode(DecoderWorkspace* workspace)
+	//  Purpose: 
+	//		Finds the viterbi path with the current probabilities (e.g. ones
+	//		loaded from a model file) without training.  The results for
+	//		the path are gathered as for one viterbi training iteration, but
+	//		the probabilities are left unchanged.
+	//
+	//		The path is found by HMMDecoder without building the model graph.
+	//		Passing a workspace that outlives the model lets a caller decoding
+	//		region after region reuse its buffers; otherwise a temporary one
+	//		is used.
+	//  Postconditions:
+	//		viterbiResults - contains the results for the path
+	void viterbiDecode(DecoderWorkspace* workspace = NULL);
+
+	// resetModel()
+	//  Purpose: 
+	//		Releases the model graph and the viterbi results, keeping the
+	//		probabilities.  The graph is freed in bulk with the arena, so a
+	//		long running process can decode again without the memory of
+	//		the previous model building up.
+	//  Postconditions:
+	//		model - empty, rebuilt by the next training or decode
+	//		viterbiResults - empty
+	void resetModel();
+
+	// compareEMAcceleration(bool viterbi, int numIterations)
+	//  Purpose: 
+	//		Runs plain EM training (viterbi or Baum-Welch) and then SQUAREM
+	//		accelerated training from the same starting probabilities.  Both
+	//		runs stop by the same rule, with numIterations as their EM step
+	//		budget, and SQUAREM also stops as soon as it reaches the final
+	//		likelihood of plain EM, so the iterations saved are the EM steps
+	//		it did not need to get as far.  The iterations and wall-clock
+	//		time saved are logged and the probabilities (and viterbi results
+	//		and path) of whichever run ended with the higher likelihood are
+	//		kept, so the result is never worse than plain EM.  The node
+	//		scores of the model graph are left from the last SQUAREM step.
+	//  Postconditions:
+	//		probabilities - set to the better of the two trained probabilities
+	//		viterbiResults - results of the kept run (viterbi only)
+	//		statePath - viterbi path of the kept run (viterbi only)
+	void compareEMAcceleration(bool viterbi, int numIterations);
+
+	// setParameterStore(ParameterStore* aParameterStore)
+	//  Purpose: 
+	//		Publishes the current probabilities to aParameterStore, and the
+	//		probabilities of every completed training iteration (or SQUAREM
+	//		cycle) from then on.  NULL stops publishing.  The store is not
+	//		owned.
+	void setParameterStore(ParameterStore* aParameterStore);
 
 	// string allScoresResultsString()
 	//  Purpose:
 	//		Returns a string representing the score (weight) from each node
-	//		in each position of the viterbi path.
+	//		in each position of the viterbi path (see writeAllScoresResults)
+	//  Preconditions:
+	//		viterbiTraining has been run
+	string allScoresResultsString();
+
+	// string pathStatesResultsString()
+	//  Purpose:
+	//		Returns a string representing the state for each position in the
+	//		viterbi path (see writePathStatesResults)
+	//  Preconditions:
+	//		viterbiTraining has been run
+	string pathStatesResultsString();
+
+	// string viterbiResultsString()
+	//  Purpose:
+	//		Returns a string representing the results for each iteration in
+	//		the viterbi training (see writeViterbiResults)
+	//  Preconditions:
+	//		viterbiTraining has been run
+	string viterbiResultsString();
+
+	// string baumWelchResultsString(int iterations, double logLikelihood)
+	//  Purpose:
+	//		Returns the EM result (iterations, log likelihood and the
+	//		probabilities) reported at the end of Baum-Welch training,
+	//		also used for training run by a TrainingCoordinator
+	string baumWelchResultsString(int iterations, double logLikelihood);
+
+	// writeAllScoresResults(OutputBuffer& out)
+	//  Purpose:
+	//		Appends the score (weight) from each node in each position of
+	//		the viterbi path to out.
 	//
 	//		format:
 	//			Position: <positionId>
@@ -134,24 +244,23 @@ public:
 	//			  ...
 	//  Preconditions:
 	//		viterbiTraining has been run
-	string allScoresResultsString();
+	void writeAllScoresResults(OutputBuffer& out);
 
-	// string pathStatesResultsString()
+	// writePathStatesResults(OutputBuffer& out)
 	//  Purpose:
-	//		Returns a string representing the state for each position in the
-	//		viterbi path.
+	//		Appends the state for each position in the viterbi path to out.
 	//
 	//		format:
 	//			<position1State><position2State> ... <positionNstate>
 	//  Preconditions:
 	//		viterbiTraining has been run
-	string pathStatesResultsString();
+	void writePathStatesResults(OutputBuffer& out);
 
-	// string viterbiResultsString()
+	// writeViterbiResults(OutputBuffer& out)
 	//  Purpose:
-	//		Returns a string representing the results for each iteration in
-	//		the viterbi training. See HMMViterbiResults.resultsWithoutSegments()
-	//		and HMMViterbiResults.allResults() for details on the format of
+	//		Appends the results for each iteration in the viterbi training to
+	//		out. See HMMViterbiResults.writeResultsWithoutSegments() and
+	//		HMMViterbiResults.writeAllResults() for details on the format of
 	//		the viterbi results for a particular iteration.
 	//
 	//		format:
@@ -161,7 +270,28 @@ public:
 	//			<viterbiResultsIterationLast.allResults()>
 	//  Preconditions:
 	//		viterbiTraining has been run
-	string viterbiResultsString();
+	void writeViterbiResults(OutputBuffer& out);
+
+	// writeSegmentsBed(BedFileWriter& bedFile, int state)
+	//  Purpose:
+	//		Writes every segment of the state in the viterbi path to the BED
+	//		file as it is found.  The path is scanned for state changes one
+	//		block at a time, so segments are streamed out a block at a time
+	//		rather than collected first.  Segments are split at the
+	//		alignment's coordinate breaks, so none covers unaligned
+	//		coordinates.
+	//  Preconditions:
+	//		viterbiTraining has been run
+	void writeSegmentsBed(BedFileWriter& bedFile, int state);
+
+	// writePathFile(string fileName)
+	//  Purpose:
+	//		Writes the viterbi state path to a binary path file that can be
+	//		queried by coordinate (see HMMPathFile).  Coordinates that are
+	//		not in the alignment (between MAF blocks) have state 0.
+	//  Preconditions:
+	//		viterbiTraining has been run
+	void writePathFile(string fileName);
 
 private:
 
@@ -169,12 +299,23 @@ private:
 	// =============================================
 	static const int numStates;
 	MultipleAlignmentFile* multiAlignFile;
+	ModelArena arena;					// holds the positions, nodes and transitions
 	vector<HMMPosition*> model;
 	bool modelBuilt;
+	vector<int> symbols;				// column dictionary id for each sequence position
+	vector<unsigned char> statePath;	// decoded viterbi state for each sequence position
+	ParameterStore* parameterStore;		// NULL unless publishing snapshots
 
 	// Private Methods
 	// =============================================
 
+	// writeSegments(BedFileWriter& bedFile, vector<StatePathUtilities::StateRun>& segments)
+	//  Purpose:
+	//		Writes the segments (runs of sequence positions, in order) to the
+	//		BED file, split at the alignment's coordinate breaks, and clears
+	//		them
+	void writeSegments(BedFileWriter& bedFile, vector<StatePathUtilities::StateRun>& segments);
+
 	// buildAndCalculateModel(bool calculateForward)
 	//  Purpose: 
 	//		Build the hidden markov model (if not already built) and calculate
@@ -195,6 +336,9 @@ private:
 	//				   node in the position
 	//				d. add the position to the model attribute
 	//
+	//		Building throws a runtime_error if no state can emit one of the
+	//		columns.
+	//
 	//  Postconditions:
 	//		model - contains HMMPosition objects for every position in the
 	//				sequence from the fastaFile
@@ -250,12 +394,24 @@ private:
 	//		model.nodes.logConditionalProbabilty will be set for all nodes
 	void calculateLogConditionalProbabilities();
 
+	// decodeStatePath()
+	//  Purpose: 
+	//		Walks the viterbi path backward from the highest scoring node in
+	//		the last position of the model graph and records the state of
+	//		every sequence position.  Throws a runtime_error if a position
+	//		has no path into it (no state can emit its column).
+	//
+	//  Postconditions:
+	//		statePath - contains the viterbi state for each sequence position
+	void decodeStatePath();
+
 	// HMMViterbiResults* gatherViterbiResults(int iteration);
 	//  Purpose: 
 	//		Creates, populates, and return a HMMViterbiResults object containing
 	//		the results for the most recent iteration in the viterbi training.
 	//
-	//		Results are gathered by walking the viterbi path backward.  Results
+	//		The results are gathered from the decoded state path (see
+	//		HMMViterbiResults::gatherCounts).  Results
 	//		gathered include the following:
 	//			state counts - how many times a state occurs in the path
 	//			segment counts - how many segments (i.e., continuos occurencee of
@@ -274,11 +430,90 @@ private:
 	//			- set to the previous node that generated the highest calculated weight
 	HMMViterbiResults* gatherViterbiResults(int iteration);
 
+	// double emIteration(bool viterbi, int iteration)
+	//  Purpose: 
+	//		Performs one EM step (viterbi training or Baum-Welch) starting
+	//		from the current probabilities and returns the log likelihood of
+	//		the probabilities the step started from (the viterbi path weight
+	//		for viterbi training).
+	//  Postconditions:
+	//		probabilities - set to the re-estimated probabilities
+	//		viterbiResults - results for the iteration appended (viterbi only)
+	double emIteration(bool viterbi, int iteration);
+
+	// double plainEMTraining(bool viterbi, int maxIterations, int& iterations)
+	//  Purpose: 
+	//		Runs unaccelerated EM until it is done (see emStepAllowed and
+	//		emConverged).  Returns the final log likelihood.
+	double plainEMTraining(bool viterbi, int maxIterations, int& iterations);
+
+	// bool emStepAllowed(bool viterbi, int steps, int maxSteps)
+	//  Purpose: 
+	//		Returns true if EM training that has taken steps EM steps may
+	//		take another.  Viterbi training takes exactly maxSteps steps,
+	//		Baum-Welch at most maxSteps (no limit if maxSteps <= 0).
+	bool emStepAllowed(bool viterbi, int steps, int maxSteps);
+
+	// bool emConverged(bool viterbi, double lastLogLikelihood, double logLikelihood)
+	//  Purpose: 
+	//		Returns true if Baum-Welch training has converged (the log
+	//		likelihood changed by less than 0.1).  Viterbi training only
+	//		stops at its step budget.
+	bool emConverged(bool viterbi, double lastLogLikelihood, double logLikelihood);
+
+	// double squaremTraining(bool viterbi, int maxEvaluations, int& evaluations,
+	//		double targetLogLikelihood)
+	//  Purpose: 
+	//		Runs SQUAREM accelerated EM (Varadhan & Roland, 2008).  Each cycle
+	//		takes three EM steps theta1 = F(theta0), theta2 = F(theta1) and
+	//		theta3 = F(theta2), the last of which gives the likelihood of the
+	//		plain EM point theta2, and extrapolates along r = theta1 - theta0,
+	//		v = theta2 - theta1 - r:
+	//			theta' = theta0 - 2 alpha r + alpha^2 v,  alpha = -|r|/|v|
+	//		theta' is projected back to valid probabilities and followed by
+	//		one stabilizing EM step.  If theta' is less likely than theta2,
+	//		alpha is halved toward -1 (alpha = -1 gives theta2 itself, whose
+	//		EM step theta3 is then kept), so every cycle does at least as
+	//		well as plain EM.
+	//
+	//		Training stops by the same rule as plain EM (see emStepAllowed
+	//		and emConverged), counting every EM step against maxEvaluations,
+	//		or as soon as an EM step's log likelihood reaches
+	//		targetLogLikelihood (NaN for no target).  The budget is checked
+	//		before each step, so it is never exceeded; a cycle cut short
+	//		keeps the last EM point reached.  Returns the final log
+	//		likelihood.
+	double squaremTraining(bool viterbi, int maxEvaluations, int& evaluations, double targetLogLikelihood);
+
+	// bool setProbabilitiesFromVector(const vector<long double>& parameters)
+	//  Purpose: 
+	//		Replaces probabilities with a copy set from a packed parameter
+	//		vector.  Returns false if the vector can not be projected to
+	//		valid probabilities.
+	bool setProbabilitiesFromVector(const vector<long double>& parameters);
+
+	// replaceProbabilities(HMMProbabilities* newProbabilities)
+	//  Purpose: 
+	//		Deletes the current probabilities and takes ownership of
+	//		newProbabilities in their place
+	void replaceProbabilities(HMMProbabilities* newProbabilities);
+
+	// clearViterbiResults()
+	//  Purpose: 
+	//		Deletes the results of every viterbi iteration
+	void clearViterbiResults();
+
+	// publishProbabilities()
+	//  Purpose: 
+	//		Publishes a snapshot of the probabilities to the parameter
+	//		store, if there is one
+	void publishProbabilities();
+
 	void calculateBaumWelchEmissionProbabilities();
 	void calculateBaumWelchTransitionProbabilities();
 	void calculateBaumWelchInitiationProbabilities();
 	double calculateLogLikelihood();
-	string baumWelchResultsString(int iterations, double logLikelihood);
+	void writeBaumWelchResults(OutputBuffer& out, int iterations, double logLikelihood);
 
 
 };
@@ -0,0 +1,339 @@
+/*
+ * Instrumentation.cpp
+ *
+ *	The Instrumentation object records phase times and counters and
+ *  writes them as a JSON report.  See Instrumentation.h.
+ *
+ *  Created on: 10-18-26
+ */
+#include "Instrumentation.h"
+#include "OutputBuffer.h"
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <stdexcept>
+
+// static variable initialization
+// ==============================================
+bool Instrumentation::enabled = false;
+bool Instrumentation::countingHardware = false;
+atomic<long long> Instrumentation::phaseNanoseconds[numPhases];
+atomic<long long> Instrumentation::phaseCalls[numPhases];
+atomic<long long> Instrumentation::phaseColumns[numPhases];
+atomic<long long> Instrumentation::phaseEvents[numPhases][HardwareCounters::numEvents];
+atomic<long long> Instrumentation::counters[numCounters];
+chrono::steady_clock::time_point Instrumentation::enabledAt;
+mutex Instrumentation::iterationsLock;
+vector<Instrumentation::Iteration> Instrumentation::iterations;
+Instrumentation::Totals Instrumentation::iterationStart;
+
+// Public Class Methods
+// =============================================
+
+// enable(bool hardwareCounters)
+//  Purpose:
+//		Starts recording, with the CPU counters of each phase if
+//		hardwareCounters is set.  Must be called before any other
+//		thread uses the instrumentation.
+void Instrumentation::enable(bool hardwareCounters) {
+	for (int phase = 0; phase < numPhases; phase++) {
+		phaseNanoseconds[phase] = 0;
+		phaseCalls[phase] = 0;
+		phaseColumns[phase] = 0;
+		for (int event = 0; event < HardwareCounters::numEvents; event++)
+			phaseEvents[phase][event] = 0;
+	}
+	for (int counter = 0; counter < numCounters; counter++)
+		counters[counter] = 0;
+	iterations.clear();
+	enabledAt = chrono::steady_clock::now();
+	iterationStart = currentTotals();
+
+	// Opening the counters now puts the reason they are not available
+	// in the report even if no phase runs
+	countingHardware = hardwareCounters;
+	if (countingHardware) {
+		HardwareCounters::Reading reading;
+		HardwareCounters::read(reading);
+	}
+	enabled = true;
+}
+
+// endIteration(int iteration, double logLikelihood)
+//  Purpose:
+//		Records the time and counts since the previous iteration ended
+//		(or recording started) as a training iteration
+void Instrumentation::endIteration(int iteration, double logLikelihood) {
+	if (!enabled)
+		return;
+
+	lock_guard<mutex> guard(iterationsLock);
+	Iteration record;
+	record.iteration = iteration;
+	record.logLikelihood = logLikelihood;
+	record.start = iterationStart;
+	record.end = currentTotals();
+	iterations.push_back(record);
+	iterationStart = record.end;
+}
+
+// writeReport(string fileName, string command)
+//  Purpose:
+//		Writes the JSON report of everything recorded to fileName.
+//		Throws if it cannot be written.
+void Instrumentation::writeReport(string fileName, string command) {
+	Totals start = zeroTotals();
+	Totals end = currentTotals();
+
+	OutputBuffer out(fileName);
+	out.append("{\n  \"command\": ");
+	writeString(out, command);
+	out.append(",\n  \"wallSeconds\": ");
+	writeNumber(out, chrono::duration<double>(end.time - start.time).count());
+	out.append(",\n");
+	if (countingHardware) {
+		out.append("  \"hardwareCounters\": {\"available\": ");
+		out.append(HardwareCounters::isAvailable() ? "true" : "false");
+		if (!HardwareCounters::isAvailable()) {
+			out.append(", \"reason\": ");
+			writeString(out, HardwareCounters::getUnavailableReason());
+		}
+		out.append("},\n");
+	}
+	writeTotals(out, start, end, "  ");
+	out.append(",\n  \"iterations\": [");
+
+	lock_guard<mutex> guard(iterationsLock);
+	for (size_t index = 0; index < iterations.size(); index++) {
+		const Iteration& record = iterations[index];
+		out.append(index == 0 ? "\n" : ",\n");
+		out.append("    {\n      \"iteration\": ");
+		out.appendInt(record.iteration);
+		out.append(",\n      \"logLikelihood\": ");
+		writeNumber(out, record.logLikelihood);
+		out.append(",\n      \"seconds\": ");
+		writeNumber(out, chrono::duration<double>(record.end.time - record.start.time).count());
+		out.append(",\n");
+		writeTotals(out, record.start, record.end, "      ");
+		out.append("\n    }");
+	}
+	out.append(iterations.empty() ? "]\n}\n" : "\n  ]\n}\n");
+	out.flush();
+}
+
+// string phaseName(Phase phase)
+//  Purpose:
+//		Returns the name of a phase in the report
+string Instrumentation::phaseName(Phase phase) {
+	switch (phase) {
+		case parsePhase:		return "parse";
+		case buildPhase:		return "build";
+		case viterbiPhase:		return "viterbi";
+		case tracebackPhase:	return "traceback";
+		case statisticsPhase:	return "statistics";
+		case expectationPhase:	return "expectation";
+		case maximizationPhase:	return "maximization";
+		case outputPhase:		return "output";
+		default:				return "unknown";
+	}
+}
+
+// string counterName(Counter counter)
+//  Purpose:
+//		Returns the name of a counter in the report
+string Instrumentation::counterName(Counter counter) {
+	switch (counter) {
+		case columnsCounter:			return "columns";
+		case arenaAllocationsCounter:	return "arenaAllocations";
+		case heapAllocationsCounter:	return "heapAllocations";
+		case bufferGrowthsCounter:		return "bufferGrowths";
+		default:						return "unknown";
+	}
+}
+
+// Private Class Methods
+// =============================================
+
+// addTime(Phase phase, chrono::steady_clock::duration duration)
+//  Purpose:
+//		Adds one call of duration to a phase
+void Instrumentation::addTime(Phase phase, chrono::steady_clock::duration duration) {
+	phaseNanoseconds[phase].fetch_add(chrono::duration_cast<chrono::nanoseconds>(duration).count(),
+		memory_order_relaxed);
+	phaseCalls[phase].fetch_add(1, memory_order_relaxed);
+}
+
+// addHardwareCounts(Phase phase, const HardwareCounters::Reading& startCounts)
+//  Purpose:
+//		Adds the CPU counts since startCounts (read by the same
+//		thread) to a phase
+void Instrumentation::addHardwareCounts(Phase phase, const HardwareCounters::Reading& startCounts) {
+	HardwareCounters::Reading endCounts;
+	if (!HardwareCounters::read(endCounts))
+		return;
+
+	for (int event = 0; event < HardwareCounters::numEvents; event++)
+		if (startCounts.values[event] >= 0 && endCounts.values[event] >= 0)
+			phaseEvents[phase][event].fetch_add(endCounts.values[event] - startCounts.values[event],
+				memory_order_relaxed);
+}
+
+// Totals currentTotals()
+//  Purpose:
+//		Returns the totals so far
+Instrumentation::Totals Instrumentation::currentTotals() {
+	Totals totals;
+	for (int phase = 0; phase < numPhases; phase++) {
+		totals.phaseNanoseconds[phase] = phaseNanoseconds[phase].load(memory_order_relaxed);
+		totals.phaseCalls[phase] = phaseCalls[phase].load(memory_order_relaxed);
+		totals.phaseColumns[phase] = phaseColumns[phase].load(memory_order_relaxed);
+		for (int event = 0; event < HardwareCounters::numEvents; event++)
+			totals.phaseEvents[phase][event] = phaseEvents[phase][event].load(memory_order_relaxed);
+	}
+	for (int counter = 0; counter < numCounters; counter++)
+		totals.counters[counter] = counters[counter].load(memory_order_relaxed);
+	totals.time = chrono::steady_clock::now();
+	return totals;
+}
+
+// Totals zeroTotals()
+//  Purpose:
+//		Returns totals of nothing, at the time recording started
+Instrumentation::Totals Instrumentation::zeroTotals() {
+	Totals totals;
+	for (int phase = 0; phase < numPhases; phase++) {
+		totals.phaseNanoseconds[phase] = 0;
+		totals.phaseCalls[phase] = 0;
+		totals.phaseColumns[phase] = 0;
+		for (int event = 0; event < HardwareCounters::numEvents; event++)
+			totals.phaseEvents[phase][event] = 0;
+	}
+	for (int counter = 0; counter < numCounters; counter++)
+		totals.counters[counter] = 0;
+	totals.time = enabledAt;
+	return totals;
+}
+
+// writeTotals(OutputBuffer& out, const Totals& start, const Totals& end, string indent)
+//  Purpose:
+//		Appends the "phases" and "counters" members for the difference
+//		between two totals
+void Instrumentation::writeTotals(OutputBuffer& out, const Totals& start, const Totals& end, string indent) {
+	out.append(indent + "\"phases\": {");
+	for (int phase = 0; phase < numPhases; phase++) {
+		out.append(phase == 0 ? "\n" : ",\n");
+		out.append(indent + "  \"" + phaseName((Phase) phase) + "\": {\"seconds\": ");
+		writeNumber(out, (end.phaseNanoseconds[phase] - start.phaseNanoseconds[phase]) / 1e9);
+		out.append(", \"calls\": ");
+		out.appendInt(end.phaseCalls[phase] - start.phaseCalls[phase]);
+		long long numColumns = end.phaseColumns[phase] - start.phaseColumns[phase];
+		out.append(", \"columns\": ");
+		out.appendInt(numColumns);
+
+		if (countingHardware) {
+			// -1 for an event that was not measured
+			long long events[HardwareCounters::numEvents];
+			for (int event = 0; event < HardwareCounters::numEvents; event++) {
+				events[event] = -1;
+				if (HardwareCounters::isCounted((HardwareCounters::Event) event))
+					events[event] = end.phaseEvents[phase][event] - start.phaseEvents[phase][event];
+				out.append(", \"" + HardwareCounters::eventName((HardwareCounters::Event) event) + "\": ");
+				if (events[event] < 0)
+					out.append("null");
+				else
+					out.appendInt(events[event]);
+			}
+			out.append(", \"ipc\": ");
+			writeRatio(out, events[HardwareCounters::instructionsEvent], events[HardwareCounters::cyclesEvent]);
+			out.append(", \"cacheMissesPerColumn\": ");
+			writeRatio(out, events[HardwareCounters::cacheMissesEvent], numColumns);
+			out.append(", \"branchMissesPerColumn\": ");
+			writeRatio(out, events[HardwareCounters::branchMissesEvent], numColumns);
+		}
+		out.append('}');
+	}
+	out.append("\n" + indent + "},\n");
+
+	out.append(indent + "\"counters\": {");
+	for (int counter = 0; counter < numCounters; counter++) {
+		out.append(counter == 0 ? "" : ", ");
+		out.append("\"" + counterName((Counter) counter) + "\": ");
+		out.appendInt(end.counters[counter] - start.counters[counter]);
+	}
+	out.append('}');
+}
+
+// writeRatio(OutputBuffer& out, long long numerator, long long denominator)
+//  Purpose:
+//		Appends numerator / denominator as a JSON number (null if
+//		either was not measured or the denominator is zero)
+void Instrumentation::writeRatio(OutputBuffer& out, long long numerator, long long denominator) {
+	if (numerator < 0 || denominator <= 0)
+		out.append("null");
+	else
+		writeNumber(out, (double) numerator / denominator);
+}
+
+// writeNumber(OutputBuffer& out, double value)
+//  Purpose:
+//		Appends value as a JSON number (null if it is not finite)
+void Instrumentation::writeNumber(OutputBuffer& out, double value) {
+	if (std::isfinite(value))
+		out.appendDouble(value, 9);
+	else
+		out.append("null");
+}
+
+// writeString(OutputBuffer& out, const string& text)
+//  Purpose:
+//		Appends text as a quoted JSON string
+void Instrumentation::writeString(OutputBuffer& out, const string& text) {
+	out.append('"');
+	for (char character : text) {
+		if (character == '"' || character == '\\') {
+			out.append('\\');
+			out.append(character);
+		}
+		else if ((unsigned char) character < 0x20) {
+			char escaped[8];
+			snprintf(escaped, sizeof(escaped), "\\u%04x", (unsigned char) character);
+			out.append(escaped);
+		}
+		else
+			out.append(character);
+	}
+	out.append('"');
+}
+
+// Global Allocation Functions
+// =============================================
+//	The replaceable operator new and delete, so heapAllocations counts
+//	every allocation made while recording.  The array, nothrow and sized
+//	forms all end up in these by default.  When not recording a call
+//	costs one test of a flag on top of malloc.
+
+void* operator new(size_t size) {
+	Instrumentation::count(Instrumentation::heapAllocationsCounter);
+	void* memory = malloc(size == 0 ? 1 : size);
+	if (memory == NULL)
+		throw bad_alloc();
+	return memory;
+}
+
+void* operator new(size_t size, align_val_t alignment) {
+	Instrumentation::count(Instrumentation::heapAllocationsCounter);
+	size_t align = (size_t) alignment;
+	void* memory = aligned_alloc(align, size == 0 ? align : (size + align - 1) / align * align);
+	if (memory == NULL)
+		throw bad_alloc();
+	return memory;
+}
+
+void operator delete(void* memory) noexcept {
+	free(memory);
+}
+
+void operator delete(void* memory, align_val_t) noexcept {
+	free(memory);
+}
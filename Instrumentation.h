@@ -0,0 +1,277 @@
+/*
+ * Instrumentation.h
+ *
+ *	This is the header file for the Instrumentation object.
+ *  Instrumentation is a container for the run's phase timers and
+ *  counters: how long was spent parsing alignments, building the model
+ *  graph, running viterbi, tracing back, gathering statistics, in the
+ *  E and M steps of Baum-Welch and writing output, and how many
+ *  columns were processed and heap allocations made.  The totals for the
+ *  run, and the part of them spent in each training iteration, are
+ *  written as a JSON report (writeReport).
+ *
+ *	Nothing is recorded until enable() is called, and a disabled timer
+ *  or counter costs one test of a flag, so the calls can stay in the
+ *  hot paths.  Phases are timed with a Timer on the stack, which is
+ *  also told the columns the phase covered:
+ *
+ *		{
+ *			Instrumentation::Timer timer(Instrumentation::viterbiPhase);
+ *			timer.addColumns(length);
+ *			...
+ *		}
+ *		Instrumentation::count(Instrumentation::columnsCounter, length);
+ *
+ *	If enabled with hardware counters, each Timer also reads the
+ *  thread's CPU counters (see HardwareCounters) when it starts and
+ *  stops, and each phase reports its cycles, instructions, cache misses
+ *  and branch misses, its instructions per cycle and its misses per
+ *  column.  A memory bound phase shows a low IPC with many cache misses
+ *  per column; a compute bound one a high IPC with few.  Where counters
+ *  are not available the report says why and only has the times.
+ *
+ *	Times are from the monotonic (steady) clock.  Timers and counters may
+ *  be used from any thread; time spent in a phase by several threads at
+ *  once is summed, so a phase can add up to more than the run's wall
+ *  clock time.  Timers of one phase must not nest.
+ *
+ *	Report format:
+ *		{
+ *		  "command": "<<command line>>",
+ *		  "wallSeconds": <<s>>,
+ *		  "hardwareCounters": {"available": <<bool>>, "reason": "<<why not>>"},	(if asked for)
+ *		  "phases": {
+ *		    "parse": {"seconds": <<s>>, "calls": <<n>>, "columns": <<n>>,
+ *		              "cycles": <<n>>, "instructions": <<n>>, "cacheMisses": <<n>>, "branchMisses": <<n>>,
+ *		              "ipc": <<x>>, "cacheMissesPerColumn": <<x>>, "branchMissesPerColumn": <<x>>},	(counts if asked for)
+ *		    ...
+ *		  },
+ *		  "counters": {"columns": <<n>>, "arenaAllocations": <<n>>, "heapAllocations": <<n>>,
+ *		               "bufferGrowths": <<n>>},
+ *		  "iterations": [
+ *		    {"iteration": <<n>>, "logLikelihood": <<l>>, "seconds": <<s>>,
+ *		     "phases": {...}, "counters": {...}},
+ *		    ...
+ *		  ]
+ *		}
+ *	Counts that were not measured, and ratios without a denominator, are
+ *  null.
+ *
+ *	heapAllocations counts every call of the global operator new (which
+ *  Instrumentation.cpp replaces, counting only while enabled) plus each
+ *  block a ModelArena mallocs; bufferGrowths counts the ModelArena
+ *  blocks and DecoderWorkspace buffer growths alone, which are the
+ *  allocations the decoder is meant to stop making once warmed up.
+ *
+ *  Created on: 10-18-26
+ */
+
+#ifndef INSTRUMENTATION_H
+#define INSTRUMENTATION_H
+
+#include "HardwareCounters.h"
+#include <string>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+using namespace std;
+
+class OutputBuffer;
+
+class Instrumentation
+{
+public:
+	// Public Types
+	// =============================================
+	enum Phase {
+		parsePhase,
+		buildPhase,
+		viterbiPhase,
+		tracebackPhase,
+		statisticsPhase,
+		expectationPhase,
+		maximizationPhase,
+		outputPhase,
+		numPhases
+	};
+
+	enum Counter {
+		columnsCounter,					// columns through a viterbi or forward pass
+		arenaAllocationsCounter,		// objects carved out of a ModelArena
+		heapAllocationsCounter,			// operator new calls and arena blocks
+		bufferGrowthsCounter,			// arena blocks and decoder buffer growths
+		numCounters
+	};
+
+	// Times a phase from construction to destruction (if enabled when
+	// constructed)
+	class Timer
+	{
+	public:
+		Timer(Phase aPhase) {
+			phase = aPhase;
+			running = enabled;
+			readingHardware = false;
+			if (running) {
+				if (countingHardware)
+					readingHardware = HardwareCounters::read(startCounts);
+				start = chrono::steady_clock::now();
+			}
+		}
+
+		~Timer() {
+			if (running) {
+				addTime(phase, chrono::steady_clock::now() - start);
+				if (readingHardware)
+					addHardwareCounts(phase, startCounts);
+			}
+		}
+
+		// addColumns(long long numColumns)
+		//  Purpose:
+		//		Adds to the columns the phase covered
+		void addColumns(long long numColumns) {
+			if (running)
+				phaseColumns[phase].fetch_add(numColumns, memory_order_relaxed);
+		}
+
+	private:
+		Phase phase;
+		bool running;
+		bool readingHardware;
+		chrono::steady_clock::time_point start;
+		HardwareCounters::Reading startCounts;
+	};
+
+	// Public Class Methods
+	// =============================================
+
+	// enable(bool hardwareCounters)
+	//  Purpose:
+	//		Starts recording, with the CPU counters of each phase if
+	//		hardwareCounters is set.  Must be called before any other
+	//		thread uses the instrumentation.
+	static void enable(bool hardwareCounters = false);
+
+	// bool isEnabled()
+	//  Purpose:
+	//		Returns true if recording
+	static bool isEnabled() {
+		return enabled;
+	}
+
+	// count(Counter counter, long long amount)
+	//  Purpose:
+	//		Adds amount to a counter
+	static void count(Counter counter, long long amount = 1) {
+		if (enabled)
+			counters[counter].fetch_add(amount, memory_order_relaxed);
+	}
+
+	// endIteration(int iteration, double logLikelihood)
+	//  Purpose:
+	//		Records the time and counts since the previous iteration ended
+	//		(or recording started) as a training iteration
+	static void endIteration(int iteration, double logLikelihood);
+
+	// writeReport(string fileName, string command)
+	//  Purpose:
+	//		Writes the JSON report of everything recorded to fileName.
+	//		Throws if it cannot be written.
+	static void writeReport(string fileName, string command);
+
+	// string phaseName(Phase phase)
+	//  Purpose:
+	//		Returns the name of a phase in the report
+	static string phaseName(Phase phase);
+
+	// string counterName(Counter counter)
+	//  Purpose:
+	//		Returns the name of a counter in the report
+	static string counterName(Counter counter);
+
+private:
+	// Private Types
+	// =============================================
+
+	// The totals at one point of the run
+	struct Totals {
+		long long phaseNanoseconds[numPhases];
+		long long phaseCalls[numPhases];
+		long long phaseColumns[numPhases];
+		long long phaseEvents[numPhases][HardwareCounters::numEvents];
+		long long counters[numCounters];
+		chrono::steady_clock::time_point time;
+	};
+
+	struct Iteration {
+		int iteration;
+		double logLikelihood;
+		Totals start;
+		Totals end;
+	};
+
+	// Private Attributes
+	// =============================================
+	static bool enabled;
+	static bool countingHardware;
+	static atomic<long long> phaseNanoseconds[numPhases];
+	static atomic<long long> phaseCalls[numPhases];
+	static atomic<long long> phaseColumns[numPhases];
+	static atomic<long long> phaseEvents[numPhases][HardwareCounters::numEvents];
+	static atomic<long long> counters[numCounters];
+	static chrono::steady_clock::time_point enabledAt;
+
+	static mutex iterationsLock;
+	static vector<Iteration> iterations;
+	static Totals iterationStart;	// totals when the current iteration started
+
+	// Private Class Methods
+	// =============================================
+
+	// addTime(Phase phase, chrono::steady_clock::duration duration)
+	//  Purpose:
+	//		Adds one call of duration to a phase
+	static void addTime(Phase phase, chrono::steady_clock::duration duration);
+
+	// addHardwareCounts(Phase phase, const HardwareCounters::Reading& startCounts)
+	//  Purpose:
+	//		Adds the CPU counts since startCounts (read by the same
+	//		thread) to a phase
+	static void addHardwareCounts(Phase phase, const HardwareCounters::Reading& startCounts);
+
+	// Totals currentTotals()
+	//  Purpose:
+	//		Returns the totals so far
+	static Totals currentTotals();
+
+	// Totals zeroTotals()
+	//  Purpose:
+	//		Returns totals of nothing, at the time recording started
+	static Totals zeroTotals();
+
+	// writeTotals(OutputBuffer& out, const Totals& start, const Totals& end, string indent)
+	//  Purpose:
+	//		Appends the "phases" and "counters" members for the difference
+	//		between two totals
+	static void writeTotals(OutputBuffer& out, const Totals& start, const Totals& end, string indent);
+
+	// writeRatio(OutputBuffer& out, long long numerator, long long denominator)
+	//  Purpose:
+	//		Appends numerator / denominator as a JSON number (null if
+	//		either was not measured or the denominator is zero)
+	static void writeRatio(OutputBuffer& out, long long numerator, long long denominator);
+
+	// writeNumber(OutputBuffer& out, double value)
+	//  Purpose:
+	//		Appends value as a JSON number (null if it is not finite)
+	static void writeNumber(OutputBuffer& out, double value);
+
+	// writeString(OutputBuffer& out, const string& text)
+	//  Purpose:
+	//		Appends text as a quoted JSON string
+	static void writeString(OutputBuffer& out, const string& text);
+};
+
+#endif // INSTRUMENTATION_H
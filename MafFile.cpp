@@ -0,0 +1,373 @@
+/*
+ * MafFile.cpp
+ *
+ *	The MafFile object reads the columns of a UCSC MAF file for a list of
+ *  species, projected onto the reference (first) species.  See MafFile.h
+ *  for how gaps, missing species and coordinates are handled.
+ *
+ *	Only the 's' lines of a block are used; 'i', 'e' and 'q' lines and
+ *  comments are skipped.  Blocks whose reference row is on another
+ *  chromosome or on the minus strand are skipped.
+ *
+ *  Created on: 10-18-26
+ */
+#include "MafFile.h"
+#include "MappedFile.h"
+#include "GzipDecompressor.h"
+#include "AlignmentTranspose.h"
+#include <cstring>
+#include <cstdlib>
+#include <stdexcept>
+#include <thread>
+#include <algorithm>
+
+// Constuctors
+// ==============================================
+MafFile::MafFile(const vector<string>& speciesList, string aChromosome) {
+	species = speciesList;
+	chromosome = aChromosome;
+	if (species.empty())
+		throw runtime_error("No species selected for MAF file");
+}
+
+MafFile::MafFile(string fileName, const vector<string>& speciesList, string aChromosome)
+	: MafFile(speciesList, aChromosome) {
+	MappedFile inputFile(fileName);
+	if (GzipDecompressor::isGzip(inputFile.data(), inputFile.size())) {
+		vector<char> text;
+		GzipDecompressor::decompress(inputFile.data(), inputFile.size(), text);
+		parse(text.data(), text.size());
+	}
+	else
+		parse(inputFile.data(), inputFile.size());
+}
+
+// Destructor
+// =============================================
+MafFile::~MafFile() {
+}
+
+// Public Class Methods
+// =============================================
+
+// bool isMafFile(const char* data, size_t length)
+//  Purpose: 
+//		Returns true if data starts with the ##maf header line
+bool MafFile::isMafFile(const char* data, size_t length) {
+	return length >= 5 && memcmp(data, "##maf", 5) == 0;
+}
+
+// int getCoordinate(const vector<pair<int, int> >& coordinateBreaks, int column)
+//  Purpose: 
+//		Returns the coordinate of column given the (column, coordinate)
+//		breaks of an alignment (column itself if there are no breaks)
+int MafFile::getCoordinate(const vector<pair<int, int> >& coordinateBreaks, int column) {
+	// Last break at or before the column
+	vector<pair<int, int> >::const_iterator aBreak = upper_bound(coordinateBreaks.begin(),
+		coordinateBreaks.end(), make_pair(column, 0x7fffffff));
+	if (aBreak == coordinateBreaks.begin())
+		return column;
+	--aBreak;
+
+	return aBreak->second + (column - aBreak->first);
+}
+
+// Public Methods
+// =============================================
+
+// parse(const char* text, size_t length)
+//  Purpose: 
+//		Parses MAF text (called by the file constructor with the file
+//		contents).  Throws a runtime_error if the reference blocks
+//		overlap or are out of coordinate order.
+//
+//		Parsing Steps:
+//			1. Find the reference chromosome (the first reference row)
+//			   if one was not given
+//			2. Split the text into one chunk per thread, moving each split
+//			   point forward to the next 'a' line
+//			3. Parse each chunk's blocks into its own columns in parallel
+//			4. Append the chunks in order, shifting their break columns and
+//			   dropping breaks where a chunk carries on from the previous one
+void MafFile::parse(const char* text, size_t length) {
+	const char* end = text + length;
+	if (chromosome.empty())
+		chromosome = findChromosome(text, length);
+
+	// Split the text into chunks at 'a' lines (small files are not worth
+	// the thread start up)
+	const size_t minChunkLength = 1 << 20;
+	int numChunks = thread::hardware_concurrency();
+	if (numChunks < 1)
+		numChunks = 1;
+	if ((size_t) numChunks > length / minChunkLength)
+		numChunks = max((size_t) 1, length / minChunkLength);
+
+	vector<const char*> chunkStarts;
+	chunkStarts.push_back(text);
+	for (int chunk = 1; chunk < numChunks; chunk++) {
+		const char* split = max(chunkStarts.back(), text + length * chunk / numChunks);
+		while (split < end) {
+			const char* lineEnd = (const char*) memchr(split, '\n', end - split);
+			if (lineEnd == NULL) {
+				split = end;
+				break;
+			}
+			split = lineEnd + 1;
+			if (split < end && split[0] == 'a' && (end - split == 1 || split[1] == ' ' || split[1] == '\n'))
+				break;
+		}
+		chunkStarts.push_back(split);
+	}
+	chunkStarts.push_back(end);
+
+	// Parse the chunks
+	vector<ChunkColumns> chunks(numChunks);
+	vector<thread> threads;
+	for (int chunk = 0; chunk < numChunks - 1; chunk++) {
+		threads.push_back(thread([this, &chunkStarts, &chunks, chunk]() {
+			try {
+				parseChunk(chunkStarts[chunk], chunkStarts[chunk + 1], chunks[chunk]);
+			}
+			catch (const exception& error) {
+				chunks[chunk].error = error.what();
+			}
+		}));
+	}
+	try {
+		parseChunk(chunkStarts[numChunks - 1], end, chunks[numChunks - 1]);
+	}
+	catch (const exception& error) {
+		chunks[numChunks - 1].error = error.what();
+	}
+	for (thread& aThread : threads)
+		aThread.join();
+	for (ChunkColumns& chunk : chunks) {
+		if (!chunk.error.empty())
+			throw runtime_error(chunk.error);
+	}
+
+	// Append the chunks
+	int numSpecies = species.size();
+	size_t totalResidues = 0;
+	for (ChunkColumns& chunk : chunks)
+		totalResidues += chunk.residues.size();
+	residues.clear();
+	residues.reserve(totalResidues);
+	coordinateBreaks.clear();
+	for (ChunkColumns& chunk : chunks) {
+		int firstColumn = residues.size() / numSpecies;
+		for (pair<int, int>& aBreak : chunk.coordinateBreaks) {
+			int column = aBreak.first + firstColumn;
+			if (aBreak.first == 0 && column > 0 && aBreak.second <= getCoordinate(column - 1))
+				throw runtime_error("MAF blocks are not in reference coordinate order");
+			if (aBreak.first == 0 && column > 0 && getCoordinate(column - 1) + 1 == aBreak.second)
+				continue;
+			coordinateBreaks.push_back(make_pair(column, aBreak.second));
+		}
+		residues.insert(residues.end(), chunk.residues.begin(), chunk.residues.end());
+		vector<char>().swap(chunk.residues);
+	}
+}
+
+// int getCoordinate(int column)
+//  Purpose: 
+//		Returns the reference coordinate of column
+int MafFile::getCoordinate(int column) {
+	return getCoordinate(coordinateBreaks, column);
+}
+
+// Public Accessors
+// =============================================
+int MafFile::getNumSpecies() {
+	return species.size();
+}
+
+int MafFile::getNumColumns() {
+	return residues.size() / species.size();
+}
+
+const char* MafFile::getColumn(int column) {
+	return residues.data() + (size_t) column * species.size();
+}
+
+vector<char>& MafFile::getResidues() {
+	return residues;
+}
+
+vector<pair<int, int> >& MafFile::getCoordinateBreaks() {
+	return coordinateBreaks;
+}
+
+string& MafFile::getChromosome() {
+	return chromosome;
+}
+
+// Private Methods
+// =============================================
+
+// parseChunk(const char* begin, const char* end, ChunkColumns& chunk)
+//  Purpose: 
+//		Parses the blocks between begin and end into chunk (the break
+//		columns are relative to the start of the chunk)
+//
+//		's' line format (whitespace separated):
+//			s src start size strand srcSize text
+//		where src is species.chromosome and start is 0 based
+void MafFile::parseChunk(const char* begin, const char* end, ChunkColumns& chunk) {
+	int numSpecies = species.size();
+	vector<const char*> rows(numSpecies, NULL);
+	vector<int> rowLengths(numSpecies, 0);
+	int referenceStart = -1;		// -1 unless the block is on the reference chromosome
+	bool inBlock = false;
+
+	const char* lineStart = begin;
+	while (lineStart <= end) {
+		const char* lineEnd = (lineStart < end) ? (const char*) memchr(lineStart, '\n', end - lineStart) : NULL;
+		if (lineEnd == NULL)
+			lineEnd = end;
+
+		// A block ends at an 'a' line, a blank line or the end of the chunk
+		bool blockEnd = lineStart == end || lineEnd == lineStart || lineStart[0] == 'a'
+			|| (lineEnd - lineStart == 1 && lineStart[0] == '\r');
+		if (blockEnd && inBlock) {
+			if (referenceStart >= 0) {
+				for (int i = 1; i < numSpecies; i++) {
+					if (rows[i] != NULL && rowLengths[i] != rowLengths[0])
+						throw runtime_error("MAF rows in a block have different lengths");
+				}
+				addBlock(rows, referenceStart, rowLengths[0], chunk);
+			}
+			fill(rows.begin(), rows.end(), (const char*) NULL);
+			referenceStart = -1;
+			inBlock = false;
+		}
+		if (lineStart == end)
+			break;
+
+		if (lineStart[0] == 'a')
+			inBlock = true;
+		else if (lineStart[0] == 's' && inBlock) {
+			// Split the line into its seven fields
+			const char* fields[7];
+			const char* fieldEnds[7];
+			int numFields = 0;
+			const char* position = lineStart;
+			while (numFields < 7) {
+				while (position < lineEnd && (*position == ' ' || *position == '\t' || *position == '\r'))
+					position++;
+				if (position == lineEnd)
+					break;
+				fields[numFields] = position;
+				while (position < lineEnd && *position != ' ' && *position != '\t' && *position != '\r')
+					position++;
+				fieldEnds[numFields++] = position;
+			}
+			if (numFields < 7)
+				throw runtime_error("Invalid MAF s line");
+
+			// src is species.chromosome
+			const char* dot = (const char*) memchr(fields[1], '.', fieldEnds[1] - fields[1]);
+			const char* speciesEnd = (dot == NULL) ? fieldEnds[1] : dot;
+			size_t speciesLength = speciesEnd - fields[1];
+			int speciesIndex = -1;
+			for (int i = 0; i < numSpecies && speciesIndex < 0; i++) {
+				if (species[i].size() == speciesLength && memcmp(species[i].data(), fields[1], speciesLength) == 0)
+					speciesIndex = i;
+			}
+
+			// Only the first row of a species in a block is used
+			if (speciesIndex >= 0 && rows[speciesIndex] == NULL) {
+				rows[speciesIndex] = fields[6];
+				rowLengths[speciesIndex] = fieldEnds[6] - fields[6];
+
+				if (speciesIndex == 0) {
+					const char* chromosomeStart = (dot == NULL) ? fieldEnds[1] : dot + 1;
+					if ((size_t) (fieldEnds[1] - chromosomeStart) == chromosome.size()
+						&& memcmp(chromosomeStart, chromosome.data(), chromosome.size()) == 0
+						&& fields[4][0] == '+')
+						referenceStart = atoi(fields[2]);
+				}
+			}
+		}
+
+		lineStart = lineEnd + 1;
+	}
+}
+
+// addBlock(vector<const char*>& rows, int referenceStart, int textLength, ChunkColumns& chunk)
+//  Purpose: 
+//		Appends the reference projected columns of one block to chunk.
+//		rows holds the alignment text of each species (NULL if missing).
+//		Throws a runtime_error if the block starts at or before the last
+//		coordinate kept (blocks must not overlap and must be in
+//		coordinate order, as in the UCSC files).
+void MafFile::addBlock(vector<const char*>& rows, int referenceStart, int textLength, ChunkColumns& chunk) {
+	int numSpecies = species.size();
+	const char* reference = rows[0];
+	int coordinate = referenceStart + 1;	// 1 based
+	int lastCoordinate = -1;
+	if (!chunk.residues.empty())
+		lastCoordinate = chunk.coordinateBreaks.back().second
+			+ ((int) (chunk.residues.size() / numSpecies) - 1 - chunk.coordinateBreaks.back().first);
+	if (coordinate <= lastCoordinate)
+		throw runtime_error("MAF blocks are not in reference coordinate order");
+
+	// Transpose the whole block, then squeeze out the dropped columns
+	size_t blockStart = chunk.residues.size();
+	chunk.residues.resize(blockStart + (size_t) textLength * numSpecies);
+	char* blockColumns = chunk.residues.data() + blockStart;
+	AlignmentTranspose::transpose(rows.data(), numSpecies, textLength, blockColumns);
+
+	int numKept = 0;
+	for (int i = 0; i < textLength; i++) {
+		char referenceResidue = reference[i];
+		if (referenceResidue == '-' || referenceResidue == '.')
+			continue;
+		int columnCoordinate = coordinate++;
+		if (AlignmentTranspose::normalizeResidue(referenceResidue) == '-')
+			continue;
+
+		if (columnCoordinate != lastCoordinate + 1)
+			chunk.coordinateBreaks.push_back(make_pair((int) (blockStart / numSpecies) + numKept, columnCoordinate));
+		lastCoordinate = columnCoordinate;
+
+		if (numKept != i)
+			memcpy(blockColumns + (size_t) numKept * numSpecies, blockColumns + (size_t) i * numSpecies, numSpecies);
+		numKept++;
+	}
+	chunk.residues.resize(blockStart + (size_t) numKept * numSpecies);
+}
+
+// string findChromosome(const char* text, size_t length)
+//  Purpose: 
+//		Returns the chromosome of the first reference row in the text
+string MafFile::findChromosome(const char* text, size_t length) {
+	const char* end = text + length;
+	const char* lineStart = text;
+	while (lineStart < end) {
+		const char* lineEnd = (const char*) memchr(lineStart, '\n', end - lineStart);
+		if (lineEnd == NULL)
+			lineEnd = end;
+
+		// 's' lines may pad the src with extra spaces
+		if (lineStart[0] == 's') {
+			const char* src = lineStart + 1;
+			while (src < lineEnd && (*src == ' ' || *src == '\t'))
+				src++;
+			size_t speciesLength = species[0].size();
+			if ((size_t) (lineEnd - src) > speciesLength && memcmp(src, species[0].data(), speciesLength) == 0
+				&& src[speciesLength] == '.') {
+				const char* chromosomeStart = src + speciesLength + 1;
+				const char* chromosomeEnd = chromosomeStart;
+				while (chromosomeEnd < lineEnd && *chromosomeEnd != ' ' && *chromosomeEnd != '\t')
+					chromosomeEnd++;
+				return string(chromosomeStart, chromosomeEnd);
+			}
+		}
+
+		lineStart = lineEnd + 1;
+	}
+
+	return "";
+}
@@ -0,0 +1,134 @@
+/*
+ * MafFile.h
+ *
+ *	This is the header file for the MafFile object.  MafFile reads a UCSC
+ *  Multiple Alignment Format (MAF) file and keeps the alignment columns
+ *  for a chosen list of species, projected onto the reference species
+ *  (the first species in the list).
+ *
+ *	For every alignment block ('a' line followed by 's' lines) on the
+ *  reference chromosome:
+ *		- columns where the reference has a gap are dropped, as are
+ *		  columns where the reference residue is not A, C, G or T
+ *		- species missing from the block are gaps in every column
+ *		- residues are upper cased and anything other than A, C, G or T
+ *		  (e.g. N) is stored as a gap
+ *
+ *	Each kept column is stored as one residue per species, in the order
+ *  of the species list, along with its reference coordinate.  The
+ *  coordinates are 1 based and are kept as breakpoints: a (column,
+ *  coordinate) pair wherever the coordinate does not follow on from the
+ *  previous column, so a region made of several blocks with unaligned
+ *  stretches between them maps back to the right reference positions.
+ *
+ *	The file (optionally gzip/BGZF compressed) is mapped and parsed block
+ *  parallel like the .aln format, split into one chunk per thread at 'a'
+ *  lines.
+ *
+ *	Typical use:
+ *		vector<string> species = {"hg18", "canFam2", "mm8"};
+ *		MafFile mafFile("chr7.maf.gz", species);
+ *		const char* column = mafFile.getColumn(0);  // hg18, canFam2, mm8
+ *
+ *  Created on: 10-18-26
+ */
+
+#ifndef MAFFILE_H
+#define MAFFILE_H
+
+#include <string>
+#include <vector>
+#include <utility>
+using namespace std;
+
+class MafFile
+{
+public:
+	// Constuctors
+	// ==============================================
+	MafFile(const vector<string>& species, string chromosome = "");
+	MafFile(string fileName, const vector<string>& species, string chromosome = "");
+
+	// Destructor
+	// =============================================
+	~MafFile();
+
+	// Public Class Methods
+	// =============================================
+
+	// bool isMafFile(const char* data, size_t length)
+	//  Purpose: 
+	//		Returns true if data starts with the ##maf header line
+	static bool isMafFile(const char* data, size_t length);
+
+	// int getCoordinate(const vector<pair<int, int> >& coordinateBreaks, int column)
+	//  Purpose: 
+	//		Returns the coordinate of column given the (column, coordinate)
+	//		breaks of an alignment (column itself if there are no breaks)
+	static int getCoordinate(const vector<pair<int, int> >& coordinateBreaks, int column);
+
+	// Public Methods
+	// =============================================
+
+	// parse(const char* text, size_t length)
+	//  Purpose: 
+	//		Parses MAF text (called by the file constructor with the file
+	//		contents).  Throws a runtime_error if the reference blocks
+	//		overlap or are out of coordinate order.
+	void parse(const char* text, size_t length);
+
+	// int getCoordinate(int column)
+	//  Purpose: 
+	//		Returns the reference coordinate of column
+	int getCoordinate(int column);
+
+	// Public Accessors
+	// =============================================
+	int getNumSpecies();
+	int getNumColumns();
+	const char* getColumn(int column);	// one residue per species
+	vector<char>& getResidues();			// all columns, numSpecies residues each
+	vector<pair<int, int> >& getCoordinateBreaks();	// (column, coordinate)
+	string& getChromosome();
+
+private:
+	// Private Types
+	// =============================================
+	struct ChunkColumns {
+		vector<char> residues;
+		vector<pair<int, int> > coordinateBreaks;
+		string error;					// why parsing the chunk failed (empty if it did not)
+	};
+
+	// Private Attributes
+	// =============================================
+	vector<string> species;
+	string chromosome;
+	vector<char> residues;
+	vector<pair<int, int> > coordinateBreaks;
+
+	// Private Methods
+	// =============================================
+
+	// parseChunk(const char* begin, const char* end, ChunkColumns& chunk)
+	//  Purpose: 
+	//		Parses the blocks between begin and end into chunk (the break
+	//		columns are relative to the start of the chunk)
+	void parseChunk(const char* begin, const char* end, ChunkColumns& chunk);
+
+	// addBlock(vector<const char*>& rows, int referenceStart, int textLength, ChunkColumns& chunk)
+	//  Purpose: 
+	//		Appends the reference projected columns of one block to chunk.
+	//		rows holds the alignment text of each species (NULL if missing).
+	//		Throws a runtime_error if the block starts at or before the last
+	//		coordinate kept (blocks must not overlap and must be in
+	//		coordinate order, as in the UCSC files).
+	void addBlock(vector<const char*>& rows, int referenceStart, int textLength, ChunkColumns& chunk);
+
+	// string findChromosome(const char* text, size_t length)
+	//  Purpose: 
+	//		Returns the chromosome of the first reference row in the text
+	string findChromosome(const char* text, size_t length);
+};
+
+#endif // MAFFILE_H
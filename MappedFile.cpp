@@ -0,0 +1,67 @@
+/*
+ * MappedFile.cpp
+ *
+ *	The MappedFile object maps a whole file read only into memory for the
+ *  lifetime of the object.  Failing to open or map the file throws a
+ *  runtime_error naming the file.
+ *
+ *  Created on: 10-18-26
+ */
+#include "MappedFile.h"
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Constuctors
+// ==============================================
+MappedFile::MappedFile(string aFileName) {
+	fileName = aFileName;
+	mapping = NULL;
+	length = 0;
+
+	int fileDescriptor = open(fileName.c_str(), O_RDONLY);
+	if (fileDescriptor < 0)
+		throw runtime_error("Unable to open file: " + fileName);
+
+	struct stat fileStat;
+	if (fstat(fileDescriptor, &fileStat) != 0) {
+		close(fileDescriptor);
+		throw runtime_error("Unable to read file: " + fileName);
+	}
+
+	// mmap rejects zero length mappings, so an empty file has no data
+	length = fileStat.st_size;
+	if (length > 0) {
+		mapping = mmap(NULL, length, PROT_READ, MAP_SHARED, fileDescriptor, 0);
+		if (mapping == MAP_FAILED) {
+			mapping = NULL;
+			close(fileDescriptor);
+			throw runtime_error("Unable to map file: " + fileName);
+		}
+	}
+
+	close(fileDescriptor);
+}
+
+// Destructor
+// =============================================
+MappedFile::~MappedFile() {
+	if (mapping != NULL)
+		munmap(mapping, length);
+}
+
+// Public Accessors
+// =============================================
+const char* MappedFile::data() {
+	return (const char*) mapping;
+}
+
+size_t MappedFile::size() {
+	return length;
+}
+
+string& MappedFile::getFileName() {
+	return fileName;
+}
@@ -0,0 +1,50 @@
+/*
+ * MappedFile.h
+ *
+ *	This is the header file for the MappedFile object.  MappedFile maps
+ *  a whole file read only into memory and unmaps it when destroyed, so
+ *  the binary file formats can be read in place without copying.
+ *
+ *	Typical use:
+ *		MappedFile file("chr7.path");
+ *		const char* contents = file.data();
+ *
+ *  Created on: 10-18-26
+ */
+
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <string>
+using namespace std;
+
+class MappedFile
+{
+public:
+	// Constuctors
+	// ==============================================
+	MappedFile(string fileName);
+
+	// Destructor
+	// =============================================
+	~MappedFile();
+
+	// Public Accessors
+	// =============================================
+	const char* data();		// start of the mapping (NULL for an empty file)
+	size_t size();			// length of the file in bytes
+	string& getFileName();
+
+private:
+	// Private Attributes
+	// =============================================
+	string fileName;
+	void* mapping;
+	size_t length;
+
+	// Not copyable (the object owns the mapping)
+	MappedFile(const MappedFile&);
+	MappedFile& operator=(const MappedFile&);
+};
+
+#endif // MAPPEDFILE_H
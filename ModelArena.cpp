@@ -0,0 +1,112 @@
+/*
+ * ModelArena.cpp
+ *
+ *	The ModelArena object allocates the hidden markov model graph in
+ *  bulk.  See ModelArena.h for the block sizes and what reset() keeps.
+ *
+ *  Created on: 10-18-26
+ */
+#include "ModelArena.h"
+#include "Instrumentation.h"
+#include <cstdlib>
+#include <cstdint>
+
+// const variable initialization
+// ==============================================
+const size_t ModelArena::maxBlockSize = 1 << 26;
+
+// Constuctors
+// ==============================================
+ModelArena::ModelArena(size_t anInitialBlockSize) {
+	initialBlockSize = anInitialBlockSize;
+	current = NULL;
+	blockEnd = NULL;
+	bytesUsed = 0;
+}
+
+// Destructor
+// =============================================
+ModelArena::~ModelArena() {
+	for (char* block : blocks)
+		free(block);
+}
+
+// Public Methods
+// =============================================
+
+// void* allocate(size_t size, size_t alignment)
+//  Purpose:
+//		Returns size bytes aligned to alignment (a power of two no
+//		larger than alignof(max_align_t))
+void* ModelArena::allocate(size_t size, size_t alignment) {
+	Instrumentation::count(Instrumentation::arenaAllocationsCounter);
+
+	// Blocks come from malloc, so they are aligned for any type and only
+	// the offset into the block needs rounding
+	char* aligned = (char*) (((uintptr_t) current + alignment - 1) & ~(uintptr_t) (alignment - 1));
+	if (current == NULL || aligned + size > blockEnd) {
+		addBlock(size);
+		aligned = current;
+	}
+
+	bytesUsed += aligned + size - current;
+	current = aligned + size;
+	return aligned;
+}
+
+// reset()
+//  Purpose:
+//		Releases every object in the arena.  The largest block is kept
+//		for reuse and the others are freed.
+void ModelArena::reset() {
+	if (!blocks.empty()) {
+		for (size_t i = 0; i + 1 < blocks.size(); i++)
+			free(blocks[i]);
+		blocks.front() = blocks.back();
+		blockSizes.front() = blockSizes.back();
+		blocks.resize(1);
+		blockSizes.resize(1);
+		current = blocks.front();
+		blockEnd = current + blockSizes.front();
+	}
+	bytesUsed = 0;
+}
+
+// Public Accessors
+// =============================================
+size_t ModelArena::getBytesReserved() {
+	size_t bytesReserved = 0;
+	for (size_t blockSize : blockSizes)
+		bytesReserved += blockSize;
+	return bytesReserved;
+}
+
+size_t ModelArena::getBytesUsed() {
+	return bytesUsed;
+}
+
+// Private Methods
+// =============================================
+
+// addBlock(size_t minimumSize)
+//  Purpose:
+//		Adds a block of at least minimumSize bytes and allocates from
+//		it from now on
+void ModelArena::addBlock(size_t minimumSize) {
+	size_t blockSize = blockSizes.empty() ? initialBlockSize : blockSizes.back() * 2;
+	if (blockSize > maxBlockSize)
+		blockSize = maxBlockSize;
+	if (blockSize < minimumSize)
+		blockSize = minimumSize;
+
+	char* block = (char*) malloc(blockSize);
+	if (block == NULL)
+		throw bad_alloc();
+	Instrumentation::count(Instrumentation::heapAllocationsCounter);
+	Instrumentation::count(Instrumentation::bufferGrowthsCounter);
+
+	blocks.push_back(block);
+	blockSizes.push_back(blockSize);
+	current = block;
+	blockEnd = block + blockSize;
+}
@@ -0,0 +1,163 @@
+/*
+ * ModelArena.h
+ *
+ *	This is the header file for the ModelArena object.  ModelArena is
+ *  the bump allocator that holds the graph of a hidden markov model
+ *  (HMMPosition, HMMNode and HMMTransition objects and the arrays linking
+ *  them).  A model of n positions is built from a few million small
+ *  objects that all live exactly as long as the model, so they are
+ *  carved out of large blocks instead of being allocated one at a time,
+ *  and are all released together by reset() or the destructor.
+ *
+ *	Blocks double in size (up to maxBlockSize), so a model of any length
+ *  takes a handful of blocks and releasing it costs a handful of frees
+ *  regardless of the number of objects.  reset() keeps the largest block
+ *  so the next model of a similar size allocates nothing new.
+ *
+ *	Destructors are never run for objects created in the arena, so they
+ *  must not own memory outside it.  Collections inside arena objects use
+ *  ArenaArray (a fixed capacity array in the arena) rather than vector.
+ *
+ *	Typical use:
+ *		ModelArena arena;
+ *		HMMNode* node = arena.create<HMMNode>(id, state, symbol, model);
+ *		node->inTransitions.reserve(arena, 2);
+ *		...
+ *		arena.reset();		// every object above is gone
+ *
+ *  Created on: 10-18-26
+ */
+
+#ifndef MODELARENA_H
+#define MODELARENA_H
+
+#include <vector>
+#include <cstddef>
+#include <new>
+#include <utility>
+#include <stdexcept>
+using namespace std;
+
+class ModelArena
+{
+public:
+	// Constuctors
+	// ==============================================
+	ModelArena(size_t anInitialBlockSize = 1 << 16);
+
+	// Destructor
+	// =============================================
+	~ModelArena();
+
+	// Public Methods
+	// =============================================
+
+	// void* allocate(size_t size, size_t alignment)
+	//  Purpose:
+	//		Returns size bytes aligned to alignment (a power of two no
+	//		larger than alignof(max_align_t))
+	void* allocate(size_t size, size_t alignment);
+
+	// T* create<T>(args...)
+	//  Purpose:
+	//		Constructs a T in the arena from args
+	template <class T, class... Args>
+	T* create(Args&&... args) {
+		return new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+	}
+
+	// T* allocateArray<T>(size_t count)
+	//  Purpose:
+	//		Returns uninitialized space for count objects of T
+	template <class T>
+	T* allocateArray(size_t count) {
+		return (T*) allocate(count * sizeof(T), alignof(T));
+	}
+
+	// reset()
+	//  Purpose:
+	//		Releases every object in the arena.  The largest block is kept
+	//		for reuse and the others are freed.
+	void reset();
+
+	// Public Accessors
+	// =============================================
+	size_t getBytesReserved();		// total size of the blocks held
+	size_t getBytesUsed();			// bytes handed out since the last reset
+
+private:
+	// Private Attributes
+	// =============================================
+	static const size_t maxBlockSize;
+	vector<char*> blocks;
+	vector<size_t> blockSizes;
+	size_t initialBlockSize;
+	char* current;					// next free byte of the last block
+	char* blockEnd;
+	size_t bytesUsed;
+
+	// Private Methods
+	// =============================================
+
+	// addBlock(size_t minimumSize)
+	//  Purpose:
+	//		Adds a block of at least minimumSize bytes and allocates from
+	//		it from now on
+	void addBlock(size_t minimumSize);
+};
+
+// ArenaArray is a fixed capacity array whose storage is in a ModelArena.
+// It has no destructor, so it can be a member of an arena object.  The
+// capacity must be reserved before items are added.
+template <class T>
+class ArenaArray
+{
+public:
+	// Constuctors
+	// ==============================================
+	ArenaArray() {
+		items = NULL;
+		count = 0;
+		capacity = 0;
+	}
+
+	// Public Methods
+	// =============================================
+
+	// reserve(ModelArena& arena, int aCapacity)
+	//  Purpose:
+	//		Empties the array and gives it room for aCapacity items
+	void reserve(ModelArena& arena, int aCapacity) {
+		items = arena.allocateArray<T>(aCapacity);
+		count = 0;
+		capacity = aCapacity;
+	}
+
+	// add(const T& item)
+	//  Purpose:
+	//		Appends item, throwing if the array is full
+	void add(const T& item) {
+		if (count == capacity)
+			throw runtime_error("ArenaArray capacity exceeded");
+		items[count++] = item;
+	}
+
+	// Public Accessors
+	// =============================================
+	T* begin() { return items; }
+	T* end() { return items + count; }
+	T& front() { return items[0]; }
+	T& back() { return items[count - 1]; }
+	T& operator[](int index) { return items[index]; }
+	int size() { return count; }
+	bool empty() { return count == 0; }
+
+private:
+	// Private Attributes
+	// =============================================
+	T* items;
+	int count;
+	int capacity;
+};
+
+#endif // MODELARENA_H
@@ -17,7 +17,37 @@
  * Typical use for the file would be to use the MultipleAlignementFile(fileName)
  * constructor to create the object.  This will automatically open the
  * Multiple Alignment File specified by the fileName, and read its contents
- * storing them in the sequence vector
+ * storing one encoded symbol per column (see encodeColumn).  Every
+ * distinct column is also interned in a ColumnDictionary, and the column
+ * ids are what the hidden markov model reads; the sequence vector of
+ * residue strings is only filled in on request.
+ *
+ * The file is parsed block parallel: it is split into one chunk per
+ * thread at hg18 block boundaries, the blocks in each chunk are located
+ * in parallel, and then each chunk encodes its blocks into its own
+ * pre-sized slice of the symbol array, so the column order is preserved.
+ *
+ * Gzip or BGZF compressed alignment files are inflated in memory (see
+ * GzipDecompressor) and the text is handed straight to the parser.
+ *
+ * UCSC MAF files (starting with ##maf) are read with MafFile using the
+ * species list given to the constructor (hg18, canFam2, mm8 by default).
+ * Any number of species can be read; the one byte symbols (and alignment
+ * caches) are only available for three species alignments.
+ * Their columns are projected onto the reference species and can skip
+ * reference coordinates, so coordinates are kept as (column, coordinate)
+ * breaks and getCoordinate should be used rather than the start position
+ * plus the column.
+ *
+ * If fileName is an alignment cache (see AlignmentCacheFile) the symbols
+ * are mapped straight from the cache instead.
+ *
+ * The range constructor loads only the columns with coordinates in
+ * [rangeStart, rangeEnd).  Text alignments need an alignment index (see
+ * AlignmentIndexFile) so that only the blocks covering the range are
+ * parsed; caches are simply narrowed.  The start position and
+ * coordinate breaks are those of the first column loaded, so results
+ * and BED segments come out in chromosome coordinates.
  *
  *  Created on: 3-6-13
  *      Author: tomkolar
@@ -25,99 +55,608 @@
 
 #include "MultipleAlignmentFile.h"
 #include "StringUtilities.h"
-#include <sstream>
-#include <iostream>
-#include <fstream>
+#include "AlignmentCacheFile.h"
+#include "AlignmentIndexFile.h"
+#include "MappedFile.h"
+#include "GzipDecompressor.h"
+#include "MafFile.h"
+#include "ColumnDictionary.h"
+#include "AlignmentTranspose.h"
+#include "Instrumentation.h"
+#include "TraceRecorder.h"
+#include <cstring>
+#include <cstdlib>
+#include <stdexcept>
+#include <thread>
+#include <algorithm>
 #include <vector>
 using namespace std;
 
+// const variable initialization
+// ==============================================
+const unsigned char MultipleAlignmentFile::unknownSymbol = 255;
+const vector<string> MultipleAlignmentFile::defaultSpecies = {"hg18", "canFam2", "mm8"};
+
 // Constuctors
 // ==============================================
 MultipleAlignmentFile::MultipleAlignmentFile() {
+	startPosition = 0;
+	rangeStart = 0;
+	rangeEnd = 0;
+	symbols = NULL;
+	numColumns = 0;
+	cacheFile = NULL;
+	columnDictionary = new ColumnDictionary(defaultSpecies);
+}
+
+MultipleAlignmentFile::MultipleAlignmentFile(string name)
+	: MultipleAlignmentFile(name, defaultSpecies) {
 }
 
-MultipleAlignmentFile::MultipleAlignmentFile(string name) {
+MultipleAlignmentFile::MultipleAlignmentFile(string name, const vector<string>& speciesList)
+	: MultipleAlignmentFile(name, speciesList, 0, 0) {
+}
+
+MultipleAlignmentFile::MultipleAlignmentFile(string name, const vector<string>& speciesList,
+	int aRangeStart, int aRangeEnd) {
 	fileName = name;
-	populate();
+	species = speciesList;
+	rangeStart = aRangeStart;
+	rangeEnd = aRangeEnd;
+	startPosition = 0;
+	symbols = NULL;
+	numColumns = 0;
+	cacheFile = NULL;
+	columnDictionary = new ColumnDictionary(species);
+
+	// The destructor does not run if populating throws, so free here
+	// (a scan keeps going after a bad file)
+	Instrumentation::Timer timer(Instrumentation::parsePhase);
+	TraceRecorder::Span span("parse", "parse alignment");
+	try {
+		if (AlignmentCacheFile::isCacheFile(fileName))
+			populateFromCache();
+		else if (isRange())
+			populateFromIndex();
+		else
+			populate();
+	}
+	catch (...) {
+		delete cacheFile;
+		delete columnDictionary;
+		throw;
+	}
+	timer.addColumns(numColumns);
 }
 
 // Destructor
 // ==============================================
 MultipleAlignmentFile::~MultipleAlignmentFile() {
+	delete cacheFile;
+	delete columnDictionary;
+}
+
+// Public Class Methods
+// =============================================
+
+// unsigned char encodeColumn(char human, char dog, char mouse)
+//  Purpose: 
+//		Returns the symbol for an alignment column.  Each residue is
+//		A, C, T, G or - (0-4) and the symbol is the base 5 number
+//		human dog mouse, which is also the column's index in
+//		HMMProbabilities.emissionResidueMap.  Returns unknownSymbol
+//		if any residue is outside the alphabet.
+unsigned char MultipleAlignmentFile::encodeColumn(char human, char dog, char mouse) {
+	static const signed char residueCodes[256] = {
+		-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+		-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+		-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,  4, -1, -1,	// '-'
+		-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+		-1,  0, -1,  1, -1, -1, -1,  3, -1, -1, -1, -1, -1, -1, -1, -1,	// A C G
+		-1, -1, -1, -1,  2, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,	// T
+		-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+		-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+		-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+		-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+		-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+		-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+		-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+		-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+		-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+		-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1
+	};
+
+	int humanCode = residueCodes[(unsigned char) human];
+	int dogCode = residueCodes[(unsigned char) dog];
+	int mouseCode = residueCodes[(unsigned char) mouse];
+	if (humanCode < 0 || dogCode < 0 || mouseCode < 0)
+		return unknownSymbol;
+
+	return (unsigned char) (25 * humanCode + 5 * dogCode + mouseCode);
+}
+
+// string symbolResidue(unsigned char symbol)
+//  Purpose: 
+//		Returns the three residue string for a symbol
+string MultipleAlignmentFile::symbolResidue(unsigned char symbol) {
+	static const char alphabet[] = "ACTG-";
+	if (symbol >= 125)
+		return "NNN";
+
+	string residue(3, ' ');
+	residue[0] = alphabet[symbol / 25];
+	residue[1] = alphabet[(symbol / 5) % 5];
+	residue[2] = alphabet[symbol % 5];
+	return residue;
+}
+
+// parseHeaderLine(string line, int& startPosition, string& chromosome)
+//  Purpose: 
+//		Sets the start position and chromosome from the header line of
+//		a Multiple Alignment File (e.g. "ENm012 chr7:115000-135000").
+//		Either is left unchanged if it is missing from the line.
+void MultipleAlignmentFile::parseHeaderLine(string line, int& startPosition, string& chromosome) {
+	while (!line.empty() && (line.back() == '\n' || line.back() == '\r'))
+		line.pop_back();
+	vector<string> firstLineTokens;
+	StringUtilities::split(line, ':', firstLineTokens);
+	if (!firstLineTokens.empty()) {
+		vector<string> positions;
+		StringUtilities::split(firstLineTokens.back(), '-', positions);
+		if (!positions.empty())
+			startPosition = atoi(positions.front().c_str());
+	}
+
+	// Chromosome is the last word before the ':'
+	if (firstLineTokens.size() > 1) {
+		string& beforeColon = firstLineTokens[firstLineTokens.size() - 2];
+		size_t wordStart = beforeColon.find_last_of(" \t");
+		chromosome = (wordStart == string::npos) ? beforeColon : beforeColon.substr(wordStart + 1);
+	}
+}
+
+// Public Methods
+// =============================================
+
+// string getResidue(int position)
+//  Purpose: 
+//		Returns the three residue string for the column at position
+string MultipleAlignmentFile::getResidue(int position) {
+	return columnDictionary->column(columnIds[position]);
+}
+
+// int getCoordinate(int position)
+//  Purpose: 
+//		Returns the chromosome coordinate of the column at position
+int MultipleAlignmentFile::getCoordinate(int position) {
+	if (coordinateBreaks.empty())
+		return startPosition + position;
+
+	return MafFile::getCoordinate(coordinateBreaks, position);
+}
+
+// int findColumn(int coordinate)
+//  Purpose: 
+//		Returns the first column with a coordinate at or after
+//		coordinate (the sequence length if there is none)
+int MultipleAlignmentFile::findColumn(int coordinate) {
+	// Coordinates increase with the column
+	int column = 0;
+	int count = numColumns;
+	while (count > 0) {
+		int step = count / 2;
+		if (getCoordinate(column + step) < coordinate) {
+			column += step + 1;
+			count -= step + 1;
+		}
+		else
+			count = step;
+	}
+	return column;
 }
 
 // Public Accessors
 // =============================================
 const int MultipleAlignmentFile::getSequenceLength() {
-	return sequence.size();
+	return numColumns;
 }
 
 const int MultipleAlignmentFile::getStartPosition() {
 	return startPosition;
 }
 
+string& MultipleAlignmentFile::getChromosome() {
+	return chromosome;
+}
+
 string& MultipleAlignmentFile::getFileName() {
 	return fileName;
 }
 
 vector<string>& MultipleAlignmentFile::getSequence() {
+	// Only the column ids are kept, so build the strings once
+	if (sequence.empty()) {
+		sequence.reserve(numColumns);
+		for (int i = 0; i < numColumns; i++)
+			sequence.push_back(getResidue(i));
+	}
+
 	return sequence;
 }
 
+const unsigned char* MultipleAlignmentFile::getSymbols() {
+	return symbols;
+}
+
+const int* MultipleAlignmentFile::getColumnIds() {
+	return columnIds.data();
+}
+
+ColumnDictionary* MultipleAlignmentFile::getColumnDictionary() {
+	return columnDictionary;
+}
+
+bool MultipleAlignmentFile::isCached() {
+	return cacheFile != NULL;
+}
+
+vector<pair<int, int> >& MultipleAlignmentFile::getCoordinateBreaks() {
+	return coordinateBreaks;
+}
+
+bool MultipleAlignmentFile::isRange() {
+	return rangeEnd > rangeStart;
+}
+
 // Private Methods
 // =============================================
 
 // populate()
 //  Purpose:
-//		Reads in the Multiple Alignment File specified by fileName and
-//		populates the object with its contents
+//		Reads in the Multiple Alignment File specified by fileName
+//		(inflating it first if it is gzip compressed) and populates the
+//		object with its contents
 //	Preconditions:
 //		fileName has been set
 //  Postconditions:
-//		sequence - populated with sequence from file
+//		symbols - the encoded symbol for each column in the file
 void MultipleAlignmentFile::populate() {
+	MappedFile inputFile(fileName);
+	const char* text = inputFile.data();
+	size_t length = inputFile.size();
+	vector<char> inflatedText;
+	if (GzipDecompressor::isGzip(text, length)) {
+		GzipDecompressor::decompress(text, length, inflatedText);
+		text = inflatedText.data();
+		length = inflatedText.size();
+	}
 
-	ifstream inputFile( fileName);
-	string line;
+	if (MafFile::isMafFile(text, length))
+		populateFromMaf(text, length);
+	else {
+		parseAlignment(text, length);
+		internSymbols();
+	}
+}
 
-	getline(inputFile, line);
-	vector<string> firstLineTokens;
-	StringUtilities::split(line, ':', firstLineTokens);
-	vector<string> positions;
-	StringUtilities::split(firstLineTokens.back(), '-', positions);
-	startPosition = atoi(positions.front().c_str());
-		
-	while(getline(inputFile, line)) {
-		if (line.empty())
-			continue;
-		vector<string> tokens;
-		StringUtilities::split(line, '\t', tokens);	
-		if ("hg18" == tokens.front()) {
-			string humanSeq = tokens.back();
-
-			// Get the dog sequence
-			getline(inputFile, line);
-			vector<string> dogTokens;
-			StringUtilities::split(line, '\t', dogTokens);	
-			string  dogSeq = dogTokens.back();
-
-			// Get the mouse sequence
-			getline(inputFile, line);
-			vector<string> mouseTokens;
-			StringUtilities::split(line, '\t', mouseTokens);	
-			string  mouseSeq = mouseTokens.back();
-
-			// Create the residue for the sequences
-			for (size_t i=0; i < humanSeq.length(); i++) {
-				stringstream ss;
-				ss
-					<< humanSeq.at(i)
-					<< dogSeq.at(i)
-					<< mouseSeq.at(i);
-				sequence.push_back(ss.str());
+// populateFromIndex()
+//  Purpose:
+//		Loads the columns in [rangeStart, rangeEnd) of the Multiple
+//		Alignment File specified by fileName, using its alignment index
+//		(see AlignmentIndexFile) to parse only the blocks covering them.
+//		The file is mapped, so only the pages holding those blocks are
+//		read.
+//	Preconditions:
+//		fileName is an uncompressed alignment with an up to date index
+//  Postconditions:
+//		startPosition - the coordinate of the first column in the range
+//		symbols - the encoded symbol for each column in the range
+//		columnIds - the column dictionary id of each column in the range
+void MultipleAlignmentFile::populateFromIndex() {
+	AlignmentIndexFile index(AlignmentIndexFile::indexFileName(fileName));
+	if (!index.matchesSource())
+		throw runtime_error("Alignment index is out of date for " + fileName + " (run hmm index)");
+	if (index.isMaf() && index.getReferenceSpecies() != species[0])
+		throw runtime_error("Alignment index was built for reference species " + index.getReferenceSpecies());
+
+	size_t textOffset;
+	size_t textLength;
+	int firstCoordinate;
+	if (!index.findBlocks(rangeStart, rangeEnd, textOffset, textLength, firstCoordinate))
+		throw runtime_error("No alignment blocks in range");
+
+	MappedFile inputFile(fileName);
+	const char* text = inputFile.data() + textOffset;
+	if (index.isMaf()) {
+		populateFromMaf(text, textLength, index.getChromosome());
+		return;
+	}
+
+	// The blocks carry on from the first block's coordinate
+	parseBlocks(text, text + textLength);
+	chromosome = index.getChromosome();
+	startPosition = firstCoordinate;
+	keepRange();
+	internSymbols();
+}
+
+// parseAlignment(const char* text, size_t length)
+//  Purpose:
+//		Parses the text of a Multiple Alignment File: the header line
+//		followed by hg18/dog/mouse row blocks (see parseBlocks)
+//  Postconditions:
+//		startPosition, chromosome - set from the header line
+//		symbols - the encoded symbol for each column in the file
+void MultipleAlignmentFile::parseAlignment(const char* text, size_t length) {
+	const char* end = text + length;
+	const char* body = (const char*) memchr(text, '\n', length);
+	body = (body == NULL) ? end : body + 1;
+
+	// Header line (e.g. "ENm012 chr7:115000-135000")
+	parseHeaderLine(string(text, body - text), startPosition, chromosome);
+
+	parseBlocks(body, end);
+}
+
+// parseBlocks(const char* body, const char* end)
+//  Purpose:
+//		Parses the hg18/dog/mouse row blocks between body and end
+//
+//		Parsing Steps:
+//			1. Split the text into one chunk per thread, moving each split
+//			   point forward to the start of the next hg18 line so that no
+//			   block straddles two chunks
+//			2. Find the blocks in each chunk in parallel
+//			3. Prefix sum the column counts of the chunks to get each
+//			   chunk's slice of the symbol array
+//			4. Encode each chunk's blocks into its slice in parallel
+//  Postconditions:
+//		symbols - the encoded symbol for each column
+void MultipleAlignmentFile::parseBlocks(const char* body, const char* end) {
+	// Split the body into chunks at hg18 lines (small files are not
+	// worth the thread start up)
+	const size_t minChunkLength = 1 << 20;
+	size_t bodyLength = end - body;
+	int numChunks = thread::hardware_concurrency();
+	if (numChunks < 1)
+		numChunks = 1;
+	if ((size_t) numChunks > bodyLength / minChunkLength)
+		numChunks = max((size_t) 1, bodyLength / minChunkLength);
+
+	vector<const char*> chunkStarts;
+	chunkStarts.push_back(body);
+	for (int chunk = 1; chunk < numChunks; chunk++) {
+		const char* split = max(chunkStarts.back(), body + bodyLength * chunk / numChunks);
+		while (split < end) {
+			const char* lineEnd = (const char*) memchr(split, '\n', end - split);
+			if (lineEnd == NULL) {
+				split = end;
+				break;
+			}
+			split = lineEnd + 1;
+			if (end - split > 4 && memcmp(split, "hg18", 4) == 0 && (split[4] == '\t' || split[4] == '\n'))
+				break;
+		}
+		chunkStarts.push_back(split);
+	}
+	chunkStarts.push_back(end);
+
+	// Find the blocks in each chunk
+	vector<vector<AlignmentBlock> > chunkBlocks(numChunks);
+	vector<thread> threads;
+	for (int chunk = 0; chunk < numChunks - 1; chunk++)
+		threads.push_back(thread(&MultipleAlignmentFile::findBlocks,
+			chunkStarts[chunk], chunkStarts[chunk + 1], ref(chunkBlocks[chunk])));
+	findBlocks(chunkStarts[numChunks - 1], end, chunkBlocks[numChunks - 1]);
+	for (thread& aThread : threads)
+		aThread.join();
+	threads.clear();
+
+	// Each chunk's slice of the symbols starts after the previous chunks' columns
+	vector<size_t> chunkOffsets(numChunks + 1, 0);
+	for (int chunk = 0; chunk < numChunks; chunk++) {
+		chunkOffsets[chunk + 1] = chunkOffsets[chunk];
+		for (AlignmentBlock& block : chunkBlocks[chunk])
+			chunkOffsets[chunk + 1] += block.length;
+	}
+	symbolStorage.resize(chunkOffsets[numChunks]);
+
+	// Encode the chunks into their slices
+	for (int chunk = 0; chunk < numChunks - 1; chunk++)
+		threads.push_back(thread(&MultipleAlignmentFile::encodeBlocks,
+			cref(chunkBlocks[chunk]), symbolStorage.data() + chunkOffsets[chunk]));
+	encodeBlocks(chunkBlocks[numChunks - 1], symbolStorage.data() + chunkOffsets[numChunks - 1]);
+	for (thread& aThread : threads)
+		aThread.join();
+
+	symbols = symbolStorage.data();
+	numColumns = symbolStorage.size();
+}
+
+// findBlocks(const char* begin, const char* end, vector<AlignmentBlock>& blocks)
+//  Purpose:
+//		Appends the blocks between begin and end to blocks.  A block is a
+//		line whose first field is hg18 and the two lines after it, and the
+//		residues of each row are the row's last tab separated field.
+//		Lines that are not part of a block are skipped.
+void MultipleAlignmentFile::findBlocks(const char* begin, const char* end, vector<AlignmentBlock>& blocks) {
+	const char* lineStart = begin;
+	while (lineStart < end) {
+		const char* lineEnd = (const char*) memchr(lineStart, '\n', end - lineStart);
+		if (lineEnd == NULL)
+			lineEnd = end;
+
+		if (lineEnd - lineStart >= 4 && memcmp(lineStart, "hg18", 4) == 0
+			&& (lineEnd - lineStart == 4 || lineStart[4] == '\t')) {
+
+			// The hg18 row and the two rows after it
+			const char* rows[3];
+			int lengths[3];
+			const char* rowStart = lineStart;
+			for (int row = 0; row < 3; row++) {
+				if (rowStart >= end)
+					throw runtime_error("Incomplete alignment block");
+				const char* rowEnd = (const char*) memchr(rowStart, '\n', end - rowStart);
+				if (rowEnd == NULL)
+					rowEnd = end;
+				const char* fieldEnd = rowEnd;
+				if (fieldEnd > rowStart && fieldEnd[-1] == '\r')
+					fieldEnd--;
+				const char* field = fieldEnd;
+				while (field > rowStart && field[-1] != '\t')
+					field--;
+				rows[row] = field;
+				lengths[row] = fieldEnd - field;
+				rowStart = rowEnd + 1;
 			}
+
+			if (lengths[1] < lengths[0] || lengths[2] < lengths[0])
+				throw runtime_error("Alignment rows shorter than the hg18 row");
+
+			AlignmentBlock block = {rows[0], rows[1], rows[2], lengths[0]};
+			blocks.push_back(block);
+			lineStart = rowStart;
+		}
+		else
+			lineStart = lineEnd + 1;
+	}
+}
+
+// encodeBlocks(const vector<AlignmentBlock>& blocks, unsigned char* columnSymbols)
+//  Purpose:
+//		Encodes the columns of the blocks into columnSymbols
+void MultipleAlignmentFile::encodeBlocks(const vector<AlignmentBlock>& blocks, unsigned char* columnSymbols) {
+	for (const AlignmentBlock& block : blocks) {
+		AlignmentTranspose::encodeColumns(block.human, block.dog, block.mouse, block.length, columnSymbols);
+		columnSymbols += block.length;
+	}
+}
+
+// populateFromMaf(const char* text, size_t length, string mafChromosome)
+//  Purpose:
+//		Reads the species columns of MAF text and encodes them.  The
+//		reference chromosome is the first reference row's unless
+//		mafChromosome is given.  Only the columns in [rangeStart,
+//		rangeEnd) are kept if a range was requested.
+//  Postconditions:
+//		startPosition, chromosome, coordinateBreaks - set from the
+//		reference rows
+//		symbols - the encoded symbol for each column (three species only)
+//		columnIds - the column dictionary id of each column
+void MultipleAlignmentFile::populateFromMaf(const char* text, size_t length, string mafChromosome) {
+	MafFile mafFile(species, mafChromosome);
+	mafFile.parse(text, length);
+
+	chromosome = mafFile.getChromosome();
+	coordinateBreaks = mafFile.getCoordinateBreaks();
+	numColumns = mafFile.getNumColumns();
+	startPosition = (numColumns > 0) ? mafFile.getCoordinate(0) : 0;
+	int firstColumn = isRange() ? keepRange() : 0;
+
+	// Three species columns also get symbols (so they can be cached)
+	if (species.size() == 3) {
+		symbolStorage.resize(numColumns);
+		for (int i = 0; i < numColumns; i++) {
+			const char* column = mafFile.getColumn(firstColumn + i);
+			symbolStorage[i] = encodeColumn(column[0], column[1], column[2]);
+		}
+		symbols = symbolStorage.data();
+		internSymbols();
+		return;
+	}
+
+	columnIds.resize(numColumns);
+	for (int i = 0; i < numColumns; i++)
+		columnIds[i] = columnDictionary->intern(mafFile.getColumn(firstColumn + i));
+}
+
+// populateFromCache()
+//  Purpose:
+//		Maps the alignment cache specified by fileName and uses its
+//		symbols in place (only those in [rangeStart, rangeEnd) if a
+//		range was requested).  Throws a runtime_error if the alignment
+//		the cache was written from has changed since.
+//	Preconditions:
+//		fileName is an alignment cache
+//  Postconditions:
+//		symbols - points into the mapped cache
+void MultipleAlignmentFile::populateFromCache() {
+	cacheFile = new AlignmentCacheFile(fileName);
+	if (!cacheFile->matchesSource())
+		throw runtime_error("Alignment cache is out of date for " + cacheFile->getSourceFileName()
+			+ " (run hmm encode)");
+	startPosition = cacheFile->getStartPosition();
+	chromosome = cacheFile->getChromosome();
+	symbols = cacheFile->getSymbols();
+	numColumns = cacheFile->getNumColumns();
+	cacheFile->getCoordinateBreaks(coordinateBreaks);
+	if (isRange())
+		keepRange();
+	internSymbols();
+}
+
+// int keepRange()
+//  Purpose:
+//		Narrows the columns to those with coordinates in [rangeStart,
+//		rangeEnd) and returns the index of the first column kept.  The
+//		symbols are narrowed if they have been set; otherwise the caller
+//		encodes the kept columns.
+//  Postconditions:
+//		startPosition, coordinateBreaks - those of the first kept column
+//		numColumns - the number of columns kept
+int MultipleAlignmentFile::keepRange() {
+	int firstColumn = findColumn(rangeStart);
+	int lastColumn = findColumn(rangeEnd);
+	if (firstColumn == lastColumn)
+		throw runtime_error("No alignment columns in range");
+
+	int firstCoordinate = getCoordinate(firstColumn);
+	if (!coordinateBreaks.empty()) {
+		vector<pair<int, int> > rangeBreaks;
+		rangeBreaks.push_back(make_pair(0, firstCoordinate));
+		for (pair<int, int>& aBreak : coordinateBreaks) {
+			if (aBreak.first > firstColumn && aBreak.first < lastColumn)
+				rangeBreaks.push_back(make_pair(aBreak.first - firstColumn, aBreak.second));
 		}
+		coordinateBreaks.swap(rangeBreaks);
+	}
+	startPosition = firstCoordinate;
+	numColumns = lastColumn - firstColumn;
+
+	if (!symbolStorage.empty()) {
+		symbolStorage.erase(symbolStorage.begin() + lastColumn, symbolStorage.end());
+		symbolStorage.erase(symbolStorage.begin(), symbolStorage.begin() + firstColumn);
+		symbols = symbolStorage.data();
+	}
+	else if (symbols != NULL)
+		symbols += firstColumn;
+
+	return firstColumn;
+}
+
+// internSymbols()
+//  Purpose:
+//		Interns the column of every symbol in the column dictionary.  The
+//		seeded columns' ids are their symbols, so only columns outside
+//		them (a human gap) need a lookup.  Throws a runtime_error for a
+//		column with a residue outside ACTG-, which no model can emit.
+//  Postconditions:
+//		columnIds - the column dictionary id of each column
+void MultipleAlignmentFile::internSymbols() {
+	// Symbols are always human/dog/mouse columns (whatever species were asked for)
+	if (columnDictionary->getNumSpecies() != 3) {
+		delete columnDictionary;
+		columnDictionary = new ColumnDictionary(defaultSpecies);
 	}
 
-	inputFile.close();
+	columnIds.resize(numColumns);
+	for (int i = 0; i < numColumns; i++) {
+		if (symbols[i] < ColumnDictionary::numLegacyColumns)
+			columnIds[i] = symbols[i];
+		else if (symbols[i] == unknownSymbol)
+			throw runtime_error("Alignment column at " + to_string(getCoordinate(i))
+				+ " has a residue outside ACTG-: " + fileName);
+		else
+			columnIds[i] = columnDictionary->intern(symbolResidue(symbols[i]).c_str());
+	}
 }
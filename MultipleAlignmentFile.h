@@ -17,7 +17,37 @@
  * Typical use for the file would be to use the MultipleAlignementFile(fileName)
  * constructor to create the object.  This will automatically open the
  * Multiple Alignment File specified by the fileName, and read its contents
- * storing them in the sequence vector
+ * storing one encoded symbol per column (see encodeColumn).  Every
+ * distinct column is also interned in a ColumnDictionary, and the column
+ * ids are what the hidden markov model reads; the sequence vector of
+ * residue strings is only filled in on request.
+ *
+ * The file is parsed block parallel: it is split into one chunk per
+ * thread at hg18 block boundaries, the blocks in each chunk are located
+ * in parallel, and then each chunk encodes its blocks into its own
+ * pre-sized slice of the symbol array, so the column order is preserved.
+ *
+ * Gzip or BGZF compressed alignment files are inflated in memory (see
+ * GzipDecompressor) and the text is handed straight to the parser.
+ *
+ * UCSC MAF files (starting with ##maf) are read with MafFile using the
+ * species list given to the constructor (hg18, canFam2, mm8 by default).
+ * Any number of species can be read; the one byte symbols (and alignment
+ * caches) are only available for three species alignments.
+ * Their columns are projected onto the reference species and can skip
+ * reference coordinates, so coordinates are kept as (column, coordinate)
+ * breaks and getCoordinate should be used rather than the start position
+ * plus the column.
+ *
+ * If fileName is an alignment cache (see AlignmentCacheFile) the symbols
+ * are mapped straight from the cache instead.
+ *
+ * The range constructor loads only the columns with coordinates in
+ * [rangeStart, rangeEnd).  Text alignments need an alignment index (see
+ * AlignmentIndexFile) so that only the blocks covering the range are
+ * parsed; caches are simply narrowed.  The start position and
+ * coordinate breaks are those of the first column loaded, so results
+ * and BED segments come out in chromosome coordinates.
  *
  *  Created on: 3-6-13
  *      Author: tomkolar
@@ -28,8 +58,13 @@
 
 #include <string>
 #include <vector>
+#include <utility>
 using namespace std;
 
+class AlignmentCacheFile;
+class MafFile;
+class ColumnDictionary;
+
 class MultipleAlignmentFile {
 
 public:
@@ -38,41 +73,196 @@ public:
 	// ==============================================
 	MultipleAlignmentFile(); 
 	MultipleAlignmentFile(string fileName);  
+	MultipleAlignmentFile(string fileName, const vector<string>& species);
+	MultipleAlignmentFile(string fileName, const vector<string>& species, int rangeStart, int rangeEnd);
 
 	// Destructor
 	// =============================================
 	virtual ~MultipleAlignmentFile();
 
+	// Public Attributes
+	// =============================================
+	static const unsigned char unknownSymbol;	// column with a residue outside ACTG-
+	static const vector<string> defaultSpecies;	// MAF species (human, dog, mouse)
+
+	// Public Class Methods
+	// =============================================
+
+	// unsigned char encodeColumn(char human, char dog, char mouse)
+	//  Purpose: 
+	//		Returns the symbol for an alignment column.  Each residue is
+	//		A, C, T, G or - (0-4) and the symbol is the base 5 number
+	//		human dog mouse, which is also the column's index in
+	//		HMMProbabilities.emissionResidueMap.  Returns unknownSymbol
+	//		if any residue is outside the alphabet.
+	static unsigned char encodeColumn(char human, char dog, char mouse);
+
+	// string symbolResidue(unsigned char symbol)
+	//  Purpose: 
+	//		Returns the three residue string for a symbol
+	static string symbolResidue(unsigned char symbol);
+
+	// parseHeaderLine(string line, int& startPosition, string& chromosome)
+	//  Purpose: 
+	//		Sets the start position and chromosome from the header line of
+	//		a Multiple Alignment File (e.g. "ENm012 chr7:115000-135000").
+	//		Either is left unchanged if it is missing from the line.
+	static void parseHeaderLine(string line, int& startPosition, string& chromosome);
+
 	// Public Methods
 	// =============================================
 
+	// string getResidue(int position)
+	//  Purpose: 
+	//		Returns the three residue string for the column at position
+	string getResidue(int position);
+
+	// int getCoordinate(int position)
+	//  Purpose: 
+	//		Returns the chromosome coordinate of the column at position
+	int getCoordinate(int position);
+
+	// int findColumn(int coordinate)
+	//  Purpose: 
+	//		Returns the first column with a coordinate at or after
+	//		coordinate (the sequence length if there is none)
+	int findColumn(int coordinate);
+
 	// Public Accessors
 	// =============================================
 	const int getSequenceLength();  // length of dnaSequence
 	const int getStartPosition();  // start position on chromosome
+	string& getChromosome();  // chromosome from the header line (may be empty)
 	string& getFileName();
 	vector<string>& getSequence();
+	const unsigned char* getSymbols();  // one symbol per column (NULL unless three species)
+	const int* getColumnIds();  // column dictionary id of each column
+	ColumnDictionary* getColumnDictionary();
+	bool isCached();  // true if loaded from an alignment cache
+	vector<pair<int, int> >& getCoordinateBreaks();  // (column, coordinate), empty if contiguous
+	bool isRange();  // true if only a coordinate range was loaded
 
 private:
+	// Private Types
+	// =============================================
+	struct AlignmentBlock {
+		const char* human;		// hg18 row residues
+		const char* dog;		// row after hg18
+		const char* mouse;		// second row after hg18
+		int length;				// columns in the block (hg18 row length)
+	};
+
 	// Attributes
 	// =============================================
     string fileName;
 	int startPosition;
+	int rangeStart;		// coordinates to load, [rangeStart, rangeEnd)
+	int rangeEnd;		// (the whole file unless rangeEnd > rangeStart)
+	string chromosome;
+	vector<string> species;
+	vector<pair<int, int> > coordinateBreaks;
     vector<string> sequence;
+	vector<unsigned char> symbolStorage;
+	const unsigned char* symbols;
+	int numColumns;
+	ColumnDictionary* columnDictionary;
+	vector<int> columnIds;
+	AlignmentCacheFile* cacheFile;
 
 	// Private Methods
 	// =============================================
 
 	// populate()
 	//  Purpose:
-	//		Reads in the Multiple Alignment File specified by fileName and
-	//		populates the object with its contents
+	//		Reads in the Multiple Alignment File specified by fileName
+	//		(inflating it first if it is gzip compressed) and populates the
+	//		object with its contents
 	//	Preconditions:
 	//		fileName has been set
 	//  Postconditions:
-	//		sequence - populated with sequence from file
+	//		symbols - the encoded symbol for each column in the file
     void populate();
 
+	// parseAlignment(const char* text, size_t length)
+	//  Purpose:
+	//		Parses the text of a Multiple Alignment File: the header line
+	//		followed by hg18/dog/mouse row blocks
+	//  Postconditions:
+	//		startPosition, chromosome - set from the header line
+	//		symbols - the encoded symbol for each column in the file
+	void parseAlignment(const char* text, size_t length);
+
+	// parseBlocks(const char* body, const char* end)
+	//  Purpose:
+	//		Parses the hg18/dog/mouse row blocks between body and end
+	//  Postconditions:
+	//		symbols - the encoded symbol for each column
+	void parseBlocks(const char* body, const char* end);
+
+	// populateFromIndex()
+	//  Purpose:
+	//		Loads the columns in [rangeStart, rangeEnd) of the Multiple
+	//		Alignment File specified by fileName, using its alignment index
+	//		to parse only the blocks covering them
+	//	Preconditions:
+	//		fileName is an uncompressed alignment with an up to date index
+	//  Postconditions:
+	//		startPosition - the coordinate of the first column in the range
+	//		symbols - the encoded symbol for each column in the range
+	//		columnIds - the column dictionary id of each column in the range
+	void populateFromIndex();
+
+	// populateFromMaf(const char* text, size_t length, string mafChromosome = "")
+	//  Purpose:
+	//		Reads the species columns of MAF text and encodes them.  The
+	//		reference chromosome is the first reference row's unless
+	//		mafChromosome is given.  Only the columns in [rangeStart,
+	//		rangeEnd) are kept if a range was requested.
+	//  Postconditions:
+	//		startPosition, chromosome, coordinateBreaks - set from the
+	//		reference rows
+	//		symbols - the encoded symbol for each column (three species only)
+	//		columnIds - the column dictionary id of each column
+	void populateFromMaf(const char* text, size_t length, string mafChromosome = "");
+
+	// findBlocks(const char* begin, const char* end, vector<AlignmentBlock>& blocks)
+	//  Purpose:
+	//		Appends the blocks between begin and end to blocks
+	static void findBlocks(const char* begin, const char* end, vector<AlignmentBlock>& blocks);
+
+	// encodeBlocks(const vector<AlignmentBlock>& blocks, unsigned char* columnSymbols)
+	//  Purpose:
+	//		Encodes the columns of the blocks into columnSymbols
+	static void encodeBlocks(const vector<AlignmentBlock>& blocks, unsigned char* columnSymbols);
+
+	// internSymbols()
+	//  Purpose:
+	//		Interns the column of every symbol in the column dictionary
+	//  Postconditions:
+	//		columnIds - the column dictionary id of each column
+	void internSymbols();
+
+	// populateFromCache()
+	//  Purpose:
+	//		Maps the alignment cache specified by fileName and uses its
+	//		symbols in place (only those in [rangeStart, rangeEnd) if a
+	//		range was requested).  Throws a runtime_error if the alignment
+	//		the cache was written from has changed since.
+	//	Preconditions:
+	//		fileName is an alignment cache
+	//  Postconditions:
+	//		symbols - points into the mapped cache
+	void populateFromCache();
+
+	// int keepRange()
+	//  Purpose:
+	//		Narrows the columns to those with coordinates in [rangeStart,
+	//		rangeEnd) and returns the index of the first column kept
+	//  Postconditions:
+	//		startPosition, coordinateBreaks - those of the first kept column
+	//		numColumns - the number of columns kept
+	int keepRange();
+
 };
 
 #endif // MULTIPLEALIGNMENTFILE_H 
@@ -0,0 +1,210 @@
+/*
+ * OutputBuffer.cpp
+ *
+ *  The OutputBuffer object is an append-only output buffer in front of a
+ *  file descriptor.  Text is appended to a large fixed size buffer which
+ *  is written to the file descriptor with a single write whenever it
+ *  fills up (and when the buffer is flushed or destroyed), so producing
+ *  output costs a memcpy rather than a string allocation per item.
+ *
+ *  Numbers are formatted directly into the buffer (to_chars style) and
+ *  produce the same text as writing them to a stream with the same
+ *  precision, so results written through an OutputBuffer are byte for
+ *  byte the same as the older stringstream built results.
+ *
+ *  An OutputBuffer created without a file descriptor keeps everything in
+ *  memory (the buffer grows as needed) and str() returns the contents.
+ *
+ *  Created on: 10-18-26
+ */
+#include "OutputBuffer.h"
+#include <cstring>
+#include <cstdio>
+#include <charconv>
+#include <cerrno>
+#include <stdexcept>
+#include <algorithm>
+#include <fcntl.h>
+#ifdef _WIN32
+#include <io.h>
+#define write _write
+#define close _close
+#define open _open
+#else
+#include <unistd.h>
+#endif
+
+// const variable initialization
+// ==============================================
+const size_t OutputBuffer::defaultCapacity = 1 << 20;
+
+// Constuctors
+// ==============================================
+OutputBuffer::OutputBuffer() {
+	fileDescriptor = -1;
+	ownsFileDescriptor = false;
+	buffer.resize(256);
+	used = 0;
+}
+
+OutputBuffer::OutputBuffer(int aFileDescriptor, size_t aCapacity) {
+	fileDescriptor = aFileDescriptor;
+	ownsFileDescriptor = false;
+	buffer.resize(aCapacity);
+	used = 0;
+}
+
+OutputBuffer::OutputBuffer(string fileName, size_t aCapacity) {
+	fileDescriptor = open(fileName.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fileDescriptor < 0)
+		throw runtime_error("Unable to open output file: " + fileName);
+	ownsFileDescriptor = true;
+	buffer.resize(aCapacity);
+	used = 0;
+}
+
+// Destructor
+// =============================================
+OutputBuffer::~OutputBuffer() {
+	// A destructor can not throw, so write errors are only reported to
+	// callers that flush before the buffer is destroyed
+	try {
+		flush();
+	}
+	catch (const runtime_error& error) {
+	}
+	if (ownsFileDescriptor)
+		close(fileDescriptor);
+}
+
+// Public Methods
+// =============================================
+
+// append(const char* text, size_t length)
+//  Purpose: 
+//		Appends length characters of text to the buffer, writing the
+//		buffer out first if there is not enough room.
+void OutputBuffer::append(const char* text, size_t length) {
+	if (used + length > buffer.size()) {
+		// In memory buffers just grow
+		if (fileDescriptor < 0) {
+			buffer.resize(max(buffer.size() * 2, used + length));
+			memcpy(&buffer[used], text, length);
+			used += length;
+			return;
+		}
+
+		flush();
+
+		// Too big to buffer, so write it straight through
+		if (length > buffer.size()) {
+			writeAll(text, length);
+			return;
+		}
+	}
+
+	memcpy(&buffer[used], text, length);
+	used += length;
+}
+
+// append(const string& text)
+//  Purpose: 
+//		Appends text to the buffer
+void OutputBuffer::append(const string& text) {
+	append(text.data(), text.size());
+}
+
+// append(const char* text)
+//  Purpose: 
+//		Appends a null terminated string to the buffer
+void OutputBuffer::append(const char* text) {
+	append(text, strlen(text));
+}
+
+// append(char character)
+//  Purpose: 
+//		Appends a single character to the buffer
+void OutputBuffer::append(char character) {
+	if (used == buffer.size()) {
+		if (fileDescriptor < 0)
+			buffer.resize(buffer.size() * 2);
+		else
+			flush();
+	}
+	buffer[used++] = character;
+}
+
+// appendInt(long long value)
+//  Purpose: 
+//		Appends the decimal representation of value to the buffer
+void OutputBuffer::appendInt(long long value) {
+	char digits[24];
+	char* end = digits + sizeof(digits);
+	char* start = end;
+
+	unsigned long long magnitude = value < 0 ? 0ULL - (unsigned long long) value : value;
+	do {
+		*--start = (char) ('0' + magnitude % 10);
+		magnitude /= 10;
+	} while (magnitude != 0);
+	if (value < 0)
+		*--start = '-';
+
+	append(start, end - start);
+}
+
+// appendDouble(long double value, int precision)
+//  Purpose: 
+//		Appends value formatted the way a stream with the given precision
+//		(and default floatfield) would print it, i.e. printf("%.*g")
+void OutputBuffer::appendDouble(long double value, int precision) {
+	char digits[64];
+#if defined(__cpp_lib_to_chars) && __cpp_lib_to_chars >= 201611L
+	to_chars_result result = to_chars(digits, digits + sizeof(digits), value, chars_format::general, precision);
+	append(digits, result.ptr - digits);
+#else
+	int length = snprintf(digits, sizeof(digits), "%.*Lg", precision, value);
+	append(digits, length);
+#endif
+}
+
+// flush()
+//  Purpose: 
+//		Writes the contents of the buffer to the file descriptor (does
+//		nothing for an in memory buffer)
+//	Postconditions:
+//		buffer - empty
+void OutputBuffer::flush() {
+	if (fileDescriptor < 0)
+		return;
+	if (used > 0)
+		writeAll(buffer.data(), used);
+	used = 0;
+}
+
+// string str()
+//  Purpose: 
+//		Returns the text currently held in the buffer
+string OutputBuffer::str() {
+	return string(buffer.data(), used);
+}
+
+// Private Methods
+// =============================================
+
+// writeAll(const char* data, size_t length)
+//  Purpose: 
+//		Writes length bytes of data to the file descriptor, retrying
+//		partial writes
+void OutputBuffer::writeAll(const char* data, size_t length) {
+	while (length > 0) {
+		long written = write(fileDescriptor, data, length);
+		if (written < 0) {
+			if (errno == EINTR)
+				continue;
+			throw runtime_error("Error writing output");
+		}
+		data += written;
+		length -= written;
+	}
+}
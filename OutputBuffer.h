@@ -0,0 +1,125 @@
+/*
+ * OutputBuffer.h
+ *
+ *  The OutputBuffer object is an append-only output buffer in front of a
+ *  file descriptor.  Text is appended to a large fixed size buffer which
+ *  is written to the file descriptor with a single write whenever it
+ *  fills up (and when the buffer is flushed or destroyed), so producing
+ *  output costs a memcpy rather than a string allocation per item.
+ *  Write errors throw a runtime_error, except from the destructor, which
+ *  drops them: call flush() before the buffer goes out of scope to see
+ *  them.
+ *
+ *  Numbers are formatted directly into the buffer (to_chars style) and
+ *  produce the same text as writing them to a stream with the same
+ *  precision, so results written through an OutputBuffer are byte for
+ *  byte the same as the older stringstream built results.
+ *
+ *  An OutputBuffer created without a file descriptor keeps everything in
+ *  memory (the buffer grows as needed) and str() returns the contents.
+ *
+ *  Typical use:
+ *		OutputBuffer out("segments.bed");
+ *		out.append("chr7\t");
+ *		out.appendInt(115000);
+ *		out.append('\n');
+ *
+ *  Created on: 10-18-26
+ */
+
+#ifndef OUTPUTBUFFER_H
+#define OUTPUTBUFFER_H
+
+#include <string>
+#include <vector>
+using namespace std;
+
+class OutputBuffer
+{
+public:
+	// Constuctors
+	// ==============================================
+	OutputBuffer();
+	OutputBuffer(int aFileDescriptor, size_t aCapacity = defaultCapacity);
+	OutputBuffer(string fileName, size_t aCapacity = defaultCapacity);
+
+	// Destructor
+	// =============================================
+	~OutputBuffer();
+
+	// Public Attributes
+	// =============================================
+	static const size_t defaultCapacity;
+
+	// Public Methods
+	// =============================================
+
+	// append(const char* text, size_t length)
+	//  Purpose: 
+	//		Appends length characters of text to the buffer, writing the
+	//		buffer out first if there is not enough room.
+	void append(const char* text, size_t length);
+
+	// append(const string& text)
+	//  Purpose: 
+	//		Appends text to the buffer
+	void append(const string& text);
+
+	// append(const char* text)
+	//  Purpose: 
+	//		Appends a null terminated string to the buffer
+	void append(const char* text);
+
+	// append(char character)
+	//  Purpose: 
+	//		Appends a single character to the buffer
+	void append(char character);
+
+	// appendInt(long long value)
+	//  Purpose: 
+	//		Appends the decimal representation of value to the buffer
+	void appendInt(long long value);
+
+	// appendDouble(long double value, int precision)
+	//  Purpose: 
+	//		Appends value formatted the way a stream with the given precision
+	//		(and default floatfield) would print it, i.e. printf("%.*g")
+	void appendDouble(long double value, int precision = 6);
+
+	// flush()
+	//  Purpose: 
+	//		Writes the contents of the buffer to the file descriptor (does
+	//		nothing for an in memory buffer)
+	//	Postconditions:
+	//		buffer - empty
+	void flush();
+
+	// string str()
+	//  Purpose: 
+	//		Returns the text currently held in the buffer
+	string str();
+
+private:
+
+	// Private Attributes
+	// =============================================
+	int fileDescriptor;
+	bool ownsFileDescriptor;
+	vector<char> buffer;
+	size_t used;
+
+	// Private Methods
+	// =============================================
+
+	// writeAll(const char* data, size_t length)
+	//  Purpose: 
+	//		Writes length bytes of data to the file descriptor, retrying
+	//		partial writes
+	void writeAll(const char* data, size_t length);
+
+	// Not copyable (the buffer owns the file descriptor)
+	OutputBuffer(const OutputBuffer&);
+	OutputBuffer& operator=(const OutputBuffer&);
+};
+
+#endif // OUTPUTBUFFER_H
@@ -0,0 +1,56 @@
+/*
+ * ParameterStore.cpp
+ *
+ *	The ParameterStore object publishes immutable snapshots of trained
+ *  probabilities to concurrent readers.  See ParameterStore.h.
+ *
+ *  Created on: 10-18-26
+ */
+#include "ParameterStore.h"
+
+// Constuctors
+// ==============================================
+ParameterStore::ParameterStore() {
+	numPublished = 0;
+}
+
+// Destructor
+// =============================================
+ParameterStore::~ParameterStore() {
+}
+
+// Public Methods
+// =============================================
+
+// publish(const HMMProbabilities& someProbabilities)
+//  Purpose:
+//		Makes an immutable copy of someProbabilities the current
+//		snapshot
+void ParameterStore::publish(const HMMProbabilities& someProbabilities) {
+	publish(make_shared<const HMMProbabilities>(someProbabilities));
+}
+
+// publish(shared_ptr<const HMMProbabilities> snapshot)
+//  Purpose:
+//		Makes snapshot (which must not be changed afterwards) the
+//		current snapshot
+void ParameterStore::publish(shared_ptr<const HMMProbabilities> snapshot) {
+	// The previous snapshot is freed by whichever holder lets go last
+	atomic_store(&current, snapshot);
+	numPublished++;
+}
+
+// shared_ptr<const HMMProbabilities> pin()
+//  Purpose:
+//		Returns the current snapshot (empty if nothing has been
+//		published).  It stays valid while the caller holds it,
+//		whatever is published meanwhile.
+shared_ptr<const HMMProbabilities> ParameterStore::pin() {
+	return atomic_load(&current);
+}
+
+// Public Accessors
+// =============================================
+long long ParameterStore::getNumPublished() {
+	return numPublished;
+}
@@ -0,0 +1,82 @@
+/*
+ * ParameterStore.h
+ *
+ *	This is the header file for the ParameterStore object.  A
+ *  ParameterStore hands trained probabilities from the thread training
+ *  them to any number of threads decoding with them.  The trainer
+ *  publishes a copy of its probabilities as an immutable snapshot
+ *  whenever it has a new estimate, and a reader pins the current
+ *  snapshot for as long as it needs it (a decode job): publishing a new
+ *  one never changes or frees a snapshot someone still holds.
+ *
+ *	The current snapshot is swapped with atomic_store and read with
+ *  atomic_load, so publishing and pinning never wait on each other for
+ *  longer than the pointer swap.  A reader pins once per job, not per
+ *  column; the probabilities themselves are read without any locking.
+ *
+ *	A snapshot refers to the ColumnDictionary of the probabilities it
+ *  was copied from, which must outlive it.
+ *
+ *	Typical use:
+ *		ParameterStore store;
+ *		hmm.setParameterStore(&store);			// trainer publishes each iteration
+ *		...
+ *		shared_ptr<const HMMProbabilities> snapshot = store.pin();	// in a reader
+ *		HMMDecoder decoder(snapshot.get());
+ *
+ *  Created on: 10-18-26
+ */
+
+#ifndef PARAMETERSTORE_H
+#define PARAMETERSTORE_H
+
+#include "HMMProbabilities.h"
+#include <memory>
+#include <atomic>
+using namespace std;
+
+class ParameterStore
+{
+public:
+	// Constuctors
+	// ==============================================
+	ParameterStore();
+
+	// Destructor
+	// =============================================
+	~ParameterStore();
+
+	// Public Methods
+	// =============================================
+
+	// publish(const HMMProbabilities& someProbabilities)
+	//  Purpose:
+	//		Makes an immutable copy of someProbabilities the current
+	//		snapshot
+	void publish(const HMMProbabilities& someProbabilities);
+
+	// publish(shared_ptr<const HMMProbabilities> snapshot)
+	//  Purpose:
+	//		Makes snapshot (which must not be changed afterwards) the
+	//		current snapshot
+	void publish(shared_ptr<const HMMProbabilities> snapshot);
+
+	// shared_ptr<const HMMProbabilities> pin()
+	//  Purpose:
+	//		Returns the current snapshot (empty if nothing has been
+	//		published).  It stays valid while the caller holds it,
+	//		whatever is published meanwhile.
+	shared_ptr<const HMMProbabilities> pin();
+
+	// Public Accessors
+	// =============================================
+	long long getNumPublished();		// snapshots published so far
+
+private:
+	// Private Attributes
+	// =============================================
+	shared_ptr<const HMMProbabilities> current;		// only through atomic_load/atomic_store
+	atomic<long long> numPublished;
+};
+
+#endif // PARAMETERSTORE_H
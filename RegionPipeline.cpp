@@ -0,0 +1,286 @@
+/*
+ * RegionPipeline.cpp
+ *
+ *	The RegionPipeline object decodes a list of regions as a parse,
+ *  decode and write pipeline (see RegionPipeline.h).  Parse and decode
+ *  run on their own threads and the write stage on the calling thread.
+ *  A job belongs to exactly one stage at a time, so the only shared
+ *  state between the stages is the two queues.  A NULL job marks the
+ *  end of the regions.
+ *
+ *  Created on: 10-18-26
+ */
+#include "RegionPipeline.h"
+#include "MultipleAlignmentFile.h"
+#include "HiddenMarkovModel.h"
+#include "HMMProbabilities.h"
+#include "DecoderWorkspace.h"
+#include "BedFileWriter.h"
+#include "OutputBuffer.h"
+#include "Instrumentation.h"
+#include "TraceRecorder.h"
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <cstdio>
+#include <thread>
+#include <chrono>
+#include <stdexcept>
+
+// Constuctors
+// ==============================================
+RegionPipeline::RegionPipeline(string aModelFileName, const vector<string>& someSpecies, int aQueueDepth) {
+	modelFileName = aModelFileName;
+	species = someSpecies;
+	queueDepth = (aQueueDepth < 1) ? 1 : aQueueDepth;
+	regions = NULL;
+	bedFile = NULL;
+	resetStatistics(parseStatistics, "parse");
+	resetStatistics(decodeStatistics, "decode");
+	resetStatistics(writeStatistics, "write");
+	wallSeconds = 0;
+	numFailed = 0;
+}
+
+// Destructor
+// =============================================
+RegionPipeline::~RegionPipeline() {
+}
+
+// Public Methods
+// =============================================
+
+// int run(const vector<RegionScanner::Region>& someRegions, string bedFileName)
+//  Purpose:
+//		Decodes every region through the pipeline, writing the results
+//		to stdout and the conserved segments to the BED file (if
+//		named).  Returns the number of regions that failed, and throws
+//		a runtime_error if the output can not be written.
+int RegionPipeline::run(const vector<RegionScanner::Region>& someRegions, string bedFileName) {
+	regions = &someRegions;
+	numFailed = 0;
+	resetStatistics(parseStatistics, "parse");
+	resetStatistics(decodeStatistics, "decode");
+	resetStatistics(writeStatistics, "write");
+	writeError.clear();
+	bedFile = bedFileName.empty() ? NULL : new BedFileWriter(bedFileName);
+
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	SPSCQueue<RegionJob*> parsed(queueDepth);
+	SPSCQueue<RegionJob*> decoded(queueDepth);
+	thread parseThread(&RegionPipeline::parseStage, this, ref(parsed));
+	thread decodeThread(&RegionPipeline::decodeStage, this, ref(parsed), ref(decoded));
+	writeStage(decoded);
+	parseThread.join();
+	decodeThread.join();
+	chrono::duration<double> seconds = chrono::steady_clock::now() - start;
+	wallSeconds = seconds.count();
+
+	if (bedFile != NULL && writeError.empty()) {
+		try {
+			bedFile->flush();
+		}
+		catch (const runtime_error& error) {
+			writeError = error.what();
+		}
+	}
+	delete bedFile;
+	bedFile = NULL;
+	regions = NULL;
+	if (!writeError.empty())
+		throw runtime_error(writeError);
+
+	return numFailed;
+}
+
+// string stageUtilizationString()
+//  Purpose:
+//		Returns a table of the time each stage of the last run spent
+//		busy, starved and blocked, and its utilization
+//
+//		format:
+//			Pipeline Stages: <<wall seconds>>s Wall-Clock  Queue Depth: <<depth>>
+//			  <<stage>>  Regions: <<n>>  Busy: <<s>>s  Starved: <<s>>s  Blocked: <<s>>s  Utilization: <<%>>%
+//			  ...
+//			  Bottleneck: <<stage>>
+string RegionPipeline::stageUtilizationString() {
+	StageStatistics* stages[] = { &parseStatistics, &decodeStatistics, &writeStatistics };
+
+	stringstream ss;
+	ss << fixed << setprecision(3);
+	ss << "Pipeline Stages: " << wallSeconds << "s Wall-Clock  Queue Depth: " << queueDepth << "\n";
+
+	StageStatistics* bottleneck = stages[0];
+	for (StageStatistics* stage : stages) {
+		double utilization = (wallSeconds > 0) ? 100 * stage->busySeconds / wallSeconds : 0;
+		ss
+			<< "  " << left << setw(6) << stage->name << right
+			<< "  Regions: " << stage->numRegions
+			<< "  Busy: " << stage->busySeconds << "s"
+			<< "  Starved: " << stage->starvedSeconds << "s"
+			<< "  Blocked: " << stage->blockedSeconds << "s"
+			<< "  Utilization: " << setprecision(1) << utilization << "%" << setprecision(3)
+			<< "\n";
+		if (stage->busySeconds > bottleneck->busySeconds)
+			bottleneck = stage;
+	}
+	ss << "  Bottleneck: " << bottleneck->name << "\n";
+
+	return ss.str();
+}
+
+// Private Methods
+// =============================================
+
+// parseStage(SPSCQueue<RegionJob*>& output)
+//  Purpose:
+//		Parses each region in turn and passes it on, ending with NULL
+void RegionPipeline::parseStage(SPSCQueue<RegionJob*>& output) {
+	TraceRecorder::setThreadName("parse stage");
+	for (size_t index = 0; index < regions->size(); index++) {
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		const RegionScanner::Region& region = (*regions)[index];
+		RegionJob* job = new RegionJob();
+		job->index = index;
+		job->multiAlignFile = NULL;
+		job->hmm = NULL;
+		try {
+			TraceRecorder::Span span("parse", "parse region", "region", index);
+			job->multiAlignFile = new MultipleAlignmentFile(region.fileName, species, region.rangeStart, region.rangeEnd);
+			HMMProbabilities* probabilities =
+				HMMProbabilities::load(modelFileName, job->multiAlignFile->getColumnDictionary());
+			job->hmm = new HiddenMarkovModel(job->multiAlignFile, probabilities);
+		}
+		catch (const exception& error) {
+			delete job->multiAlignFile;
+			job->multiAlignFile = NULL;
+			job->error = error.what();
+		}
+		parseStatistics.numRegions++;
+
+		chrono::steady_clock::time_point pushStart = chrono::steady_clock::now();
+		{
+			TraceRecorder::Span span("wait", "queue full");
+			output.push(job);
+		}
+		chrono::steady_clock::time_point pushEnd = chrono::steady_clock::now();
+		parseStatistics.busySeconds += chrono::duration<double>(pushStart - start).count();
+		parseStatistics.blockedSeconds += chrono::duration<double>(pushEnd - pushStart).count();
+	}
+	output.push(NULL);
+}
+
+// decodeStage(SPSCQueue<RegionJob*>& input, SPSCQueue<RegionJob*>& output)
+//  Purpose:
+//		Decodes each parsed region and passes it on, until NULL
+void RegionPipeline::decodeStage(SPSCQueue<RegionJob*>& input, SPSCQueue<RegionJob*>& output) {
+	TraceRecorder::setThreadName("decode stage");
+
+	// One workspace serves every region, growing to the longest
+	DecoderWorkspace workspace;
+	while (true) {
+		chrono::steady_clock::time_point popStart = chrono::steady_clock::now();
+		RegionJob* job;
+		{
+			TraceRecorder::Span span("wait", "queue empty");
+			job = input.pop();
+		}
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		decodeStatistics.starvedSeconds += chrono::duration<double>(start - popStart).count();
+		if (job == NULL)
+			break;
+
+		if (job->hmm != NULL) {
+			try {
+				TraceRecorder::Span span("decode", "decode region", "region", job->index);
+				job->hmm->viterbiDecode(&workspace);
+			}
+			catch (const exception& error) {
+				job->error = error.what();
+			}
+		}
+		decodeStatistics.numRegions++;
+
+		chrono::steady_clock::time_point pushStart = chrono::steady_clock::now();
+		{
+			TraceRecorder::Span span("wait", "queue full");
+			output.push(job);
+		}
+		chrono::steady_clock::time_point pushEnd = chrono::steady_clock::now();
+		decodeStatistics.busySeconds += chrono::duration<double>(pushStart - start).count();
+		decodeStatistics.blockedSeconds += chrono::duration<double>(pushEnd - pushStart).count();
+	}
+	output.push(NULL);
+}
+
+// writeStage(SPSCQueue<RegionJob*>& input)
+//  Purpose:
+//		Writes and frees each decoded region, until NULL
+void RegionPipeline::writeStage(SPSCQueue<RegionJob*>& input) {
+	cout << flush;
+	fflush(stdout);
+	OutputBuffer out(1);
+
+	while (true) {
+		chrono::steady_clock::time_point popStart = chrono::steady_clock::now();
+		RegionJob* job;
+		{
+			TraceRecorder::Span span("wait", "queue empty");
+			job = input.pop();
+		}
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		writeStatistics.starvedSeconds += chrono::duration<double>(start - popStart).count();
+		if (job == NULL)
+			break;
+
+		Instrumentation::Timer timer(Instrumentation::outputPhase);
+		TraceRecorder::Span span("output", "write region", "region", job->index);
+		const string& fileName = (*regions)[job->index].fileName;
+		if (!job->error.empty())
+			numFailed++;
+
+		// After a write error the regions are only freed, so the other
+		// stages still run to the end
+		if (writeError.empty()) {
+			try {
+				if (job->error.empty()) {
+					out.append("<region file=\"");
+					out.append(fileName);
+					out.append("\">\n");
+					job->hmm->writeViterbiResults(out);
+					out.append("</region>\n");
+					if (bedFile != NULL)
+						job->hmm->writeSegmentsBed(*bedFile, 2);
+				}
+				else {
+					out.append("<region file=\"");
+					out.append(fileName);
+					out.append("\" error=\"");
+					out.append(job->error);
+					out.append("\"/>\n");
+				}
+				out.flush();
+			}
+			catch (const runtime_error& error) {
+				writeError = error.what();
+			}
+		}
+
+		delete job->hmm;
+		delete job->multiAlignFile;
+		delete job;
+		writeStatistics.numRegions++;
+		writeStatistics.busySeconds += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	}
+}
+
+// resetStatistics(StageStatistics& statistics, string name)
+//  Purpose:
+//		Clears the statistics of a stage
+void RegionPipeline::resetStatistics(StageStatistics& statistics, string name) {
+	statistics.name = name;
+	statistics.numRegions = 0;
+	statistics.busySeconds = 0;
+	statistics.starvedSeconds = 0;
+	statistics.blockedSeconds = 0;
+}
@@ -0,0 +1,139 @@
+/*
+ * RegionPipeline.h
+ *
+ *	This is the header file for the RegionPipeline object.  RegionPipeline
+ *  decodes a list of regions with a trained model as a three stage
+ *  pipeline, one thread per stage:
+ *
+ *		parse	reads the alignment and loads the model against its columns
+ *		decode	runs the viterbi decoder
+ *		write	formats the results and writes them (and the BED segments)
+ *
+ *  so that region n + 1 is parsed while region n is decoded and region
+ *  n - 1 is written, keeping the disk busy while the decoder computes.
+ *  The stages are connected by bounded SPSCQueues; a stage that gets
+ *  ahead blocks on the full queue in front of it rather than parsing the
+ *  whole manifest into memory.  With the default depth of 2 every stage
+ *  has one region in hand and one waiting (double buffering).
+ *
+ *	Each stage records the time it spends working, waiting for its input
+ *  (starved) and waiting for room in its output queue (blocked).  The
+ *  busy stage with the highest utilization is the bottleneck; the other
+ *  stages will show it as time starved or blocked.
+ *
+ *	Regions are written in the order given, each as the decode results
+ *  inside a region element:
+ *		<region file="chr7.aln">
+ *		...viterbi results...
+ *		</region>
+ *  A region that fails is written as <region file="..." error="..."/>
+ *  and does not stop the pipeline.
+ *
+ *	Typical use:
+ *		RegionPipeline pipeline("trained.hmmp", species, 2);
+ *		pipeline.run(regions, "conserved.bed");
+ *		cout << pipeline.stageUtilizationString();
+ *
+ *  Created on: 10-18-26
+ */
+
+#ifndef REGIONPIPELINE_H
+#define REGIONPIPELINE_H
+
+#include "RegionScanner.h"
+#include "SPSCQueue.h"
+#include <string>
+#include <vector>
+using namespace std;
+
+class MultipleAlignmentFile;
+class HiddenMarkovModel;
+class BedFileWriter;
+
+class RegionPipeline
+{
+public:
+	// Constuctors
+	// ==============================================
+	RegionPipeline(string aModelFileName, const vector<string>& someSpecies, int aQueueDepth = 2);
+
+	// Destructor
+	// =============================================
+	~RegionPipeline();
+
+	// Public Methods
+	// =============================================
+
+	// int run(const vector<RegionScanner::Region>& someRegions, string bedFileName)
+	//  Purpose:
+	//		Decodes every region through the pipeline, writing the results
+	//		to stdout and the conserved segments to the BED file (if
+	//		named).  Returns the number of regions that failed, and throws
+	//		a runtime_error if the output can not be written.
+	int run(const vector<RegionScanner::Region>& someRegions, string bedFileName);
+
+	// string stageUtilizationString()
+	//  Purpose:
+	//		Returns a table of the time each stage of the last run spent
+	//		busy, starved and blocked, and its utilization
+	string stageUtilizationString();
+
+private:
+	// Private Types
+	// =============================================
+
+	// A region on its way through the pipeline
+	struct RegionJob {
+		int index;
+		MultipleAlignmentFile* multiAlignFile;
+		HiddenMarkovModel* hmm;
+		string error;				// empty unless a stage failed
+	};
+
+	struct StageStatistics {
+		string name;
+		int numRegions;
+		double busySeconds;
+		double starvedSeconds;		// waiting for the previous stage
+		double blockedSeconds;		// waiting for the next stage
+	};
+
+	// Private Attributes
+	// =============================================
+	string modelFileName;
+	vector<string> species;
+	int queueDepth;
+	const vector<RegionScanner::Region>* regions;
+	BedFileWriter* bedFile;			// NULL if no BED file is written
+	StageStatistics parseStatistics;
+	StageStatistics decodeStatistics;
+	StageStatistics writeStatistics;
+	double wallSeconds;
+	int numFailed;
+	string writeError;				// first output error, empty if none
+
+	// Private Methods
+	// =============================================
+
+	// parseStage(SPSCQueue<RegionJob*>& output)
+	//  Purpose:
+	//		Parses each region in turn and passes it on, ending with NULL
+	void parseStage(SPSCQueue<RegionJob*>& output);
+
+	// decodeStage(SPSCQueue<RegionJob*>& input, SPSCQueue<RegionJob*>& output)
+	//  Purpose:
+	//		Decodes each parsed region and passes it on, until NULL
+	void decodeStage(SPSCQueue<RegionJob*>& input, SPSCQueue<RegionJob*>& output);
+
+	// writeStage(SPSCQueue<RegionJob*>& input)
+	//  Purpose:
+	//		Writes and frees each decoded region, until NULL
+	void writeStage(SPSCQueue<RegionJob*>& input);
+
+	// resetStatistics(StageStatistics& statistics, string name)
+	//  Purpose:
+	//		Clears the statistics of a stage
+	void resetStatistics(StageStatistics& statistics, string name);
+};
+
+#endif // REGIONPIPELINE_H
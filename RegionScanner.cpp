@@ -0,0 +1,396 @@
+/*
+ * RegionScanner.cpp
+ *
+ *	The RegionScanner object decodes a manifest of regions on a work
+ *  stealing pool.  See RegionScanner.h for the task structure and how
+ *  the chunks of a region are joined.
+ *
+ *	Region states are only touched by the tasks of their own region until
+ *  they are finished; after that they belong to the writer, which runs
+ *  under the output lock.
+ *
+ *  Created on: 10-18-26
+ */
+#include "RegionScanner.h"
+#include "MultipleAlignmentFile.h"
+#include "HMMProbabilities.h"
+#include "HMMDecoder.h"
+#include "BedFileWriter.h"
+#include "OutputBuffer.h"
+#include "StatePathUtilities.h"
+#include "Instrumentation.h"
+#include "TraceRecorder.h"
+#include <iostream>
+#include <cstdio>
+#include <stdexcept>
+
+// Constuctors
+// ==============================================
+RegionScanner::RegionScanner(string aModelFileName, const vector<string>& someSpecies, int aChunkLength,
+	int aNumThreads) : pool(aNumThreads), numChunks(0) {
+	modelFileName = aModelFileName;
+	species = someSpecies;
+	chunkLength = (aChunkLength < 1) ? 1 : aChunkLength;
+	regions = NULL;
+	nextRegionToWrite = 0;
+	summaryOutput = NULL;
+	bedOutput = NULL;
+	numFailed = 0;
+}
+
+// Destructor
+// =============================================
+RegionScanner::~RegionScanner() {
+	for (DecoderWorkspace* workspace : freeWorkspaces)
+		delete workspace;
+}
+
+// Public Methods
+// =============================================
+
+// int scan(const vector<Region>& someRegions, string bedFileName)
+//  Purpose:
+//		Decodes every region, writing the summaries to stdout and the
+//		conserved segments to the BED file (if named) in region order.
+//		Returns the number of regions that failed, and throws a
+//		runtime_error if the output can not be written.
+int RegionScanner::scan(const vector<Region>& someRegions, string bedFileName) {
+	regions = &someRegions;
+	nextRegionToWrite = 0;
+	numFailed = 0;
+	numChunks = 0;
+
+	cout << flush;
+	fflush(stdout);
+	OutputBuffer summary(1);
+	summaryOutput = &summary;
+	bedOutput = bedFileName.empty() ? NULL : new OutputBuffer(bedFileName);
+
+	summary.append("#file\tchromosome\tfirst\tlast\tcolumns\tchunks\tconserved_columns\tconserved_segments\tpath_weight\n");
+
+	for (size_t index = 0; index < someRegions.size(); index++) {
+		RegionState* state = new RegionState();
+		state->multiAlignFile = NULL;
+		state->probabilities = NULL;
+		state->decoder = NULL;
+		state->remainingScorings = 0;
+		state->failed = false;
+		state->finished = false;
+		regionStates.push_back(state);
+	}
+
+	// Regions are started in manifest order; the tasks each one spawns
+	// stay with the worker that parsed it unless another runs dry
+	try {
+		for (size_t index = 0; index < someRegions.size(); index++)
+			pool.submit([this, index]() { parseRegion(index); });
+		pool.wait();
+
+		summary.flush();
+		if (bedOutput != NULL)
+			bedOutput->flush();
+	}
+	catch (const runtime_error& error) {
+		delete bedOutput;
+		bedOutput = NULL;
+		summaryOutput = NULL;
+		for (RegionState* state : regionStates)
+			delete state;
+		regionStates.clear();
+		regions = NULL;
+		throw;
+	}
+
+	delete bedOutput;
+	bedOutput = NULL;
+	summaryOutput = NULL;
+
+	for (RegionState* state : regionStates)
+		delete state;
+	regionStates.clear();
+	regions = NULL;
+
+	return numFailed;
+}
+
+// Public Accessors
+// =============================================
+int RegionScanner::getNumThreads() {
+	return pool.getNumThreads();
+}
+
+long long RegionScanner::getNumSteals() {
+	return pool.getNumSteals();
+}
+
+int RegionScanner::getNumChunks() {
+	return numChunks;
+}
+
+// Private Methods
+// =============================================
+
+// parseRegion(int index)
+//  Purpose:
+//		Loads the alignment and model for a region and submits the
+//		scoring of its chunks
+void RegionScanner::parseRegion(int index) {
+	TraceRecorder::Span span("parse", "parse region", "region", index);
+	RegionState* state = regionStates[index];
+	const Region& region = (*regions)[index];
+	try {
+		state->multiAlignFile = new MultipleAlignmentFile(region.fileName, species, region.rangeStart, region.rangeEnd);
+		state->probabilities = HMMProbabilities::load(modelFileName, state->multiAlignFile->getColumnDictionary());
+		state->decoder = new HMMDecoder(state->probabilities);
+	}
+	catch (const exception& error) {
+		failRegion(index, error.what());
+		return;
+	}
+
+	int length = state->multiAlignFile->getSequenceLength();
+	if (length == 0) {
+		finishRegion(index);
+		return;
+	}
+
+	// Equal chunks no longer than the chunk length
+	int numStates = state->decoder->getNumStates();
+	int numRegionChunks = (int) (((long long) length + chunkLength - 1) / chunkLength);
+	state->chunks.resize(numRegionChunks);
+	for (int chunk = 0; chunk < numRegionChunks; chunk++) {
+		state->chunks[chunk].begin = (int) ((long long) length * chunk / numRegionChunks);
+		state->chunks[chunk].end = (int) ((long long) length * (chunk + 1) / numRegionChunks);
+		state->chunks[chunk].scorings.assign(numStates, NULL);
+	}
+	state->remainingScorings = 1 + (numRegionChunks - 1) * (numStates - 1);
+	numChunks += numRegionChunks;
+
+	// The first chunk is entered from the start state, the others from
+	// each hidden state
+	pool.submit([this, index]() { scoreChunk(index, 0, 0); });
+	for (int chunk = 1; chunk < numRegionChunks; chunk++) {
+		for (int entryState = 1; entryState < numStates; entryState++)
+			pool.submit([this, index, chunk, entryState]() { scoreChunk(index, chunk, entryState); });
+	}
+}
+
+// scoreChunk(int index, int chunk, int entryState)
+//  Purpose:
+//		Scores one chunk of a region from an entry state, finishing the
+//		region if it is the last scoring
+void RegionScanner::scoreChunk(int index, int chunk, int entryState) {
+	RegionState* state = regionStates[index];
+	Chunk& aChunk = state->chunks[chunk];
+	DecoderWorkspace* workspace = acquireWorkspace();
+	aChunk.scorings[entryState] = workspace;
+
+	try {
+		TraceRecorder::Span span("decode", "decode chunk", "chunk", chunk);
+		state->decoder->viterbiScores(state->multiAlignFile->getColumnIds() + aChunk.begin,
+			aChunk.end - aChunk.begin, entryState, *workspace);
+	}
+	catch (const exception& error) {
+		lock_guard<mutex> guard(outputLock);
+		if (!state->failed)
+			state->summary = error.what();
+		state->failed = true;
+	}
+
+	if (--state->remainingScorings == 0) {
+		if (state->failed)
+			failRegion(index, state->summary);
+		else
+			finishRegion(index);
+	}
+}
+
+// finishRegion(int index)
+//  Purpose:
+//		Joins the chunk scorings into the viterbi path, formats the
+//		region's output and frees the region's alignment
+void RegionScanner::finishRegion(int index) {
+	RegionState* state = regionStates[index];
+	MultipleAlignmentFile* multiAlignFile = state->multiAlignFile;
+	int length = multiAlignFile->getSequenceLength();
+	int numRegionChunks = state->chunks.size();
+
+	vector<unsigned char> statePath(length);
+	double pathWeight = 0;
+	if (length > 0) {
+		TraceRecorder::Span span("reduce", "join chunks", "region", index);
+		HMMDecoder* decoder = state->decoder;
+		int numHiddenStates = decoder->getNumStates() - 1;
+
+		// Carry the scores across the chunks, remembering for every chunk
+		// and end state the entry state it was best reached from
+		vector<double> scores(numHiddenStates);
+		vector<double> nextScores(numHiddenStates);
+		vector<unsigned char> entryStates((size_t) numRegionChunks * numHiddenStates, 0);
+		DecoderWorkspace* first = state->chunks[0].scorings[0];
+		const double* exitScores = first->getScores() + (size_t) (first->getLength() - 1) * numHiddenStates;
+		scores.assign(exitScores, exitScores + numHiddenStates);
+
+		for (int chunk = 1; chunk < numRegionChunks; chunk++) {
+			for (int endState = 1; endState <= numHiddenStates; endState++) {
+				double bestScore = 0;
+				int bestEntry = 0;
+				for (int entryState = 1; entryState <= numHiddenStates; entryState++) {
+					DecoderWorkspace* scoring = state->chunks[chunk].scorings[entryState];
+					double score = scores[entryState - 1]
+						+ scoring->getScores()[(size_t) (scoring->getLength() - 1) * numHiddenStates + endState - 1];
+					if (bestEntry == 0 || score > bestScore) {
+						bestScore = score;
+						bestEntry = entryState;
+					}
+				}
+				nextScores[endState - 1] = bestScore;
+				entryStates[(size_t) chunk * numHiddenStates + endState - 1] = bestEntry;
+			}
+			scores.swap(nextScores);
+		}
+
+		// Trace the best final state back through the chunks
+		int endState = decoder->bestState(scores.data());
+		pathWeight = scores[endState - 1];
+		for (int chunk = numRegionChunks - 1; chunk >= 0; chunk--) {
+			Chunk& aChunk = state->chunks[chunk];
+			int entryState = (chunk == 0) ? 0 : entryStates[(size_t) chunk * numHiddenStates + endState - 1];
+			decoder->traceback(*aChunk.scorings[entryState], endState, statePath.data() + aChunk.begin);
+			endState = entryState;
+		}
+	}
+
+	// Conserved segments as BED lines (split where a MAF region skips
+	// reference coordinates) and the summary line
+	string& chromosome = multiAlignFile->getChromosome();
+	vector<StatePathUtilities::StateRun> runs;
+	StatePathUtilities::extractRuns(statePath.data(), length, runs);
+	StatePathUtilities::splitRunsAtBreaks(runs, multiAlignFile->getCoordinateBreaks());
+	OutputBuffer segments;
+	long long conservedColumns = 0;
+	long long conservedSegments = 0;
+	for (StatePathUtilities::StateRun& run : runs) {
+		if (run.state != 2)
+			continue;
+		conservedColumns += run.end - run.start + 1;
+		conservedSegments++;
+		BedFileWriter::appendSegment(segments, chromosome, multiAlignFile->getCoordinate(run.start),
+			multiAlignFile->getCoordinate(run.end));
+	}
+
+	OutputBuffer summary;
+	summary.append((*regions)[index].fileName);
+	summary.append('\t');
+	summary.append(chromosome);
+	summary.append('\t');
+	summary.appendInt(length > 0 ? multiAlignFile->getCoordinate(0) : 0);
+	summary.append('\t');
+	summary.appendInt(length > 0 ? multiAlignFile->getCoordinate(length - 1) : 0);
+	summary.append('\t');
+	summary.appendInt(length);
+	summary.append('\t');
+	summary.appendInt(numRegionChunks);
+	summary.append('\t');
+	summary.appendInt(conservedColumns);
+	summary.append('\t');
+	summary.appendInt(conservedSegments);
+	summary.append('\t');
+	summary.appendDouble(pathWeight, 10);
+	summary.append('\n');
+
+	freeRegion(state);
+
+	unique_lock<mutex> guard(outputLock, defer_lock);
+	{
+		TraceRecorder::Span span("wait", "output lock", "region", index);
+		guard.lock();
+	}
+	state->summary = summary.str();
+	state->segments = segments.str();
+	state->finished = true;
+	writeFinishedRegions();
+}
+
+// failRegion(int index, string error)
+//  Purpose:
+//		Records a region's error as its output
+void RegionScanner::failRegion(int index, string error) {
+	RegionState* state = regionStates[index];
+	freeRegion(state);
+
+	lock_guard<mutex> guard(outputLock);
+	state->summary = (*regions)[index].fileName + "\terror\t" + error + "\n";
+	state->segments.clear();
+	state->failed = true;
+	state->finished = true;
+	numFailed++;
+	writeFinishedRegions();
+}
+
+// freeRegion(RegionState* state)
+//  Purpose:
+//		Frees the alignment, model and workspaces of a region, keeping
+//		only its output
+void RegionScanner::freeRegion(RegionState* state) {
+	for (Chunk& aChunk : state->chunks) {
+		for (DecoderWorkspace* workspace : aChunk.scorings) {
+			if (workspace != NULL)
+				releaseWorkspace(workspace);
+		}
+	}
+	state->chunks.clear();
+
+	delete state->decoder;
+	delete state->probabilities;
+	delete state->multiAlignFile;
+	state->decoder = NULL;
+	state->probabilities = NULL;
+	state->multiAlignFile = NULL;
+}
+
+// writeFinishedRegions()
+//  Purpose:
+//		Writes the output of every finished region that all regions
+//		before it in the manifest have been written for
+void RegionScanner::writeFinishedRegions() {
+	Instrumentation::Timer timer(Instrumentation::outputPhase);
+	TraceRecorder::Span span("output", "write regions");
+	bool written = false;
+	while (nextRegionToWrite < regionStates.size() && regionStates[nextRegionToWrite]->finished) {
+		RegionState* state = regionStates[nextRegionToWrite];
+		summaryOutput->append(state->summary);
+		if (bedOutput != NULL)
+			bedOutput->append(state->segments);
+		string().swap(state->summary);
+		string().swap(state->segments);
+		nextRegionToWrite++;
+		written = true;
+	}
+
+	// Summaries are streamed as regions complete
+	if (written)
+		summaryOutput->flush();
+}
+
+// DecoderWorkspace* acquireWorkspace()
+//  Purpose:
+//		Returns a free workspace, creating one if there are none
+DecoderWorkspace* RegionScanner::acquireWorkspace() {
+	lock_guard<mutex> guard(workspacesLock);
+	if (freeWorkspaces.empty())
+		return new DecoderWorkspace();
+
+	DecoderWorkspace* workspace = freeWorkspaces.back();
+	freeWorkspaces.pop_back();
+	return workspace;
+}
+
+// releaseWorkspace(DecoderWorkspace* workspace)
+//  Purpose:
+//		Returns a workspace for reuse
+void RegionScanner::releaseWorkspace(DecoderWorkspace* workspace) {
+	workspace->reset();
+	lock_guard<mutex> guard(workspacesLock);
+	freeWorkspaces.push_back(workspace);
+}
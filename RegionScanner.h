@@ -0,0 +1,189 @@
+/*
+ * RegionScanner.h
+ *
+ *	This is the header file for the RegionScanner object.  RegionScanner
+ *  decodes a list of regions (alignment files, optionally limited to a
+ *  coordinate range) with a trained model, running the parsing, decoding
+ *  and output of every region as tasks on a WorkStealingPool.
+ *
+ *	Each region is one task to parse the alignment and load the model
+ *  against its columns, then one task per chunk and entry state to score
+ *  the chunk (see HMMDecoder::viterbiScores), then a final step, run by
+ *  whichever chunk task finishes last, that joins the chunks and formats
+ *  the region's output.  Regions shorter than the chunk length are one
+ *  chunk; longer ones are split so that a single large region is spread
+ *  over every worker instead of holding up the end of the scan.
+ *
+ *	Joining the chunks: the first chunk is scored from the start state
+ *  and every later chunk from each hidden state s.  If v is the vector of
+ *  scores at the end of one chunk and M[s][t] the score of state t at the
+ *  end of the next chunk scored from s, the scores at the end of the next
+ *  chunk are max over s of v[s] + M[s][t].  The best final state is
+ *  traced back through the chunks in reverse, each chunk using the
+ *  scoring whose entry state was the best predecessor of the state it
+ *  ends in.  The path is the exact viterbi path; only the rounding of the
+ *  path weight can differ from a single pass.
+ *
+ *	Output is written in manifest order whatever order the regions finish
+ *  in: one summary line per region to stdout and, if a BED file is named,
+ *  the conserved segments of every region.  A region that fails (e.g. a
+ *  missing file) gets an error line and does not stop the scan.
+ *
+ *	Summary line (tab separated):
+ *		<<file>> <<chromosome>> <<first coordinate>> <<last coordinate>>
+ *		<<columns>> <<chunks>> <<conserved columns>> <<conserved segments>>
+ *		<<path weight>>
+ *
+ *	Typical use:
+ *		RegionScanner scanner("trained.hmmp", species, 1 << 20, 0);
+ *		scanner.scan(regions, "conserved.bed");
+ *
+ *  Created on: 10-18-26
+ */
+
+#ifndef REGIONSCANNER_H
+#define REGIONSCANNER_H
+
+#include "WorkStealingPool.h"
+#include "DecoderWorkspace.h"
+#include <string>
+#include <vector>
+#include <mutex>
+#include <atomic>
+using namespace std;
+
+class MultipleAlignmentFile;
+class HMMProbabilities;
+class HMMDecoder;
+class OutputBuffer;
+
+class RegionScanner
+{
+public:
+	// Public Types
+	// =============================================
+
+	// A manifest entry: an alignment file and the coordinates [rangeStart,
+	// rangeEnd) to decode (0, 0 for the whole file)
+	struct Region {
+		string fileName;
+		int rangeStart;
+		int rangeEnd;
+	};
+
+	// Constuctors
+	// ==============================================
+	RegionScanner(string aModelFileName, const vector<string>& someSpecies, int aChunkLength, int aNumThreads);
+
+	// Destructor
+	// =============================================
+	~RegionScanner();
+
+	// Public Methods
+	// =============================================
+
+	// int scan(const vector<Region>& someRegions, string bedFileName)
+	//  Purpose:
+	//		Decodes every region, writing the summaries to stdout and the
+	//		conserved segments to the BED file (if named) in region order.
+	//		Returns the number of regions that failed, and throws a
+	//		runtime_error if the output can not be written.
+	int scan(const vector<Region>& someRegions, string bedFileName);
+
+	// Public Accessors
+	// =============================================
+	int getNumThreads();
+	long long getNumSteals();
+	int getNumChunks();				// chunks decoded by the last scan
+
+private:
+	// Private Types
+	// =============================================
+
+	// A chunk of a region and its scorings, one per entry state (only
+	// entry state 0 for the first chunk)
+	struct Chunk {
+		int begin;
+		int end;
+		vector<DecoderWorkspace*> scorings;
+	};
+
+	struct RegionState {
+		MultipleAlignmentFile* multiAlignFile;
+		HMMProbabilities* probabilities;
+		HMMDecoder* decoder;
+		vector<Chunk> chunks;
+		atomic<int> remainingScorings;
+		string summary;
+		string segments;			// BED lines
+		bool failed;
+		bool finished;
+	};
+
+	// Private Attributes
+	// =============================================
+	string modelFileName;
+	vector<string> species;
+	int chunkLength;
+	WorkStealingPool pool;
+	vector<RegionState*> regionStates;
+	const vector<Region>* regions;
+	mutex workspacesLock;
+	vector<DecoderWorkspace*> freeWorkspaces;	// reused between chunks and scans
+	mutex outputLock;
+	size_t nextRegionToWrite;
+	OutputBuffer* summaryOutput;
+	OutputBuffer* bedOutput;			// NULL if no BED file is written
+	int numFailed;
+	atomic<int> numChunks;
+
+	// Private Methods
+	// =============================================
+
+	// parseRegion(int index)
+	//  Purpose:
+	//		Loads the alignment and model for a region and submits the
+	//		scoring of its chunks
+	void parseRegion(int index);
+
+	// scoreChunk(int index, int chunk, int entryState)
+	//  Purpose:
+	//		Scores one chunk of a region from an entry state, finishing the
+	//		region if it is the last scoring
+	void scoreChunk(int index, int chunk, int entryState);
+
+	// finishRegion(int index)
+	//  Purpose:
+	//		Joins the chunk scorings into the viterbi path, formats the
+	//		region's output and frees the region's alignment
+	void finishRegion(int index);
+
+	// failRegion(int index, string error)
+	//  Purpose:
+	//		Records a region's error as its output
+	void failRegion(int index, string error);
+
+	// freeRegion(RegionState* state)
+	//  Purpose:
+	//		Frees the alignment, model and workspaces of a region, keeping
+	//		only its output
+	void freeRegion(RegionState* state);
+
+	// writeFinishedRegions()
+	//  Purpose:
+	//		Writes the output of every finished region that all regions
+	//		before it in the manifest have been written for
+	void writeFinishedRegions();
+
+	// DecoderWorkspace* acquireWorkspace()
+	//  Purpose:
+	//		Returns a free workspace, creating one if there are none
+	DecoderWorkspace* acquireWorkspace();
+
+	// releaseWorkspace(DecoderWorkspace* workspace)
+	//  Purpose:
+	//		Returns a workspace for reuse
+	void releaseWorkspace(DecoderWorkspace* workspace);
+};
+
+#endif // REGIONSCANNER_H
@@ -0,0 +1,129 @@
+/*
+ * SPSCQueue.h
+ *
+ *	This is the header file for the SPSCQueue template.  SPSCQueue is a
+ *  bounded single producer, single consumer queue connecting two threads
+ *  without a lock: a ring buffer whose head is only written by the
+ *  consumer and whose tail is only written by the producer.  The two
+ *  indices sit on separate cache lines so the threads do not bounce a
+ *  line between them on every item.
+ *
+ *	tryPush and tryPop never block.  push blocks while the queue is full,
+ *  which is what holds a fast producer back to the pace of its consumer,
+ *  and pop blocks while it is empty.  Both wait by spinning briefly, then
+ *  yielding, then sleeping, so a stage that is waiting on a slow stage
+ *  does not take a core away from it.
+ *
+ *	Exactly one thread may push and exactly one thread may pop.
+ *
+ *	Typical use:
+ *		SPSCQueue<Job*> queue(2);
+ *		queue.push(job);			// producer thread
+ *		Job* job = queue.pop();		// consumer thread
+ *
+ *  Created on: 10-18-26
+ */
+
+#ifndef SPSCQUEUE_H
+#define SPSCQUEUE_H
+
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <cstddef>
+using namespace std;
+
+template <class T>
+class SPSCQueue
+{
+public:
+	// Constuctors
+	// ==============================================
+
+	// The capacity is rounded up to a power of two
+	SPSCQueue(size_t aCapacity) : head(0), tail(0) {
+		size_t capacity = 1;
+		while (capacity < aCapacity)
+			capacity <<= 1;
+		items.resize(capacity);
+		mask = capacity - 1;
+	}
+
+	// Public Methods
+	// =============================================
+
+	// bool tryPush(const T& item)
+	//  Purpose:
+	//		Adds item to the queue, returning false if it is full
+	bool tryPush(const T& item) {
+		size_t aTail = tail.load(memory_order_relaxed);
+		if (aTail - head.load(memory_order_acquire) > mask)
+			return false;
+		items[aTail & mask] = item;
+		tail.store(aTail + 1, memory_order_release);
+		return true;
+	}
+
+	// bool tryPop(T& item)
+	//  Purpose:
+	//		Removes the oldest item into item, returning false if the
+	//		queue is empty
+	bool tryPop(T& item) {
+		size_t aHead = head.load(memory_order_relaxed);
+		if (aHead == tail.load(memory_order_acquire))
+			return false;
+		item = items[aHead & mask];
+		head.store(aHead + 1, memory_order_release);
+		return true;
+	}
+
+	// push(const T& item)
+	//  Purpose:
+	//		Adds item to the queue, waiting while it is full
+	void push(const T& item) {
+		for (int attempt = 0; !tryPush(item); attempt++)
+			backOff(attempt);
+	}
+
+	// T pop()
+	//  Purpose:
+	//		Removes and returns the oldest item, waiting while the queue
+	//		is empty
+	T pop() {
+		T item;
+		for (int attempt = 0; !tryPop(item); attempt++)
+			backOff(attempt);
+		return item;
+	}
+
+	// Public Accessors
+	// =============================================
+	size_t getCapacity() { return mask + 1; }
+
+private:
+	// Private Attributes
+	// =============================================
+	vector<T> items;
+	size_t mask;
+	alignas(64) atomic<size_t> head;		// next item to pop, written by the consumer
+	alignas(64) atomic<size_t> tail;		// next slot to push, written by the producer
+
+	// Private Methods
+	// =============================================
+
+	// backOff(int attempt)
+	//  Purpose:
+	//		Waits a little longer with each failed attempt: spinning, then
+	//		yielding, then sleeping
+	static void backOff(int attempt) {
+		if (attempt < 64)
+			return;
+		if (attempt < 128)
+			this_thread::yield();
+		else
+			this_thread::sleep_for(chrono::microseconds(50));
+	}
+};
+
+#endif // SPSCQUEUE_H
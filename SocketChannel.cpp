@@ -0,0 +1,334 @@
+/*
+ * SocketChannel.cpp
+ *
+ *	The SocketChannel object sends and receives framed messages over a
+ *  stream socket.  See SocketChannel.h for the address forms and the
+ *  frame layout.
+ *
+ *  Created on: 10-18-26
+ */
+#include "SocketChannel.h"
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+#include <chrono>
+
+// const variable initialization
+// ==============================================
+const uint64_t SocketChannel::defaultMaxPayloadLength = (uint64_t) 1 << 28;
+
+static const string unixPrefix = "unix:";
+
+// bool isUnixAddress(const string& address)
+//  Purpose:
+//		Returns true for a unix:path address
+static bool isUnixAddress(const string& address) {
+	return address.compare(0, unixPrefix.size(), unixPrefix) == 0;
+}
+
+// sockaddr_un unixAddress(const string& address)
+//  Purpose:
+//		Returns the Unix domain socket address of a unix:path address,
+//		throwing if the path is too long
+static sockaddr_un unixAddress(const string& address) {
+	string path = address.substr(unixPrefix.size());
+	sockaddr_un socketAddress;
+	memset(&socketAddress, 0, sizeof(socketAddress));
+	socketAddress.sun_family = AF_UNIX;
+	if (path.empty() || path.size() >= sizeof(socketAddress.sun_path))
+		throw runtime_error("Invalid socket path: " + address);
+	memcpy(socketAddress.sun_path, path.c_str(), path.size());
+	return socketAddress;
+}
+
+// removeStaleSocket(const sockaddr_un& socketAddress, const string& address)
+//  Purpose:
+//		Removes the Unix domain socket file at the address if it was
+//		left by a server that is no longer running.  Throws if anything
+//		else is at the path, or a server still accepts connections there.
+static void removeStaleSocket(const sockaddr_un& socketAddress, const string& address) {
+	struct stat status;
+	if (lstat(socketAddress.sun_path, &status) != 0)
+		return;
+	if (!S_ISSOCK(status.st_mode))
+		throw runtime_error("Unable to listen on: " + address + " (address in use by a file that is not a socket)");
+
+	int probe = ::socket(AF_UNIX, SOCK_STREAM, 0);
+	if (probe < 0)
+		throw runtime_error("Unable to create socket: " + address);
+	bool listening = ::connect(probe, (const sockaddr*) &socketAddress, sizeof(socketAddress)) == 0
+		|| errno != ECONNREFUSED;
+	close(probe);
+	if (listening)
+		throw runtime_error("Unable to listen on: " + address + " (address in use)");
+	unlink(socketAddress.sun_path);
+}
+
+// addrinfo* tcpAddresses(const string& address)
+//  Purpose:
+//		Resolves a host:port address, localhost if the host is left out
+//		(the caller frees the result with freeaddrinfo)
+static addrinfo* tcpAddresses(const string& address) {
+	size_t colon = address.rfind(':');
+	if (colon == string::npos || colon + 1 == address.size())
+		throw runtime_error("Invalid address (expected unix:path or host:port): " + address);
+	string host = address.substr(0, colon);
+	string port = address.substr(colon + 1);
+	if (host.empty())
+		host = "localhost";
+
+	addrinfo hints;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	addrinfo* addresses = NULL;
+	if (getaddrinfo(host.c_str(), port.c_str(), &hints, &addresses) != 0)
+		throw runtime_error("Unable to resolve address: " + address);
+	return addresses;
+}
+
+// Constuctors
+// ==============================================
+SocketChannel::SocketChannel(int aSocket, string aPeerName) {
+	socket = aSocket;
+	peerName = aPeerName;
+	maxPayloadLength = defaultMaxPayloadLength;
+	bytesSent = 0;
+	bytesReceived = 0;
+}
+
+// Destructor
+// =============================================
+SocketChannel::~SocketChannel() {
+	close(socket);
+}
+
+// Public Class Methods
+// =============================================
+
+// int listen(string address)
+//  Purpose:
+//		Returns a socket listening on the address.  A stale Unix domain
+//		socket file is replaced, but a path holding anything else or a
+//		running server's socket is refused as in use.  With no host
+//		(:port) only localhost connections are accepted.
+int SocketChannel::listen(string address) {
+	if (isUnixAddress(address)) {
+		sockaddr_un socketAddress = unixAddress(address);
+		removeStaleSocket(socketAddress, address);
+		int listener = ::socket(AF_UNIX, SOCK_STREAM, 0);
+		if (listener < 0)
+			throw runtime_error("Unable to create socket: " + address);
+		if (::bind(listener, (sockaddr*) &socketAddress, sizeof(socketAddress)) != 0
+			|| ::listen(listener, SOMAXCONN) != 0) {
+			close(listener);
+			throw runtime_error("Unable to listen on: " + address + " (" + strerror(errno) + ")");
+		}
+		return listener;
+	}
+
+	addrinfo* addresses = tcpAddresses(address);
+	int listener = -1;
+	for (addrinfo* candidate = addresses; candidate != NULL && listener < 0; candidate = candidate->ai_next) {
+		listener = ::socket(candidate->ai_family, candidate->ai_socktype, candidate->ai_protocol);
+		if (listener < 0)
+			continue;
+		int reuse = 1;
+		setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+		if (::bind(listener, candidate->ai_addr, candidate->ai_addrlen) != 0
+			|| ::listen(listener, SOMAXCONN) != 0) {
+			close(listener);
+			listener = -1;
+		}
+	}
+	freeaddrinfo(addresses);
+	if (listener < 0)
+		throw runtime_error("Unable to listen on: " + address + " (" + strerror(errno) + ")");
+
+	return listener;
+}
+
+// SocketChannel* accept(int listener)
+//  Purpose:
+//		Waits for and returns the next connection on a listening socket
+SocketChannel* SocketChannel::accept(int listener) {
+	sockaddr_storage peerAddress;
+	socklen_t peerLength = sizeof(peerAddress);
+	int aSocket;
+	do {
+		aSocket = ::accept(listener, (sockaddr*) &peerAddress, &peerLength);
+	} while (aSocket < 0 && errno == EINTR);
+	if (aSocket < 0)
+		throw runtime_error(string("Unable to accept connection (") + strerror(errno) + ")");
+
+	string name = "local";
+	if (peerAddress.ss_family != AF_UNIX) {
+		char host[NI_MAXHOST];
+		char port[NI_MAXSERV];
+		if (getnameinfo((sockaddr*) &peerAddress, peerLength, host, sizeof(host), port, sizeof(port),
+				NI_NUMERICHOST | NI_NUMERICSERV) == 0)
+			name = string(host) + ":" + port;
+		int noDelay = 1;
+		setsockopt(aSocket, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+	}
+
+	return new SocketChannel(aSocket, name);
+}
+
+// SocketChannel* connect(string address, int retrySeconds)
+//  Purpose:
+//		Returns a channel connected to the address, retrying for up to
+//		retrySeconds while nothing is listening there yet
+SocketChannel* SocketChannel::connect(string address, int retrySeconds) {
+	chrono::steady_clock::time_point deadline = chrono::steady_clock::now() + chrono::seconds(retrySeconds);
+	while (true) {
+		int aSocket = -1;
+		if (isUnixAddress(address)) {
+			sockaddr_un socketAddress = unixAddress(address);
+			aSocket = ::socket(AF_UNIX, SOCK_STREAM, 0);
+			if (aSocket >= 0 && ::connect(aSocket, (sockaddr*) &socketAddress, sizeof(socketAddress)) != 0) {
+				close(aSocket);
+				aSocket = -1;
+			}
+		}
+		else {
+			addrinfo* addresses = tcpAddresses(address);
+			for (addrinfo* candidate = addresses; candidate != NULL && aSocket < 0; candidate = candidate->ai_next) {
+				aSocket = ::socket(candidate->ai_family, candidate->ai_socktype, candidate->ai_protocol);
+				if (aSocket >= 0 && ::connect(aSocket, candidate->ai_addr, candidate->ai_addrlen) != 0) {
+					close(aSocket);
+					aSocket = -1;
+				}
+			}
+			freeaddrinfo(addresses);
+			if (aSocket >= 0) {
+				int noDelay = 1;
+				setsockopt(aSocket, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+			}
+		}
+
+		if (aSocket >= 0)
+			return new SocketChannel(aSocket, address);
+		if (chrono::steady_clock::now() >= deadline)
+			throw runtime_error("Unable to connect to: " + address);
+		this_thread::sleep_for(chrono::milliseconds(100));
+	}
+}
+
+// closeListener(int listener, string address)
+//  Purpose:
+//		Closes a listening socket, removing its Unix domain socket file
+void SocketChannel::closeListener(int listener, string address) {
+	close(listener);
+	if (isUnixAddress(address))
+		unlink(address.substr(unixPrefix.size()).c_str());
+}
+
+// Public Methods
+// =============================================
+
+// send(uint32_t type, const string& payload)
+//  Purpose:
+//		Sends one message
+void SocketChannel::send(uint32_t type, const string& payload) {
+	char header[sizeof(uint32_t) + sizeof(uint64_t)];
+	uint64_t length = payload.size();
+	memcpy(header, &type, sizeof(type));
+	memcpy(header + sizeof(type), &length, sizeof(length));
+	writeAll(header, sizeof(header));
+	writeAll(payload.data(), payload.size());
+}
+
+// uint32_t receive(string& payload)
+//  Purpose:
+//		Waits for the next message, setting payload and returning its
+//		type
+uint32_t SocketChannel::receive(string& payload) {
+	char header[sizeof(uint32_t) + sizeof(uint64_t)];
+	uint32_t type;
+	uint64_t length;
+	readAll(header, sizeof(header));
+	memcpy(&type, header, sizeof(type));
+	memcpy(&length, header + sizeof(type), sizeof(length));
+	if (length > maxPayloadLength)
+		throw runtime_error("Invalid message from: " + peerName);
+
+	payload.resize(length);
+	readAll(&payload[0], length);
+	return type;
+}
+
+// shutdown()
+//  Purpose:
+//		Shuts the connection down in both directions, so a receive
+//		waiting on it (in any thread) throws
+void SocketChannel::shutdown() {
+	::shutdown(socket, SHUT_RDWR);
+}
+
+// setMaxPayloadLength(uint64_t length)
+//  Purpose:
+//		Sets the longest payload receive accepts (defaultMaxPayloadLength
+//		until set)
+void SocketChannel::setMaxPayloadLength(uint64_t length) {
+	maxPayloadLength = length;
+}
+
+// Public Accessors
+// =============================================
+string& SocketChannel::getPeerName() {
+	return peerName;
+}
+
+long long SocketChannel::getBytesSent() {
+	return bytesSent;
+}
+
+long long SocketChannel::getBytesReceived() {
+	return bytesReceived;
+}
+
+// Private Methods
+// =============================================
+
+// writeAll(const char* data, size_t length)
+//  Purpose:
+//		Writes all of data to the socket
+void SocketChannel::writeAll(const char* data, size_t length) {
+	while (length > 0) {
+		// MSG_NOSIGNAL: a closed peer is an error here, not a SIGPIPE
+		ssize_t written = ::send(socket, data, length, MSG_NOSIGNAL);
+		if (written < 0 && errno == EINTR)
+			continue;
+		if (written <= 0)
+			throw runtime_error("Connection lost: " + peerName);
+		data += written;
+		length -= written;
+		bytesSent += written;
+	}
+}
+
+// readAll(char* data, size_t length)
+//  Purpose:
+//		Reads exactly length bytes from the socket
+void SocketChannel::readAll(char* data, size_t length) {
+	while (length > 0) {
+		ssize_t numRead = ::recv(socket, data, length, 0);
+		if (numRead < 0 && errno == EINTR)
+			continue;
+		if (numRead <= 0)
+			throw runtime_error("Connection lost: " + peerName);
+		data += numRead;
+		length -= numRead;
+		bytesReceived += numRead;
+	}
+}
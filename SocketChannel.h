@@ -0,0 +1,142 @@
+/*
+ * SocketChannel.h
+ *
+ *	This is the header file for the SocketChannel object.  A
+ *  SocketChannel is one end of a connected stream socket that carries
+ *  framed messages: a type and a payload of any length.  Addresses are
+ *  either a Unix domain socket path or a TCP host and port:
+ *
+ *		unix:/tmp/hmm.sock
+ *		localhost:5540
+ *		:5540				(localhost; listen on 0.0.0.0:5540 for every
+ *							 interface)
+ *
+ *	listen opens a listening socket for an address, accept takes the next
+ *  connection on it, and connect connects to an address.  Every failure
+ *  (including the other end closing the connection) throws a
+ *  runtime_error.
+ *
+ *	Message frame (native byte order):
+ *		type			- uint32
+ *		length			- uint64 length of the payload
+ *		payload			- length bytes
+ *	A message longer than the channel's maximum payload length (see
+ *  setMaxPayloadLength) is refused rather than read.
+ *
+ *	Typical use:
+ *		int listener = SocketChannel::listen("unix:/tmp/hmm.sock");
+ *		SocketChannel* channel = SocketChannel::accept(listener);
+ *		channel->send(1, "hello");
+ *		string payload;
+ *		uint32_t type = channel->receive(payload);
+ *
+ *  Created on: 10-18-26
+ */
+
+#ifndef SOCKETCHANNEL_H
+#define SOCKETCHANNEL_H
+
+#include <string>
+#include <cstdint>
+#include <cstddef>
+using namespace std;
+
+class SocketChannel
+{
+public:
+	// Constuctors
+	// ==============================================
+	SocketChannel(int aSocket, string aPeerName);
+
+	// Destructor
+	// =============================================
+	~SocketChannel();
+
+	// Public Class Methods
+	// =============================================
+
+	// int listen(string address)
+	//  Purpose:
+	//		Returns a socket listening on the address.  A stale Unix domain
+	//		socket file is replaced, but a path holding anything else or a
+	//		running server's socket is refused as in use.  With no host
+	//		(:port) only localhost connections are accepted.
+	static int listen(string address);
+
+	// SocketChannel* accept(int listener)
+	//  Purpose:
+	//		Waits for and returns the next connection on a listening socket
+	static SocketChannel* accept(int listener);
+
+	// SocketChannel* connect(string address, int retrySeconds)
+	//  Purpose:
+	//		Returns a channel connected to the address, retrying for up to
+	//		retrySeconds while nothing is listening there yet
+	static SocketChannel* connect(string address, int retrySeconds = 0);
+
+	// closeListener(int listener, string address)
+	//  Purpose:
+	//		Closes a listening socket, removing its Unix domain socket file
+	static void closeListener(int listener, string address);
+
+	// Public Methods
+	// =============================================
+
+	// send(uint32_t type, const string& payload)
+	//  Purpose:
+	//		Sends one message
+	void send(uint32_t type, const string& payload);
+
+	// uint32_t receive(string& payload)
+	//  Purpose:
+	//		Waits for the next message, setting payload and returning its
+	//		type
+	uint32_t receive(string& payload);
+
+	// shutdown()
+	//  Purpose:
+	//		Shuts the connection down in both directions, so a receive
+	//		waiting on it (in any thread) throws
+	void shutdown();
+
+	// setMaxPayloadLength(uint64_t length)
+	//  Purpose:
+	//		Sets the longest payload receive accepts (defaultMaxPayloadLength
+	//		until set)
+	void setMaxPayloadLength(uint64_t length);
+
+	// Public Accessors
+	// =============================================
+	string& getPeerName();
+	long long getBytesSent();
+	long long getBytesReceived();
+
+private:
+	// Private Attributes
+	// =============================================
+	static const uint64_t defaultMaxPayloadLength;
+	int socket;
+	uint64_t maxPayloadLength;
+	string peerName;
+	long long bytesSent;
+	long long bytesReceived;
+
+	// Private Methods
+	// =============================================
+
+	// writeAll(const char* data, size_t length)
+	//  Purpose:
+	//		Writes all of data to the socket
+	void writeAll(const char* data, size_t length);
+
+	// readAll(char* data, size_t length)
+	//  Purpose:
+	//		Reads exactly length bytes from the socket
+	void readAll(char* data, size_t length);
+
+	// Not copyable (owns the socket)
+	SocketChannel(const SocketChannel&);
+	SocketChannel& operator=(const SocketChannel&);
+};
+
+#endif // SOCKETCHANNEL_H
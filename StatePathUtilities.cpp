@@ -0,0 +1,158 @@
+/*
+ * StatePathUtilities.cpp
+ *
+ *  The StatePathUtilities object is a container for operations on a
+ *  decoded state path, an array holding the hidden state (one byte) for
+ *  every position in the sequence.
+ *
+ *  The run extraction finds the positions where the state changes by
+ *  comparing the path against itself shifted by one position, 16 (SSE2)
+ *  or 32 (AVX2) positions at a time, and turning the compare result into
+ *  a bit mask.  Only the set bits (the state changes) are visited, so
+ *  long runs of one state are passed over at memory bandwidth.
+ *
+ *  Created on: 10-18-26
+ */
+#include "StatePathUtilities.h"
+
+#if defined(__AVX2__) || defined(__SSE2__) || defined(_M_X64)
+#include <immintrin.h>
+#define STATEPATH_SSE2
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// Returns the index of the lowest set bit in a non zero mask
+static inline int lowestSetBit(unsigned int mask) {
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanForward(&index, mask);
+	return (int) index;
+#else
+	return __builtin_ctz(mask);
+#endif
+}
+
+// Constuctors
+// ==============================================
+StatePathUtilities::StatePathUtilities() {
+}
+
+// Destructor
+// =============================================
+StatePathUtilities::~StatePathUtilities() {
+}
+
+// Public Class Methods
+// =============================================
+
+// vector<StateRun>& extractRuns(const unsigned char* states, int length, vector<StateRun>& runs)
+//	Purpose:
+//		Appends the runs of one state in states[0, length) to runs in
+//		position order.  Run positions are relative to states.
+//	Postconditions:
+//		runs - contains one entry for every run in the path
+vector<StatePathUtilities::StateRun>& StatePathUtilities::extractRuns(
+	const unsigned char* states, int length, vector<StateRun>& runs) {
+
+	if (length <= 0)
+		return runs;
+
+	vector<int> changes;
+	findStateChanges(states, 1, length, changes);
+
+	int runStart = 0;
+	for (int change : changes) {
+		StateRun run = { states[runStart], runStart, change - 1 };
+		runs.push_back(run);
+		runStart = change;
+	}
+	StateRun lastRun = { states[runStart], runStart, length - 1 };
+	runs.push_back(lastRun);
+
+	return runs;
+}
+
+// int findStateChanges(const unsigned char* states, int start, int end, vector<int>& changes)
+//	Purpose:
+//		Appends every position i in [start, end) where states[i] differs
+//		from states[i - 1] to changes.  start must be at least 1.  Returns
+//		the number of changes found.
+int StatePathUtilities::findStateChanges(const unsigned char* states, int start, int end, vector<int>& changes) {
+	size_t numChanges = changes.size();
+	int position = start;
+
+#ifdef __AVX2__
+	for (; position + 32 <= end; position += 32) {
+		__m256i current = _mm256_loadu_si256((const __m256i*) (states + position));
+		__m256i previous = _mm256_loadu_si256((const __m256i*) (states + position - 1));
+		unsigned int changed = ~(unsigned int) _mm256_movemask_epi8(_mm256_cmpeq_epi8(current, previous));
+		while (changed != 0) {
+			changes.push_back(position + lowestSetBit(changed));
+			changed &= changed - 1;
+		}
+	}
+#endif
+
+#ifdef STATEPATH_SSE2
+	for (; position + 16 <= end; position += 16) {
+		__m128i current = _mm_loadu_si128((const __m128i*) (states + position));
+		__m128i previous = _mm_loadu_si128((const __m128i*) (states + position - 1));
+		unsigned int changed = ~(unsigned int) _mm_movemask_epi8(_mm_cmpeq_epi8(current, previous)) & 0xFFFF;
+		while (changed != 0) {
+			changes.push_back(position + lowestSetBit(changed));
+			changed &= changed - 1;
+		}
+	}
+#endif
+
+	// Remaining positions (and the whole path without SIMD support)
+	for (; position < end; position++) {
+		if (states[position] != states[position - 1])
+			changes.push_back(position);
+	}
+
+	return changes.size() - numChanges;
+}
+
+// countSegments(const vector<StateRun>& runs, vector<int>& segmentCounts)
+//	Purpose:
+//		Adds the number of runs of each state to segmentCounts (which
+//		must be sized to the number of states).
+void StatePathUtilities::countSegments(const vector<StateRun>& runs, vector<int>& segmentCounts) {
+	for (const StateRun& run : runs)
+		segmentCounts[run.state]++;
+}
+
+// splitRunsAtBreaks(vector<StateRun>& runs, const vector<pair<int, int> >& coordinateBreaks)
+//	Purpose:
+//		Splits every run that crosses a coordinate break (a column whose
+//		coordinate does not follow on from the previous column's, see
+//		MultipleAlignmentFile) so each run covers contiguous coordinates.
+//		Runs must be in position order, with positions being the
+//		alignment columns the breaks refer to.
+void StatePathUtilities::splitRunsAtBreaks(vector<StateRun>& runs, const vector<pair<int, int> >& coordinateBreaks) {
+	if (coordinateBreaks.size() <= 1)
+		return;
+
+	vector<StateRun> splitRuns;
+	splitRuns.reserve(runs.size());
+	size_t nextBreak = 0;
+	for (const StateRun& run : runs) {
+		while (nextBreak < coordinateBreaks.size() && coordinateBreaks[nextBreak].first <= run.start)
+			nextBreak++;
+
+		int start = run.start;
+		while (nextBreak < coordinateBreaks.size() && coordinateBreaks[nextBreak].first <= run.end) {
+			StateRun piece = { run.state, start, coordinateBreaks[nextBreak].first - 1 };
+			splitRuns.push_back(piece);
+			start = coordinateBreaks[nextBreak].first;
+			nextBreak++;
+		}
+		StateRun lastPiece = { run.state, start, run.end };
+		splitRuns.push_back(lastPiece);
+	}
+	runs.swap(splitRuns);
+}
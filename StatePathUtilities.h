@@ -0,0 +1,80 @@
+/*
+ * StatePathUtilities.h
+ *
+ *  The StatePathUtilities object is a container for operations on a
+ *  decoded state path, an array holding the hidden state (one byte) for
+ *  every position in the sequence.
+ *
+ *  The run extraction finds the positions where the state changes by
+ *  comparing the path against itself shifted by one position, 16 (SSE2)
+ *  or 32 (AVX2) positions at a time, and turning the compare result into
+ *  a bit mask.  Only the set bits (the state changes) are visited, so
+ *  long runs of one state are passed over at memory bandwidth.
+ *
+ *  Created on: 10-18-26
+ */
+
+#ifndef STATEPATHUTILITIES_H
+#define STATEPATHUTILITIES_H
+
+#include <vector>
+#include <utility>
+using namespace std;
+
+class StatePathUtilities
+{
+public:
+
+	// Public Types
+	// =============================================
+
+	// A run of one state over the positions [start, end]
+	struct StateRun {
+		int state;
+		int start;
+		int end;
+	};
+
+	// Constuctors
+	// ==============================================
+	StatePathUtilities();
+
+	// Destructor
+	// =============================================
+	~StatePathUtilities();
+
+	// Public Class Methods
+	// =============================================
+
+	// vector<StateRun>& extractRuns(const unsigned char* states, int length, vector<StateRun>& runs)
+	//	Purpose:
+	//		Appends the runs of one state in states[0, length) to runs in
+	//		position order.  Run positions are relative to states.
+	//	Postconditions:
+	//		runs - contains one entry for every run in the path
+	static vector<StateRun>& extractRuns(const unsigned char* states, int length, vector<StateRun>& runs);
+
+	// int findStateChanges(const unsigned char* states, int start, int end, vector<int>& changes)
+	//	Purpose:
+	//		Appends every position i in [start, end) where states[i] differs
+	//		from states[i - 1] to changes.  start must be at least 1.  Returns
+	//		the number of changes found.
+	static int findStateChanges(const unsigned char* states, int start, int end, vector<int>& changes);
+
+	// countSegments(const vector<StateRun>& runs, vector<int>& segmentCounts)
+	//	Purpose:
+	//		Adds the number of runs of each state to segmentCounts (which
+	//		must be sized to the number of states).
+	static void countSegments(const vector<StateRun>& runs, vector<int>& segmentCounts);
+
+	// splitRunsAtBreaks(vector<StateRun>& runs, const vector<pair<int, int> >& coordinateBreaks)
+	//	Purpose:
+	//		Splits every run that crosses a coordinate break (a column whose
+	//		coordinate does not follow on from the previous column's, see
+	//		MultipleAlignmentFile) so each run covers contiguous coordinates.
+	//		Runs must be in position order, with positions being the
+	//		alignment columns the breaks refer to.
+	static void splitRunsAtBreaks(vector<StateRun>& runs, const vector<pair<int, int> >& coordinateBreaks);
+};
+
+#endif // STATEPATHUTILITIES_H
@@ -48,11 +48,9 @@ vector<string>& StringUtilities::split(const string& s, char delim, vector<strin
 //		Returns an XML Result string in the following format:
 //			<result type=" <<type>> "> <<value>> <\result>
 string StringUtilities::xmlResult(const string& type, const string& value) {
-	stringstream ss;
-	ss
-		<< "    <result type=\"" << type << "\">" << value << "</result>\n";
-
-	return ss.str();
+	OutputBuffer out;
+	xmlResult(out, type, value);
+	return out.str();
 }
 
 // string xmlResult(const string& type, const double value, const int precision)
@@ -61,12 +59,9 @@ string StringUtilities::xmlResult(const string& type, const string& value) {
 //		The return string has the following format:
 //			<result type=" <<type>> "> <<value>> <\result>
 string StringUtilities::xmlResult(const string& type, const double value, const int precision){
-	stringstream ss;
-	ss.precision(precision);
-	ss
-		<< "    <result type=\"" << type << "\">" << value << "</result>\n";
-
-	return ss.str();
+	OutputBuffer out;
+	xmlResult(out, type, value, precision);
+	return out.str();
 }
 
 
@@ -77,11 +72,58 @@ string StringUtilities::xmlResult(const string& type, const double value, const
 //				<<value>>
 //			<\result>
 string StringUtilities::xmlResultFormatted(const string& type, const string& value) {
-	stringstream ss;
-	ss
-		<< "    <result type=\"" << type << "\">" << "\n"
-		<< "      " << value << "\n" 
-		<<"    </result>\n";
+	OutputBuffer out;
+	xmlResultFormatted(out, type, value);
+	return out.str();
+}
+
+// xmlResult(OutputBuffer& out, const string& type, const string& value)
+//  Purpose: 
+//		Appends an XML Result in the following format to out:
+//			<result type=" <<type>> "> <<value>> <\result>
+void StringUtilities::xmlResult(OutputBuffer& out, const string& type, const string& value) {
+	xmlResultStart(out, type);
+	out.append(value);
+	xmlResultEnd(out);
+}
+
+// xmlResult(OutputBuffer& out, const string& type, const double value, const int precision)
+//  Purpose: 
+//		Appends an XML Result with the <<value>> set to precision <<precision>>
+//		to out in the following format:
+//			<result type=" <<type>> "> <<value>> <\result>
+void StringUtilities::xmlResult(OutputBuffer& out, const string& type, const double value, const int precision) {
+	xmlResultStart(out, type);
+	out.appendDouble(value, precision);
+	xmlResultEnd(out);
+}
+
+// xmlResultFormatted(OutputBuffer& out, const string& type, const string& value)
+//  Purpose: 
+//		Appends an XML Result in the following format to out:
+//			<result type=" <<type>> ">
+//				<<value>>
+//			<\result>
+void StringUtilities::xmlResultFormatted(OutputBuffer& out, const string& type, const string& value) {
+	out.append("    <result type=\"");
+	out.append(type);
+	out.append("\">\n      ");
+	out.append(value);
+	out.append("\n    </result>\n");
+}
+
+// xmlResultStart(OutputBuffer& out, const string& type)
+// xmlResultEnd(OutputBuffer& out)
+//  Purpose: 
+//		Append the opening and closing of an XML Result to out so that the
+//		<<value>> can be written directly in between:
+//			<result type=" <<type>> ">  ...  <\result>
+void StringUtilities::xmlResultStart(OutputBuffer& out, const string& type) {
+	out.append("    <result type=\"");
+	out.append(type);
+	out.append("\">");
+}
 
-	return ss.str();
+void StringUtilities::xmlResultEnd(OutputBuffer& out) {
+	out.append("</result>\n");
 }
@@ -12,6 +12,7 @@
 #ifndef STRINGUTILITIES_H_
 #define STRINGUTILITIES_H_
 
+#include "OutputBuffer.h"
 #include <string>
 #include <vector>
 using namespace std;
@@ -58,6 +59,36 @@ public:
 	//				<<value>>
 	//			<\result>
 	static string xmlResultFormatted(const string& type, const string& value);
+
+	// xmlResult(OutputBuffer& out, const string& type, const string& value)
+	//  Purpose: 
+	//		Appends an XML Result in the following format to out:
+	//			<result type=" <<type>> "> <<value>> <\result>
+	static void xmlResult(OutputBuffer& out, const string& type, const string& value);
+
+	// xmlResult(OutputBuffer& out, const string& type, const double value, const int precision)
+	//  Purpose: 
+	//		Appends an XML Result with the <<value>> set to precision <<precision>>
+	//		to out in the following format:
+	//			<result type=" <<type>> "> <<value>> <\result>
+	static void xmlResult(OutputBuffer& out, const string& type, const double value, const int precision);
+
+	// xmlResultFormatted(OutputBuffer& out, const string& type, const string& value)
+	//  Purpose: 
+	//		Appends an XML Result in the following format to out:
+	//			<result type=" <<type>> ">
+	//				<<value>>
+	//			<\result>
+	static void xmlResultFormatted(OutputBuffer& out, const string& type, const string& value);
+
+	// xmlResultStart(OutputBuffer& out, const string& type)
+	// xmlResultEnd(OutputBuffer& out)
+	//  Purpose: 
+	//		Append the opening and closing of an XML Result to out so that the
+	//		<<value>> can be written directly in between:
+	//			<result type=" <<type>> ">  ...  <\result>
+	static void xmlResultStart(OutputBuffer& out, const string& type);
+	static void xmlResultEnd(OutputBuffer& out);
 };
 
 #endif /* STRINGUTILITIES_H_ */
@@ -0,0 +1,172 @@
+/*
+ * TraceRecorder.cpp
+ *
+ *	The TraceRecorder object records what each thread was doing when
+ *  and writes it as a Chrome trace.  See TraceRecorder.h.
+ *
+ *  Created on: 10-18-26
+ */
+#include "TraceRecorder.h"
+#include "OutputBuffer.h"
+#include <unistd.h>
+
+// static variable initialization
+// ==============================================
+bool TraceRecorder::enabled = false;
+size_t TraceRecorder::capacity = TraceRecorder::defaultEventsPerThread;
+chrono::steady_clock::time_point TraceRecorder::enabledAt;
+mutex TraceRecorder::buffersLock;
+vector<TraceRecorder::ThreadBuffer*> TraceRecorder::buffers;
+
+// appendMicroseconds(OutputBuffer& out, long long nanoseconds)
+//  Purpose:
+//		Appends nanoseconds as microseconds with three decimals
+static void appendMicroseconds(OutputBuffer& out, long long nanoseconds) {
+	if (nanoseconds < 0)
+		nanoseconds = 0;
+	long long fraction = nanoseconds % 1000;
+	out.appendInt(nanoseconds / 1000);
+	out.append('.');
+	out.append((char) ('0' + fraction / 100));
+	out.append((char) ('0' + fraction / 10 % 10));
+	out.append((char) ('0' + fraction % 10));
+}
+
+// Public Class Methods
+// =============================================
+
+// enable(size_t eventsPerThread)
+//  Purpose:
+//		Starts recording, keeping the last eventsPerThread events of
+//		each thread.  Must be called before any other thread records.
+void TraceRecorder::enable(size_t eventsPerThread) {
+	capacity = (eventsPerThread > 0) ? eventsPerThread : 1;
+	enabledAt = chrono::steady_clock::now();
+	enabled = true;
+	threadBuffer();
+}
+
+// setThreadName(const char* name)
+//  Purpose:
+//		Names the calling thread's lane in the trace
+void TraceRecorder::setThreadName(const char* name) {
+	if (!enabled)
+		return;
+
+	ThreadBuffer* buffer = threadBuffer();
+	lock_guard<mutex> guard(buffersLock);
+	buffer->name = name;
+}
+
+// writeTrace(string fileName)
+//  Purpose:
+//		Writes the Chrome trace of everything recorded to fileName.
+//		Throws if it cannot be written.
+void TraceRecorder::writeTrace(string fileName) {
+	lock_guard<mutex> guard(buffersLock);
+	long long pid = getpid();
+	long long numDropped = 0;
+	bool first = true;
+
+	OutputBuffer out(fileName);
+	out.append("{\"traceEvents\": [");
+	for (ThreadBuffer* buffer : buffers) {
+		size_t numRecorded = buffer->numRecorded.load(memory_order_acquire);
+		size_t numKept = (numRecorded < capacity) ? numRecorded : capacity;
+		size_t oldest = (numRecorded < capacity) ? 0 : numRecorded % capacity;
+		numDropped += numRecorded - numKept;
+
+		for (size_t count = 0; count < numKept; count++) {
+			const Event& event = buffer->events[(oldest + count) % capacity];
+			out.append(first ? "\n" : ",\n");
+			first = false;
+			out.append("{\"name\": \"");
+			out.append(event.name);
+			out.append("\", \"cat\": \"");
+			out.append(event.category);
+			out.append("\", \"ph\": \"X\", \"ts\": ");
+			appendMicroseconds(out, event.startNanoseconds);
+			out.append(", \"dur\": ");
+			appendMicroseconds(out, event.endNanoseconds - event.startNanoseconds);
+			out.append(", \"pid\": ");
+			out.appendInt(pid);
+			out.append(", \"tid\": ");
+			out.appendInt(buffer->threadId);
+			if (event.argumentName != NULL) {
+				out.append(", \"args\": {\"");
+				out.append(event.argumentName);
+				out.append("\": ");
+				out.appendInt(event.argument);
+				out.append('}');
+			}
+			out.append('}');
+		}
+
+		if (buffer->name != NULL) {
+			out.append(first ? "\n" : ",\n");
+			first = false;
+			out.append("{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": ");
+			out.appendInt(pid);
+			out.append(", \"tid\": ");
+			out.appendInt(buffer->threadId);
+			out.append(", \"args\": {\"name\": \"");
+			out.append(buffer->name);
+			out.append("\"}}");
+		}
+	}
+	out.append("\n], \"displayTimeUnit\": \"ms\", \"otherData\": {\"droppedEvents\": ");
+	out.appendInt(numDropped);
+	out.append("}}\n");
+	out.flush();
+}
+
+// Private Class Methods
+// =============================================
+
+// record(const char* category, const char* name, const char* argumentName, long long argument,
+//		chrono::steady_clock::time_point start, chrono::steady_clock::time_point end)
+//  Purpose:
+//		Adds an event to the calling thread's buffer
+void TraceRecorder::record(const char* category, const char* name, const char* argumentName, long long argument,
+	chrono::steady_clock::time_point start, chrono::steady_clock::time_point end) {
+	ThreadBuffer* buffer = threadBuffer();
+
+	Event event;
+	event.category = category;
+	event.name = name;
+	event.argumentName = argumentName;
+	event.argument = argument;
+	event.startNanoseconds = chrono::duration_cast<chrono::nanoseconds>(start - enabledAt).count();
+	event.endNanoseconds = chrono::duration_cast<chrono::nanoseconds>(end - enabledAt).count();
+
+	// Only this thread writes the buffer; the release publishes the
+	// event to writeTrace
+	size_t numRecorded = buffer->numRecorded.load(memory_order_relaxed);
+	if (numRecorded < capacity)
+		buffer->events.push_back(event);
+	else
+		buffer->events[numRecorded % capacity] = event;
+	buffer->numRecorded.store(numRecorded + 1, memory_order_release);
+}
+
+// ThreadBuffer* threadBuffer()
+//  Purpose:
+//		Returns the calling thread's buffer, registering it if this
+//		is the thread's first event
+TraceRecorder::ThreadBuffer* TraceRecorder::threadBuffer() {
+	static thread_local ThreadBuffer* current = NULL;
+	if (current != NULL)
+		return current;
+
+	// Kept after the thread exits so its events are still written
+	ThreadBuffer* buffer = new ThreadBuffer();
+	buffer->name = NULL;
+	buffer->numRecorded = 0;
+	buffer->events.reserve(capacity < 1024 ? capacity : 1024);
+
+	lock_guard<mutex> guard(buffersLock);
+	buffer->threadId = buffers.size();
+	buffers.push_back(buffer);
+	current = buffer;
+	return current;
+}
@@ -0,0 +1,169 @@
+/*
+ * TraceRecorder.h
+ *
+ *	This is the header file for the TraceRecorder object.
+ *  TraceRecorder is a container for a timeline of what each thread of
+ *  a parallel run was doing: parsing a region, decoding a chunk,
+ *  joining chunks or gathering statistics (reductions), writing output
+ *  or waiting on a queue or lock.  It is written as Chrome trace event
+ *  JSON (writeTrace), which chrome://tracing and ui.perfetto.dev show
+ *  as one lane per thread, so load imbalance, lock contention and
+ *  starved stages can be seen rather than inferred from totals.
+ *
+ *	Nothing is recorded until enable() is called, and a disabled span
+ *  costs one test of a flag.  Work is recorded with a Span on the
+ *  stack, which logs one complete event (begin and end time) when it
+ *  is destroyed:
+ *
+ *		{
+ *			TraceRecorder::Span span("decode", "decode chunk", "chunk", chunk);
+ *			...
+ *		}
+ *
+ *	Each thread records into its own ring buffer, so recording takes no
+ *  lock and threads never share a cache line; the only lock is taken
+ *  once per thread, to register its buffer.  A full buffer overwrites
+ *  its oldest events, and the trace notes how many were dropped.
+ *  Category and name must be string literals (only the pointers are
+ *  kept).  Spans may nest on a thread.
+ *
+ *	Buffers live until the process exits, so writeTrace() sees the
+ *  events of threads that have already finished; it must be called
+ *  once the threads being traced have stopped (or are idle).
+ *
+ *	Trace format:
+ *		{"traceEvents": [
+ *		  {"name": "<<name>>", "cat": "<<category>>", "ph": "X", "ts": <<us>>, "dur": <<us>>,
+ *		   "pid": <<pid>>, "tid": <<thread>>, "args": {"<<argument>>": <<n>>}},
+ *		  ...
+ *		  {"name": "thread_name", "ph": "M", "pid": <<pid>>, "tid": <<thread>>, "args": {"name": "<<name>>"}},
+ *		  ...
+ *		 ],
+ *		 "displayTimeUnit": "ms",
+ *		 "otherData": {"droppedEvents": <<n>>}}
+ *	Times are microseconds since enable().  Threads are numbered in the
+ *  order they first record, the enabling thread being 0.
+ *
+ *  Created on: 10-18-26
+ */
+
+#ifndef TRACERECORDER_H
+#define TRACERECORDER_H
+
+#include <string>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+using namespace std;
+
+class TraceRecorder
+{
+public:
+	// Records the time from construction to destruction (if enabled
+	// when constructed) as one event on the calling thread
+	class Span
+	{
+	public:
+		Span(const char* aCategory, const char* aName, const char* anArgumentName = NULL, long long anArgument = 0) {
+			running = enabled;
+			category = aCategory;
+			name = aName;
+			argumentName = anArgumentName;
+			argument = anArgument;
+			if (running)
+				start = chrono::steady_clock::now();
+		}
+
+		~Span() {
+			if (running)
+				record(category, name, argumentName, argument, start, chrono::steady_clock::now());
+		}
+
+	private:
+		bool running;
+		const char* category;
+		const char* name;
+		const char* argumentName;
+		long long argument;
+		chrono::steady_clock::time_point start;
+	};
+
+	// Public Class Methods
+	// =============================================
+
+	// enable(size_t eventsPerThread)
+	//  Purpose:
+	//		Starts recording, keeping the last eventsPerThread events of
+	//		each thread.  Must be called before any other thread records.
+	static void enable(size_t eventsPerThread = defaultEventsPerThread);
+
+	// bool isEnabled()
+	//  Purpose:
+	//		Returns true if recording
+	static bool isEnabled() {
+		return enabled;
+	}
+
+	// setThreadName(const char* name)
+	//  Purpose:
+	//		Names the calling thread's lane in the trace
+	static void setThreadName(const char* name);
+
+	// writeTrace(string fileName)
+	//  Purpose:
+	//		Writes the Chrome trace of everything recorded to fileName.
+	//		Throws if it cannot be written.
+	static void writeTrace(string fileName);
+
+private:
+	// Private Types
+	// =============================================
+
+	// One complete event
+	struct Event {
+		const char* category;
+		const char* name;
+		const char* argumentName;		// NULL if the event has no argument
+		long long argument;
+		long long startNanoseconds;		// since enable()
+		long long endNanoseconds;
+	};
+
+	// The events of one thread, written only by that thread
+	struct ThreadBuffer {
+		int threadId;
+		const char* name;				// NULL if not named
+		vector<Event> events;			// grows to capacity, then is a ring
+		atomic<size_t> numRecorded;		// ever, so the next slot is numRecorded % capacity
+	};
+
+	// Private Attributes
+	// =============================================
+	static const size_t defaultEventsPerThread = 1 << 16;
+
+	static bool enabled;
+	static size_t capacity;
+	static chrono::steady_clock::time_point enabledAt;
+
+	static mutex buffersLock;
+	static vector<ThreadBuffer*> buffers;	// every thread's buffer, in the order registered
+
+	// Private Class Methods
+	// =============================================
+
+	// record(const char* category, const char* name, const char* argumentName, long long argument,
+	//		chrono::steady_clock::time_point start, chrono::steady_clock::time_point end)
+	//  Purpose:
+	//		Adds an event to the calling thread's buffer
+	static void record(const char* category, const char* name, const char* argumentName, long long argument,
+		chrono::steady_clock::time_point start, chrono::steady_clock::time_point end);
+
+	// ThreadBuffer* threadBuffer()
+	//  Purpose:
+	//		Returns the calling thread's buffer, registering it if this
+	//		is the thread's first event
+	static ThreadBuffer* threadBuffer();
+};
+
+#endif // TRACERECORDER_H
@@ -0,0 +1,186 @@
+/*
+ * TrainingCoordinator.cpp
+ *
+ *	The TrainingCoordinator object runs distributed Baum-Welch training.
+ *  See TrainingCoordinator.h for the protocol.
+ *
+ *  Created on: 10-18-26
+ */
+#include "TrainingCoordinator.h"
+#include "OutputBuffer.h"
+#include "Instrumentation.h"
+#include "TraceRecorder.h"
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+// const variable initialization
+// ==============================================
+const uint32_t TrainingCoordinator::protocolVersion = 1;
+
+// Constuctors
+// ==============================================
+TrainingCoordinator::TrainingCoordinator(string anAddress, int aNumWorkers) {
+	address = anAddress;
+	numWorkers = aNumWorkers;
+}
+
+// Destructor
+// =============================================
+TrainingCoordinator::~TrainingCoordinator() {
+	// Closing the connections stops any worker still waiting
+	for (Worker& worker : workers)
+		delete worker.channel;
+}
+
+// Public Methods
+// =============================================
+
+// acceptWorkers()
+//  Purpose:
+//		Listens on the address and waits until every worker has
+//		connected and said hello
+void TrainingCoordinator::acceptWorkers() {
+	int listener = SocketChannel::listen(address);
+	cout << "Waiting for " << numWorkers << " workers on " << address << "\n" << flush;
+
+	try {
+		while ((int) workers.size() < numWorkers) {
+			Worker worker;
+			worker.channel = SocketChannel::accept(listener);
+			workers.push_back(worker);
+
+			string payload = expectMessage(workers.back(), helloMessage);
+			WorkerHello& hello = workers.back().hello;
+			if (payload.size() != sizeof(hello))
+				throw runtime_error("Invalid hello from worker: " + worker.channel->getPeerName());
+			memcpy(&hello, payload.data(), sizeof(hello));
+			if (hello.protocolVersion != protocolVersion)
+				throw runtime_error("Worker protocol version does not match: " + worker.channel->getPeerName());
+
+			cout
+				<< "Worker Connected: " << worker.channel->getPeerName()
+				<< "  Shard: " << hello.shardIndex << "/" << hello.numShards
+				<< "  Regions: " << hello.numRegions
+				<< "  Columns: " << hello.numColumns
+				<< "\n" << flush;
+		}
+	}
+	catch (...) {
+		SocketChannel::closeListener(listener, address);
+		throw;
+	}
+	SocketChannel::closeListener(listener, address);
+
+	// Shard order makes the sums (and so the training) repeatable
+	stable_sort(workers.begin(), workers.end(), [](const Worker& a, const Worker& b) {
+		return a.hello.shardIndex < b.hello.shardIndex;
+	});
+}
+
+// double train(HMMProbabilities* probabilities, int maxIterations, int& iterations)
+//  Purpose:
+//		Runs Baum-Welch over the workers' regions starting from
+//		probabilities, which are re-estimated in place, then tells the
+//		workers to stop.  Stops after maxIterations if it is positive.
+//		Returns the final log likelihood.
+double TrainingCoordinator::train(HMMProbabilities* probabilities, int maxIterations, int& iterations) {
+	if (workers.empty())
+		acceptWorkers();
+
+	BaumWelchStatistics statistics(probabilities->getNumStates());
+	double logLikelihood = 0;
+	bool trainingDone = false;
+	iterations = 0;
+	while (!trainingDone) {
+		// Likelihood of the probabilities sent, and the update from them
+		{
+			Instrumentation::Timer timer(Instrumentation::statisticsPhase);
+			timer.addColumns(getNumColumns());
+			gatherStatistics(probabilities, statistics);
+		}
+		double currentLogLikelihood = statistics.logLikelihood;
+		{
+			Instrumentation::Timer timer(Instrumentation::maximizationPhase);
+			statistics.setProbabilities(probabilities);
+		}
+		if (abs(logLikelihood - currentLogLikelihood) < 0.1)
+			trainingDone = true;
+		if (maxIterations > 0 && iterations + 1 >= maxIterations)
+			trainingDone = true;
+
+		// Set values for next iteration
+		logLikelihood = currentLogLikelihood;
+		iterations++;
+		Instrumentation::endIteration(iterations, currentLogLikelihood);
+		cout
+			<< "Iteration: " << iterations
+			<< "  Likelihood: " << currentLogLikelihood
+			<< "\n" << flush;
+	}
+
+	for (Worker& worker : workers)
+		worker.channel->send(doneMessage, "");
+
+	return logLikelihood;
+}
+
+// Public Accessors
+// =============================================
+int TrainingCoordinator::getNumRegions() {
+	int numRegions = 0;
+	for (Worker& worker : workers)
+		numRegions += worker.hello.numRegions;
+	return numRegions;
+}
+
+long long TrainingCoordinator::getNumColumns() {
+	long long numColumns = 0;
+	for (Worker& worker : workers)
+		numColumns += worker.hello.numColumns;
+	return numColumns;
+}
+
+// Private Methods
+// =============================================
+
+// gatherStatistics(HMMProbabilities* probabilities, BaumWelchStatistics& statistics)
+//  Purpose:
+//		Sends the probabilities to every worker and sets statistics to
+//		the sum of their replies
+void TrainingCoordinator::gatherStatistics(HMMProbabilities* probabilities, BaumWelchStatistics& statistics) {
+	OutputBuffer out;
+	probabilities->save(out);
+	string parameters = out.str();
+
+	// Every worker starts before any reply is read
+	for (Worker& worker : workers)
+		worker.channel->send(parametersMessage, parameters);
+
+	statistics.clear();
+	BaumWelchStatistics workerStatistics(statistics.numStates);
+	for (size_t index = 0; index < workers.size(); index++) {
+		{
+			TraceRecorder::Span span("wait", "worker reply", "worker", index);
+			workerStatistics.unpack(expectMessage(workers[index], statisticsMessage));
+		}
+		TraceRecorder::Span span("reduce", "add statistics", "worker", index);
+		statistics.add(workerStatistics);
+	}
+}
+
+// string expectMessage(Worker& worker, uint32_t type)
+//  Purpose:
+//		Receives the next message from a worker and returns its
+//		payload, throwing if it is an error or not of the type
+string TrainingCoordinator::expectMessage(Worker& worker, uint32_t type) {
+	string payload;
+	uint32_t receivedType = worker.channel->receive(payload);
+	if (receivedType == errorMessage)
+		throw runtime_error("Worker " + worker.channel->getPeerName() + " failed: " + payload);
+	if (receivedType != type)
+		throw runtime_error("Unexpected message from worker: " + worker.channel->getPeerName());
+	return payload;
+}
@@ -0,0 +1,136 @@
+/*
+ * TrainingCoordinator.h
+ *
+ *	This is the header file for the TrainingCoordinator object.  The
+ *  TrainingCoordinator runs Baum-Welch training over regions held by
+ *  TrainingWorker processes (on this machine or others) instead of in
+ *  its own address space.  Each iteration it:
+ *
+ *		1. sends the current probabilities to every worker (as the bytes
+ *		   of a model file, so each worker loads them against its own
+ *		   column dictionaries)
+ *		2. receives each worker's BaumWelchStatistics for its regions
+ *		3. adds them up and re-estimates the probabilities
+ *
+ *  until the log likelihood changes by less than 0.1, as in
+ *  HiddenMarkovModel::plainEMTraining.  Statistics are added in shard
+ *  order whatever order the workers connect in, so a run is repeatable.
+ *
+ *	Protocol (SocketChannel messages; every worker message is answered
+ *  or the connection is closed):
+ *
+ *		worker -> coordinator	hello		version, shard, shards, regions,
+ *											columns
+ *		coordinator -> worker	parameters	model file bytes
+ *		worker -> coordinator	statistics	BaumWelchStatistics::pack()
+ *		coordinator -> worker	done
+ *		either way				error		message text
+ *
+ *	A worker that fails sends an error message and the coordinator stops
+ *  with that error; if the coordinator stops the workers see the
+ *  connection close and exit.
+ *
+ *	Typical use:
+ *		TrainingCoordinator coordinator("unix:/tmp/hmm.sock", 4);
+ *		coordinator.acceptWorkers();
+ *		double logLikelihood = coordinator.train(probabilities, 0, iterations);
+ *
+ *  Created on: 10-18-26
+ */
+
+#ifndef TRAININGCOORDINATOR_H
+#define TRAININGCOORDINATOR_H
+
+#include "HMMProbabilities.h"
+#include "BaumWelchStatistics.h"
+#include "SocketChannel.h"
+#include <string>
+#include <vector>
+#include <cstdint>
+using namespace std;
+
+class TrainingCoordinator
+{
+public:
+	// Public Types
+	// =============================================
+	enum MessageType {
+		helloMessage = 1,
+		parametersMessage = 2,
+		statisticsMessage = 3,
+		doneMessage = 4,
+		errorMessage = 5
+	};
+
+	// Payload of the hello message
+	struct WorkerHello {
+		uint32_t protocolVersion;
+		uint32_t shardIndex;
+		uint32_t numShards;
+		uint32_t numRegions;
+		int64_t numColumns;
+	};
+
+	static const uint32_t protocolVersion;
+
+	// Constuctors
+	// ==============================================
+	TrainingCoordinator(string anAddress, int aNumWorkers);
+
+	// Destructor
+	// =============================================
+	~TrainingCoordinator();
+
+	// Public Methods
+	// =============================================
+
+	// acceptWorkers()
+	//  Purpose:
+	//		Listens on the address and waits until every worker has
+	//		connected and said hello
+	void acceptWorkers();
+
+	// double train(HMMProbabilities* probabilities, int maxIterations, int& iterations)
+	//  Purpose:
+	//		Runs Baum-Welch over the workers' regions starting from
+	//		probabilities, which are re-estimated in place, then tells the
+	//		workers to stop.  Stops after maxIterations if it is positive.
+	//		Returns the final log likelihood.
+	double train(HMMProbabilities* probabilities, int maxIterations, int& iterations);
+
+	// Public Accessors
+	// =============================================
+	int getNumRegions();			// regions over all workers
+	long long getNumColumns();		// columns over all workers
+
+private:
+	// Private Types
+	// =============================================
+	struct Worker {
+		SocketChannel* channel;
+		WorkerHello hello;
+	};
+
+	// Private Attributes
+	// =============================================
+	string address;
+	int numWorkers;
+	vector<Worker> workers;			// in shard order
+
+	// Private Methods
+	// =============================================
+
+	// gatherStatistics(HMMProbabilities* probabilities, BaumWelchStatistics& statistics)
+	//  Purpose:
+	//		Sends the probabilities to every worker and sets statistics to
+	//		the sum of their replies
+	void gatherStatistics(HMMProbabilities* probabilities, BaumWelchStatistics& statistics);
+
+	// string expectMessage(Worker& worker, uint32_t type)
+	//  Purpose:
+	//		Receives the next message from a worker and returns its
+	//		payload, throwing if it is an error or not of the type
+	string expectMessage(Worker& worker, uint32_t type);
+};
+
+#endif // TRAININGCOORDINATOR_H
@@ -0,0 +1,129 @@
+/*
+ * TrainingWorker.cpp
+ *
+ *	The TrainingWorker object computes Baum-Welch statistics over a shard
+ *  of regions for a TrainingCoordinator.  See TrainingWorker.h.
+ *
+ *  Created on: 10-18-26
+ */
+#include "TrainingWorker.h"
+#include "TrainingCoordinator.h"
+#include "MultipleAlignmentFile.h"
+#include "HMMProbabilities.h"
+#include "HMMDecoder.h"
+#include "DecoderWorkspace.h"
+#include "BaumWelchStatistics.h"
+#include "SocketChannel.h"
+#include "TraceRecorder.h"
+#include <cstring>
+#include <stdexcept>
+
+// Constuctors
+// ==============================================
+TrainingWorker::TrainingWorker(const vector<RegionScanner::Region>& someRegions, const vector<string>& someSpecies,
+	int aShardIndex, int aNumShards) : regions(someRegions) {
+	species = someSpecies;
+	shardIndex = aShardIndex;
+	numShards = aNumShards;
+	numColumns = 0;
+}
+
+// Destructor
+// =============================================
+TrainingWorker::~TrainingWorker() {
+	for (MultipleAlignmentFile* multiAlignFile : multiAlignFiles)
+		delete multiAlignFile;
+}
+
+// Public Methods
+// =============================================
+
+// int run(string address)
+//  Purpose:
+//		Connects to the coordinator at address and answers its
+//		requests until it is done.  Returns the number of iterations
+//		computed.
+int TrainingWorker::run(string address) {
+	// The coordinator may still be starting
+	SocketChannel* channel = SocketChannel::connect(address, 30);
+
+	int iterations = 0;
+	try {
+		loadRegions();
+
+		TrainingCoordinator::WorkerHello hello;
+		hello.protocolVersion = TrainingCoordinator::protocolVersion;
+		hello.shardIndex = shardIndex;
+		hello.numShards = numShards;
+		hello.numRegions = multiAlignFiles.size();
+		hello.numColumns = numColumns;
+		channel->send(TrainingCoordinator::helloMessage, string((const char*) &hello, sizeof(hello)));
+
+		DecoderWorkspace workspace;
+		BaumWelchStatistics statistics;
+		string payload;
+		while (true) {
+			uint32_t type = channel->receive(payload);
+			if (type == TrainingCoordinator::doneMessage)
+				break;
+			if (type == TrainingCoordinator::errorMessage)
+				throw runtime_error("Coordinator failed: " + payload);
+			if (type != TrainingCoordinator::parametersMessage)
+				throw runtime_error("Unexpected message from coordinator");
+
+			// Statistics of every region under the probabilities sent
+			statistics.clear();
+			for (size_t index = 0; index < multiAlignFiles.size(); index++) {
+				TraceRecorder::Span span("decode", "expected counts", "region", index);
+				MultipleAlignmentFile* multiAlignFile = multiAlignFiles[index];
+				HMMProbabilities* probabilities = HMMProbabilities::load(payload.data(), payload.size(),
+					multiAlignFile->getColumnDictionary(), "coordinator parameters");
+				HMMDecoder decoder(probabilities);
+				delete probabilities;
+				decoder.accumulateExpectedCounts(multiAlignFile->getColumnIds(), multiAlignFile->getSequenceLength(),
+					workspace, statistics);
+				workspace.reset();
+			}
+			channel->send(TrainingCoordinator::statisticsMessage, statistics.pack());
+			iterations++;
+		}
+	}
+	catch (const exception& error) {
+		// Tell the coordinator why, if the connection is still there
+		try {
+			channel->send(TrainingCoordinator::errorMessage, error.what());
+		}
+		catch (const exception&) {
+		}
+		delete channel;
+		throw;
+	}
+
+	delete channel;
+	return iterations;
+}
+
+// Public Accessors
+// =============================================
+int TrainingWorker::getNumRegions() {
+	return multiAlignFiles.size();
+}
+
+long long TrainingWorker::getNumColumns() {
+	return numColumns;
+}
+
+// Private Methods
+// =============================================
+
+// loadRegions()
+//  Purpose:
+//		Parses the regions of the shard
+void TrainingWorker::loadRegions() {
+	for (size_t index = shardIndex; index < regions.size(); index += numShards) {
+		const RegionScanner::Region& region = regions[index];
+		multiAlignFiles.push_back(
+			new MultipleAlignmentFile(region.fileName, species, region.rangeStart, region.rangeEnd));
+		numColumns += multiAlignFiles.back()->getSequenceLength();
+	}
+}
@@ -0,0 +1,79 @@
+/*
+ * TrainingWorker.h
+ *
+ *	This is the header file for the TrainingWorker object.  A
+ *  TrainingWorker holds one shard of the regions of a manifest in memory
+ *  and computes their Baum-Welch statistics for a TrainingCoordinator
+ *  (see TrainingCoordinator.h for the protocol).  Shard k of n is every
+ *  region whose manifest index is k modulo n, so n workers given the
+ *  same manifest split it between them.
+ *
+ *	The regions are parsed once, after connecting (so a region that can
+ *  not be read is reported to the coordinator); each iteration only loads
+ *  the probabilities sent by the coordinator against each region's
+ *  columns and runs forward-backward (HMMDecoder) over it.
+ *
+ *	Typical use:
+ *		TrainingWorker worker(regions, species, 0, 4);
+ *		worker.run("unix:/tmp/hmm.sock");
+ *
+ *  Created on: 10-18-26
+ */
+
+#ifndef TRAININGWORKER_H
+#define TRAININGWORKER_H
+
+#include "RegionScanner.h"
+#include <string>
+#include <vector>
+using namespace std;
+
+class MultipleAlignmentFile;
+
+class TrainingWorker
+{
+public:
+	// Constuctors
+	// ==============================================
+	TrainingWorker(const vector<RegionScanner::Region>& someRegions, const vector<string>& someSpecies,
+		int aShardIndex, int aNumShards);
+
+	// Destructor
+	// =============================================
+	~TrainingWorker();
+
+	// Public Methods
+	// =============================================
+
+	// int run(string address)
+	//  Purpose:
+	//		Connects to the coordinator at address and answers its
+	//		requests until it is done.  Returns the number of iterations
+	//		computed.
+	int run(string address);
+
+	// Public Accessors
+	// =============================================
+	int getNumRegions();			// regions of the shard, once loaded
+	long long getNumColumns();
+
+private:
+	// Private Attributes
+	// =============================================
+	const vector<RegionScanner::Region>& regions;
+	vector<string> species;
+	int shardIndex;
+	int numShards;
+	vector<MultipleAlignmentFile*> multiAlignFiles;		// the shard's regions
+	long long numColumns;
+
+	// Private Methods
+	// =============================================
+
+	// loadRegions()
+	//  Purpose:
+	//		Parses the regions of the shard
+	void loadRegions();
+};
+
+#endif // TRAININGWORKER_H
@@ -0,0 +1,190 @@
+/*
+ * WorkStealingPool.cpp
+ *
+ *	The WorkStealingPool object runs tasks on worker threads with per
+ *  worker deques (see WorkStealingPool.h).  Each deque has its own lock,
+ *  so a worker working through its own tasks only contends with the
+ *  occasional thief.  Idle workers sleep on a condition variable and are
+ *  woken by submit.
+ *
+ *  Created on: 10-18-26
+ */
+#include "WorkStealingPool.h"
+#include "TraceRecorder.h"
+#include <stdexcept>
+
+// static variable initialization
+// ==============================================
+thread_local WorkStealingPool* WorkStealingPool::currentPool = NULL;
+thread_local int WorkStealingPool::currentWorker = -1;
+
+// Constuctors
+// ==============================================
+WorkStealingPool::WorkStealingPool(int aNumThreads) : numQueued(0), numPending(0), numSteals(0) {
+	stopping = false;
+
+	int numThreads = aNumThreads;
+	if (numThreads < 1)
+		numThreads = thread::hardware_concurrency();
+	if (numThreads < 1)
+		numThreads = 1;
+
+	for (int index = 0; index < numThreads; index++)
+		workers.push_back(new Worker());
+	for (int index = 0; index < numThreads; index++)
+		threads.push_back(thread(&WorkStealingPool::runWorker, this, index));
+}
+
+// Destructor
+// =============================================
+WorkStealingPool::~WorkStealingPool() {
+	{
+		lock_guard<mutex> guard(sleepLock);
+		stopping = true;
+	}
+	workAvailable.notify_all();
+	for (thread& aThread : threads)
+		aThread.join();
+	for (Worker* worker : workers)
+		delete worker;
+}
+
+// Public Methods
+// =============================================
+
+// submit(function<void()> task)
+//  Purpose:
+//		Queues task to be run by a worker.  Called from a worker the
+//		task goes on that worker's own deque.
+void WorkStealingPool::submit(function<void()> task) {
+	numPending++;
+	if (currentPool == this) {
+		Worker* worker = workers[currentWorker];
+		lock_guard<mutex> guard(worker->lock);
+		worker->tasks.push_back(std::move(task));
+	}
+	else {
+		lock_guard<mutex> guard(submittedLock);
+		submittedTasks.push_back(std::move(task));
+	}
+	numQueued++;
+
+	// Taking the sleep lock orders this with a worker about to sleep
+	{
+		lock_guard<mutex> guard(sleepLock);
+	}
+	workAvailable.notify_one();
+}
+
+// wait()
+//  Purpose:
+//		Blocks until every submitted task, including the tasks they
+//		submit, has run.  Throws if a task threw.  Must not be called
+//		from a task.
+void WorkStealingPool::wait() {
+	TraceRecorder::Span span("wait", "all tasks");
+	unique_lock<mutex> guard(sleepLock);
+	allDone.wait(guard, [this]() { return numPending == 0; });
+	if (!firstError.empty()) {
+		string error = firstError;
+		firstError.clear();
+		throw runtime_error(error);
+	}
+}
+
+// Public Accessors
+// =============================================
+int WorkStealingPool::getNumThreads() {
+	return threads.size();
+}
+
+long long WorkStealingPool::getNumSteals() {
+	return numSteals;
+}
+
+// Private Methods
+// =============================================
+
+// runWorker(int index)
+//  Purpose:
+//		Runs tasks until the pool is destroyed, sleeping while there
+//		are none
+void WorkStealingPool::runWorker(int index) {
+	currentPool = this;
+	currentWorker = index;
+	TraceRecorder::setThreadName("pool worker");
+
+	function<void()> task;
+	while (true) {
+		if (!takeTask(index, task)) {
+			TraceRecorder::Span span("wait", "idle");
+			unique_lock<mutex> guard(sleepLock);
+			workAvailable.wait(guard, [this]() { return numQueued > 0 || stopping; });
+			if (stopping && numQueued == 0)
+				return;
+			continue;
+		}
+
+		try {
+			task();
+		}
+		catch (const exception& error) {
+			lock_guard<mutex> guard(sleepLock);
+			if (firstError.empty())
+				firstError = error.what();
+		}
+		task = nullptr;
+
+		if (--numPending == 0) {
+			lock_guard<mutex> guard(sleepLock);
+			allDone.notify_all();
+		}
+	}
+}
+
+// bool takeTask(int index, function<void()>& task)
+//  Purpose:
+//		Takes the next task for worker index: the back of its own
+//		deque, else the oldest outside task, else the front of another
+//		worker's deque.  Returns false if there is no task anywhere.
+bool WorkStealingPool::takeTask(int index, function<void()>& task) {
+	if (numQueued == 0)
+		return false;
+
+	{
+		Worker* worker = workers[index];
+		lock_guard<mutex> guard(worker->lock);
+		if (!worker->tasks.empty()) {
+			task = std::move(worker->tasks.back());
+			worker->tasks.pop_back();
+			numQueued--;
+			return true;
+		}
+	}
+
+	{
+		lock_guard<mutex> guard(submittedLock);
+		if (!submittedTasks.empty()) {
+			task = std::move(submittedTasks.front());
+			submittedTasks.pop_front();
+			numQueued--;
+			return true;
+		}
+	}
+
+	// Steal, starting with the next worker so thieves spread out
+	int numWorkers = workers.size();
+	for (int offset = 1; offset < numWorkers; offset++) {
+		Worker* victim = workers[(index + offset) % numWorkers];
+		lock_guard<mutex> guard(victim->lock);
+		if (!victim->tasks.empty()) {
+			task = std::move(victim->tasks.front());
+			victim->tasks.pop_front();
+			numQueued--;
+			numSteals++;
+			return true;
+		}
+	}
+
+	return false;
+}
@@ -0,0 +1,116 @@
+/*
+ * WorkStealingPool.h
+ *
+ *	This is the header file for the WorkStealingPool object.  The pool
+ *  runs tasks on a fixed set of worker threads.  Each worker keeps its
+ *  own deque of tasks: tasks a worker submits go on the back of its own
+ *  deque and it takes its next task from the back as well, so work a
+ *  task spawns is done next, by the same thread, while its data is
+ *  still in cache.  A worker whose deque is empty takes the oldest task
+ *  submitted from outside the pool and, failing that, steals the oldest
+ *  task of another worker, so no thread sits idle while there is work
+ *  anywhere in the pool.
+ *
+ *	Tasks submitted from outside the pool are started in the order they
+ *  were submitted.
+ *
+ *	A task that throws does not stop the pool; the message of the first
+ *  exception is rethrown (as a runtime_error) by wait().
+ *
+ *	Typical use:
+ *		WorkStealingPool pool;
+ *		for (Region& region : regions)
+ *			pool.submit([&region]() { decode(region); });
+ *		pool.wait();
+ *
+ *  Created on: 10-18-26
+ */
+
+#ifndef WORKSTEALINGPOOL_H
+#define WORKSTEALINGPOOL_H
+
+#include <vector>
+#include <deque>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <string>
+using namespace std;
+
+class WorkStealingPool
+{
+public:
+	// Constuctors
+	// ==============================================
+	WorkStealingPool(int aNumThreads = 0);		// 0 for one per hardware thread
+
+	// Destructor
+	// =============================================
+	~WorkStealingPool();
+
+	// Public Methods
+	// =============================================
+
+	// submit(function<void()> task)
+	//  Purpose:
+	//		Queues task to be run by a worker.  Called from a worker the
+	//		task goes on that worker's own deque.
+	void submit(function<void()> task);
+
+	// wait()
+	//  Purpose:
+	//		Blocks until every submitted task, including the tasks they
+	//		submit, has run.  Throws if a task threw.  Must not be called
+	//		from a task.
+	void wait();
+
+	// Public Accessors
+	// =============================================
+	int getNumThreads();
+	long long getNumSteals();		// tasks taken from another worker's deque
+
+private:
+	// Private Types
+	// =============================================
+	struct Worker {
+		mutex lock;
+		deque<function<void()> > tasks;
+	};
+
+	// Private Attributes
+	// =============================================
+	static thread_local WorkStealingPool* currentPool;	// pool of the calling worker thread
+	static thread_local int currentWorker;
+	vector<Worker*> workers;
+	vector<thread> threads;
+	mutex submittedLock;
+	deque<function<void()> > submittedTasks;	// tasks from outside the pool
+	mutex sleepLock;
+	condition_variable workAvailable;
+	condition_variable allDone;
+	atomic<long long> numQueued;		// tasks waiting in any deque
+	atomic<long long> numPending;		// tasks submitted and not yet finished
+	atomic<long long> numSteals;
+	bool stopping;
+	string firstError;
+
+	// Private Methods
+	// =============================================
+
+	// runWorker(int index)
+	//  Purpose:
+	//		Runs tasks until the pool is destroyed, sleeping while there
+	//		are none
+	void runWorker(int index);
+
+	// bool takeTask(int index, function<void()>& task)
+	//  Purpose:
+	//		Takes the next task for worker index: the back of its own
+	//		deque, else the oldest outside task, else the front of another
+	//		worker's deque.  Returns false if there is no task anywhere.
+	bool takeTask(int index, function<void()>& task);
+};
+
+#endif // WORKSTEALINGPOOL_H
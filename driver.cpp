@@ -6,24 +6,999 @@
  *  GC rich portions of the sequence.
  *
  *	Typical use:
- *		hmm fastaFile numIterations
+ *		hmm multipleAlignmentFile iterations nuetralCountsFile conservedCountsFile [options]
+ *		hmm decode multipleAlignmentFile --model modelFile [options]
+ *		hmm scan manifestFile --model modelFile [options]
+ *		hmm batch manifestFile --model modelFile [options]
+ *		hmm train-coordinator address --model modelFile --workers n [options]
+ *		hmm train-worker address manifestFile [options]
+ *		hmm serve address --model modelFile [options]
+ *		hmm serve address --train multipleAlignmentFile iterations nuetralCountsFile conservedCountsFile [options]
+ *		hmm request address command [arguments]
+ *		hmm query pathFile start [end]
+ *		hmm encode multipleAlignmentFile cacheFile [--species list]
+ *		hmm index multipleAlignmentFile [--species list]
+ *		hmm count multipleAlignmentFile annotationBedFile countsFile [--species list] [--pseudocount n]
+ *		hmm bench-transpose [columns]
+ *
+ *	Options:
+ *		--baum-welch		train with Baum-Welch instead of viterbi training
+ *		--squarem			accelerate training with SQUAREM extrapolation
+ *		--squarem-compare	run plain and SQUAREM training and log the savings
+ *		--bed file			write every conserved segment of the final viterbi
+ *							path to a BED file (after Baum-Welch the trained
+ *							model is decoded once for the path)
+ *		--path-out file		write the final viterbi path to a binary path file
+ *		--species list		comma separated species to read from a MAF file,
+ *							reference first (default hg18,canFam2,mm8)
+ *		--range start-end	only decode the columns with coordinates in
+ *							[start, end) (text alignments need an index)
+ *		--model-out file	write the trained probabilities to a binary
+ *							model file
+ *
+ *	The counts files may instead be BED annotations (named *.bed, e.g.
+ *  ancestral repeats and codon positions); both must then be BED files
+ *  and the counts are tallied from the alignment itself.
+ *
+ *	count tallies the alignment columns inside the intervals of a BED
+ *  file and writes them as a counts file (with a pseudocount of 1 added
+ *  to every column unless --pseudocount is given).
+ *
+ *	decode runs the viterbi decoder once with the probabilities from a
+ *  model file written with --model-out, skipping training and the counts
+ *  files.  It takes the --bed, --path-out, --species and --range options.
+ *
+ *	scan decodes every region listed in a manifest file (one alignment
+ *  file per line, optionally followed by a start-end range; blank lines
+ *  and lines starting with # are skipped) on a pool of threads, splitting
+ *  regions longer than the chunk length so they decode in parallel.  One
+ *  summary line per region is printed, and the conserved segments written
+ *  to the --bed file, in manifest order.  It takes the --bed and --species
+ *  options and:
+ *		--threads n			worker threads (default one per core)
+ *		--chunk-length n	columns per chunk (default 1048576)
+ *
+ *	batch decodes the regions of a manifest file one at a time, writing the
+ *  full decode results of each, as a three stage pipeline: the next
+ *  region is parsed and the previous one written while each region is
+ *  decoded.  The time each stage spent busy and waiting is printed at the
+ *  end.  It takes the --bed and --species options and:
+ *		--queue-depth n		regions held between two stages (default 2)
+ *
+ *	train-coordinator and train-worker run Baum-Welch training with the
+ *  regions of a manifest split between worker processes.  The coordinator
+ *  listens on the address (unix:path or host:port), waits for n workers,
+ *  then each iteration sends them the probabilities and combines the
+ *  statistics they send back.  It starts from the probabilities in a
+ *  model file (e.g. written by training with 0 iterations and
+ *  --model-out) and takes:
+ *		--model-out file	write the trained probabilities to a model file
+ *		--max-iterations n	stop after n iterations (default until converged)
+ *	Each worker loads its shard of the manifest's regions and takes:
+ *		--shard k/n			take regions k, k + n, k + 2n, ... (default 0/1)
+ *		--species list		as for decode
+ *	For example, on one machine:
+ *		hmm train-coordinator unix:/tmp/hmm.sock --model initial.hmmp --workers 2 &
+ *		hmm train-worker unix:/tmp/hmm.sock regions.txt --shard 0/2 &
+ *		hmm train-worker unix:/tmp/hmm.sock regions.txt --shard 1/2
+ *
+ *	serve keeps the probabilities from a model file and the alignments it
+ *  is asked about loaded, and answers requests sent with request on a
+ *  socket (unix:path or host:port) until sent shutdown.  The requests are
+ *  decode, posterior and likelihood of an alignment file, optionally
+ *  followed by a start-end range, stats and shutdown (see DecodeServer.h
+ *  for the replies).  Requests may only name preloaded alignments or
+ *  ones inside the --data-dir directory, and a host:port address with
+ *  no host only accepts connections from localhost.  It takes the
+ *  --species option and:
+ *		--preload file		load an alignment before serving (repeatable)
+ *		--data-dir dir		also serve any alignment inside dir
+ *		--threads n			decode threads (default one per core)
+ *		--max-alignments n	alignments kept loaded (default 16)
+ *		--train multipleAlignmentFile iterations nuetralCountsFile conservedCountsFile
+ *							run viterbi training in the server instead of
+ *							loading a model; requests are answered with
+ *							the probabilities of the latest iteration
+ *	For example:
+ *		hmm serve unix:/tmp/hmm.sock --model trained.hmmp --preload chr7.aln &
+ *		hmm request unix:/tmp/hmm.sock decode chr7.aln 115000-215000
+ *
+ *	query prints the state at start, or the number of columns in each state
+ *  over [start, end), from a binary path file written with --path-out.
+ *
+ *	The multiple alignment file may be the .aln format or UCSC MAF, plain
+ *  text or gzip/BGZF compressed, or an alignment cache.
+ *
+ *	encode parses a multiple alignment file once and writes an alignment
+ *  cache.  The cache can be passed anywhere a multiple alignment file is
+ *  expected and is memory mapped instead of parsed.  It is refused once
+ *  the alignment it was written from changes.
+ *
+ *	index writes an alignment index (multipleAlignmentFile.hmmi) mapping
+ *  coordinates to blocks, so --range only parses the blocks it needs.
+ *  It must be rebuilt if the alignment changes.
+ *
+ *	bench-transpose times the scalar and blocked alignment row to column
+ *  transposes for a range of species counts.
+ *
+ *	Any command also takes:
+ *		--report file		write a JSON report of the time spent in each
+ *							phase (parse, build, viterbi, traceback,
+ *							statistics, E and M steps, output) and the
+ *							columns processed and heap allocations made, for
+ *							the run and each training iteration (see
+ *							Instrumentation.h)
+ *		--hardware-counters	also count cycles, instructions, cache misses
+ *							and branch misses in each phase and report
+ *							the IPC and misses per column (Linux
+ *							perf_event_open; the report says why if they
+ *							are not available)
+ *		--trace file		write a Chrome trace (chrome://tracing or
+ *							ui.perfetto.dev) of what each thread did
+ *							when: region parses, chunk decodes, chunk
+ *							joins and statistics sums, output writes and
+ *							waits on queues and locks (see
+ *							TraceRecorder.h)
  *
  *  Created on: 2-15-13
  *      Author: tomkolar
  */
 #include "MultipleAlignmentFile.h"
 #include "HiddenMarkovModel.h"
+#include "HMMPathFile.h"
+#include "AlignmentCacheFile.h"
+#include "AlignmentIndexFile.h"
+#include "AlignmentTranspose.h"
+#include "EmissionCounter.h"
+#include "StringUtilities.h"
+#include "RegionScanner.h"
+#include "RegionPipeline.h"
+#include "TrainingCoordinator.h"
+#include "TrainingWorker.h"
+#include "DecodeServer.h"
+#include "ParameterStore.h"
+#include "Instrumentation.h"
+#include "TraceRecorder.h"
 #include <string>
 #include <sstream>
 #include <iostream>
+#include <fstream>
+#include <cstdio>
+#include <cstdlib>
+#include <stdexcept>
+#include <chrono>
+#include <thread>
 using namespace std;
 
-int main( int argc, char *argv[] ) {
+// runQuery(int argc, char *argv[])
+//  Purpose:
+//		Answers a point or range query against a binary path file
+int runQuery(int argc, char *argv[]) {
+	if (argc < 4) {
+			cout << "Invalid # of arguments\n";
+			cout << "usage: hmm query pathFile start [end]\n";
+			return -1;
+	}
+
+	try {
+		HMMPathFile pathFile(argv[2]);
+		long long start = atoll(argv[3]);
+		if (argc < 5) {
+			cout << pathFile.getChromosome() << "\t" << start << "\t" << pathFile.stateAt(start) << "\n";
+			return 0;
+		}
+
+		long long end = atoll(argv[4]);
+		cout << pathFile.getChromosome() << "\t" << start << "\t" << end;
+		for (int state = 0; state < pathFile.getNumStates(); state++)
+			cout << "\t" << pathFile.stateCount(state, start, end);
+		cout << "\n";
+	}
+	catch (const runtime_error& error) {
+		cout << error.what() << "\n";
+		return -1;
+	}
+
+	return 0;
+}
+
+// runEncode(int argc, char *argv[])
+//  Purpose:
+//		Writes an alignment cache for a multiple alignment file
+int runEncode(int argc, char *argv[]) {
+	if (argc < 4) {
+			cout << "Invalid # of arguments\n";
+			cout << "usage: hmm encode multipleAlignmentFile cacheFile [--species list]\n";
+			return -1;
+	}
+
+	try {
+		vector<string> species = MultipleAlignmentFile::defaultSpecies;
+		if (argc > 5 && string(argv[4]) == "--species") {
+			species.clear();
+			StringUtilities::split(argv[5], ',', species);
+		}
+
+		// Columns with a residue outside ACTG- are rejected when parsed
+		MultipleAlignmentFile multiAlignFile(argv[2], species);
+		AlignmentCacheFile::write(argv[3], multiAlignFile);
+		cout << "Encoded " << multiAlignFile.getSequenceLength() << " columns.\n";
+	}
+	catch (const runtime_error& error) {
+		cout << error.what() << "\n";
+		return -1;
+	}
+
+	return 0;
+}
+
+// runIndex(int argc, char *argv[])
+//  Purpose:
+//		Writes the alignment index for a text multiple alignment file
+int runIndex(int argc, char *argv[]) {
+	if (argc < 3) {
+			cout << "Invalid # of arguments\n";
+			cout << "usage: hmm index multipleAlignmentFile [--species list]\n";
+			return -1;
+	}
+
+	try {
+		vector<string> species = MultipleAlignmentFile::defaultSpecies;
+		if (argc > 4 && string(argv[3]) == "--species") {
+			species.clear();
+			StringUtilities::split(argv[4], ',', species);
+		}
+
+		int numBlocks = AlignmentIndexFile::build(argv[2], species);
+		cout << "Indexed " << numBlocks << " blocks.\n";
+	}
+	catch (const runtime_error& error) {
+		cout << error.what() << "\n";
+		return -1;
+	}
+
+	return 0;
+}
+
+// bool parseRange(const char* text, int& rangeStart, int& rangeEnd)
+//  Purpose:
+//		Reads a start-end coordinate range, returning false if it is
+//		not a non empty range
+bool parseRange(const char* text, int& rangeStart, int& rangeEnd) {
+	vector<string> range;
+	StringUtilities::split(text, '-', range);
+	if (range.size() != 2 || atoi(range[1].c_str()) <= atoi(range[0].c_str()))
+		return false;
+
+	rangeStart = atoi(range[0].c_str());
+	rangeEnd = atoi(range[1].c_str());
+	return true;
+}
+
+// writeDecodeResults(HiddenMarkovModel& hmm, string bedFileName, string pathFileName)
+//  Purpose:
+//		Writes the viterbi results to stdout and the conserved segments
+//		and path to the BED and path files (if named)
+void writeDecodeResults(HiddenMarkovModel& hmm, string bedFileName, string pathFileName) {
+	Instrumentation::Timer timer(Instrumentation::outputPhase);
+
+	// Results go straight from the model into one large output buffer
+	cout << flush;
+	fflush(stdout);
+	OutputBuffer out(1);
+	hmm.writeViterbiResults(out);
+	out.flush();
+
+	if (!bedFileName.empty()) {
+		BedFileWriter bedFile(bedFileName);
+		hmm.writeSegmentsBed(bedFile, 2);
+		bedFile.flush();
+		cout << "Conserved Segments Written: " << bedFile.getSegmentCount() << "\n";
+	}
+	if (!pathFileName.empty()) {
+		hmm.writePathFile(pathFileName);
+		cout << "Path File Written.\n";
+	}
+}
+
+// runDecode(int argc, char *argv[])
+//  Purpose:
+//		Decodes a multiple alignment file with the probabilities from a
+//		model file (no training and no counts files)
+int runDecode(int argc, char *argv[]) {
+	if (argc < 4) {
+			cout << "Invalid # of arguments\n";
+			cout << "usage: hmm decode multipleAlignmentFile --model modelFile [--bed file] [--path-out file] [--species list] [--range start-end]\n";
+			return -1;
+	}
+
+	string multiAlignFileName = argv[2];
+	string modelFileName;
+	string bedFileName;
+	string pathFileName;
+	vector<string> species = MultipleAlignmentFile::defaultSpecies;
+	int rangeStart = 0;
+	int rangeEnd = 0;
+	for (int i = 3; i < argc; i++) {
+		string option = argv[i];
+		if (option == "--model" && i + 1 < argc)
+			modelFileName = argv[++i];
+		else if (option == "--bed" && i + 1 < argc)
+			bedFileName = argv[++i];
+		else if (option == "--path-out" && i + 1 < argc)
+			pathFileName = argv[++i];
+		else if (option == "--species" && i + 1 < argc) {
+			species.clear();
+			StringUtilities::split(argv[++i], ',', species);
+		}
+		else if (option == "--range" && i + 1 < argc) {
+			if (!parseRange(argv[++i], rangeStart, rangeEnd)) {
+				cout << "Invalid range: " << argv[i] << "\n";
+				return -1;
+			}
+		}
+		else {
+			cout << "Unknown option: " << option << "\n";
+			return -1;
+		}
+	}
+	if (modelFileName.empty()) {
+		cout << "No model file given (--model modelFile)\n";
+		return -1;
+	}
+
+	try {
+		MultipleAlignmentFile multiAlignFile(multiAlignFileName, species, rangeStart, rangeEnd);
+		HMMProbabilities* probabilities =
+			HMMProbabilities::load(modelFileName, multiAlignFile.getColumnDictionary());
+		HiddenMarkovModel hmm(&multiAlignFile, probabilities);
+		hmm.viterbiDecode();
+		writeDecodeResults(hmm, bedFileName, pathFileName);
+	}
+	catch (const runtime_error& error) {
+		cout << error.what() << "\n";
+		return -1;
+	}
+
+	return 0;
+}
+
+// bool readManifest(string fileName, vector<RegionScanner::Region>& regions)
+//  Purpose:
+//		Reads the regions of a scan manifest, returning false (after
+//		printing the problem) if it cannot be read
+bool readManifest(string fileName, vector<RegionScanner::Region>& regions) {
+	ifstream manifest(fileName);
+	if (!manifest.is_open()) {
+		cout << "Unable to open manifest file: " << fileName << "\n";
+		return false;
+	}
+
+	string line;
+	int lineNumber = 0;
+	while (getline(manifest, line)) {
+		lineNumber++;
+		vector<string> fields;
+		istringstream lineStream(line);
+		string field;
+		while (lineStream >> field)
+			fields.push_back(field);
+		if (fields.empty() || fields[0][0] == '#')
+			continue;
+
+		RegionScanner::Region region;
+		region.fileName = fields[0];
+		region.rangeStart = 0;
+		region.rangeEnd = 0;
+		if (fields.size() > 2 || (fields.size() == 2 && !parseRange(fields[1].c_str(), region.rangeStart, region.rangeEnd))) {
+			cout << "Invalid manifest line " << lineNumber << ": " << line << "\n";
+			return false;
+		}
+		regions.push_back(region);
+	}
+
+	return true;
+}
+
+// runScan(int argc, char *argv[])
+//  Purpose:
+//		Decodes every region of a manifest file with the probabilities
+//		from a model file on a work stealing pool
+int runScan(int argc, char *argv[]) {
+	if (argc < 4) {
+			cout << "Invalid # of arguments\n";
+			cout << "usage: hmm scan manifestFile --model modelFile [--bed file] [--species list] [--threads n] [--chunk-length n]\n";
+			return -1;
+	}
+
+	string manifestFileName = argv[2];
+	string modelFileName;
+	string bedFileName;
+	vector<string> species = MultipleAlignmentFile::defaultSpecies;
+	int numThreads = 0;
+	int chunkLength = 1 << 20;
+	for (int i = 3; i < argc; i++) {
+		string option = argv[i];
+		if (option == "--model" && i + 1 < argc)
+			modelFileName = argv[++i];
+		else if (option == "--bed" && i + 1 < argc)
+			bedFileName = argv[++i];
+		else if (option == "--species" && i + 1 < argc) {
+			species.clear();
+			StringUtilities::split(argv[++i], ',', species);
+		}
+		else if (option == "--threads" && i + 1 < argc)
+			numThreads = atoi(argv[++i]);
+		else if (option == "--chunk-length" && i + 1 < argc) {
+			chunkLength = atoi(argv[++i]);
+			if (chunkLength <= 0) {
+				cout << "Invalid chunk length: " << argv[i] << "\n";
+				return -1;
+			}
+		}
+		else {
+			cout << "Unknown option: " << option << "\n";
+			return -1;
+		}
+	}
+	if (modelFileName.empty()) {
+		cout << "No model file given (--model modelFile)\n";
+		return -1;
+	}
+
+	vector<RegionScanner::Region> regions;
+	if (!readManifest(manifestFileName, regions))
+		return -1;
+
+	int numFailed = 0;
+	try {
+		RegionScanner scanner(modelFileName, species, chunkLength, numThreads);
+		numFailed = scanner.scan(regions, bedFileName);
+		cout << "Regions: " << regions.size() << "  Failed: " << numFailed
+			<< "  Chunks: " << scanner.getNumChunks() << "  Threads: " << scanner.getNumThreads()
+			<< "  Steals: " << scanner.getNumSteals() << "\n";
+	}
+	catch (const runtime_error& error) {
+		cout << error.what() << "\n";
+		return -1;
+	}
+
+	return (numFailed == 0) ? 0 : -1;
+}
+
+// runBatch(int argc, char *argv[])
+//  Purpose:
+//		Decodes every region of a manifest file with the probabilities
+//		from a model file through the parse, decode and write pipeline
+int runBatch(int argc, char *argv[]) {
+	if (argc < 4) {
+			cout << "Invalid # of arguments\n";
+			cout << "usage: hmm batch manifestFile --model modelFile [--bed file] [--species list] [--queue-depth n]\n";
+			return -1;
+	}
+
+	string manifestFileName = argv[2];
+	string modelFileName;
+	string bedFileName;
+	vector<string> species = MultipleAlignmentFile::defaultSpecies;
+	int queueDepth = 2;
+	for (int i = 3; i < argc; i++) {
+		string option = argv[i];
+		if (option == "--model" && i + 1 < argc)
+			modelFileName = argv[++i];
+		else if (option == "--bed" && i + 1 < argc)
+			bedFileName = argv[++i];
+		else if (option == "--species" && i + 1 < argc) {
+			species.clear();
+			StringUtilities::split(argv[++i], ',', species);
+		}
+		else if (option == "--queue-depth" && i + 1 < argc) {
+			queueDepth = atoi(argv[++i]);
+			if (queueDepth <= 0) {
+				cout << "Invalid queue depth: " << argv[i] << "\n";
+				return -1;
+			}
+		}
+		else {
+			cout << "Unknown option: " << option << "\n";
+			return -1;
+		}
+	}
+	if (modelFileName.empty()) {
+		cout << "No model file given (--model modelFile)\n";
+		return -1;
+	}
+
+	vector<RegionScanner::Region> regions;
+	if (!readManifest(manifestFileName, regions))
+		return -1;
+
+	int numFailed = 0;
+	try {
+		RegionPipeline pipeline(modelFileName, species, queueDepth);
+		numFailed = pipeline.run(regions, bedFileName);
+		cout << "Regions: " << regions.size() << "  Failed: " << numFailed << "\n";
+		cout << pipeline.stageUtilizationString();
+	}
+	catch (const runtime_error& error) {
+		cout << error.what() << "\n";
+		return -1;
+	}
+
+	return (numFailed == 0) ? 0 : -1;
+}
+
+// runTrainCoordinator(int argc, char *argv[])
+//  Purpose:
+//		Runs Baum-Welch training over the regions held by worker
+//		processes, starting from the probabilities in a model file
+int runTrainCoordinator(int argc, char *argv[]) {
+	if (argc < 3) {
+			cout << "Invalid # of arguments\n";
+			cout << "usage: hmm train-coordinator address --model modelFile --workers n [--model-out file] [--max-iterations n]\n";
+			return -1;
+	}
+
+	string address = argv[2];
+	string modelFileName;
+	string modelOutFileName;
+	int numWorkers = 0;
+	int maxIterations = 0;
+	for (int i = 3; i < argc; i++) {
+		string option = argv[i];
+		if (option == "--model" && i + 1 < argc)
+			modelFileName = argv[++i];
+		else if (option == "--model-out" && i + 1 < argc)
+			modelOutFileName = argv[++i];
+		else if (option == "--workers" && i + 1 < argc)
+			numWorkers = atoi(argv[++i]);
+		else if (option == "--max-iterations" && i + 1 < argc)
+			maxIterations = atoi(argv[++i]);
+		else {
+			cout << "Unknown option: " << option << "\n";
+			return -1;
+		}
+	}
+	if (modelFileName.empty() || numWorkers <= 0) {
+		cout << "A model file (--model modelFile) and number of workers (--workers n) are required\n";
+		return -1;
+	}
+
+	ColumnDictionary* columnDictionary = NULL;
+	try {
+		columnDictionary = HMMProbabilities::loadColumns(modelFileName);
+		HiddenMarkovModel hmm(NULL, HMMProbabilities::load(modelFileName, columnDictionary));
+
+		TrainingCoordinator coordinator(address, numWorkers);
+		coordinator.acceptWorkers();
+		cout << "Regions: " << coordinator.getNumRegions() << "  Columns: " << coordinator.getNumColumns() << "\n";
+
+		int iterations;
+		double logLikelihood = coordinator.train(hmm.probabilities, maxIterations, iterations);
+		cout << hmm.baumWelchResultsString(iterations, logLikelihood);
+
+		if (!modelOutFileName.empty()) {
+			hmm.probabilities->save(modelOutFileName);
+			cout << "Model Written.\n";
+		}
+	}
+	catch (const runtime_error& error) {
+		cout << error.what() << "\n";
+		delete columnDictionary;
+		return -1;
+	}
+
+	delete columnDictionary;
+	return 0;
+}
+
+// runTrainWorker(int argc, char *argv[])
+//  Purpose:
+//		Holds a shard of the regions of a manifest file and computes
+//		their Baum-Welch statistics for a training coordinator
+int runTrainWorker(int argc, char *argv[]) {
+	if (argc < 4) {
+			cout << "Invalid # of arguments\n";
+			cout << "usage: hmm train-worker address manifestFile [--shard k/n] [--species list]\n";
+			return -1;
+	}
+
+	string address = argv[2];
+	string manifestFileName = argv[3];
+	vector<string> species = MultipleAlignmentFile::defaultSpecies;
+	int shardIndex = 0;
+	int numShards = 1;
+	for (int i = 4; i < argc; i++) {
+		string option = argv[i];
+		if (option == "--shard" && i + 1 < argc) {
+			vector<string> shard;
+			StringUtilities::split(argv[++i], '/', shard);
+			if (shard.size() != 2 || atoi(shard[1].c_str()) <= 0 || atoi(shard[0].c_str()) < 0
+				|| atoi(shard[0].c_str()) >= atoi(shard[1].c_str())) {
+				cout << "Invalid shard: " << argv[i] << "\n";
+				return -1;
+			}
+			shardIndex = atoi(shard[0].c_str());
+			numShards = atoi(shard[1].c_str());
+		}
+		else if (option == "--species" && i + 1 < argc) {
+			species.clear();
+			StringUtilities::split(argv[++i], ',', species);
+		}
+		else {
+			cout << "Unknown option: " << option << "\n";
+			return -1;
+		}
+	}
+
+	vector<RegionScanner::Region> regions;
+	if (!readManifest(manifestFileName, regions))
+		return -1;
+
+	try {
+		TrainingWorker worker(regions, species, shardIndex, numShards);
+		int iterations = worker.run(address);
+		cout
+			<< "Shard: " << shardIndex << "/" << numShards
+			<< "  Regions: " << worker.getNumRegions()
+			<< "  Columns: " << worker.getNumColumns()
+			<< "  Iterations Computed: " << iterations
+			<< "\n";
+	}
+	catch (const runtime_error& error) {
+		cout << error.what() << "\n";
+		return -1;
+	}
+
+	return 0;
+}
+
+// serveWhileTraining(string address, const vector<string>& trainArguments,
+//		const vector<string>& preloadFileNames, string dataDirectory, const vector<string>& species,
+//		int numThreads, int maxAlignments)
+//  Purpose:
+//		Runs viterbi training on a thread of its own while serving
+//		requests with the probabilities of its latest iteration
+int serveWhileTraining(string address, const vector<string>& trainArguments,
+	const vector<string>& preloadFileNames, string dataDirectory, const vector<string>& species,
+	int numThreads, int maxAlignments) {
+	MultipleAlignmentFile* multiAlignFile = NULL;
+	HiddenMarkovModel* hmmPointer = NULL;
+	ParameterStore parameterStore;
+	try {
+		multiAlignFile = new MultipleAlignmentFile(trainArguments[0], species);
+		hmmPointer = new HiddenMarkovModel(multiAlignFile, trainArguments[2], trainArguments[3]);
+		hmmPointer->setParameterStore(&parameterStore);
+		cout << "HMM Created.\n";
+
+		DecodeServer server(&parameterStore, species, numThreads, maxAlignments);
+		for (const string& fileName : preloadFileNames) {
+			server.preload(fileName);
+			cout << "Preloaded: " << fileName << "\n";
+		}
+		if (!dataDirectory.empty())
+			server.setDataDirectory(dataDirectory);
+
+		// Training publishes each iteration to the store the server reads
+		int iterations = atoi(trainArguments[1].c_str());
+		HiddenMarkovModel& hmm = *hmmPointer;
+		thread trainer([&hmm, iterations]() {
+			try {
+				hmm.viterbiTraining(iterations);
+				cout << "Training Done.\n" << flush;
+			}
+			catch (const runtime_error& error) {
+				cout << "Training failed: " << error.what() << "\n" << flush;
+			}
+		});
+		try {
+			server.serve(address);
+		}
+		catch (...) {
+			trainer.join();
+			throw;
+		}
+		trainer.join();
+		cout << server.statisticsString();
+	}
+	catch (const runtime_error& error) {
+		cout << error.what() << "\n";
+		delete hmmPointer;
+		delete multiAlignFile;
+		return -1;
+	}
+
+	delete hmmPointer;
+	delete multiAlignFile;
+	return 0;
+}
+
+// runServe(int argc, char *argv[])
+//  Purpose:
+//		Answers decode requests on a socket with the model and
+//		alignments kept loaded until a shutdown request
+int runServe(int argc, char *argv[]) {
+	if (argc < 3) {
+			cout << "Invalid # of arguments\n";
+			cout << "usage: hmm serve address --model modelFile [--preload file]... [--data-dir dir] [--species list] [--threads n] [--max-alignments n]\n";
+			cout << "       hmm serve address --train multipleAlignmentFile iterations nuetralCountsFile conservedCountsFile [options]\n";
+			return -1;
+	}
+
+	string address = argv[2];
+	string modelFileName;
+	vector<string> trainArguments;
+	vector<string> preloadFileNames;
+	string dataDirectory;
+	vector<string> species = MultipleAlignmentFile::defaultSpecies;
+	int numThreads = 0;
+	int maxAlignments = 16;
+	for (int i = 3; i < argc; i++) {
+		string option = argv[i];
+		if (option == "--model" && i + 1 < argc)
+			modelFileName = argv[++i];
+		else if (option == "--train" && i + 4 < argc) {
+			trainArguments.assign(argv + i + 1, argv + i + 5);
+			i += 4;
+		}
+		else if (option == "--preload" && i + 1 < argc)
+			preloadFileNames.push_back(argv[++i]);
+		else if (option == "--data-dir" && i + 1 < argc)
+			dataDirectory = argv[++i];
+		else if (option == "--species" && i + 1 < argc) {
+			species.clear();
+			StringUtilities::split(argv[++i], ',', species);
+		}
+		else if (option == "--threads" && i + 1 < argc)
+			numThreads = atoi(argv[++i]);
+		else if (option == "--max-alignments" && i + 1 < argc)
+			maxAlignments = atoi(argv[++i]);
+		else {
+			cout << "Unknown option: " << option << "\n";
+			return -1;
+		}
+	}
+	if (modelFileName.empty() == trainArguments.empty()) {
+		cout << "Give one of --model modelFile or --train\n";
+		return -1;
+	}
+
+	if (!trainArguments.empty())
+		return serveWhileTraining(address, trainArguments, preloadFileNames, dataDirectory, species, numThreads,
+			maxAlignments);
+
+	try {
+		DecodeServer server(modelFileName, species, numThreads, maxAlignments);
+		for (string& fileName : preloadFileNames) {
+			server.preload(fileName);
+			cout << "Preloaded: " << fileName << "\n";
+		}
+		if (!dataDirectory.empty())
+			server.setDataDirectory(dataDirectory);
+		server.serve(address);
+		cout << server.statisticsString();
+	}
+	catch (const runtime_error& error) {
+		cout << error.what() << "\n";
+		return -1;
+	}
+
+	return 0;
+}
+
+// runRequest(int argc, char *argv[])
+//  Purpose:
+//		Sends one request to a decode server and prints the reply
+int runRequest(int argc, char *argv[]) {
+	if (argc < 4) {
+			cout << "Invalid # of arguments\n";
+			cout << "usage: hmm request address decode|posterior|likelihood file [start-end]\n";
+			cout << "       hmm request address stats|shutdown\n";
+			return -1;
+	}
+
+	string text = argv[3];
+	for (int i = 4; i < argc; i++)
+		text += string(" ") + argv[i];
+
+	try {
+		cout << DecodeServer::request(argv[2], text);
+	}
+	catch (const runtime_error& error) {
+		cout << error.what() << "\n";
+		return -1;
+	}
+
+	return 0;
+}
+
+// runCount(int argc, char *argv[])
+//  Purpose:
+//		Writes a counts file for the columns of a multiple alignment file
+//		inside the intervals of a BED file
+int runCount(int argc, char *argv[]) {
+	if (argc < 5) {
+			cout << "Invalid # of arguments\n";
+			cout << "usage: hmm count multipleAlignmentFile annotationBedFile countsFile [--species list] [--pseudocount n]\n";
+			return -1;
+	}
+
+	vector<string> species = MultipleAlignmentFile::defaultSpecies;
+	long long pseudocount = 1;
+	for (int i = 5; i < argc; i++) {
+		string option = argv[i];
+		if (option == "--species" && i + 1 < argc) {
+			species.clear();
+			StringUtilities::split(argv[++i], ',', species);
+		}
+		else if (option == "--pseudocount" && i + 1 < argc)
+			pseudocount = atoll(argv[++i]);
+		else {
+			cout << "Unknown option: " << option << "\n";
+			return -1;
+		}
+	}
+
+	try {
+		MultipleAlignmentFile multiAlignFile(argv[2], species);
+		EmissionCounter counter(&multiAlignFile, pseudocount);
+		vector<long long> counts;
+		long long numCounted = counter.countAnnotations(argv[3], counts);
+		counter.writeCounts(counts, argv[4]);
+		cout << "Counted " << numCounted << " columns.\n";
+	}
+	catch (const runtime_error& error) {
+		cout << error.what() << "\n";
+		return -1;
+	}
+
+	return 0;
+}
+
+// runBenchTranspose(int argc, char *argv[])
+//  Purpose:
+//		Times the scalar and blocked row to column transposes (and the
+//		three species encoder) on random alignment rows for a range of
+//		species counts
+int runBenchTranspose(int argc, char *argv[]) {
+	int length = (argc > 2) ? atoi(argv[2]) : 1000000;
+	if (length <= 0) {
+			cout << "usage: hmm bench-transpose [columns]\n";
+			return -1;
+	}
+
+	const char residues[] = "ACGTACGTacgtN-";
+	const int speciesCounts[] = {3, 4, 8, 16, 24, 32, 64, 100};
+	unsigned int seed = 1;
+
+	cout << "species\tcolumns\tscalar ms\tblocked ms\tspeedup\n";
+	for (int numSpecies : speciesCounts) {
+		vector<string> rowText(numSpecies, string(length, '-'));
+		vector<const char*> rows(numSpecies);
+		for (int r = 0; r < numSpecies; r++) {
+			for (int c = 0; c < length; c++) {
+				seed = seed * 1103515245 + 12345;
+				rowText[r][c] = residues[(seed >> 16) % (sizeof(residues) - 1)];
+			}
+			rows[r] = rowText[r].data();
+		}
+
+		vector<char> scalarColumns((size_t) length * numSpecies);
+		vector<char> blockedColumns((size_t) length * numSpecies);
+
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		AlignmentTranspose::transposeScalar(rows.data(), numSpecies, length, scalarColumns.data());
+		chrono::duration<double, milli> scalarTime = chrono::steady_clock::now() - start;
+
+		start = chrono::steady_clock::now();
+		AlignmentTranspose::transpose(rows.data(), numSpecies, length, blockedColumns.data());
+		chrono::duration<double, milli> blockedTime = chrono::steady_clock::now() - start;
+
+		if (scalarColumns != blockedColumns) {
+			cout << "Blocked transpose differs from scalar for " << numSpecies << " species\n";
+			return -1;
+		}
+		cout << numSpecies << "\t" << length << "\t" << scalarTime.count() << "\t" << blockedTime.count()
+			<< "\t" << scalarTime.count() / blockedTime.count() << "\n";
+
+		// The three species rows are also encoded straight to symbols
+		if (numSpecies == 3) {
+			vector<unsigned char> scalarSymbols(length);
+			vector<unsigned char> blockedSymbols(length);
+
+			start = chrono::steady_clock::now();
+			for (int c = 0; c < length; c++)
+				scalarSymbols[c] = MultipleAlignmentFile::encodeColumn(rows[0][c], rows[1][c], rows[2][c]);
+			scalarTime = chrono::steady_clock::now() - start;
+
+			start = chrono::steady_clock::now();
+			AlignmentTranspose::encodeColumns(rows[0], rows[1], rows[2], length, blockedSymbols.data());
+			blockedTime = chrono::steady_clock::now() - start;
+
+			if (scalarSymbols != blockedSymbols) {
+				cout << "Blocked encoding differs from scalar\n";
+				return -1;
+			}
+			cout << "3 (encode)\t" << length << "\t" << scalarTime.count() << "\t" << blockedTime.count()
+				<< "\t" << scalarTime.count() / blockedTime.count() << "\n";
+		}
+	}
+
+	return 0;
+}
+
+// string takeReportOptions(int& argc, char *argv[], bool& hardwareCounters, string& traceFileName)
+//  Purpose:
+//		Removes --report file, --hardware-counters and --trace file from
+//		the arguments and returns the report file name (empty if not
+//		given)
+string takeReportOptions(int& argc, char *argv[], bool& hardwareCounters, string& traceFileName) {
+	string reportFileName;
+	hardwareCounters = false;
+	traceFileName.clear();
+	int kept = 1;
+	for (int i = 1; i < argc; i++) {
+		if (string(argv[i]) == "--report" && i + 1 < argc)
+			reportFileName = argv[++i];
+		else if (string(argv[i]) == "--trace" && i + 1 < argc)
+			traceFileName = argv[++i];
+		else if (string(argv[i]) == "--hardware-counters")
+			hardwareCounters = true;
+		else
+			argv[kept++] = argv[i];
+	}
+	argc = kept;
+	return reportFileName;
+}
+
+// runCommand(int argc, char *argv[])
+//  Purpose:
+//		Runs the command named by the arguments, or trains a model if
+//		none is named
+int runCommand(int argc, char *argv[]) {
+
+	if (argc > 1 && string(argv[1]) == "query")
+		return runQuery(argc, argv);
+	if (argc > 1 && string(argv[1]) == "encode")
+		return runEncode(argc, argv);
+	if (argc > 1 && string(argv[1]) == "index")
+		return runIndex(argc, argv);
+	if (argc > 1 && string(argv[1]) == "count")
+		return runCount(argc, argv);
+	if (argc > 1 && string(argv[1]) == "decode")
+		return runDecode(argc, argv);
+	if (argc > 1 && string(argv[1]) == "scan")
+		return runScan(argc, argv);
+	if (argc > 1 && string(argv[1]) == "batch")
+		return runBatch(argc, argv);
+	if (argc > 1 && string(argv[1]) == "train-coordinator")
+		return runTrainCoordinator(argc, argv);
+	if (argc > 1 && string(argv[1]) == "train-worker")
+		return runTrainWorker(argc, argv);
+	if (argc > 1 && string(argv[1]) == "serve")
+		return runServe(argc, argv);
+	if (argc > 1 && string(argv[1]) == "request")
+		return runRequest(argc, argv);
+	if (argc > 1 && string(argv[1]) == "bench-transpose")
+		return runBenchTranspose(argc, argv);
 
 	// Check that file name and iterations were entered as arguments
 	if (argc < 5) {
 			cout << "Invalid # of arguments\n";
-			cout << "usage: hmm multipleAlignmentFile iterations nuetralCountsFile conservedCountsFile \n";
+			cout << "usage: hmm multipleAlignmentFile iterations nuetralCountsFile conservedCountsFile [--baum-welch] [--squarem] [--squarem-compare] [--bed file] [--path-out file] [--species list] [--range start-end] [--model-out file]\n";
+			cout << "       hmm decode multipleAlignmentFile --model modelFile [--bed file] [--path-out file] [--species list] [--range start-end]\n";
+			cout << "       hmm scan manifestFile --model modelFile [--bed file] [--species list] [--threads n] [--chunk-length n]\n";
+			cout << "       hmm batch manifestFile --model modelFile [--bed file] [--species list] [--queue-depth n]\n";
+			cout << "       hmm train-coordinator address --model modelFile --workers n [--model-out file] [--max-iterations n]\n";
+			cout << "       hmm train-worker address manifestFile [--shard k/n] [--species list]\n";
+			cout << "       hmm serve address --model modelFile [--preload file]... [--data-dir dir] [--species list] [--threads n] [--max-alignments n]\n";
+			cout << "       hmm request address command [arguments]\n";
+			cout << "       hmm query pathFile start [end]\n";
+			cout << "       hmm encode multipleAlignmentFile cacheFile [--species list]\n";
+			cout << "       hmm index multipleAlignmentFile [--species list]\n";
+			cout << "       hmm count multipleAlignmentFile annotationBedFile countsFile [--species list] [--pseudocount n]\n";
+			cout << "       hmm bench-transpose [columns]\n";
+			cout << "       (any command also takes --report file [--hardware-counters] and --trace file)\n";
 			return -1;
 	}
 
@@ -34,6 +1009,44 @@ int main( int argc, char *argv[] ) {
 	int iterations = atoi(argv[2]);
 	string neutralCountsFileName = argv[3];
 	string conservedCountsFileName = argv[4];
+	bool baumWelch = false;
+	bool accelerate = false;
+	bool compareAcceleration = false;
+	string bedFileName;
+	string pathFileName;
+	string modelFileName;
+	vector<string> species = MultipleAlignmentFile::defaultSpecies;
+	int rangeStart = 0;
+	int rangeEnd = 0;
+	for (int i = 5; i < argc; i++) {
+		string option = argv[i];
+		if (option == "--baum-welch")
+			baumWelch = true;
+		else if (option == "--squarem")
+			accelerate = true;
+		else if (option == "--squarem-compare")
+			compareAcceleration = true;
+		else if (option == "--bed" && i + 1 < argc)
+			bedFileName = argv[++i];
+		else if (option == "--path-out" && i + 1 < argc)
+			pathFileName = argv[++i];
+		else if (option == "--species" && i + 1 < argc) {
+			species.clear();
+			StringUtilities::split(argv[++i], ',', species);
+		}
+		else if (option == "--range" && i + 1 < argc) {
+			if (!parseRange(argv[++i], rangeStart, rangeEnd)) {
+				cout << "Invalid range: " << argv[i] << "\n";
+				return -1;
+			}
+		}
+		else if (option == "--model-out" && i + 1 < argc)
+			modelFileName = argv[++i];
+		else {
+			cout << "Unknown option: " << option << "\n";
+			return -1;
+		}
+	}
 /*
 	// Set Parameters
 	string multiAlignFileName = "c:/Users/kolart/Documents/Genome540/Assignment8/ENm012.aln";
@@ -41,17 +1054,115 @@ int main( int argc, char *argv[] ) {
 	string neutralCountsFileName = "c:/Users/kolart/Documents/Genome540/Assignment8/anc_rep_counts.txt";
 	string conservedCountsFileName = "c:/Users/kolart/Documents/Genome540/Assignment8/codon1_2_counts.txt";
 */
-	// Create the fasta file object
-	MultipleAlignmentFile* multiAlignFile =
-		new MultipleAlignmentFile(multiAlignFileName);
-	cout << "Multi Align Created.\n";
-
-	// Create the Hidden Markov Model
-	HiddenMarkovModel hmm(multiAlignFile, neutralCountsFileName, conservedCountsFileName);
-	cout << "HMM Created.\n";
-	hmm.viterbiTraining(iterations);
-	cout << "Viterbi Path Calculated.\n";
-
-	cout << hmm.viterbiResultsString();
-	cout << "Fred";
+	// Counts files or BED annotations (counted from the alignment)
+	bool neutralBed = EmissionCounter::isBedFile(neutralCountsFileName);
+	bool conservedBed = EmissionCounter::isBedFile(conservedCountsFileName);
+	if (neutralBed != conservedBed) {
+		cout << "Counts must both be counts files or both be BED annotations\n";
+		return -1;
+	}
+
+	MultipleAlignmentFile* multiAlignFile = NULL;
+	HiddenMarkovModel* hmmPointer = NULL;
+	try {
+		// Create the fasta file object
+		multiAlignFile = new MultipleAlignmentFile(multiAlignFileName, species, rangeStart, rangeEnd);
+		cout << "Multi Align Created.\n";
+
+		// Create the Hidden Markov Model (counting the emissions from the
+		// alignment if annotations were given instead of counts files)
+		if (neutralBed) {
+			EmissionCounter counter(multiAlignFile);
+			vector<long long> neutralCounts;
+			vector<long long> conservedCounts;
+			counter.countAnnotations(neutralCountsFileName, neutralCounts);
+			counter.countAnnotations(conservedCountsFileName, conservedCounts);
+			cout << "Emissions Counted.\n";
+			HMMProbabilities* initialProbabilities = HMMProbabilities::initialProbabilities(neutralCounts,
+				conservedCounts, multiAlignFile->getColumnDictionary());
+			hmmPointer = new HiddenMarkovModel(multiAlignFile, initialProbabilities);
+		}
+		else
+			hmmPointer = new HiddenMarkovModel(multiAlignFile, neutralCountsFileName, conservedCountsFileName);
+		HiddenMarkovModel& hmm = *hmmPointer;
+		cout << hmm.probabilities->probabilitiesResultsString();
+		cout << "HMM Created.\n";
+		if (compareAcceleration)
+			hmm.compareEMAcceleration(!baumWelch, iterations);
+		else if (baumWelch)
+			hmm.baumWelchTraining(accelerate);
+		else
+			hmm.viterbiTraining(iterations, accelerate);
+
+		if (!modelFileName.empty()) {
+			hmm.probabilities->save(modelFileName);
+			cout << "Model Written.\n";
+		}
+		if (!baumWelch) {
+			cout << "Viterbi Path Calculated.\n";
+			writeDecodeResults(hmm, bedFileName, pathFileName);
+		}
+		else if (!bedFileName.empty() || !pathFileName.empty()) {
+			// Baum-Welch finds no path, so decode the trained model once
+			hmm.viterbiDecode();
+			cout << "Viterbi Path Calculated.\n";
+			writeDecodeResults(hmm, bedFileName, pathFileName);
+		}
+	}
+	catch (const runtime_error& error) {
+		cout << error.what() << "\n";
+		delete hmmPointer;
+		delete multiAlignFile;
+		return -1;
+	}
+
+	delete hmmPointer;
+	delete multiAlignFile;
+	return 0;
+}
+
+int main( int argc, char *argv[] ) {
+	string commandLine = argv[0];
+	for (int i = 1; i < argc; i++)
+		commandLine += string(" ") + argv[i];
+
+	// Recording starts before anything is parsed
+	bool hardwareCounters;
+	string traceFileName;
+	string reportFileName = takeReportOptions(argc, argv, hardwareCounters, traceFileName);
+	if (hardwareCounters && reportFileName.empty()) {
+		cout << "--hardware-counters needs --report file\n";
+		return -1;
+	}
+	if (!reportFileName.empty())
+		Instrumentation::enable(hardwareCounters);
+	if (hardwareCounters && !HardwareCounters::isAvailable())
+		cout << HardwareCounters::getUnavailableReason() << ", reporting times only\n";
+	if (!traceFileName.empty()) {
+		TraceRecorder::enable();
+		TraceRecorder::setThreadName("main");
+	}
+
+	int result = runCommand(argc, argv);
+
+	if (!traceFileName.empty()) {
+		try {
+			TraceRecorder::writeTrace(traceFileName);
+		}
+		catch (const runtime_error& error) {
+			cout << error.what() << "\n";
+			return -1;
+		}
+	}
+
+	if (!reportFileName.empty()) {
+		try {
+			Instrumentation::writeReport(reportFileName, commandLine);
+		}
+		catch (const runtime_error& error) {
+			cout << error.what() << "\n";
+			return -1;
+		}
+	}
+	return result;
 }